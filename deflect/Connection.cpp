@@ -0,0 +1,372 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "Connection.h"
+
+#include "NetworkProtocol.h"
+#include "PackedEvent.h"
+
+#include <QDataStream>
+#include <QString>
+
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+const char* STREAM_HOST_ENV_VAR = "DEFLECT_HOST";
+const int RECEIVE_TIMEOUT_MS = 1000;
+const size_t MAX_PENDING_MESSAGES = 4096; // if the application never reads
+
+std::string _getStreamHost(const std::string& host)
+{
+    if (!host.empty())
+        return host;
+
+    const auto streamHost = QString(qgetenv(STREAM_HOST_ENV_VAR).constData());
+    const auto list = streamHost.split(':');
+    if (list.size() > 0 && !list[0].isEmpty())
+        return list[0].toStdString();
+
+    throw std::runtime_error("No host provided");
+}
+
+unsigned short _getStreamPort(const unsigned short port)
+{
+    if (port != 0)
+        return port;
+
+    const QString streamHost = qgetenv(STREAM_HOST_ENV_VAR).constData();
+    const auto list = streamHost.split(':');
+    if (list.size() == 1)
+        return DEFAULT_PORT_NUMBER;
+
+    if (list.size() == 2)
+    {
+        bool ok = false;
+        const auto portNum = list[1].toUShort(&ok);
+        if (ok)
+            return portNum;
+    }
+
+    throw std::runtime_error("No port provided");
+}
+
+/** @return the id as it is received in the uri of a MessageHeader. */
+std::string _toUri(const std::string& id)
+{
+    return deflect::MessageHeader(deflect::MESSAGE_TYPE_NONE, 0, id).uri;
+}
+
+/** @return true for the events which are superseded by the next ones. */
+bool _isMotion(const int type)
+{
+    return type == deflect::Event::EVT_MOVE ||
+           type == deflect::Event::EVT_TOUCH_UPDATE;
+}
+
+/**
+ * Remove the motion events of an event message.
+ * @return the number of events removed.
+ */
+size_t _removeMotion(deflect::MessageHeader& header, QByteArray& message)
+{
+    if (header.type == deflect::MESSAGE_TYPE_EVENT)
+    {
+        deflect::Event event;
+        {
+            QDataStream stream(message);
+            stream >> event;
+        }
+        if (!_isMotion(event.type))
+            return 0;
+        message.clear();
+        return 1;
+    }
+
+    const size_t recordSize = sizeof(deflect::PackedEvent);
+    if (header.type != deflect::MESSAGE_TYPE_EVENTS ||
+        message.size() % recordSize != 0)
+    {
+        return 0;
+    }
+
+    QByteArray kept;
+    size_t removed = 0;
+    for (int i = 0; i < message.size(); i += recordSize)
+    {
+        const auto record = message.constData() + i;
+        if (_isMotion(uint8_t(record[offsetof(deflect::PackedEvent, type)])))
+            ++removed;
+        else
+            kept.append(record, recordSize);
+    }
+    if (removed > 0)
+    {
+        message = kept;
+        header.size = message.size();
+    }
+    return removed;
+}
+}
+
+namespace deflect
+{
+bool Connection::Inbox::isOpen() const
+{
+    return _open;
+}
+
+bool Connection::Inbox::hasMessage() const
+{
+    std::lock_guard<std::mutex> lock(_messagesMutex);
+    return !_messages.empty();
+}
+
+bool Connection::Inbox::receive(MessageHeader& messageHeader,
+                                QByteArray& message)
+{
+    std::unique_lock<std::mutex> lock(_messagesMutex);
+    if (!_messageReceived.wait_for(lock,
+                                   std::chrono::milliseconds{
+                                       RECEIVE_TIMEOUT_MS},
+                                   [this] { return !_messages.empty(); }))
+    {
+        return false;
+    }
+
+    messageHeader = _messages.front().first;
+    message = std::move(_messages.front().second);
+    _messages.pop_front();
+
+    return messageHeader.type != MESSAGE_TYPE_QUIT;
+}
+
+void Connection::Inbox::setMessageHandlers(const MessageHandlers& handlers)
+{
+    std::lock_guard<std::mutex> lock(_handlersMutex);
+    for (const auto& handler : handlers)
+    {
+        if (handler.second)
+            _handlers[handler.first] = handler.second;
+        else
+            _handlers.erase(handler.first);
+    }
+
+    // no message is delivered meanwhile, the next ones come after these
+    for (const auto& message : _dequeueHandledMessages())
+        _handlers[message.first.type](message.second);
+}
+
+void Connection::Inbox::setMessageHandler(const MessageType type,
+                                          MessageHandler handler)
+{
+    setMessageHandlers({{type, std::move(handler)}});
+}
+
+void Connection::Inbox::setClosedCallback(std::function<void()> callback)
+{
+    std::lock_guard<std::mutex> lock(_handlersMutex);
+    _closedCallback = std::move(callback);
+}
+
+uint64_t Connection::Inbox::getDroppedEventCount() const
+{
+    return _droppedEvents;
+}
+
+void Connection::Inbox::_deliver(const MessageHeader& messageHeader,
+                                 const QByteArray& message)
+{
+    if (messageHeader.type == MESSAGE_TYPE_QUIT)
+    {
+        _close();
+        return;
+    }
+
+    // queue under the lock, for setMessageHandlers() to find the message
+    std::lock_guard<std::mutex> lock(_handlersMutex);
+    const auto it = _handlers.find(messageHeader.type);
+    if (it != _handlers.end())
+        it->second(message);
+    else
+        _enqueue(std::make_pair(messageHeader, message));
+}
+
+void Connection::Inbox::_enqueue(Message message)
+{
+    std::lock_guard<std::mutex> lock(_messagesMutex);
+
+    // if the application does not keep up, discard the oldest motion events
+    // until a message is emptied; the other events are never lost
+    if (_messages.size() >= MAX_PENDING_MESSAGES)
+    {
+        for (auto it = _messages.begin(); it != _messages.end(); ++it)
+        {
+            const auto removed = _removeMotion(it->first, it->second);
+            _droppedEvents += removed;
+            if (removed > 0 && it->second.isEmpty())
+            {
+                _messages.erase(it);
+                break;
+            }
+        }
+    }
+    _messages.push_back(std::move(message));
+    _messageReceived.notify_one();
+}
+
+std::vector<Connection::Inbox::Message>
+    Connection::Inbox::_dequeueHandledMessages()
+{
+    std::vector<Message> handled;
+    std::deque<Message> remaining;
+
+    std::lock_guard<std::mutex> lock(_messagesMutex);
+    for (auto& message : _messages)
+    {
+        if (_handlers.count(message.first.type))
+            handled.push_back(std::move(message));
+        else
+            remaining.push_back(std::move(message));
+    }
+    _messages.swap(remaining);
+    return handled;
+}
+
+void Connection::Inbox::_close()
+{
+    if (!_open.exchange(false))
+        return;
+
+    // wake up a pending receive()
+    {
+        std::lock_guard<std::mutex> lock(_messagesMutex);
+        _messages.push_back(Message{MessageHeader(MESSAGE_TYPE_QUIT, 0), {}});
+    }
+    _messageReceived.notify_all();
+
+    std::function<void()> callback;
+    {
+        std::lock_guard<std::mutex> lock(_handlersMutex);
+        callback = _closedCallback;
+    }
+    if (callback)
+        callback();
+}
+
+Connection::Connection(const std::string& host, const unsigned short port)
+    : socket{_getStreamHost(host), _getStreamPort(port)}
+    , sendWorker{socket}
+{
+    socket.setMessageHandler(
+        [this](const MessageHeader& header, const QByteArray& message) {
+            _route(header, message);
+        });
+    QObject::connect(&socket, &Socket::disconnected, [this]() { _closeAll(); });
+
+    socket.moveToThread(&sendWorker);
+    sendWorker.start();
+}
+
+Connection::~Connection()
+{
+    // the socket receives until it is destroyed, after the other members
+    socket.setMessageHandler(nullptr);
+    QObject::disconnect(&socket, &Socket::disconnected, nullptr, nullptr);
+}
+
+Connection::InboxPtr Connection::addStream(const std::string& id)
+{
+    std::lock_guard<std::mutex> lock(_streamsMutex);
+
+    auto& inbox = _streams[_toUri(id)];
+    if (inbox)
+        throw std::runtime_error("The connection already has a stream '" + id +
+                                 "'");
+
+    inbox = std::make_shared<Inbox>();
+    return inbox;
+}
+
+void Connection::removeStream(const std::string& id)
+{
+    std::lock_guard<std::mutex> lock(_streamsMutex);
+    _streams.erase(_toUri(id));
+}
+
+void Connection::_route(const MessageHeader& messageHeader,
+                        const QByteArray& message)
+{
+    std::vector<InboxPtr> inboxes;
+    {
+        std::lock_guard<std::mutex> lock(_streamsMutex);
+
+        // messages without uri are addressed to all the streams
+        if (messageHeader.uri[0] == '\0')
+        {
+            for (const auto& stream : _streams)
+                inboxes.push_back(stream.second);
+        }
+        else
+        {
+            const auto it = _streams.find(messageHeader.uri);
+            if (it != _streams.end())
+                inboxes.push_back(it->second);
+        }
+    }
+
+    for (const auto& inbox : inboxes)
+        inbox->_deliver(messageHeader, message);
+}
+
+void Connection::_closeAll()
+{
+    std::vector<InboxPtr> inboxes;
+    {
+        std::lock_guard<std::mutex> lock(_streamsMutex);
+        for (const auto& stream : _streams)
+            inboxes.push_back(stream.second);
+    }
+
+    for (const auto& inbox : inboxes)
+        inbox->_close();
+}
+}
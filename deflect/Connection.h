@@ -0,0 +1,187 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_CONNECTION_H
+#define DEFLECT_CONNECTION_H
+
+#include "MessageHeader.h"    // MessageType
+#include "Socket.h"           // member
+#include "StreamSendWorker.h" // member
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace deflect
+{
+/**
+ * A connection to a Server shared by one or more streams and observers.
+ *
+ * All the streams of a connection send through the same socket and send
+ * thread. Each message carries the id of its stream in the MessageHeader uri,
+ * which the Server uses to demultiplex the streams. Conversely, the messages
+ * received from the Server are routed to the Inbox of the stream they are
+ * addressed to.
+ */
+class Connection
+{
+public:
+    /** Function called from the receiving thread with a message body. */
+    using MessageHandler = std::function<void(const QByteArray&)>;
+    using MessageHandlers = std::map<MessageType, MessageHandler>;
+
+    /** The messages received for one of the streams of the connection. */
+    class Inbox
+    {
+    public:
+        /** @return false once the stream was closed or disconnected. */
+        bool isOpen() const;
+
+        /** Is there a complete pending message. */
+        bool hasMessage() const;
+
+        /**
+         * Receive a message, waiting for it if none is pending.
+         * @param messageHeader The received message header
+         * @param message The received message data
+         * @return true if a message could be received, false otherwise
+         */
+        bool receive(MessageHeader& messageHeader, QByteArray& message);
+
+        /**
+         * Handle the messages of some types as soon as they are received,
+         * instead of queueing them for receive().
+         *
+         * The queued messages of these types are first passed to the handlers
+         * by the calling thread, in the order in which they were received and
+         * before any later message. The handlers are then called from the
+         * receiving thread. They must not call setMessageHandlers().
+         *
+         * @param handlers the function to call for each type of messages,
+         *        nullptr to queue the messages of the type again
+         */
+        void setMessageHandlers(const MessageHandlers& handlers);
+
+        /** Handle the messages of a single type, see setMessageHandlers(). */
+        void setMessageHandler(MessageType type, MessageHandler handler);
+
+        /**
+         * Set a function to be called when the stream is closed by the Server
+         * or the connection is lost.
+         */
+        void setClosedCallback(std::function<void()> callback);
+
+        /**
+         * @return the number of MOVE and TOUCH_UPDATE events discarded
+         *         because too many messages were pending.
+         */
+        uint64_t getDroppedEventCount() const;
+
+    private:
+        friend class Connection;
+
+        using Message = std::pair<MessageHeader, QByteArray>;
+
+        std::atomic_bool _open{true};
+        mutable std::mutex _messagesMutex;
+        std::condition_variable _messageReceived;
+        std::deque<Message> _messages;
+        std::atomic<uint64_t> _droppedEvents{0};
+
+        std::mutex _handlersMutex;
+        std::map<MessageType, MessageHandler> _handlers;
+        std::function<void()> _closedCallback;
+
+        void _deliver(const MessageHeader& messageHeader,
+                      const QByteArray& message);
+        void _enqueue(Message message);
+        std::vector<Message> _dequeueHandledMessages();
+        void _close();
+    };
+    using InboxPtr = std::shared_ptr<Inbox>;
+
+    /**
+     * Open a new connection to the Server.
+     *
+     * @param host Address of the target Server instance. If empty, the
+     *        environment variable DEFLECT_HOST will be used instead.
+     * @param port Port of the target Server instance. If 0, the port from
+     *        DEFLECT_HOST or the default port will be used instead.
+     * @throw std::runtime_error if no host was provided or the connection to
+     *        the Server could not be established.
+     */
+    Connection(const std::string& host, unsigned short port);
+
+    /** Stop the send thread and close the connection. */
+    ~Connection();
+
+    /** The communication socket instance */
+    Socket socket;
+
+    /** The worker doing all the socket send operations. */
+    StreamSendWorker sendWorker;
+
+    /**
+     * Add a stream to the connection.
+     * @param id the identifier of the stream
+     * @return the inbox for the messages addressed to the stream
+     * @throw std::runtime_error if the connection already has a stream with
+     *        the same id.
+     */
+    InboxPtr addStream(const std::string& id);
+
+    /** Remove a stream, dropping the messages addressed to it. */
+    void removeStream(const std::string& id);
+
+private:
+    std::mutex _streamsMutex;
+    std::map<std::string, InboxPtr> _streams;
+
+    void _route(const MessageHeader& messageHeader, const QByteArray& message);
+    void _closeAll();
+};
+}
+
+#endif
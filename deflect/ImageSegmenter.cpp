@@ -41,18 +41,244 @@
 #include "ImageSegmenter.h"
 
 #include "ImageWrapper.h"
+#include "Trace.h"
 #ifdef DEFLECT_USE_LIBJPEGTURBO
 #include "ImageJpegCompressor.h"
 #endif
 
+#include <QThread>
 #include <QThreadStorage>
 #include <QtConcurrentMap>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 
 namespace deflect
 {
+namespace
+{
+// COMPRESSION_AUTO content analysis: one row out of ANALYSIS_ROW_STEP is
+// sampled, luma steps of at least SHARP_EDGE_STEP between neighbours are edges
+const int ANALYSIS_ROW_STEP = 4;
+const int SHARP_EDGE_STEP = 48;
+const double MIN_SYNTHETIC_FLAT_RATIO = 0.5;
+const double MIN_SYNTHETIC_EDGE_RATIO = 0.05;
+
+// COMPRESSION_AUTO cost estimates, until JPEG compression has been measured
+const double DEFAULT_JPEG_NS_PER_PIXEL = 10.0;
+const double DEFAULT_JPEG_BYTES_PER_PIXEL = 0.4;
+
+// offsets of the red, green and blue channels for each PixelFormat
+const int rgbOffsets[][3] = {{0, 1, 2}, {0, 1, 2}, {1, 2, 3},
+                             {2, 1, 0}, {2, 1, 0}, {3, 2, 1}};
+
+// offset of the alpha channel for each PixelFormat, -1 if none
+const int alphaOffsets[] = {-1, 3, 0, -1, 3, 0};
+
+/** A range [start, start + size) of pixels along one image dimension. */
+struct Span
+{
+    uint start;
+    uint size;
+};
+
+/**
+ * Divide a range of pixels in spans of (at most) the nominal size, restarting
+ * from each of the (sorted) boundaries.
+ */
+std::vector<Span> _split(const uint start, const uint size,
+                         const uint nominalSize,
+                         const std::vector<uint>& boundaries)
+{
+    const uint end = start + size;
+
+    std::vector<uint> cuts{start};
+    for (const auto boundary : boundaries)
+    {
+        if (boundary > start && boundary < end)
+            cuts.push_back(boundary);
+    }
+    cuts.push_back(end);
+
+    std::vector<Span> spans;
+    for (size_t i = 0; i + 1 < cuts.size(); ++i)
+    {
+        const auto spanEnd = cuts[i + 1];
+        if (nominalSize == 0)
+        {
+            spans.push_back({cuts[i], spanEnd - cuts[i]});
+            continue;
+        }
+        for (auto pos = cuts[i]; pos < spanEnd; pos += nominalSize)
+            spans.push_back({pos, std::min(nominalSize, spanEnd - pos)});
+    }
+    return spans;
+}
+
+void _sortBoundaries(std::vector<uint>& boundaries)
+{
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()),
+                     boundaries.end());
+}
+
+/**
+ * Check if all the pixels of a region of an image are identical.
+ *
+ * Comparing the first row with itself shifted by one pixel and the other rows
+ * with the first one lets memcmp do the scan with wide vector loads, and stop
+ * at the first difference.
+ */
+bool _isUniform(const ImageWrapper& image, const QRect& region)
+{
+    // assume imageBuffer isn't padded
+    const size_t bytesPerPixel = image.getBytesPerPixel();
+    const size_t pitch = image.width * bytesPerPixel;
+    const size_t rowSize = size_t(region.width()) * bytesPerPixel;
+
+    const char* firstRow = (const char*)image.data + region.y() * pitch +
+                           region.x() * bytesPerPixel;
+    if (std::memcmp(firstRow, firstRow + bytesPerPixel,
+                    rowSize - bytesPerPixel) != 0)
+    {
+        return false;
+    }
+
+    const char* row = firstRow + pitch;
+    for (int y = 1; y < region.height(); ++y, row += pitch)
+    {
+        if (std::memcmp(row, firstRow, rowSize) != 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @param image the source image.
+ * @param region the region of the image, of a single color.
+ * @param keepAlpha keep the alpha of the image instead of making the color
+ *        opaque like the JPEG segments.
+ * @return the color of the first pixel of a region as RGBA.
+ */
+QByteArray _getFillColor(const ImageWrapper& image, const QRect& region,
+                         const bool keepAlpha)
+{
+    const auto& offset = rgbOffsets[image.pixelFormat];
+    const auto alphaOffset = alphaOffsets[image.pixelFormat];
+    const size_t bytesPerPixel = image.getBytesPerPixel();
+    const char* pixel = (const char*)image.data +
+                        region.y() * image.width * bytesPerPixel +
+                        region.x() * bytesPerPixel;
+
+    const char alpha =
+        keepAlpha && alphaOffset >= 0 ? pixel[alphaOffset] : char(0xff);
+    const char rgba[] = {pixel[offset[0]], pixel[offset[1]], pixel[offset[2]],
+                         alpha};
+    return QByteArray(rgba, sizeof(rgba));
+}
+
+/** @return true if the image has no alpha or the region is fully opaque. */
+bool _isOpaque(const ImageWrapper& image, const QRect& region)
+{
+    const auto alphaOffset = alphaOffsets[image.pixelFormat];
+    if (alphaOffset < 0)
+        return true;
+
+    const size_t bytesPerPixel = image.getBytesPerPixel();
+    const size_t pitch = image.width * bytesPerPixel;
+    for (int y = 0; y < region.height(); ++y)
+    {
+        const uint8_t* pixel = (const uint8_t*)image.data +
+                               (region.y() + y) * pitch +
+                               region.x() * bytesPerPixel + alphaOffset;
+        for (int x = 0; x < region.width(); ++x, pixel += bytesPerPixel)
+        {
+            if (*pixel != 0xff)
+                return false;
+        }
+    }
+    return true;
+}
+
+/** @return a copy of the pixels of a region of an image. */
+QByteArray _copyRegion(const ImageWrapper& image, const QRect& region)
+{
+    // assume imageBuffer isn't padded
+    const size_t bytesPerPixel = image.getBytesPerPixel();
+    const size_t pitch = image.width * bytesPerPixel;
+    const int rowSize = region.width() * int(bytesPerPixel);
+
+    QByteArray data;
+    data.reserve(rowSize * region.height());
+
+    const char* row = (const char*)image.data + region.y() * pitch +
+                      region.x() * bytesPerPixel;
+    for (int y = 0; y < region.height(); ++y, row += pitch)
+        data.append(row, rowSize);
+    return data;
+}
+
+/** The kind of content of a segment, for COMPRESSION_AUTO. */
+enum class Content
+{
+    uniform,   // a single color
+    synthetic, // text, UIs, plots: flat areas and sharp edges
+    natural    // photos, renderings: noise and smooth gradients
+};
+
+/**
+ * Classify the content of a region of an image.
+ *
+ * Along the sampled rows, synthetic content has many neighbours of identical
+ * luma (a low local variance) or a high density of sharp edges, which JPEG
+ * blurs unless the chroma is kept at full resolution.
+ */
+Content _classify(const ImageWrapper& image, const QRect& region)
+{
+    if (_isUniform(image, region))
+        return Content::uniform;
+
+    const auto& offset = rgbOffsets[image.pixelFormat];
+    const size_t bytesPerPixel = image.getBytesPerPixel();
+    const size_t pitch = image.width * bytesPerPixel;
+    const auto luma = [&offset](const uint8_t* pixel) {
+        return (77 * pixel[offset[0]] + 150 * pixel[offset[1]] +
+                29 * pixel[offset[2]]) >> 8;
+    };
+
+    uint64_t pairs = 0;
+    uint64_t flat = 0;
+    uint64_t edges = 0;
+    for (int y = 0; y < region.height(); y += ANALYSIS_ROW_STEP)
+    {
+        const uint8_t* pixel = (const uint8_t*)image.data +
+                               (region.y() + y) * pitch +
+                               region.x() * bytesPerPixel;
+        int previous = luma(pixel);
+        for (int x = 1; x < region.width(); ++x)
+        {
+            pixel += bytesPerPixel;
+            const int current = luma(pixel);
+            const int step = std::abs(current - previous);
+            flat += step == 0;
+            edges += step >= SHARP_EDGE_STEP;
+            previous = current;
+        }
+        pairs += uint64_t(region.width() - 1);
+    }
+    if (pairs == 0)
+        return Content::natural;
+
+    const bool synthetic = flat >= MIN_SYNTHETIC_FLAT_RATIO * pairs ||
+                           edges >= MIN_SYNTHETIC_EDGE_RATIO * pairs;
+    return synthetic ? Content::synthetic : Content::natural;
+}
+}
+
 bool ImageSegmenter::_isOnRightSideOfSideBySideImage(const SegmentTask& segment)
 {
     return segment.sourceImage->view == View::side_by_side &&
@@ -61,9 +287,25 @@ bool ImageSegmenter::_isOnRightSideOfSideBySideImage(const SegmentTask& segment)
 
 bool ImageSegmenter::generate(const ImageWrapper& image, Handler handler)
 {
-    if (image.compressionPolicy == COMPRESSION_ON)
-        return _generateJpeg(image, handler);
-    return _generateRaw(image, handler);
+    const Handler countingHandler = [this, &image,
+                                     &handler](const Segment& segment) {
+        if (!handler(segment))
+            return false;
+        _countSegment(image, segment);
+        return true;
+    };
+
+    switch (image.compressionPolicy)
+    {
+    case COMPRESSION_ON:
+        return _generateJpeg(image, countingHandler);
+    case COMPRESSION_AUTO:
+        return _generateParallel(image, countingHandler,
+                                 std::bind(&ImageSegmenter::_computeAuto, this,
+                                           std::placeholders::_1, true));
+    default:
+        return _generateRaw(image, countingHandler);
+    }
 }
 
 Segment ImageSegmenter::createSingleSegment(const ImageWrapper& image)
@@ -75,7 +317,13 @@ Segment ImageSegmenter::createSingleSegment(const ImageWrapper& image)
 
     auto& segment = segments[0];
 
-    if (image.compressionPolicy == COMPRESSION_OFF)
+    if (image.compressionPolicy == COMPRESSION_AUTO)
+    {
+        _computeAuto(segment, false);
+        if (segment.exception)
+            std::rethrow_exception(segment.exception);
+    }
+    else if (image.compressionPolicy == COMPRESSION_OFF)
     {
         segment.imageData.reserve(segment.parameters.width *
                                   segment.parameters.height *
@@ -96,9 +344,32 @@ Segment ImageSegmenter::createSingleSegment(const ImageWrapper& image)
 #endif
     }
 
+    _countSegment(image, segment);
     return segment;
 }
 
+void ImageSegmenter::updateStatistics(StreamStatistics& statistics) const
+{
+    std::lock_guard<std::mutex> lock(_statisticsMutex);
+    statistics.segmentsSent += _segments;
+    statistics.segmentsFilled += _filledSegments;
+    statistics.rawBytes += _rawBytes;
+    statistics.compressedBytes += _compressedBytes;
+    statistics.compressTime = _compressTime;
+    statistics.segmentCacheHits += _cache.getHits();
+    statistics.segmentCacheMisses += _cache.getMisses();
+}
+
+void ImageSegmenter::setCacheSize(const size_t maxBytes)
+{
+    _cache.setMaxBytes(maxBytes);
+}
+
+void ImageSegmenter::setLinkThroughput(const double bytesPerSecond)
+{
+    _linkThroughput = bytesPerSecond;
+}
+
 void ImageSegmenter::setNominalSegmentDimensions(const uint width,
                                                  const uint height)
 {
@@ -106,18 +377,39 @@ void ImageSegmenter::setNominalSegmentDimensions(const uint width,
     _nominalSegmentHeight = height;
 }
 
+void ImageSegmenter::setSegmentBoundaries(std::vector<uint> columns,
+                                          std::vector<uint> rows)
+{
+    _sortBoundaries(columns);
+    _sortBoundaries(rows);
+    _columnBoundaries = std::move(columns);
+    _rowBoundaries = std::move(rows);
+}
+
 bool ImageSegmenter::_generateJpeg(const ImageWrapper& image,
                                    const Handler& handler)
 {
 #ifdef DEFLECT_USE_LIBJPEGTURBO
-    // The resulting Jpeg segments
+    return _generateParallel(image, handler,
+                             std::bind(&ImageSegmenter::_computeJpeg, this,
+                                       std::placeholders::_1, true));
+#else
+    throw std::runtime_error(
+        "LibJpegTurbo not available, needed for sending JPEG compressed image");
+#endif
+}
+
+bool ImageSegmenter::_generateParallel(const ImageWrapper& image,
+                                       const Handler& handler,
+                                       const SegmentFunc& compute)
+{
+    // The resulting segments
     auto segments = _generateSegmentTasks(image);
 
-    // start creating JPEGs for each segment, in parallel
-    QtConcurrent::map(segments, std::bind(&ImageSegmenter::_computeJpeg, this,
-                                          std::placeholders::_1, true));
+    // start computing each segment, in parallel
+    QtConcurrent::map(segments, compute);
 
-    // Sending compressed jpeg segments while they arrive in the queue.
+    // Sending computed segments while they arrive in the queue.
     // Note: Qt insists that sending (by calling handler()) should happen
     // exclusively from the QThread where the socket lives. Sending from the
     // worker threads triggers a qWarning.
@@ -145,51 +437,167 @@ bool ImageSegmenter::_generateJpeg(const ImageWrapper& image,
             _sendQueue.dequeue();
         std::rethrow_exception(std::current_exception());
     }
-#else
-    throw std::runtime_error(
-        "LibJpegTurbo not available, needed for sending JPEG compressed image");
-#endif
 }
 
-void ImageSegmenter::_computeJpeg(SegmentTask& segment, const bool sendSegment)
+QRect ImageSegmenter::_getImageRegion(const SegmentTask& segment)
 {
-#ifdef DEFLECT_USE_LIBJPEGTURBO
     QRect imageRegion(segment.parameters.x - segment.sourceImage->x,
                       segment.parameters.y - segment.sourceImage->y,
                       segment.parameters.width, segment.parameters.height);
 
     if (_isOnRightSideOfSideBySideImage(segment))
         imageRegion.translate(segment.sourceImage->width / 2, 0);
+    return imageRegion;
+}
 
-    // turbojpeg handles need to be per thread, and this function is called from
-    // multiple threads by QtConcurrent::map
-    static QThreadStorage<ImageJpegCompressor> compressor;
-    try
+void ImageSegmenter::_computeJpeg(SegmentTask& segment, const bool sendSegment)
+{
+    trace::Span span{"computeJpeg", "client", segment.index, segment.frame};
+    const auto imageRegion = _getImageRegion(segment);
+
+    const auto& image = *segment.sourceImage;
+    if (image.data && _isUniform(image, imageRegion))
     {
-        segment.imageData =
-            compressor.localData().computeJpeg(*segment.sourceImage,
-                                               imageRegion);
+        segment.imageData = _getFillColor(image, imageRegion, false);
+        segment.parameters.format = Format::fill;
     }
-    catch (...)
+    else
+        _compressJpeg(segment, image, imageRegion);
+
+    if (sendSegment)
+        _sendQueue.enqueue(segment);
+}
+
+void ImageSegmenter::_computeAuto(SegmentTask& segment, const bool sendSegment)
+{
+    trace::Span span{"computeAuto", "client", segment.index, segment.frame};
+    const auto imageRegion = _getImageRegion(segment);
+
+    const auto& image = *segment.sourceImage;
+    if (!image.data)
     {
-        segment.exception = std::current_exception();
+        segment.exception = std::make_exception_ptr(
+            std::invalid_argument("image data is NULL"));
+    }
+    else
+    {
+        const auto content = _classify(image, imageRegion);
+        if (content == Content::uniform)
+        {
+            // unlike JPEG, raw segments keep their alpha: so does the fill
+            segment.imageData = _getFillColor(image, imageRegion, true);
+            segment.parameters.format = Format::fill;
+        }
+        else if (_isRawFasterThanJpeg(image, imageRegion) ||
+                 (image.pixelFormat == RGBA && !_isOpaque(image, imageRegion)))
+        {
+            segment.imageData = _copyRegion(image, imageRegion);
+            segment.parameters.format = Format::rgba;
+        }
+        else
+        {
+            auto jpegImage = image;
+            jpegImage.subsampling = content == Content::synthetic
+                                        ? ChromaSubsampling::YUV444
+                                        : ChromaSubsampling::YUV420;
+            _compressJpeg(segment, jpegImage, imageRegion);
+        }
     }
 
-    segment.parameters.format = Format::jpeg;
     if (sendSegment)
         _sendQueue.enqueue(segment);
+}
+
+bool ImageSegmenter::_isRawFasterThanJpeg(const ImageWrapper& image,
+                                          const QRect& region) const
+{
+    // the Server only accepts uncompressed images in RGBA
+    if (image.pixelFormat != RGBA)
+        return false;
+#ifdef DEFLECT_USE_LIBJPEGTURBO
+    // without a measure of the link, keep sending uncompressed images
+    const double throughput = _linkThroughput;
+    if (throughput <= 0.0)
+        return true;
+
+    double nsPerPixel = DEFAULT_JPEG_NS_PER_PIXEL;
+    double bytesPerPixel = DEFAULT_JPEG_BYTES_PER_PIXEL;
+    {
+        std::lock_guard<std::mutex> lock(_statisticsMutex);
+        if (_jpegPixels > 0)
+        {
+            nsPerPixel = double(_jpegTime.count()) / _jpegPixels;
+            bytesPerPixel = double(_jpegBytes) / _jpegPixels;
+        }
+    }
+
+    // the segments are compressed in parallel
+    const auto threads = std::max(QThread::idealThreadCount(), 1);
+    const double pixels = double(region.width()) * region.height();
+    const double rawTime = pixels * image.getBytesPerPixel() / throughput;
+    const double jpegTime =
+        pixels * (nsPerPixel * 1e-9 / threads + bytesPerPixel / throughput);
+    return rawTime <= jpegTime;
+#else
+    Q_UNUSED(region);
+    return true;
 #endif
 }
 
+void ImageSegmenter::_compressJpeg(SegmentTask& segment,
+                                   const ImageWrapper& image,
+                                   const QRect& imageRegion)
+{
+#ifdef DEFLECT_USE_LIBJPEGTURBO
+    // turbojpeg handles need to be per thread, and this function is called from
+    // multiple threads by QtConcurrent::map
+    static QThreadStorage<ImageJpegCompressor> compressor;
+
+    // invalid images are left to the compressor to report
+    const bool useCache = _cache.isEnabled() && image.data;
+    const auto key = useCache ? SegmentCache::makeKey(image, imageRegion)
+                              : SegmentCache::Key();
+    if (!useCache || !_cache.find(key, segment.imageData))
+    {
+        const auto start = std::chrono::steady_clock::now();
+        try
+        {
+            segment.imageData =
+                compressor.localData().computeJpeg(image, imageRegion);
+            if (useCache)
+                _cache.insert(key, segment.imageData);
+        }
+        catch (...)
+        {
+            segment.exception = std::current_exception();
+        }
+        const auto compressTime = std::chrono::steady_clock::now() - start;
+        std::lock_guard<std::mutex> lock(_statisticsMutex);
+        _compressTime.record(compressTime);
+        if (!segment.exception)
+        {
+            _jpegPixels += uint64_t(imageRegion.width()) * imageRegion.height();
+            _jpegBytes += uint64_t(segment.imageData.size());
+            _jpegTime +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    compressTime);
+        }
+    }
+#else
+    Q_UNUSED(image);
+    Q_UNUSED(imageRegion);
+    segment.exception = std::make_exception_ptr(
+        std::runtime_error("LibJpegTurbo not available, needed for JPEG"));
+#endif
+    segment.parameters.format = Format::jpeg;
+}
+
 bool ImageSegmenter::_generateRaw(const ImageWrapper& image,
                                   const Handler& handler) const
 {
     auto segments = _generateSegmentTasks(image);
     for (auto& segment : segments)
     {
-        segment.imageData.reserve(segment.parameters.width *
-                                  segment.parameters.height *
-                                  image.getBytesPerPixel());
         segment.parameters.format = Format::rgba;
 
         if (segments.size() == 1)
@@ -199,25 +607,7 @@ bool ImageSegmenter::_generateRaw(const ImageWrapper& image,
                                      int(image.getBufferSize()));
         }
         else // Copy the image subregion
-        {
-            // assume imageBuffer isn't padded
-            const auto bytesPerPixel = image.getBytesPerPixel();
-            const size_t imagePitch = image.width * bytesPerPixel;
-            size_t offset = segment.parameters.y * imagePitch +
-                            segment.parameters.x * bytesPerPixel;
-
-            if (_isOnRightSideOfSideBySideImage(segment))
-                offset += segment.sourceImage->width / 2 * bytesPerPixel;
-
-            const char* lineData = (const char*)image.data + offset;
-
-            for (uint i = 0; i < segment.parameters.height; ++i)
-            {
-                segment.imageData.append(lineData, segment.parameters.width *
-                                                       bytesPerPixel);
-                lineData += imagePitch;
-            }
-        }
+            segment.imageData = _copyRegion(image, _getImageRegion(segment));
 
         if (!handler(segment))
             return false;
@@ -226,13 +616,31 @@ bool ImageSegmenter::_generateRaw(const ImageWrapper& image,
     return true;
 }
 
+void ImageSegmenter::_countSegment(const ImageWrapper& image,
+                                   const Segment& segment)
+{
+    const auto& params = segment.parameters;
+    std::lock_guard<std::mutex> lock(_statisticsMutex);
+    ++_segments;
+    if (params.format == Format::fill)
+        ++_filledSegments;
+    _rawBytes +=
+        uint64_t(params.width) * params.height * image.getBytesPerPixel();
+    _compressedBytes += uint64_t(segment.imageData.size());
+}
+
 ImageSegmenter::SegmentTasks ImageSegmenter::_generateSegmentTasks(
     const ImageWrapper& image) const
 {
+    trace::Span span{"generateSegmentTasks", "client"};
+    const auto frame = trace::getThreadFrame();
+
     SegmentTasks segments;
     for (const auto& params : _makeSegmentParameters(image))
     {
         SegmentTask segment;
+        segment.frame = frame;
+        segment.index = int64_t(segments.size());
         segment.parameters = params;
         segment.view =
             image.view == View::side_by_side ? View::left_eye : image.view;
@@ -251,7 +659,10 @@ ImageSegmenter::SegmentTasks ImageSegmenter::_generateSegmentTasks(
         // create copy of segments for right view
         auto segmentsRight = segments;
         for (auto& segment : segmentsRight)
+        {
             segment.view = View::right_eye;
+            segment.index += int64_t(segments.size());
+        }
 
         segments.insert(segments.end(), segmentsRight.begin(),
                         segmentsRight.end());
@@ -263,59 +674,31 @@ ImageSegmenter::SegmentTasks ImageSegmenter::_generateSegmentTasks(
 ImageSegmenter::SegmentParametersList ImageSegmenter::_makeSegmentParameters(
     const ImageWrapper& image) const
 {
-    const auto info = _makeSegmentationInfo(image);
+    const auto imageWidth =
+        image.view == View::side_by_side ? image.width / 2 : image.width;
+
+    // a single segment per image (between boundaries) if any dimension is 0
+    const bool nominal = _nominalSegmentWidth > 0 && _nominalSegmentHeight > 0;
+    const auto columns = _split(image.x, imageWidth,
+                                nominal ? _nominalSegmentWidth : 0,
+                                _columnBoundaries);
+    const auto rows = _split(image.y, image.height,
+                             nominal ? _nominalSegmentHeight : 0,
+                             _rowBoundaries);
 
     SegmentParametersList parameters;
-    for (uint j = 0; j < info.countY; ++j)
+    for (const auto& row : rows)
     {
-        for (uint i = 0; i < info.countX; ++i)
+        for (const auto& column : columns)
         {
             SegmentParameters p;
-            p.x = image.x + i * info.width;
-            p.y = image.y + j * info.height;
-            p.width = (i < info.countX - 1) ? info.width : info.lastWidth;
-            p.height = (j < info.countY - 1) ? info.height : info.lastHeight;
+            p.x = column.start;
+            p.y = row.start;
+            p.width = column.size;
+            p.height = row.size;
             parameters.emplace_back(p);
         }
     }
     return parameters;
 }
-
-ImageSegmenter::SegmentationInfo ImageSegmenter::_makeSegmentationInfo(
-    const ImageWrapper& image) const
-{
-    const auto imageWidth =
-        image.view == View::side_by_side ? image.width / 2 : image.width;
-
-    SegmentationInfo info;
-    info.width = _nominalSegmentWidth;
-    info.height = _nominalSegmentHeight;
-
-    if (_nominalSegmentWidth == 0 || _nominalSegmentHeight == 0)
-    {
-        info.countX = 1;
-        info.countY = 1;
-        info.lastWidth = imageWidth;
-        info.lastHeight = image.height;
-        return info;
-    }
-
-    info.countX = imageWidth / _nominalSegmentWidth + 1;
-    info.countY = image.height / _nominalSegmentHeight + 1;
-
-    info.lastWidth = imageWidth % _nominalSegmentWidth;
-    info.lastHeight = image.height % _nominalSegmentHeight;
-
-    if (info.lastWidth == 0)
-    {
-        info.lastWidth = _nominalSegmentWidth;
-        --info.countX;
-    }
-    if (info.lastHeight == 0)
-    {
-        info.lastHeight = _nominalSegmentHeight;
-        --info.countY;
-    }
-    return info;
-}
 }
@@ -46,8 +46,14 @@
 
 #include <deflect/MTQueue.h>
 #include <deflect/Segment.h>
+#include <deflect/SegmentCache.h>
+#include <deflect/StreamStatistics.h>
 
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <mutex>
+#include <vector>
 
 namespace deflect
 {
@@ -70,6 +76,16 @@ public:
      * executed from the calling thread. When one handle() fails, the remaining
      * handle() calls may or may not be executed.
      *
+     * When compressing, the segments of a single color are not compressed but
+     * sent as a Format::fill segment holding that color.
+     *
+     * With COMPRESSION_AUTO, the format of each segment is selected from its
+     * content and the link throughput: a fill color for a single color, raw
+     * RGBA if sending it is faster than compressing it or if it is not fully
+     * opaque, otherwise JPEG with YUV444 subsampling for text and UIs or
+     * YUV420 for natural images. Unlike with COMPRESSION_ON, fill colors keep
+     * the alpha of the image.
+     *
      * @param image The image to be segmented.
      * @param handler the function to handle the generated segment.
      * @return true if all image handlers returned true, false on failure.
@@ -92,6 +108,20 @@ public:
      */
     DEFLECT_API void setNominalSegmentDimensions(uint width, uint height);
 
+    /**
+     * Set the boundaries that the segments must not cross.
+     *
+     * The images are divided at the given positions, expressed in the global
+     * coordinates of the stream, and the nominal segments restart from each
+     * boundary. This is used to align the segments to the display nodes of a
+     * WallLayout.
+     *
+     * @param columns The x positions of the vertical boundaries
+     * @param rows The y positions of the horizontal boundaries
+     */
+    DEFLECT_API void setSegmentBoundaries(std::vector<uint> columns,
+                                          std::vector<uint> rows);
+
     /**
      * For a small input image (tested with 64x64, possible for <=512 as well),
      * directly compress it to a single segment which will be enqueued for
@@ -106,19 +136,42 @@ public:
      */
     DEFLECT_API Segment createSingleSegment(const ImageWrapper& image);
 
-private:
-    struct SegmentationInfo
-    {
-        uint width = 0;
-        uint height = 0;
+    /**
+     * Set the size of the cache of compressed segments.
+     *
+     * When enabled, the JPEG data of each segment is kept in a LRU cache
+     * addressed by a hash of its pixels, dimensions and compression
+     * parameters. Segments identical to a cached one, from any previous frame
+     * and at any position, are not compressed again.
+     *
+     * @param maxBytes the maximum size of the cached JPEG data, 0 to disable
+     *        the cache (default).
+     * @threadsafe
+     */
+    DEFLECT_API void setCacheSize(size_t maxBytes);
 
-        uint countX = 0;
-        uint countY = 0;
+    /**
+     * Set the throughput of the link to the Server, for COMPRESSION_AUTO.
+     *
+     * Segments are sent uncompressed while the throughput is unknown, or
+     * while sending them takes less time than compressing and sending them
+     * in JPEG, given the compression speed and ratio measured so far.
+     *
+     * @param bytesPerSecond the measured throughput, 0 if unknown (default).
+     * @threadsafe
+     */
+    DEFLECT_API void setLinkThroughput(double bytesPerSecond);
 
-        uint lastWidth = 0;
-        uint lastHeight = 0;
-    };
+    /**
+     * Add the counters of the segments generated so far to the statistics.
+     *
+     * @param statistics the statistics to update: segments, raw and
+     *        compressed bytes, compression times and cache hits.
+     * @threadsafe
+     */
+    DEFLECT_API void updateStatistics(StreamStatistics& statistics) const;
 
+private:
     struct SegmentTask : Segment
     {
         /** Uncompressed source image used for compression */
@@ -126,12 +179,27 @@ private:
 
         /** Holds potential exception from compression thread */
         std::exception_ptr exception;
+
+        /** The frame and index of the segment, for tracing */
+        int64_t frame = -1;
+        int64_t index = -1;
     };
     static bool _isOnRightSideOfSideBySideImage(const SegmentTask& segment);
+    static QRect _getImageRegion(const SegmentTask& segment);
+
+    using SegmentFunc = std::function<void(SegmentTask&)>;
+    bool _generateParallel(const ImageWrapper& image, const Handler& handler,
+                           const SegmentFunc& compute);
 
     bool _generateJpeg(const ImageWrapper& image, const Handler& handler);
     void _computeJpeg(SegmentTask& segment, bool sendSegment);
+    void _computeAuto(SegmentTask& segment, bool sendSegment);
+    void _compressJpeg(SegmentTask& segment, const ImageWrapper& image,
+                       const QRect& imageRegion);
+    bool _isRawFasterThanJpeg(const ImageWrapper& image,
+                              const QRect& region) const;
     bool _generateRaw(const ImageWrapper& image, const Handler& handler) const;
+    void _countSegment(const ImageWrapper& image, const Segment& segment);
 
     using SegmentTasks = std::vector<SegmentTask>;
     SegmentTasks _generateSegmentTasks(const ImageWrapper& image) const;
@@ -139,12 +207,28 @@ private:
     using SegmentParametersList = std::vector<SegmentParameters>;
     SegmentParametersList _makeSegmentParameters(
         const ImageWrapper& image) const;
-    SegmentationInfo _makeSegmentationInfo(const ImageWrapper& image) const;
 
     uint _nominalSegmentWidth = 0;
     uint _nominalSegmentHeight = 0;
 
+    std::vector<uint> _columnBoundaries;
+    std::vector<uint> _rowBoundaries;
+
     MTQueue<SegmentTask> _sendQueue;
+
+    SegmentCache _cache;
+
+    std::atomic<double> _linkThroughput{0.0};
+
+    mutable std::mutex _statisticsMutex;
+    uint64_t _segments = 0;
+    uint64_t _filledSegments = 0;
+    uint64_t _rawBytes = 0;
+    uint64_t _compressedBytes = 0;
+    LatencyHistogram _compressTime;
+    uint64_t _jpegPixels = 0;
+    uint64_t _jpegBytes = 0;
+    std::chrono::nanoseconds _jpegTime{0};
 };
 }
 #endif
@@ -64,7 +64,15 @@ enum PixelFormat
 /** Image compression policy */
 enum CompressionPolicy
 {
-    COMPRESSION_AUTO, /**< Implementation specific */
+    /**
+     * Fill color, raw or JPEG chosen per segment (default).
+     *
+     * Before version 1.1 this policy always sent uncompressed images. Servers
+     * must now also handle Format::fill tiles, and Format::jpeg tiles when the
+     * link is too slow for raw images; TileDecoder or Tile::expandFill()
+     * convert them.
+     */
+    COMPRESSION_AUTO,
     COMPRESSION_ON,   /**< Force enable */
     COMPRESSION_OFF   /**< Force disable */
 };
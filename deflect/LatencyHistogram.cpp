@@ -0,0 +1,147 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Latencies below 2^SUB_BUCKET_BITS us are counted exactly, above they are
+// counted in 2^SUB_BUCKET_BITS buckets per power of two.
+const int SUB_BUCKET_BITS = 5;
+const uint64_t SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+const int MAX_BITS = 42; // 2^42 us ~ 50 days
+const size_t BUCKET_COUNT = (MAX_BITS - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+int _highestBit(uint64_t value)
+{
+    int bit = 0;
+    while (value >>= 1)
+        ++bit;
+    return bit;
+}
+
+size_t _getBucket(const uint64_t us)
+{
+    if (us < SUB_BUCKETS)
+        return us;
+
+    const auto bit = std::min(_highestBit(us), MAX_BITS);
+    const auto shift = bit - SUB_BUCKET_BITS;
+    const auto subBucket = std::min(us >> shift, 2 * SUB_BUCKETS - 1);
+    return (shift + 1) * SUB_BUCKETS + (subBucket - SUB_BUCKETS);
+}
+
+/** @return the middle of the range of values counted in a bucket. */
+uint64_t _getBucketValue(const size_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    const auto shift = bucket / SUB_BUCKETS - 1;
+    const auto subBucket = bucket % SUB_BUCKETS + SUB_BUCKETS;
+    return (subBucket << shift) + ((uint64_t(1) << shift) >> 1);
+}
+}
+
+namespace deflect
+{
+void LatencyHistogram::record(const Duration latency)
+{
+    const auto value = std::max(latency, Duration::zero());
+    const auto us =
+        std::chrono::duration_cast<std::chrono::microseconds>(value).count();
+    if (_buckets.empty())
+        _buckets.resize(BUCKET_COUNT);
+    ++_buckets[_getBucket(uint64_t(us))];
+    ++_count;
+    _max = std::max(_max, value);
+    _sum += value;
+}
+
+uint64_t LatencyHistogram::getCount() const
+{
+    return _count;
+}
+
+LatencyHistogram::Duration LatencyHistogram::getPercentile(
+    const double percent) const
+{
+    if (_count == 0)
+        return Duration::zero();
+
+    // nearest-rank percentile
+    const auto rank = std::max(
+        uint64_t(std::ceil(std::min(percent, 100.0) / 100.0 * _count)),
+        uint64_t(1));
+
+    uint64_t count = 0;
+    for (size_t bucket = 0; bucket < _buckets.size(); ++bucket)
+    {
+        count += _buckets[bucket];
+        if (count >= rank)
+        {
+            const auto value = std::chrono::microseconds(
+                _getBucketValue(bucket));
+            return std::min(Duration(value), _max);
+        }
+    }
+    return _max;
+}
+
+LatencyHistogram::Duration LatencyHistogram::getMax() const
+{
+    return _max;
+}
+
+LatencyHistogram::Duration LatencyHistogram::getSum() const
+{
+    return _sum;
+}
+
+void LatencyHistogram::clear()
+{
+    _buckets.clear();
+    _count = 0;
+    _max = Duration::zero();
+    _sum = Duration::zero();
+}
+}
@@ -0,0 +1,104 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_LATENCYHISTOGRAM_H
+#define DEFLECT_LATENCYHISTOGRAM_H
+
+#include <deflect/api.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace deflect
+{
+/**
+ * A histogram of latencies with a bounded memory footprint.
+ *
+ * Latencies are counted in buckets of microseconds whose width grows with the
+ * latency, so that the percentiles have a relative precision of about 3%
+ * from one microsecond to several days.
+ *
+ * @version 1.1
+ */
+class LatencyHistogram
+{
+public:
+    using Duration = std::chrono::nanoseconds;
+
+    /**
+     * Add a latency to the histogram.
+     * @param latency the latency, negative values are counted as zero.
+     * @version 1.1
+     */
+    DEFLECT_API void record(Duration latency);
+
+    /** @return the number of latencies recorded. @version 1.1 */
+    DEFLECT_API uint64_t getCount() const;
+
+    /**
+     * @param percent the percentile to compute, between 0 and 100.
+     * @return the latency below which the given percentage of the recorded
+     *         latencies are, zero if the histogram is empty.
+     * @version 1.1
+     */
+    DEFLECT_API Duration getPercentile(double percent) const;
+
+    /** @return the highest latency recorded. @version 1.1 */
+    DEFLECT_API Duration getMax() const;
+
+    /**
+     * @return the exact sum of the latencies recorded, for computing their
+     *         mean.
+     * @version 1.1
+     */
+    DEFLECT_API Duration getSum() const;
+
+    /** Remove all the recorded latencies. @version 1.1 */
+    DEFLECT_API void clear();
+
+private:
+    std::vector<uint64_t> _buckets;
+    uint64_t _count = 0;
+    Duration _max{0};
+    Duration _sum{0};
+};
+}
+
+#endif
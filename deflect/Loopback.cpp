@@ -0,0 +1,173 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "Loopback.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+const size_t MAX_PENDING_BYTES = 4 * 1024 * 1024; // like a TCP socket buffer
+
+std::mutex _acceptorsMutex;
+std::map<uint16_t, deflect::loopback::Acceptor> _acceptors;
+}
+
+namespace deflect
+{
+namespace loopback
+{
+bool Pipe::write(const char* data, const size_t size)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _condition.wait(lock, [this] {
+        return _closed || size_t(_buffer.size()) < MAX_PENDING_BYTES;
+    });
+    if (_closed)
+        return false;
+
+    _buffer.append(data, int(size));
+    _condition.notify_all();
+    if (_notifier)
+        _notifier();
+    return true;
+}
+
+QByteArray Pipe::read(const size_t maxSize)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto size = std::min(maxSize, size_t(_buffer.size()));
+    const auto data = _buffer.left(int(size));
+    _buffer.remove(0, int(size));
+    _condition.notify_all();
+    return data;
+}
+
+QByteArray Pipe::readAll()
+{
+    QByteArray data;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        data.swap(_buffer);
+    }
+    _condition.notify_all();
+    return data;
+}
+
+size_t Pipe::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _buffer.size();
+}
+
+bool Pipe::waitForData(const int timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _condition.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                        [this] { return _closed || !_buffer.isEmpty(); });
+    return !_buffer.isEmpty();
+}
+
+void Pipe::close()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_closed)
+        return;
+
+    _closed = true;
+    _condition.notify_all();
+    if (_notifier)
+        _notifier();
+}
+
+bool Pipe::isClosed() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _closed;
+}
+
+void Pipe::setNotifier(std::function<void()> notifier)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _notifier = std::move(notifier);
+}
+
+void Channel::close()
+{
+    toServer.close();
+    toClient.close();
+}
+
+void listen(const uint16_t port, Acceptor acceptor)
+{
+    std::lock_guard<std::mutex> lock(_acceptorsMutex);
+    if (!_acceptors.emplace(port, std::move(acceptor)).second)
+    {
+        throw std::runtime_error("in-process port already in use: " +
+                                 std::to_string(port));
+    }
+}
+
+void unlisten(const uint16_t port)
+{
+    std::lock_guard<std::mutex> lock(_acceptorsMutex);
+    _acceptors.erase(port);
+}
+
+std::shared_ptr<Channel> connect(const uint16_t port)
+{
+    auto channel = std::make_shared<Channel>();
+
+    // accept with the lock held, so that the Server cannot be destroyed
+    std::lock_guard<std::mutex> lock(_acceptorsMutex);
+    const auto it = _acceptors.find(port);
+    if (it == _acceptors.end())
+    {
+        throw std::runtime_error("could not connect to " + std::string(HOST) +
+                                 ":" + std::to_string(port));
+    }
+    it->second(channel);
+    return channel;
+}
+}
+}
@@ -0,0 +1,159 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_LOOPBACK_H
+#define DEFLECT_LOOPBACK_H
+
+#include <deflect/api.h>
+
+#include <QByteArray>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace deflect
+{
+/**
+ * In-process transport between a Stream and a Server of the same process.
+ *
+ * A Stream connects through an in-memory Channel instead of a TCP socket when
+ * its host is loopback::HOST and its port the one of a Server. The messages
+ * are exactly those of the network protocol, so that the segmentation,
+ * compression, framing, dispatching and decoding costs can be measured
+ * without the kernel networking stack.
+ */
+namespace loopback
+{
+/** Host name which selects the in-process transport. */
+const char* const HOST = "inprocess";
+
+/**
+ * Thread-safe byte stream in one direction.
+ *
+ * A write waits while more than a socket buffer worth of data is pending, so
+ * that a fast writer is throttled by its reader as with a TCP socket.
+ */
+class Pipe
+{
+public:
+    /**
+     * Append data to the pipe, waiting for the reader if it is full.
+     * @return false if the pipe is closed.
+     */
+    DEFLECT_API bool write(const char* data, size_t size);
+
+    /** @return up to maxSize bytes, without waiting. */
+    DEFLECT_API QByteArray read(size_t maxSize);
+
+    /** @return all the pending data, without waiting. */
+    DEFLECT_API QByteArray readAll();
+
+    /** @return the number of pending bytes. */
+    DEFLECT_API size_t size() const;
+
+    /**
+     * Wait until data is pending or the pipe is closed.
+     * @param timeoutMs maximum time to wait in milliseconds.
+     * @return true if data is pending.
+     */
+    DEFLECT_API bool waitForData(int timeoutMs);
+
+    /** Close the pipe; the pending data can still be read. */
+    DEFLECT_API void close();
+
+    /** @return true if the pipe has been closed by either end. */
+    DEFLECT_API bool isClosed() const;
+
+    /**
+     * Set a function called from the writer thread after data was written or
+     * the pipe was closed, nullptr to remove it.
+     *
+     * The function is called with the lock of the pipe held and must not use
+     * the pipe.
+     */
+    DEFLECT_API void setNotifier(std::function<void()> notifier);
+
+private:
+    mutable std::mutex _mutex;
+    std::condition_variable _condition;
+    QByteArray _buffer;
+    bool _closed = false;
+    std::function<void()> _notifier;
+};
+
+/** A connection between a client and a Server of the same process. */
+struct Channel
+{
+    Pipe toServer;
+    Pipe toClient;
+
+    /** Close both directions, as when a socket is closed. */
+    DEFLECT_API void close();
+};
+
+/** Function called from the thread of the connecting client. */
+using Acceptor = std::function<void(std::shared_ptr<Channel>)>;
+
+/**
+ * Accept the in-process connections to a port.
+ *
+ * @param port the port of the Server.
+ * @param acceptor the function called with each new connection.
+ * @throw std::runtime_error if the port is already in use.
+ */
+DEFLECT_API void listen(uint16_t port, Acceptor acceptor);
+
+/** Stop accepting the in-process connections to a port. */
+DEFLECT_API void unlisten(uint16_t port);
+
+/**
+ * Open an in-process connection.
+ *
+ * @param port the port of the Server.
+ * @return the channel to communicate with the Server.
+ * @throw std::runtime_error if no Server of this process uses the port.
+ */
+DEFLECT_API std::shared_ptr<Channel> connect(uint16_t port);
+}
+}
+
+#endif
@@ -70,7 +70,12 @@ enum MessageType
     MESSAGE_TYPE_IMAGE_VIEW = 15,
     MESSAGE_TYPE_OBSERVER_OPEN = 16,
     MESSAGE_TYPE_IMAGE_ROW_ORDER = 17,
-    MESSAGE_TYPE_IMAGE_CHANNEL = 18
+    MESSAGE_TYPE_IMAGE_CHANNEL = 18,
+    MESSAGE_TYPE_FRAME_ACK = 19,
+    MESSAGE_TYPE_PIXELSTREAM_BATCH = 20,
+    MESSAGE_TYPE_EVENTS = 21,
+    MESSAGE_TYPE_PING = 22,
+    MESSAGE_TYPE_PONG = 23
 };
 
 #define MESSAGE_HEADER_URI_LENGTH 64
@@ -66,6 +66,7 @@ struct MetaTypeRegistration
         qRegisterMetaType<deflect::server::FramePtr>(
             "deflect::server::FramePtr");
         qRegisterMetaType<deflect::server::Tile>("deflect::server::Tile");
+        qRegisterMetaType<deflect::server::Tiles>("deflect::server::Tiles");
     }
 };
 
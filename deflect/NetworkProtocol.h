@@ -39,7 +39,7 @@
 #ifndef DEFLECT_NETWORK_PROTOCOL_H
 #define DEFLECT_NETWORK_PROTOCOL_H
 
-#define NETWORK_PROTOCOL_VERSION 8
+#define NETWORK_PROTOCOL_VERSION 14
 #define DEFAULT_PORT_NUMBER 1701
 
 #endif
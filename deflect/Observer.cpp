@@ -41,6 +41,8 @@
 
 #include "Observer.h"
 #include "NetworkProtocol.h"
+#include "PackedEvent.h"
+#include "Session.h"
 #include "StreamPrivate.h"
 
 #include <QDataStream>
@@ -50,6 +52,21 @@
 
 namespace deflect
 {
+namespace
+{
+Event _deserialize(const QByteArray& message)
+{
+    assert((size_t)message.size() == Event::serializedSize);
+
+    Event event;
+    {
+        QDataStream stream(message);
+        stream >> event;
+    }
+    return event;
+}
+}
+
 const unsigned short Observer::defaultPortNumber = DEFAULT_PORT_NUMBER;
 
 Observer::Observer()
@@ -68,6 +85,11 @@ Observer::Observer(const std::string& id, const std::string& host,
 {
 }
 
+Observer::Observer(const std::string& id, Session& session)
+    : _impl(new StreamPrivate(id, session._connection, true))
+{
+}
+
 Observer::Observer(StreamPrivate* impl)
     : _impl(impl)
 {
@@ -79,7 +101,7 @@ Observer::~Observer()
 
 bool Observer::isConnected() const
 {
-    return _impl->socket.isConnected();
+    return _impl->isConnected();
 }
 
 const std::string& Observer::getId() const
@@ -120,7 +142,7 @@ bool Observer::registerForEvents(const bool exclusive)
     // Wait for bind reply
     MessageHeader mh;
     QByteArray message;
-    if (!_impl->socket.receive(mh, message))
+    if (!_impl->inbox->receive(mh, message))
     {
         std::cerr << "deflect::Stream::registerForEvents: receive bind reply "
                   << "failed" << std::endl;
@@ -149,33 +171,88 @@ int Observer::getDescriptor() const
 
 bool Observer::hasEvent() const
 {
-    return _impl->socket.hasMessage(Event::serializedSize);
+    return !_impl->pendingEvents.empty() || _impl->inbox->hasMessage();
 }
 
 Event Observer::getEvent()
 {
+    auto& pendingEvents = _impl->pendingEvents;
+    if (!pendingEvents.empty())
+    {
+        const auto event = pendingEvents.front();
+        pendingEvents.pop_front();
+        return event;
+    }
+
     MessageHeader mh;
     QByteArray message;
-    if (!_impl->socket.receive(mh, message))
+    if (!_impl->inbox->receive(mh, message))
     {
         std::cerr << "deflect::Stream::getEvent: receive failed" << std::endl;
         return Event();
     }
-    if (mh.type != MESSAGE_TYPE_EVENT)
+    if (mh.type == MESSAGE_TYPE_EVENT)
+        return _deserialize(message);
+
+    if (mh.type != MESSAGE_TYPE_EVENTS)
     {
         std::cerr << "deflect::Stream::getEvent: received unexpected message "
                   << "type (" << int(mh.type) << ")" << std::endl;
         return Event();
     }
 
-    assert((size_t)message.size() == Event::serializedSize);
+    try
+    {
+        const auto events = unpackEvents(message);
+        if (events.empty())
+            return Event();
+        pendingEvents.insert(pendingEvents.end(), events.begin() + 1,
+                             events.end());
+        return events.front();
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cerr << "deflect::Stream::getEvent: " << e.what() << std::endl;
+        return Event();
+    }
+}
 
-    Event event;
+void Observer::setEventCallback(std::function<void(const Event&)> callback)
+{
+    if (!callback)
     {
-        QDataStream stream(message);
-        stream >> event;
+        _impl->inbox->setMessageHandlers(
+            {{MESSAGE_TYPE_EVENT, nullptr}, {MESSAGE_TYPE_EVENTS, nullptr}});
+        return;
     }
-    return event;
+
+    // the rest of a batch partially read by getEvent() comes first
+    for (const auto& event : _impl->pendingEvents)
+        callback(event);
+    _impl->pendingEvents.clear();
+
+    // both types at once, so that the queued events keep their order
+    _impl->inbox->setMessageHandlers(
+        {{MESSAGE_TYPE_EVENT,
+          [callback](const QByteArray& message) {
+              callback(_deserialize(message));
+          }},
+         {MESSAGE_TYPE_EVENTS, [callback](const QByteArray& message) {
+              try
+              {
+                  for (const auto& event : unpackEvents(message))
+                      callback(event);
+              }
+              catch (const std::runtime_error& e)
+              {
+                  std::cerr << "deflect::Observer: " << e.what() << std::endl;
+              }
+          }}});
+}
+
+uint64_t Observer::getDroppedEventCount() const
+{
+    return _impl->inbox->getDroppedEventCount();
 }
 
 void Observer::setDisconnectedCallback(const std::function<void()> callback)
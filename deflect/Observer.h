@@ -46,12 +46,14 @@
 #include <deflect/api.h>
 #include <deflect/types.h>
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
 
 namespace deflect
 {
+class Session;
 class StreamPrivate;
 
 /**
@@ -119,6 +121,20 @@ public:
     DEFLECT_API Observer(const std::string& id, const std::string& host,
                          unsigned short port = defaultPortNumber);
 
+    /**
+     * Open a new observer on the shared connection of a Session.
+     *
+     * @param id The identifier for the stream, unique within the session. If
+     *           left empty, the environment variable DEFLECT_ID will be used.
+     *           If both values are empty, a random unique identifier will be
+     *           used.
+     * @param session The session to use for communicating with the Server.
+     * @throw std::runtime_error if the session already has a stream or
+     *                           observer with the same identifier
+     * @version 1.1
+     */
+    DEFLECT_API Observer(const std::string& id, Session& session);
+
     /** Destruct the Observer, closing the connection. @version 1.0 */
     DEFLECT_API virtual ~Observer();
 
@@ -143,7 +159,8 @@ public:
      * After registering, the Server application will send Events whenever a
      * user is interacting with this Observers's window.
      *
-     * Events can be retrieved using hasEvent() and getEvent().
+     * Events can be retrieved using hasEvent() and getEvent(), or with a
+     * function passed to setEventCallback().
      *
      * The current registration status can be checked with
      * isRegisteredForEvents().
@@ -178,6 +195,8 @@ public:
      * Observer, for example using hasEvent(), and process the events
      * accordingly.
      *
+     * @note the data is read by an internal thread as soon as it arrives, so
+     *       the descriptor may not stay readable until hasEvent() is called.
      * @return The native descriptor if available; otherwise returns -1.
      * @version 1.0
      */
@@ -209,6 +228,36 @@ public:
      */
     DEFLECT_API Event getEvent();
 
+    /**
+     * Set a function to be called for each received Event.
+     *
+     * The function is called from an internal thread as soon as an Event is
+     * received, instead of queueing it for hasEvent() and getEvent(). This
+     * avoids polling the Observer, for instance to forward the events to an
+     * application event loop. The events received before the function is set
+     * are first passed to it, in order, from the calling thread.
+     *
+     * @param callback the function to call, which must be thread-safe and
+     *        must not call setEventCallback(); nullptr to queue the events
+     *        again.
+     * @version 1.1
+     */
+    DEFLECT_API void setEventCallback(std::function<void(const Event&)> callback);
+
+    /**
+     * Get the number of events discarded because the application did not
+     * retrieve them fast enough.
+     *
+     * When too many messages are pending, the oldest EVT_MOVE and
+     * EVT_TOUCH_UPDATE events are discarded, as the next ones supersede them.
+     * The other events, such as EVT_CLOSE, EVT_PRESS and EVT_RELEASE, are
+     * never discarded.
+     *
+     * @return the number of events discarded since the observer was opened.
+     * @version 1.1
+     */
+    DEFLECT_API uint64_t getDroppedEventCount() const;
+
     /**
      * Set a function to be be called just after the observer gets disconnected.
      *
@@ -0,0 +1,145 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "PackedEvent.h"
+
+#include <QtEndian>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace deflect
+{
+namespace
+{
+const uint8_t MOUSE_LEFT = 1 << 0;
+const uint8_t MOUSE_RIGHT = 1 << 1;
+const uint8_t MOUSE_MIDDLE = 1 << 2;
+
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+void _swap(void* field)
+{
+    quint32 value;
+    std::memcpy(&value, field, sizeof(value));
+    value = qbswap(value);
+    std::memcpy(field, &value, sizeof(value));
+}
+
+void _swapBytes(PackedEvent& record)
+{
+    _swap(&record.mouseX);
+    _swap(&record.mouseY);
+    _swap(&record.dx);
+    _swap(&record.dy);
+    _swap(&record.key);
+    _swap(&record.modifiers);
+}
+#else
+void _swapBytes(PackedEvent&)
+{
+}
+#endif
+
+PackedEvent _pack(const Event& event)
+{
+    PackedEvent record;
+    record.mouseX = float(event.mouseX);
+    record.mouseY = float(event.mouseY);
+    record.dx = float(event.dx);
+    record.dy = float(event.dy);
+    record.key = event.key;
+    record.modifiers = event.modifiers;
+    std::memcpy(record.text, event.text, UNICODE_TEXT_SIZE);
+    record.type = uint8_t(event.type);
+    record.buttons = (event.mouseLeft ? MOUSE_LEFT : 0) |
+                     (event.mouseRight ? MOUSE_RIGHT : 0) |
+                     (event.mouseMiddle ? MOUSE_MIDDLE : 0);
+    record.reserved = 0;
+    _swapBytes(record);
+    return record;
+}
+
+Event _unpack(PackedEvent record)
+{
+    _swapBytes(record);
+
+    Event event;
+    event.type = Event::EventType(record.type);
+    event.mouseX = record.mouseX;
+    event.mouseY = record.mouseY;
+    event.dx = record.dx;
+    event.dy = record.dy;
+    event.mouseLeft = record.buttons & MOUSE_LEFT;
+    event.mouseRight = record.buttons & MOUSE_RIGHT;
+    event.mouseMiddle = record.buttons & MOUSE_MIDDLE;
+    event.key = record.key;
+    event.modifiers = record.modifiers;
+    std::memcpy(event.text, record.text, UNICODE_TEXT_SIZE);
+    return event;
+}
+}
+
+QByteArray packEvents(const std::vector<Event>& events)
+{
+    std::vector<PackedEvent> records;
+    records.reserve(events.size());
+    for (const auto& event : events)
+        records.emplace_back(_pack(event));
+
+    return QByteArray(reinterpret_cast<const char*>(records.data()),
+                      int(records.size() * sizeof(PackedEvent)));
+}
+
+std::vector<Event> unpackEvents(const QByteArray& message)
+{
+    const auto size = size_t(message.size());
+    if (size % sizeof(PackedEvent) != 0)
+        throw std::runtime_error("Invalid size for packed events message");
+
+    // the message data has no alignment guarantee
+    std::vector<PackedEvent> records(size / sizeof(PackedEvent));
+    std::memcpy(records.data(), message.constData(), size);
+
+    std::vector<Event> events;
+    events.reserve(records.size());
+    for (const auto& record : records)
+        events.emplace_back(_unpack(record));
+    return events;
+}
+}
@@ -0,0 +1,96 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_PACKEDEVENT_H
+#define DEFLECT_PACKEDEVENT_H
+
+#include <deflect/Event.h>
+#include <deflect/api.h>
+
+#include <QByteArray>
+
+#include <cstdint>
+#include <vector>
+
+namespace deflect
+{
+/**
+ * Compact network representation of an Event.
+ *
+ * All fields are little-endian and naturally aligned, so that a sequence of
+ * records can be decoded with a single memcpy on little-endian hosts. The
+ * coordinates are stored in single precision, which is sufficient for
+ * normalized positions even on the largest display walls.
+ *
+ * Used by MESSAGE_TYPE_EVENTS since NETWORK_PROTOCOL_VERSION == 11.
+ */
+struct PackedEvent
+{
+    float mouseX;
+    float mouseY;
+    float dx;
+    float dy;
+    int32_t key;
+    int32_t modifiers;
+    char text[UNICODE_TEXT_SIZE];
+    uint8_t type;
+    uint8_t buttons; /**< Bit field of the mouseLeft/Right/Middle states */
+    uint16_t reserved;
+};
+
+static_assert(sizeof(PackedEvent) == 32, "PackedEvent must not be padded");
+
+/**
+ * Serialize events as consecutive PackedEvent records.
+ * @param events the events to serialize.
+ * @return the payload for a MESSAGE_TYPE_EVENTS message.
+ */
+DEFLECT_API QByteArray packEvents(const std::vector<Event>& events);
+
+/**
+ * Deserialize the events of a MESSAGE_TYPE_EVENTS message.
+ * @param message the payload of the message.
+ * @return the events, in the order in which they were serialized.
+ * @throw std::runtime_error if the message size is not a multiple of the
+ *        record size.
+ */
+DEFLECT_API std::vector<Event> unpackEvents(const QByteArray& message);
+}
+
+#endif
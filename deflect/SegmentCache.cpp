@@ -0,0 +1,227 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "SegmentCache.h"
+
+#include "ImageWrapper.h"
+
+#include <cstring>
+
+namespace deflect
+{
+namespace
+{
+// Hashing constants of MurmurHash3, whose 128-bit variant this follows while
+// consuming the image rows one 64-bit word at a time.
+const uint64_t c1 = 0x87c37b91114253d5ULL;
+const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+inline uint64_t _rotl(const uint64_t x, const int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t _finalize(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+inline void _mix(const uint64_t word, uint64_t& h1, uint64_t& h2)
+{
+    h1 ^= _rotl(word * c1, 31) * c2;
+    h1 = _rotl(h1, 27) * 5 + 0x52dce729;
+    h2 ^= _rotl(word * c2, 33) * c1;
+    h2 = _rotl(h2, 31) * 5 + 0x38495ab5;
+}
+
+void _hashRow(const char* data, size_t size, uint64_t& h1, uint64_t& h2)
+{
+    uint64_t word;
+    for (; size >= sizeof(word); data += sizeof(word), size -= sizeof(word))
+    {
+        std::memcpy(&word, data, sizeof(word));
+        _mix(word, h1, h2);
+    }
+    if (size > 0)
+    {
+        word = 0;
+        std::memcpy(&word, data, size);
+        _mix(word, h1, h2);
+    }
+}
+}
+
+bool SegmentCache::Key::operator==(const Key& other) const
+{
+    return hash[0] == other.hash[0] && hash[1] == other.hash[1] &&
+           parameters == other.parameters && width == other.width &&
+           height == other.height;
+}
+
+SegmentCache::Key SegmentCache::makeKey(const ImageWrapper& image,
+                                        const QRect& region)
+{
+    // assume imageBuffer isn't padded, as the ImageJpegCompressor does
+    const size_t bytesPerPixel = image.getBytesPerPixel();
+    const size_t pitch = image.width * bytesPerPixel;
+    const size_t rowSize = size_t(region.width()) * bytesPerPixel;
+
+    const char* row = (const char*)image.data + region.y() * pitch +
+                      region.x() * bytesPerPixel;
+
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+    for (int y = 0; y < region.height(); ++y, row += pitch)
+        _hashRow(row, rowSize, h1, h2);
+
+    const uint64_t size = rowSize * region.height();
+    h1 ^= size;
+    h2 ^= size;
+    h1 += h2;
+    h2 += h1;
+    h1 = _finalize(h1);
+    h2 = _finalize(h2);
+    h1 += h2;
+    h2 += h1;
+
+    Key key;
+    key.hash[0] = h1;
+    key.hash[1] = h2;
+    key.parameters = uint32_t(image.pixelFormat) |
+                     uint32_t(image.subsampling) << 8 |
+                     uint32_t(image.compressionQuality) << 16;
+    key.width = uint32_t(region.width());
+    key.height = uint32_t(region.height());
+    return key;
+}
+
+SegmentCache::SegmentCache(const size_t maxBytes)
+    : _maxBytes(maxBytes)
+{
+}
+
+void SegmentCache::setMaxBytes(const size_t maxBytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _maxBytes = maxBytes;
+    _evict(_maxBytes);
+}
+
+size_t SegmentCache::getMaxBytes() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _maxBytes;
+}
+
+size_t SegmentCache::getBytes() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _bytes;
+}
+
+bool SegmentCache::isEnabled() const
+{
+    return getMaxBytes() > 0;
+}
+
+bool SegmentCache::find(const Key& key, QByteArray& data)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto it = _index.find(key);
+    if (it == _index.end())
+    {
+        ++_misses;
+        return false;
+    }
+    _entries.splice(_entries.begin(), _entries, it->second);
+    data = it->second->second;
+    ++_hits;
+    return true;
+}
+
+void SegmentCache::insert(const Key& key, const QByteArray& data)
+{
+    const auto size = size_t(data.size());
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (size > _maxBytes)
+        return;
+
+    // another thread may have compressed the same content concurrently
+    const auto it = _index.find(key);
+    if (it != _index.end())
+    {
+        _entries.splice(_entries.begin(), _entries, it->second);
+        return;
+    }
+
+    _evict(_maxBytes - size);
+    _entries.emplace_front(key, data);
+    _index.emplace(key, _entries.begin());
+    _bytes += size;
+}
+
+uint64_t SegmentCache::getHits() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _hits;
+}
+
+uint64_t SegmentCache::getMisses() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _misses;
+}
+
+void SegmentCache::_evict(const size_t maxBytes)
+{
+    while (_bytes > maxBytes)
+    {
+        const auto& entry = _entries.back();
+        _bytes -= size_t(entry.second.size());
+        _index.erase(entry.first);
+        _entries.pop_back();
+    }
+}
+}
@@ -0,0 +1,163 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_SEGMENTCACHE_H
+#define DEFLECT_SEGMENTCACHE_H
+
+#include <deflect/api.h>
+#include <deflect/types.h>
+
+#include <QByteArray>
+#include <QRect>
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace deflect
+{
+/**
+ * Bounded LRU cache of compressed segments, addressed by their content.
+ *
+ * Looping animations or UIs toggling between states produce the same segments
+ * again and again, possibly frames apart and at other positions. Looking up
+ * the compressed data of a segment by a hash of its pixels and encoding
+ * parameters avoids compressing it again.
+ *
+ * The cache is disabled (and find() always fails) until it is given a
+ * non-zero size.
+ *
+ * @threadsafe
+ */
+class SegmentCache
+{
+public:
+    /** The content address of a segment. */
+    struct Key
+    {
+        /** 128-bit hash of the pixels of the segment. */
+        uint64_t hash[2];
+
+        /** Pixel format, chroma subsampling and JPEG quality. */
+        uint32_t parameters;
+
+        /** Dimensions of the segment. */
+        uint32_t width;
+        uint32_t height;
+
+        bool operator==(const Key& other) const;
+    };
+
+    /**
+     * Compute the key of a region of an image.
+     *
+     * @param image the source image, must have valid data.
+     * @param region the region of the image to hash, in pixels.
+     * @return the key of the region, independent of its position.
+     */
+    DEFLECT_API static Key makeKey(const ImageWrapper& image,
+                                   const QRect& region);
+
+    /** Construct a cache of the given size in bytes, 0 to disable it. */
+    DEFLECT_API explicit SegmentCache(size_t maxBytes = 0);
+
+    /**
+     * Set the maximum size of the compressed data held by the cache.
+     *
+     * The least recently used entries are evicted to fit the new size.
+     * @param maxBytes the maximum size in bytes, 0 to disable the cache.
+     */
+    DEFLECT_API void setMaxBytes(size_t maxBytes);
+
+    /** @return the maximum size of the cache in bytes. */
+    DEFLECT_API size_t getMaxBytes() const;
+
+    /** @return the size of the compressed data held by the cache. */
+    DEFLECT_API size_t getBytes() const;
+
+    /** @return true if the cache has a non-zero size. */
+    DEFLECT_API bool isEnabled() const;
+
+    /**
+     * Look up the compressed data of a segment, counting a hit or a miss.
+     *
+     * @param key the content address of the segment.
+     * @param data set to the compressed data if found, unchanged otherwise.
+     * @return true if the segment was found.
+     */
+    DEFLECT_API bool find(const Key& key, QByteArray& data);
+
+    /**
+     * Add the compressed data of a segment as the most recently used entry.
+     *
+     * Data larger than the whole cache is not added.
+     * @param key the content address of the segment.
+     * @param data the compressed data of the segment.
+     */
+    DEFLECT_API void insert(const Key& key, const QByteArray& data);
+
+    /** @return the number of successful find() since construction. */
+    DEFLECT_API uint64_t getHits() const;
+
+    /** @return the number of failed find() since construction. */
+    DEFLECT_API uint64_t getMisses() const;
+
+private:
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const { return size_t(key.hash[0]); }
+    };
+
+    using Entry = std::pair<Key, QByteArray>;
+    using Entries = std::list<Entry>;
+
+    void _evict(size_t maxBytes);
+
+    mutable std::mutex _mutex;
+    Entries _entries; // most recently used first
+    std::unordered_map<Key, Entries::iterator, KeyHash> _index;
+    size_t _maxBytes = 0;
+    size_t _bytes = 0;
+    uint64_t _hits = 0;
+    uint64_t _misses = 0;
+};
+}
+
+#endif
@@ -0,0 +1,114 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_SESSION_H
+#define DEFLECT_SESSION_H
+
+#include <deflect/Observer.h>
+#include <deflect/api.h>
+
+#include <memory>
+#include <string>
+
+namespace deflect
+{
+class Connection;
+
+/**
+ * A connection to a Server shared by several Streams and Observers.
+ *
+ * The Streams and Observers created on a Session send and receive through a
+ * single socket and a single send thread, and are served by a single thread
+ * on the Server. The number of connections and threads thus scales with the
+ * number of processes rather than with the number of streams, for instance in
+ * an application streaming each of its windows.
+ *
+ * The identifiers of the Streams and Observers of a Session must be unique;
+ * multiple sources for the same stream need distinct Sessions (or
+ * connections).
+ *
+ * The connection is closed once the Session and all the Streams and Observers
+ * created on it have been destroyed.
+ *
+ * @version 1.1
+ */
+class Session
+{
+public:
+    /**
+     * Open a new connection to the Server.
+     *
+     * @param host The address of the target Server instance. It can be a
+     *             hostname like "localhost" or an IP in string format like
+     *             "192.168.1.83". If left empty, the environment variable
+     *             DEFLECT_HOST will be used instead. The host "inprocess"
+     *             connects to a Server of the same process without sockets.
+     * @param port Port of the Server instance, default 1701.
+     * @throw std::runtime_error if no host was provided or no
+     *                           connection to server could be established
+     * @version 1.1
+     */
+    DEFLECT_API explicit Session(
+        const std::string& host,
+        unsigned short port = Observer::defaultPortNumber);
+
+    /** Release the connection. @version 1.1 */
+    DEFLECT_API ~Session();
+
+    /** @return true if the session is connected. @version 1.1 */
+    DEFLECT_API bool isConnected() const;
+
+    /** @return the host defined by the constructor. @version 1.1 */
+    DEFLECT_API const std::string& getHost() const;
+
+    /** @return the remote port the session is connected to. @version 1.1 */
+    DEFLECT_API unsigned short getPort() const;
+
+private:
+    Session(const Session&) = delete;
+    const Session& operator=(const Session&) = delete;
+
+    friend class Observer;
+    friend class Stream;
+
+    std::shared_ptr<Connection> _connection;
+};
+}
+
+#endif
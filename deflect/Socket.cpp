@@ -40,26 +40,74 @@
 
 #include "Socket.h"
 
+#include "Loopback.h"
 #include "MessageHeader.h"
 #include "NetworkProtocol.h"
+#include "Trace.h"
 
 #include <QCoreApplication>
 #include <QDataStream>
 #include <QLoggingCategory>
 #include <QTcpSocket>
 
+#include <chrono>
+#include <cstring>
 #include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#endif
 
 namespace
 {
 const int INVALID_NETWORK_PROTOCOL_VERSION = -1;
 const int RECEIVE_TIMEOUT_MS = 1000;
+const int POLL_TIMEOUT_MS = 100;
+const size_t RECEIVE_CHUNK_SIZE = 64 * 1024;
+
+#ifdef _WIN32
+using NativeSocket = SOCKET;
+const int SHUTDOWN_READ = SD_RECEIVE;
+#else
+using NativeSocket = int;
+const int SHUTDOWN_READ = SHUT_RD;
+#endif
+
+/** Wait for the given poll() events on a native socket. */
+bool _poll(const NativeSocket socket, const short events, const int timeoutMs)
+{
+    pollfd fd;
+    fd.fd = socket;
+    fd.events = events;
+    fd.revents = 0;
+#ifdef _WIN32
+    return WSAPoll(&fd, 1, timeoutMs) > 0;
+#else
+    return ::poll(&fd, 1, timeoutMs) > 0;
+#endif
+}
+
+/** @return true if a failed recv() on a non-blocking socket can be retried. */
+bool _isTemporaryError()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
 }
 
 namespace deflect
 {
 Socket::Socket(const std::string& host, const unsigned short port)
     : _host(host)
+    , _port(port)
     , _socket(new QTcpSocket(this)) // Ensure that _socket parent is
                                     // *this* so it gets moved to thread
     , _serverProtocolVersion(INVALID_NETWORK_PROTOCOL_VERSION)
@@ -72,8 +120,31 @@ Socket::Socket(const std::string& host, const unsigned short port)
 
     _connect(host, port);
 
-    QObject::connect(_socket, &QTcpSocket::disconnected, this,
-                     &Socket::disconnected);
+    // From now on the QTcpSocket is only used for writing. It never reads the
+    // incoming data as long as no waitFor*() function is called on it and its
+    // thread does not process socket notifier events.
+    _connected = true;
+    if (_loopback)
+        _receiveThread =
+            std::thread(&Socket::_receiveLoopbackMessages, this, QByteArray());
+    else
+        _receiveThread = std::thread(&Socket::_receiveMessages, this,
+                                     _socket->readAll());
+}
+
+Socket::~Socket()
+{
+    if (!_receiveThread.joinable())
+        return;
+
+    // no disconnected() signal on destruction; wake up the receive thread,
+    // which stops on end of stream
+    _connected = false;
+    if (_loopback)
+        _loopback->close();
+    else
+        ::shutdown(NativeSocket(_socket->socketDescriptor()), SHUTDOWN_READ);
+    _receiveThread.join();
 }
 
 const std::string& Socket::getHost() const
@@ -83,12 +154,13 @@ const std::string& Socket::getHost() const
 
 unsigned short Socket::getPort() const
 {
-    return _socket->peerPort();
+    return _loopback ? _port : _socket->peerPort();
 }
 
 bool Socket::isConnected() const
 {
-    return _socket->state() == QTcpSocket::ConnectedState;
+    return _connected &&
+           (_loopback || _socket->state() == QTcpSocket::ConnectedState);
 }
 
 int32_t Socket::getServerProtocolVersion() const
@@ -98,108 +170,82 @@ int32_t Socket::getServerProtocolVersion() const
 
 int Socket::getFileDescriptor() const
 {
+    if (_loopback)
+        return -1;
     return _socket->socketDescriptor();
 }
 
-bool Socket::hasMessage(const size_t messageSize) const
+void Socket::setMessageHandler(MessageHandler handler)
 {
-    QMutexLocker locker(&_socketMutex);
-
-    // needed to 'wakeup' socket when no data was streamed for a while
-    _socket->waitForReadyRead(0);
-    return _socket->bytesAvailable() >=
-           (int)(MessageHeader::serializedSize + messageSize);
+    std::lock_guard<std::mutex> lock(_handlerMutex);
+    _handler = std::move(handler);
 }
 
 bool Socket::send(const MessageHeader& messageHeader, const QByteArray& message,
                   const bool waitForBytesWritten)
 {
+    trace::Span span{"socketSend", "client"};
     QMutexLocker locker(&_socketMutex);
     if (!isConnected())
         return false;
 
-    // send header
-    QDataStream stream(_socket);
-    stream << messageHeader;
-    if (stream.status() != QDataStream::Ok)
-        return false;
-
-    // send message
-    const bool allSent = _write(message);
+    const auto start = std::chrono::steady_clock::now();
 
-    if (waitForBytesWritten)
+    bool allSent = false;
+    if (_loopback)
+        allSent = _sendLoopback(messageHeader, message);
+    else
     {
-        // Needed in the absence of event loop, otherwise the reception is
-        // frozen.
-        while (_socket->bytesToWrite() > 0 && isConnected())
-            _socket->waitForBytesWritten();
-    }
-    return allSent;
-}
-
-bool Socket::receive(MessageHeader& messageHeader, QByteArray& message)
-{
-    QMutexLocker locker(&_socketMutex);
-
-    if (!_receiveHeader(messageHeader))
-        return false;
-
-    // get the message
-    if (messageHeader.size > 0)
-    {
-        message = _socket->read(messageHeader.size);
+        // send header
+        QDataStream stream(_socket);
+        stream << messageHeader;
+        if (stream.status() != QDataStream::Ok)
+            return false;
 
-        while (message.size() < int(messageHeader.size))
-        {
-            if (!_socket->waitForReadyRead(RECEIVE_TIMEOUT_MS))
-                return false;
+        // send message
+        allSent = _write(message);
 
-            message.append(_socket->read(messageHeader.size - message.size()));
-        }
+        if (waitForBytesWritten)
+            allSent = _waitForBytesWritten() && allSent;
     }
 
-    if (messageHeader.type == MESSAGE_TYPE_QUIT)
-    {
-        _socket->disconnectFromHost();
-        return false;
-    }
-
-    return true;
+    const auto writeTime = std::chrono::steady_clock::now() - start;
+    _writeTime += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      writeTime).count();
+    _bytesWritten += MessageHeader::serializedSize + message.size();
+    return allSent;
 }
 
-bool Socket::_receiveHeader(MessageHeader& messageHeader)
+void Socket::updateStatistics(StreamStatistics& statistics) const
 {
-    while (_socket->bytesAvailable() < qint64(MessageHeader::serializedSize))
-    {
-        if (!_socket->waitForReadyRead(RECEIVE_TIMEOUT_MS))
-            return false;
-    }
-
-    QDataStream stream(_socket);
-    stream >> messageHeader;
-
-    return stream.status() == QDataStream::Ok;
+    statistics.bytesWritten = _bytesWritten;
+    statistics.writeTime = std::chrono::nanoseconds(_writeTime);
 }
 
 void Socket::_connect(const std::string& host, const unsigned short port)
 {
-    _socket->connectToHost(host.c_str(), port);
-    if (!_socket->waitForConnected(RECEIVE_TIMEOUT_MS))
+    if (host == loopback::HOST)
+        _loopback = loopback::connect(port);
+    else
     {
-        std::stringstream ss;
-        ss << "could not connect to " << host << ":" << port;
-        throw std::runtime_error(ss.str());
+        _socket->connectToHost(host.c_str(), port);
+        if (!_socket->waitForConnected(RECEIVE_TIMEOUT_MS))
+        {
+            std::stringstream ss;
+            ss << "could not connect to " << host << ":" << port;
+            throw std::runtime_error(ss.str());
+        }
     }
 
     if (!_receiveProtocolVersion())
     {
-        _socket->disconnectFromHost();
+        _disconnect();
         throw std::runtime_error("server protocol version was not received");
     }
 
     if (_serverProtocolVersion < NETWORK_PROTOCOL_VERSION)
     {
-        _socket->disconnectFromHost();
+        _disconnect();
         std::stringstream ss;
         ss << "server uses unsupported protocol: " << _serverProtocolVersion
            << " < " << NETWORK_PROTOCOL_VERSION;
@@ -207,8 +253,19 @@ void Socket::_connect(const std::string& host, const unsigned short port)
     }
 }
 
+void Socket::_disconnect()
+{
+    if (_loopback)
+        _loopback->close();
+    else
+        _socket->disconnectFromHost();
+}
+
 bool Socket::_receiveProtocolVersion()
 {
+    if (_loopback)
+        return _receiveLoopbackProtocolVersion();
+
     while (_socket->bytesAvailable() < qint64(sizeof(int32_t)))
     {
         if (!_socket->waitForReadyRead(RECEIVE_TIMEOUT_MS))
@@ -218,6 +275,20 @@ bool Socket::_receiveProtocolVersion()
     return true;
 }
 
+bool Socket::_receiveLoopbackProtocolVersion()
+{
+    auto& pipe = _loopback->toClient;
+    QByteArray data;
+    while (size_t(data.size()) < sizeof(int32_t))
+    {
+        if (!pipe.waitForData(RECEIVE_TIMEOUT_MS))
+            return false;
+        data.append(pipe.read(sizeof(int32_t) - data.size()));
+    }
+    std::memcpy(&_serverProtocolVersion, data.constData(), sizeof(int32_t));
+    return true;
+}
+
 bool Socket::_write(const QByteArray& message)
 {
     bool allSent = true;
@@ -236,4 +307,121 @@ bool Socket::_write(const QByteArray& message)
     }
     return allSent;
 }
+
+bool Socket::_waitForBytesWritten()
+{
+    // QTcpSocket::waitForBytesWritten() would also read incoming data, which
+    // belongs to the receive thread; wait for the native socket instead.
+    const auto socket = NativeSocket(_socket->socketDescriptor());
+    while (_socket->bytesToWrite() > 0 && isConnected())
+    {
+        _socket->flush();
+        if (_socket->bytesToWrite() > 0)
+            _poll(socket, POLLOUT, POLL_TIMEOUT_MS);
+    }
+
+    if (_socket->state() != QTcpSocket::ConnectedState)
+        _setDisconnected();
+    return _socket->bytesToWrite() == 0;
+}
+
+bool Socket::_sendLoopback(const MessageHeader& messageHeader,
+                           const QByteArray& message)
+{
+    QByteArray header;
+    header.reserve(int(MessageHeader::serializedSize));
+    {
+        QDataStream stream(&header, QIODevice::WriteOnly);
+        stream << messageHeader;
+    }
+
+    auto& pipe = _loopback->toServer;
+    const bool sent = pipe.write(header.constData(), header.size()) &&
+                      pipe.write(message.constData(), message.size());
+    if (!sent)
+        _setDisconnected();
+    return sent;
+}
+
+void Socket::_receiveMessages(QByteArray buffer)
+{
+    const auto socket = NativeSocket(_socket->socketDescriptor());
+    std::vector<char> chunk(RECEIVE_CHUNK_SIZE);
+
+    while (_processMessages(buffer) && _connected)
+    {
+        if (!_poll(socket, POLLIN, POLL_TIMEOUT_MS))
+            continue;
+
+        const auto size = ::recv(socket, chunk.data(), int(chunk.size()), 0);
+        if (size < 0 && _isTemporaryError())
+            continue;
+
+        if (size <= 0)
+            break;
+
+        buffer.append(chunk.data(), int(size));
+    }
+    _setDisconnected();
+}
+
+void Socket::_receiveLoopbackMessages(QByteArray buffer)
+{
+    auto& pipe = _loopback->toClient;
+    while (_processMessages(buffer) && _connected)
+    {
+        if (pipe.waitForData(POLL_TIMEOUT_MS))
+            buffer.append(pipe.readAll());
+        else if (pipe.isClosed())
+            break;
+    }
+    _setDisconnected();
+}
+
+bool Socket::_processMessages(QByteArray& buffer)
+{
+    const auto headerSize = int(MessageHeader::serializedSize);
+
+    int offset = 0;
+    while (buffer.size() - offset >= headerSize)
+    {
+        MessageHeader messageHeader;
+        {
+            const auto headerData =
+                QByteArray::fromRawData(buffer.constData() + offset,
+                                        headerSize);
+            QDataStream stream(headerData);
+            stream >> messageHeader;
+        }
+        const auto messageSize = int(messageHeader.size);
+        if (buffer.size() - offset - headerSize < messageSize)
+            break;
+
+        offset += headerSize;
+        const auto message = buffer.mid(offset, messageSize);
+        offset += messageSize;
+
+        if (messageHeader.type == MESSAGE_TYPE_QUIT && !messageHeader.uri[0])
+            return false;
+        _dispatch(messageHeader, message);
+    }
+    buffer.remove(0, offset);
+    return true;
+}
+
+void Socket::_dispatch(const MessageHeader& messageHeader,
+                       const QByteArray& message)
+{
+    std::lock_guard<std::mutex> lock(_handlerMutex);
+    if (_handler)
+        _handler(messageHeader, message);
+}
+
+void Socket::_setDisconnected()
+{
+    if (!_connected.exchange(false))
+        return;
+
+    emit disconnected();
+}
 }
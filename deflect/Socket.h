@@ -45,10 +45,17 @@
 typedef __int32 int32_t;
 #endif
 
+#include <deflect/MessageHeader.h>
+#include <deflect/StreamStatistics.h>
 #include <deflect/api.h>
 #include <deflect/types.h>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include <QByteArray>
 #include <QMutex>
@@ -58,8 +65,21 @@ class QTcpSocket;
 
 namespace deflect
 {
+namespace loopback
+{
+struct Channel;
+}
+
 /**
  * Represent a communication Socket for the Stream Library.
+ *
+ * The socket is full-duplex: messages are sent through a QTcpSocket by the
+ * thread calling send(), while a dedicated thread receives the incoming
+ * messages and passes them to a handler. Receiving messages thus never waits
+ * for a send to complete.
+ *
+ * If the host is loopback::HOST, the Socket communicates with a Server of the
+ * same process through an in-memory channel instead.
  */
 class Socket : public QObject
 {
@@ -75,7 +95,7 @@ public:
     DEFLECT_API Socket(const std::string& host, unsigned short port);
 
     /** Destruct a Socket, disconnecting from host. */
-    DEFLECT_API ~Socket() = default;
+    DEFLECT_API ~Socket();
 
     /** Get the host passed to the constructor. */
     const std::string& getHost() const;
@@ -91,15 +111,26 @@ public:
 
     /**
      * Get the FileDescriptor for the Socket (for use by poll())
-     * @return The file descriptor if available, otherwise return -1.
+     * @return The file descriptor if available, otherwise return -1 (also for
+     *         an in-process connection).
      */
     int getFileDescriptor() const;
 
+    /** Function called from the receiving thread with a message. */
+    using MessageHandler =
+        std::function<void(const MessageHeader&, const QByteArray&)>;
+
     /**
-     * Is there a pending message
-     * @param messageSize Minimum size of the message
+     * Handle all the messages as soon as they are received.
+     *
+     * The handler is called from the receiving thread and must not call
+     * setMessageHandler(). A MESSAGE_TYPE_QUIT message addressed to a single
+     * stream (non-empty uri) is handled, while one without uri ends the
+     * connection.
+     *
+     * @param handler the function to call, nullptr to drop the messages
      */
-    bool hasMessage(const size_t messageSize = 0) const;
+    void setMessageHandler(MessageHandler handler);
 
     /**
      * Send a message.
@@ -114,12 +145,10 @@ public:
               bool waitForBytesWritten);
 
     /**
-     * Receive a message.
-     * @param messageHeader The received message header
-     * @param message The received message data
-     * @return true if a message could be received, false otherwise
+     * Add the counters of the sent messages to the statistics.
+     * @param statistics the statistics to update: bytes and time written.
      */
-    bool receive(MessageHeader& messageHeader, QByteArray& message);
+    void updateStatistics(StreamStatistics& statistics) const;
 
 signals:
     /** Signal that the socket has been disconnected. */
@@ -127,14 +156,36 @@ signals:
 
 private:
     const std::string _host;
+    const unsigned short _port;
     QTcpSocket* _socket; // Child QObject
+    std::shared_ptr<loopback::Channel> _loopback; // in-process connection
     mutable QMutex _socketMutex;
     int32_t _serverProtocolVersion;
+    std::atomic_bool _connected{false};
+
+    std::atomic<uint64_t> _bytesWritten{0};
+    std::atomic<int64_t> _writeTime{0}; // ns
+
+    std::mutex _handlerMutex;
+    MessageHandler _handler;
+
+    std::thread _receiveThread;
 
-    bool _receiveHeader(MessageHeader& messageHeader);
     void _connect(const std::string& host, const unsigned short port);
+    void _disconnect();
     bool _receiveProtocolVersion();
+    bool _receiveLoopbackProtocolVersion();
     bool _write(const QByteArray& data);
+    bool _waitForBytesWritten();
+    bool _sendLoopback(const MessageHeader& messageHeader,
+                       const QByteArray& message);
+
+    void _receiveMessages(QByteArray buffer);
+    void _receiveLoopbackMessages(QByteArray buffer);
+    bool _processMessages(QByteArray& buffer);
+    void _dispatch(const MessageHeader& messageHeader,
+                   const QByteArray& message);
+    void _setDisconnected();
 };
 }
 
@@ -40,8 +40,11 @@
 /*********************************************************************/
 
 #include "Stream.h"
+#include "Session.h"
 #include "StreamPrivate.h"
 
+#include <algorithm>
+
 namespace deflect
 {
 Stream::Stream()
@@ -60,6 +63,16 @@ Stream::Stream(const std::string& id, const std::string& host,
 {
 }
 
+Stream::Stream(const std::string& id, Session& session)
+    : Observer(new StreamPrivate(id, session._connection, false))
+{
+}
+
+Stream::Stream(const std::string& id, const WallLayout& layout)
+    : Observer(new StreamPrivate(id, layout))
+{
+}
+
 Stream::~Stream()
 {
 }
@@ -78,4 +91,31 @@ Stream::Future Stream::sendAndFinish(const ImageWrapper& image)
 {
     return _impl->sendImage(image, true);
 }
+
+void Stream::setFlowControl(const FlowControl policy,
+                            const unsigned int maxPendingFrames)
+{
+    _impl->flowControl = policy;
+    _impl->maxPendingFrames = std::max(maxPendingFrames, 1u);
+}
+
+unsigned int Stream::getPendingFrames() const
+{
+    return _impl->getPendingFrames();
+}
+
+void Stream::setSegmentCacheSize(const size_t maxBytes)
+{
+    _impl->_imageSegmenter.setCacheSize(maxBytes);
+}
+
+LatencyHistogram Stream::getFrameLatency() const
+{
+    return _impl->getFrameLatency();
+}
+
+StreamStatistics Stream::getStatistics() const
+{
+    return _impl->getStatistics();
+}
 }
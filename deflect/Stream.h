@@ -43,7 +43,10 @@
 #define DEFLECT_STREAM_H
 
 #include <deflect/ImageWrapper.h>
+#include <deflect/LatencyHistogram.h>
 #include <deflect/Observer.h>
+#include <deflect/StreamStatistics.h>
+#include <deflect/WallLayout.h>
 #include <deflect/api.h>
 #include <deflect/types.h>
 
@@ -104,7 +107,8 @@ public:
      * @param host The address of the target Server instance. It can be a
      *             hostname like "localhost" or an IP in string format like
      *             "192.168.1.83". If left empty, the environment variable
-     *             DEFLECT_HOST will be used instead.
+     *             DEFLECT_HOST will be used instead. The host "inprocess"
+     *             connects to a Server of the same process without sockets.
      * @param port Port of the Server instance, default 1701.
      * @throw std::runtime_error if no host was provided or no
      *                           connection to server could be established
@@ -113,6 +117,49 @@ public:
     DEFLECT_API Stream(const std::string& id, const std::string& host,
                        unsigned short port = defaultPortNumber);
 
+    /**
+     * Open a new stream on the shared connection of a Session.
+     *
+     * The stream sends through the socket and thread of the session, which
+     * can be used by other Streams and Observers of the application.
+     *
+     * @param id The identifier for the stream, unique within the session. If
+     *           left empty, the environment variable DEFLECT_ID will be used.
+     *           If both values are empty, a random unique identifier will be
+     *           used.
+     * @param session The session to use for communicating with the Server.
+     * @throw std::runtime_error if the session already has a stream or
+     *                           observer with the same identifier
+     * @version 1.1
+     */
+    DEFLECT_API Stream(const std::string& id, Session& session);
+
+    /**
+     * Open a new stream on the display nodes of a tiled display wall.
+     *
+     * Each display node runs its own Server, which receives only the segments
+     * of the images that it displays. The images are segmented along the
+     * boundaries between the nodes, so that each segment goes to a single
+     * node, and each frame is finished on all the nodes. The bandwidth thus
+     * scales with the number of display nodes instead of going through a
+     * single Server.
+     *
+     * The first node of the layout also receives the messages which are not
+     * related to pixels (data, event registration) and acknowledges the
+     * frames for flow control.
+     *
+     * @param id The identifier for the stream. If left empty, the environment
+     *           variable DEFLECT_ID will be used. If both values are empty,
+     *           a random unique identifier will be used.
+     * @param layout The display nodes of the wall, with the area of the
+     *               stream that each of them displays.
+     * @throw std::invalid_argument if the layout is empty
+     * @throw std::runtime_error if no connection to one of the nodes could be
+     *                           established
+     * @version 1.1
+     */
+    DEFLECT_API Stream(const std::string& id, const WallLayout& layout);
+
     /** Destruct the Stream, closing the connection. @version 1.0 */
     DEFLECT_API virtual ~Stream();
 
@@ -170,6 +217,80 @@ public:
     DEFLECT_API Future sendAndFinish(const ImageWrapper& image);
     //@}
 
+    /** @name Flow control */
+    //@{
+    /**
+     * Adapt the stream when the Server does not consume frames fast enough.
+     *
+     * The Server acknowledges the frames that it has consumed. When the number
+     * of finished frames which are not acknowledged reaches maxPendingFrames,
+     * the policy is applied to the next frame:
+     * - FlowControl::block: send() and finishFrame() wait for the Server.
+     * - FlowControl::drop: the whole frame is skipped, send() and
+     *   finishFrame() return a ready future without sending anything.
+     * - FlowControl::lower_quality: the JPEG quality of compressed images is
+     *   halved for this frame.
+     *
+     * @note with multiple sources per stream, dropping frames on one source
+     *       desynchronizes it from the others until they also drop a frame.
+     * @param policy the flow control policy
+     * @param maxPendingFrames the number of unacknowledged frames allowed
+     * @version 1.1
+     */
+    DEFLECT_API void setFlowControl(FlowControl policy,
+                                    unsigned int maxPendingFrames = 2);
+
+    /**
+     * @return the number of finished frames not yet consumed by the Server.
+     * @version 1.1
+     */
+    DEFLECT_API unsigned int getPendingFrames() const;
+    //@}
+
+    /** @name Compression */
+    //@{
+    /**
+     * Cache the compressed segments to skip compressing repeated content.
+     *
+     * Looping animations, scrolling back and UIs toggling between states
+     * produce segments which were already compressed in an earlier frame.
+     * The JPEG data of the segments is kept in a LRU cache addressed by a hash
+     * of their pixels, dimensions and compression parameters. The cost of a
+     * miss is one pass over the pixels of the segment.
+     *
+     * @param maxBytes the maximum size of the cached JPEG data, 0 to disable
+     *        the cache (default).
+     * @see StreamStatistics::getSegmentCacheHitRate()
+     * @version 1.1
+     */
+    DEFLECT_API void setSegmentCacheSize(size_t maxBytes);
+    //@}
+
+    /** @name Statistics */
+    //@{
+    /**
+     * Get the latencies of the frames acknowledged by the Server.
+     *
+     * The latency of a frame is the time between its first send() and its
+     * acknowledgement, once the Server application has consumed it.
+     *
+     * @return the histogram of the latencies since the stream was opened.
+     * @version 1.1
+     */
+    DEFLECT_API LatencyHistogram getFrameLatency() const;
+
+    /**
+     * Get the counters of the stream since it was opened.
+     *
+     * This is cheap enough to be called once per frame, for instance to adapt
+     * the rendering resolution to the streaming throughput.
+     *
+     * @return the current statistics of the stream.
+     * @version 1.1
+     */
+    DEFLECT_API StreamStatistics getStatistics() const;
+    //@}
+
 private:
     Stream(const Stream&) = delete;
     const Stream& operator=(const Stream&) = delete;
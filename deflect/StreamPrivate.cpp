@@ -41,53 +41,32 @@
 
 #include "StreamPrivate.h"
 
-#include "NetworkProtocol.h"
+#include "Trace.h"
+#include "WallRouter.h"
 
 #include <QHostInfo>
 
+#include <algorithm>
 #include <sstream>
 #include <stdexcept>
 
 namespace
 {
 const char* STREAM_ID_ENV_VAR = "DEFLECT_ID";
-const char* STREAM_HOST_ENV_VAR = "DEFLECT_HOST";
 
 const unsigned int SEGMENT_SIZE = 512;
 const unsigned int SMALL_IMAGE_SIZE = 64;
 
-std::string _getStreamHost(const std::string& host)
-{
-    if (!host.empty())
-        return host;
-
-    const auto streamHost = QString(qgetenv(STREAM_HOST_ENV_VAR).constData());
-    const auto list = streamHost.split(':');
-    if (list.size() > 0 && !list[0].isEmpty())
-        return list[0].toStdString();
-
-    throw std::runtime_error("No host provided");
-}
+const auto FRAME_ACK_WAIT_INTERVAL = std::chrono::milliseconds{100};
+const auto PING_INTERVAL = std::chrono::seconds{5};
+const size_t MAX_UNACKNOWLEDGED_FRAMES = 1000; // Server without frame acks
+const uint64_t MIN_THROUGHPUT_SAMPLE_BYTES = 1024 * 1024;
 
-unsigned short _getStreamPort(const unsigned short port)
+int64_t _toNanoseconds(const std::chrono::steady_clock::time_point time)
 {
-    if (port != 0)
-        return port;
-
-    const QString streamHost = qgetenv(STREAM_HOST_ENV_VAR).constData();
-    const auto list = streamHost.split(':');
-    if (list.size() == 1)
-        return DEFAULT_PORT_NUMBER;
-
-    if (list.size() == 2)
-    {
-        bool ok = false;
-        const auto portNum = list[1].toUShort(&ok);
-        if (ok)
-            return portNum;
-    }
-
-    throw std::runtime_error("No port provided");
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               time.time_since_epoch())
+        .count();
 }
 
 std::string _getStreamId(const std::string& id)
@@ -118,7 +97,7 @@ void _checkParameters(const ImageWrapper& image)
             "formats support remain to be implemented.");
     }
 
-    if (image.compressionPolicy == COMPRESSION_ON)
+    if (image.compressionPolicy != COMPRESSION_OFF)
     {
         if (image.compressionQuality < 1 || image.compressionQuality > 100)
         {
@@ -134,35 +113,90 @@ bool _canSendAsSingleSegment(const ImageWrapper& image)
 {
     return image.width <= SMALL_IMAGE_SIZE && image.height <= SMALL_IMAGE_SIZE;
 }
+
+const DisplayNode& _getFirstNode(const WallLayout& layout)
+{
+    if (layout.empty())
+        throw std::invalid_argument("The wall layout has no display node");
+    return layout.front();
+}
 }
 
 StreamPrivate::StreamPrivate(const std::string& id_, const std::string& host,
                              const unsigned short port, const bool observer)
+    : StreamPrivate(id_, std::make_shared<Connection>(host, port), observer)
+{
+}
+
+StreamPrivate::StreamPrivate(const std::string& id_,
+                             std::shared_ptr<Connection> connection_,
+                             const bool observer)
     : id{_getStreamId(id_)}
-    , socket{_getStreamHost(host), _getStreamPort(port)}
-    , sendWorker{socket, id}
+    , connection{std::move(connection_)}
+    , socket(connection->socket)
+    , inbox{connection->addStream(id)}
+    , sendWorker(connection->sendWorker)
+    , sendState{id}
     , task{&sendWorker, this}
 {
     _imageSegmenter.setNominalSegmentDimensions(SEGMENT_SIZE, SEGMENT_SIZE);
 
-    socket.connect(&socket, &Socket::disconnected, [this]() {
+    inbox->setMessageHandler(MESSAGE_TYPE_FRAME_ACK,
+                             [this](const QByteArray& message) {
+                                 _onFrameAck(message);
+                             });
+    inbox->setMessageHandler(MESSAGE_TYPE_PONG,
+                             [this](const QByteArray& message) {
+                                 _onPong(message);
+                             });
+
+    inbox->setClosedCallback([this]() {
+        _frameAckCondition.notify_all();
         if (disconnectedCallback)
             disconnectedCallback();
     });
 
-    socket.moveToThread(&sendWorker);
-    sendWorker.start();
-
     if (observer)
         sendWorker.enqueueRequest(task.openObserver()).wait();
     else
+    {
         sendWorker.enqueueRequest(task.openStream()).wait();
+
+        // estimate the Server clock offset for the frame timestamps
+        _lastPingTime = Clock::now();
+        sendWorker.enqueueFastRequest(task.ping());
+    }
+}
+
+StreamPrivate::StreamPrivate(const std::string& id_, const WallLayout& layout)
+    : StreamPrivate(id_,
+                    std::make_shared<Connection>(_getFirstNode(layout).host,
+                                                 _getFirstNode(layout).port),
+                    false)
+{
+    router.reset(new WallRouter(*this, layout));
+    _imageSegmenter.setSegmentBoundaries(router->getColumnBoundaries(),
+                                         router->getRowBoundaries());
 }
 
 StreamPrivate::~StreamPrivate()
 {
-    if (socket.isConnected())
-        sendWorker.enqueueRequest(task.close()).wait();
+    // The close is deferred like a finish frame, so that no pending request
+    // of this stream remains in the (possibly shared) sendWorker afterwards.
+    sendWorker.enqueueRequest(task.close(), true).wait();
+    router.reset();
+
+    inbox->setMessageHandler(MESSAGE_TYPE_FRAME_ACK, nullptr);
+    inbox->setMessageHandler(MESSAGE_TYPE_EVENT, nullptr);
+    inbox->setMessageHandler(MESSAGE_TYPE_EVENTS, nullptr);
+    inbox->setClosedCallback(nullptr);
+    connection->removeStream(id);
+}
+
+bool StreamPrivate::isConnected() const
+{
+    return socket.isConnected() && inbox->isOpen() &&
+           (!router || router->isConnected());
 }
 
 Stream::Future StreamPrivate::bindEvents(const bool exclusive)
@@ -189,21 +223,28 @@ Stream::Future StreamPrivate::sendImage(const ImageWrapper& image,
             throw std::runtime_error("Pending finish, no send allowed");
 
         _checkParameters(image);
+        _markFrameStart();
+        currentFrame = _framesFinished + 1;
+        trace::setThreadFrame(currentFrame);
 
-        if (_canSendAsSingleSegment(image))
-        {
-            // OPT for OSPRay-KNL with external thread pool - compress directly
-            // in caller thread.
-            auto segment = _imageSegmenter.createSingleSegment(image);
-            // As we expect to encounter a lot of these small sends, be
-            // optimistic and fulfill the promise already to reduce load in the
-            // send thread (c.f. lock ops performance on KNL).
-            sendWorker.enqueueFastRequest(task.send(std::move(segment)));
+        if (flowControl != FlowControl::off && !_frameStarted)
+            _startFrame();
+
+        if (_dropFrame)
             return finish ? sendFinishFrame() : make_ready_future(true);
+
+        if (image.compressionPolicy == COMPRESSION_AUTO)
+            _updateLinkThroughput();
+
+        if (_lowerQuality && image.compressionPolicy != COMPRESSION_OFF)
+        {
+            auto lowerQualityImage = image;
+            lowerQualityImage.compressionQuality =
+                std::max(image.compressionQuality / 2, 1u);
+            return _sendImage(lowerQualityImage, finish);
         }
 
-        return sendWorker.enqueueRequest(
-            task.sendUsingMTCompression(image, _imageSegmenter, finish));
+        return _sendImage(image, finish);
     }
     catch (...)
     {
@@ -211,15 +252,239 @@ Stream::Future StreamPrivate::sendImage(const ImageWrapper& image,
     }
 }
 
+Stream::Future StreamPrivate::_sendImage(const ImageWrapper& image,
+                                         const bool finish)
+{
+    // the single segment of a small image may span several display nodes
+    if (!router && _canSendAsSingleSegment(image))
+    {
+        // OPT for OSPRay-KNL with external thread pool - compress directly
+        // in caller thread.
+        auto segment = _imageSegmenter.createSingleSegment(image);
+        // As we expect to encounter a lot of these small sends, be
+        // optimistic and fulfill the promise already to reduce load in the
+        // send thread (c.f. lock ops performance on KNL).
+        sendWorker.enqueueFastRequest(task.send(std::move(segment)));
+        return finish ? sendFinishFrame() : make_ready_future(true);
+    }
+
+    if (finish)
+        _finishFrame();
+    return sendWorker.enqueueRequest(
+        task.sendUsingMTCompression(image, _imageSegmenter, finish));
+}
+
 Stream::Future StreamPrivate::sendFinishFrame()
 {
+    if (_pendingFinish)
+        return make_exception_future<bool>(
+            std::runtime_error("Already have pending finish"));
+
+    _markFrameStart();
+    currentFrame = _framesFinished + 1;
+    trace::setThreadFrame(currentFrame);
+    if (flowControl != FlowControl::off && !_frameStarted)
+        _startFrame();
+
+    if (_dropFrame)
+    {
+        ++_framesDropped;
+        _dropFrame = false;
+        _frameStarted = false;
+        _frameStartMarked = false;
+        return make_ready_future(true);
+    }
+
+    _finishFrame();
     _pendingFinish = true;
     return sendWorker.enqueueRequest(task.finishFrame(), true);
 }
 
+unsigned int StreamPrivate::getPendingFrames() const
+{
+    const uint32_t finished = _framesFinished;
+    const uint32_t acknowledged = _framesAcknowledged;
+    // sources which missed a frame deadline may be acknowledged in advance
+    return finished > acknowledged ? finished - acknowledged : 0;
+}
+
+LatencyHistogram StreamPrivate::getFrameLatency() const
+{
+    std::lock_guard<std::mutex> lock(_frameLatencyMutex);
+    return _frameLatency;
+}
+
+StreamStatistics StreamPrivate::getStatistics() const
+{
+    StreamStatistics statistics;
+    statistics.framesSent = _framesSent;
+    statistics.framesDropped = _framesDropped;
+    statistics.framesFailed = _framesFailed;
+    _imageSegmenter.updateStatistics(statistics);
+    sendWorker.updateStatistics(statistics);
+    socket.updateStatistics(statistics);
+    return statistics;
+}
+
+void StreamPrivate::_updateLinkThroughput()
+{
+    StreamStatistics statistics;
+    socket.updateStatistics(statistics);
+
+    // measure over the last writes, the link may change during the stream
+    const auto bytes = statistics.bytesWritten - _throughputBytesWritten;
+    if (bytes < MIN_THROUGHPUT_SAMPLE_BYTES)
+        return;
+
+    const auto seconds = std::chrono::duration<double>(
+                             statistics.writeTime - _throughputWriteTime)
+                             .count();
+    if (seconds > 0.0)
+        _imageSegmenter.setLinkThroughput(bytes / seconds);
+
+    _throughputBytesWritten = statistics.bytesWritten;
+    _throughputWriteTime = statistics.writeTime;
+}
+
+void StreamPrivate::_startFrame()
+{
+    _frameStarted = true;
+    _dropFrame = false;
+    _lowerQuality = false;
+
+    const auto isAhead = [this] {
+        return getPendingFrames() >= maxPendingFrames;
+    };
+
+    switch (flowControl)
+    {
+    case FlowControl::block:
+    {
+        std::unique_lock<std::mutex> lock(_frameAckMutex);
+        while (isAhead() && isConnected())
+            _frameAckCondition.wait_for(lock, FRAME_ACK_WAIT_INTERVAL);
+        break;
+    }
+    case FlowControl::drop:
+        _dropFrame = isAhead();
+        break;
+    case FlowControl::lower_quality:
+        _lowerQuality = isAhead();
+        break;
+    case FlowControl::off:
+    default:
+        break;
+    }
+}
+
+void StreamPrivate::_markFrameStart()
+{
+    if (_frameStartMarked)
+        return;
+    _frameStartTime = Clock::now();
+    _frameStartMarked = true;
+}
+
+void StreamPrivate::_onFrameAck(const QByteArray& message)
+{
+    if (size_t(message.size()) != sizeof(uint32_t))
+        return;
+
+    const auto acknowledged =
+        *reinterpret_cast<const uint32_t*>(message.data());
+
+    // record the latencies before the frames are seen as acknowledged
+    const auto now = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(_frameLatencyMutex);
+        while (!_unacknowledgedFrames.empty() &&
+               _unacknowledgedFrames.front().first <= acknowledged)
+        {
+            _frameLatency.record(now - _unacknowledgedFrames.front().second);
+            _unacknowledgedFrames.pop_front();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_frameAckMutex);
+        _framesAcknowledged = acknowledged;
+    }
+    _frameAckCondition.notify_all();
+}
+
+void StreamPrivate::_onPong(const QByteArray& message)
+{
+    if (size_t(message.size()) != 2 * sizeof(int64_t))
+        return;
+
+    const auto now = _toNanoseconds(Clock::now());
+    const auto times = reinterpret_cast<const int64_t*>(message.data());
+    const auto roundTrip = now - times[0];
+    if (roundTrip < 0)
+        return;
+
+    // use the exchange with the shortest round-trip among the last ones, for
+    // which the uncertainty on the offset is the smallest
+    std::lock_guard<std::mutex> lock(_clockMutex);
+    _clockSamples[_clockSampleCount++ % _clockSamples.size()] = {
+        roundTrip, times[1] - (times[0] + roundTrip / 2)};
+
+    const auto count = std::min(_clockSampleCount, _clockSamples.size());
+    const auto best = std::min_element(_clockSamples.begin(),
+                                       _clockSamples.begin() + count,
+                                       [](const ClockSample& a,
+                                          const ClockSample& b) {
+                                           return a.roundTrip < b.roundTrip;
+                                       });
+    _clockOffset = best->offset;
+    _clockSynchronized = true;
+}
+
+void StreamPrivate::_finishFrame()
+{
+    _markFrameStart();
+    const auto sequence = ++_framesFinished;
+    _frameStarted = false;
+    _frameStartMarked = false;
+
+    finishedFrame.sequence = sequence;
+    finishedFrame.sendTime = _toServerTime(_frameStartTime);
+    {
+        std::lock_guard<std::mutex> lock(_frameLatencyMutex);
+        _unacknowledgedFrames.emplace_back(sequence, _frameStartTime);
+        if (_unacknowledgedFrames.size() > MAX_UNACKNOWLEDGED_FRAMES)
+            _unacknowledgedFrames.pop_front();
+    }
+    _pingIfNeeded();
+}
+
+void StreamPrivate::_pingIfNeeded()
+{
+    const auto now = Clock::now();
+    if (now - _lastPingTime < PING_INTERVAL)
+        return;
+    _lastPingTime = now;
+    sendWorker.enqueueFastRequest(task.ping());
+}
+
+int64_t StreamPrivate::_toServerTime(const Clock::time_point time) const
+{
+    if (!_clockSynchronized)
+        return 0;
+    return _toNanoseconds(time) + _clockOffset;
+}
+
 bool StreamPrivate::_finishFrameDone()
 {
     _pendingFinish = false;
+    ++_framesSent;
     return true;
 }
+
+void StreamPrivate::_frameFailed(const uint32_t frame)
+{
+    // tasks are processed in order, count each frame once
+    if (_lastFailedFrame.exchange(frame) != frame)
+        ++_framesFailed;
+}
 }
@@ -42,16 +42,29 @@
 #ifndef DEFLECT_STREAMPRIVATE_H
 #define DEFLECT_STREAMPRIVATE_H
 
+#include "Connection.h"       // member
+#include "Event.h"            // member
 #include "ImageSegmenter.h"   // member
-#include "Socket.h"           // member
+#include "LatencyHistogram.h" // member
 #include "StreamSendWorker.h" // member
+#include "StreamStatistics.h" // getStatistics()
 #include "TaskBuilder.h"      // member
+#include "WallLayout.h"       // ctor
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 
 namespace deflect
 {
+class WallRouter;
+
 /** Private implementation for the Stream class. */
 class StreamPrivate
 {
@@ -69,33 +82,96 @@ public:
     StreamPrivate(const std::string& id, const std::string& host,
                   unsigned short port, bool observer);
 
+    /**
+     * Create a new stream on an existing connection to the deflect Server.
+     *
+     * @param id the unique stream identifier
+     * @param connection the connection, which may be shared with other streams
+     * @param observer If the stream is used as a pure observer or not.
+     * @throw std::runtime_error if the connection already has a stream with
+     *        the same identifier.
+     */
+    StreamPrivate(const std::string& id, std::shared_ptr<Connection> connection,
+                  bool observer);
+
+    /**
+     * Create a new stream on the display nodes of a wall.
+     *
+     * @param id the unique stream identifier
+     * @param layout the display nodes, the first one receiving all messages
+     *        which are not related to pixels.
+     * @throw std::invalid_argument if the layout is empty.
+     * @throw std::runtime_error if a connection to one of the nodes could not
+     *        be established.
+     */
+    StreamPrivate(const std::string& id, const WallLayout& layout);
+
     /** Destructor, close the Stream. */
     ~StreamPrivate();
 
     /** The stream identifier. */
     const std::string id;
 
-    /** The communication socket instance */
-    Socket socket;
+    /** The connection to the Server, possibly shared with other streams. */
+    const std::shared_ptr<Connection> connection;
+
+    /** The communication socket instance, owned by the connection. */
+    Socket& socket;
+
+    /** The messages received by the connection for this stream. */
+    const Connection::InboxPtr inbox;
 
     /** Has a successful event registration reply been received */
     bool registeredForEvents = false;
 
+    /** Events received in a batch and not yet returned by getEvent(). */
+    std::deque<Event> pendingEvents;
+
     /** Optional callback when the socket is disconnected. */
     std::function<void()> disconnectedCallback;
 
-    /** The worker doing all the socket send operations. */
-    StreamSendWorker sendWorker;
+    /** The worker doing all the send operations, owned by the connection. */
+    StreamSendWorker& sendWorker;
+
+    /** The state of this stream in the sendWorker. */
+    StreamState sendState;
 
     /** Prepare tasks for the sendWorker. */
     TaskBuilder task;
 
+    /** Route the segments to the other display nodes of a wall, if any. */
+    std::unique_ptr<WallRouter> router;
+
     /** The segmenter for doing multithreaded image segmentation + send. */
     ImageSegmenter _imageSegmenter;
 
     /** Remember a pending finishFrame where no sendImage() is allowed. */
     std::atomic_bool _pendingFinish{false};
 
+    /** Policy when too many frames are not acknowledged by the server. */
+    FlowControl flowControl = FlowControl::off;
+
+    /** Number of unacknowledged frames at which flowControl applies. */
+    unsigned int maxPendingFrames = 2;
+
+    /** The last finished frame, sent by the next TaskBuilder::finishFrame(). */
+    FrameInfo finishedFrame;
+
+    /** The frame being sent by sendImage() or sendFinishFrame(), from 1. */
+    uint32_t currentFrame = 0;
+
+    /** @return true if the stream is open and connected to the Server. */
+    bool isConnected() const;
+
+    /** @return the number of finished frames not acknowledged yet. */
+    unsigned int getPendingFrames() const;
+
+    /** @return the latencies between frame start and acknowledgement. */
+    LatencyHistogram getFrameLatency() const;
+
+    /** @return the counters of the stream and its connection. */
+    StreamStatistics getStatistics() const;
+
     Stream::Future bindEvents(bool exclusive);
     Stream::Future send(const SizeHints& hints);
     Stream::Future send(QByteArray&& data);
@@ -104,6 +180,62 @@ public:
 
     /** @internal Called by StreamSendWorker when finishFrame was processed. */
     bool _finishFrameDone();
+
+    /** @internal Called by StreamSendWorker when a task of a frame failed. */
+    void _frameFailed(uint32_t frame);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic<uint32_t> _framesFinished{0};
+    std::atomic<uint32_t> _framesAcknowledged{0};
+    std::atomic<uint64_t> _framesSent{0};
+    std::atomic<uint64_t> _framesDropped{0};
+    std::atomic<uint64_t> _framesFailed{0};
+    std::atomic<uint32_t> _lastFailedFrame{0};
+    std::mutex _frameAckMutex;
+    std::condition_variable _frameAckCondition;
+
+    /** State of the frame being sent, evaluated by _startFrame(). */
+    std::atomic_bool _frameStarted{false};
+    bool _dropFrame = false;
+    bool _lowerQuality = false;
+
+    /** Time of the first send() of the current frame. */
+    Clock::time_point _frameStartTime;
+    bool _frameStartMarked = false;
+
+    /** Start time of the finished frames which are not acknowledged yet. */
+    std::deque<std::pair<uint32_t, Clock::time_point>> _unacknowledgedFrames;
+    LatencyHistogram _frameLatency;
+    mutable std::mutex _frameLatencyMutex;
+
+    /** Round-trip and Server clock offset [ns] of a ping/pong exchange. */
+    struct ClockSample
+    {
+        int64_t roundTrip;
+        int64_t offset;
+    };
+    std::array<ClockSample, 8> _clockSamples;
+    size_t _clockSampleCount = 0;
+    std::mutex _clockMutex;
+    std::atomic<int64_t> _clockOffset{0};
+    std::atomic_bool _clockSynchronized{false};
+    Clock::time_point _lastPingTime;
+
+    /** Socket counters at the last link throughput measure, for AUTO. */
+    uint64_t _throughputBytesWritten = 0;
+    std::chrono::nanoseconds _throughputWriteTime{0};
+
+    void _updateLinkThroughput();
+    void _startFrame();
+    void _markFrameStart();
+    void _finishFrame();
+    void _pingIfNeeded();
+    int64_t _toServerTime(Clock::time_point time) const;
+    void _onFrameAck(const QByteArray& message);
+    void _onPong(const QByteArray& message);
+    Stream::Future _sendImage(const ImageWrapper& image, bool finish);
 };
 }
 #endif
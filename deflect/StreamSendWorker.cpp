@@ -44,15 +44,23 @@
 #include "Segment.h"
 #include "SizeHints.h"
 
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+// Segments are sent in batches of up to this size (or a single larger segment)
+const int MAX_SEGMENT_BATCH_SIZE = 64 * 1024;
+}
 
 namespace deflect
 {
-StreamSendWorker::StreamSendWorker(Socket& socket, const std::string& id)
+StreamSendWorker::StreamSendWorker(Socket& socket)
     : _socket(socket)
-    , _id(id)
-    , _dequeuedRequests(std::thread::hardware_concurrency() / 2)
+    , _dequeuedRequests(std::max(std::thread::hardware_concurrency() / 2, 1u))
 {
+    // reserved capacity is kept when the batch is reset after each send
+    _segmentBatch.reserve(MAX_SEGMENT_BATCH_SIZE);
 }
 
 StreamSendWorker::~StreamSendWorker()
@@ -73,6 +81,7 @@ void StreamSendWorker::stop()
     Request request;
     while (_requests.try_dequeue(request))
     {
+        --_queueDepth;
         if (request.promise)
             request.promise->set_value(false);
     }
@@ -87,7 +96,7 @@ void StreamSendWorker::run()
             break;
 
         size_t count = 0;
-        if (!_pendingFinish)
+        if (_finishRequests.empty())
             count = _requests.wait_dequeue_bulk(_dequeuedRequests.begin(),
                                                 _dequeuedRequests.size());
         else
@@ -96,17 +105,6 @@ void StreamSendWorker::run()
             // requests w/o waiting
             count = _requests.try_dequeue_bulk(_dequeuedRequests.begin(),
                                                _dequeuedRequests.size());
-
-            // no more pending sends, now process the finish request and reset
-            // for next finish
-            if (count == 0)
-            {
-                count = 1;
-                _finishRequest.isFinish = false; // reset this to process this
-                                                 // request now
-                _dequeuedRequests[0] = _finishRequest;
-                _pendingFinish = false;
-            }
         }
 
         for (size_t i = 0; i < count; ++i)
@@ -116,42 +114,66 @@ void StreamSendWorker::run()
             // postpone a finish request to maintain order (as the lockfree
             // does not guarantee order)
             if (request.isFinish)
-            {
-                if (_pendingFinish)
-                {
-                    if (request.promise)
-                        request.promise->set_exception(std::make_exception_ptr(
-                            std::runtime_error("Already have pending finish")));
-                    continue;
-                }
-
-                _finishRequest = request;
-                _pendingFinish = true;
-                continue;
-            }
+                _finishRequests.emplace_back(std::move(request));
+            else
+                _process(request);
+        }
 
-            try
-            {
-                bool success = true;
-                for (auto& task : request.tasks)
-                {
-                    if (!task())
-                    {
-                        success = false;
-                        break;
-                    }
-                }
-
-                if (request.promise)
-                    request.promise->set_value(success);
-            }
-            catch (...)
+        // no more pending sends, now process the finish requests. With
+        // several streams sending, the queue may never be empty, so this is
+        // done as soon as all pending requests fit in a single bulk.
+        if (count < _dequeuedRequests.size() && !_finishRequests.empty())
+        {
+            auto finishRequests = std::move(_finishRequests);
+            _finishRequests.clear();
+            for (auto& request : finishRequests)
+                _process(request);
+        }
+
+        // coalesce the segments of the fast requests dequeued together
+        _flushSegments();
+    }
+}
+
+void StreamSendWorker::_process(Request& request)
+{
+    const auto now = trace::Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(_statisticsMutex);
+        _queueWaitTime.record(now - request.enqueueTime);
+    }
+    if (trace::isEnabled())
+    {
+        trace::addSpan("queueWait", "client", request.enqueueTime, now,
+                       request.frame, -1);
+        trace::setThreadFrame(request.frame);
+    }
+
+    try
+    {
+        bool success = true;
+        for (auto& task : request.tasks)
+        {
+            if (!task())
             {
-                if (request.promise)
-                    request.promise->set_exception(std::current_exception());
+                success = false;
+                break;
             }
         }
+
+        if (request.promise)
+        {
+            // only report success once the segments were really sent
+            success = _flushSegments() && success;
+            request.promise->set_value(success);
+        }
+    }
+    catch (...)
+    {
+        if (request.promise)
+            request.promise->set_exception(std::current_exception());
     }
+    --_queueDepth;
 }
 
 Stream::Future StreamSendWorker::enqueueRequest(Task&& action, bool isFinish)
@@ -164,116 +186,199 @@ Stream::Future StreamSendWorker::enqueueRequest(std::vector<Task>&& tasks,
 {
     auto promise = std::make_shared<Promise>();
     auto future = promise->get_future();
-    _requests.enqueue({std::move(promise), std::move(tasks), isFinish});
+    ++_queueDepth;
+    _requests.enqueue({std::move(promise), std::move(tasks), isFinish,
+                       trace::Clock::now(), trace::getThreadFrame()});
     return future;
 }
 
 void StreamSendWorker::enqueueFastRequest(Task&& task)
 {
-    _requests.enqueue({nullptr, std::vector<Task>{std::move(task)}, false});
+    ++_queueDepth;
+    _requests.enqueue({nullptr, std::vector<Task>{std::move(task)}, false,
+                       trace::Clock::now(), trace::getThreadFrame()});
+}
+
+void StreamSendWorker::updateStatistics(StreamStatistics& statistics) const
+{
+    statistics.sendQueueDepth = _queueDepth;
+    std::lock_guard<std::mutex> lock(_statisticsMutex);
+    statistics.sendQueueWaitTime = _queueWaitTime;
 }
 
-bool StreamSendWorker::_sendOpenObserver()
+bool StreamSendWorker::_sendOpenObserver(StreamState& stream)
 {
-    return _send(MESSAGE_TYPE_OBSERVER_OPEN,
+    return _send(stream, MESSAGE_TYPE_OBSERVER_OPEN,
                  QByteArray::number(NETWORK_PROTOCOL_VERSION));
 }
 
-bool StreamSendWorker::_sendOpenStream()
+bool StreamSendWorker::_sendOpenStream(StreamState& stream)
 {
-    return _send(MESSAGE_TYPE_PIXELSTREAM_OPEN,
+    return _send(stream, MESSAGE_TYPE_PIXELSTREAM_OPEN,
                  QByteArray::number(NETWORK_PROTOCOL_VERSION));
 }
 
-bool StreamSendWorker::_sendClose()
+bool StreamSendWorker::_sendClose(StreamState& stream)
 {
-    return _send(MESSAGE_TYPE_QUIT, {});
+    return _send(stream, MESSAGE_TYPE_QUIT, {});
 }
 
-bool StreamSendWorker::_sendSegment(const Segment& segment)
+bool StreamSendWorker::_sendSegment(StreamState& stream,
+                                    const Segment& segment)
 {
-    if (segment.view != _currentView)
+    // a batch only contains the segments of one stream
+    if (_batchStream != &stream && !_flushSegments())
+        return false;
+
+    if (segment.view != stream.view)
     {
-        if (!_sendImageView(segment.view))
+        if (!_sendImageView(stream, segment.view))
             return false;
-        _currentView = segment.view;
+        stream.view = segment.view;
+    }
+    _sendRowOrderIfChanged(stream, segment.rowOrder);
+    _sendImageChannelIfChanged(stream, segment.channel);
+
+    // batch record: [uint32_t size][SegmentParameters][imageData]
+    const uint32_t size = segment.imageData.size();
+    _segmentBatch.append((const char*)(&size), sizeof(uint32_t));
+    _segmentBatch.append((const char*)(&segment.parameters),
+                         sizeof(SegmentParameters));
+    _segmentBatch.append(segment.imageData);
+    ++_batchedSegments;
+    _batchStream = &stream;
+
+    if (_segmentBatch.size() >= MAX_SEGMENT_BATCH_SIZE)
+        return _flushSegments();
+    return true;
+}
+
+bool StreamSendWorker::_flushSegments()
+{
+    if (_batchedSegments == 0)
+        return true;
+
+    const auto& id = _batchStream->id;
+    bool success = false;
+    if (_batchedSegments == 1)
+    {
+        // a single segment is sent as a regular message, without its size
+        const auto message = QByteArray::fromRawData(
+            _segmentBatch.constData() + sizeof(uint32_t),
+            _segmentBatch.size() - sizeof(uint32_t));
+        success = _socket.send(MessageHeader(MESSAGE_TYPE_PIXELSTREAM,
+                                             message.size(), id),
+                               message, false);
+    }
+    else
+    {
+        success = _socket.send(MessageHeader(MESSAGE_TYPE_PIXELSTREAM_BATCH,
+                                             _segmentBatch.size(), id),
+                               _segmentBatch, false);
     }
-    _sendRowOrderIfChanged(segment.rowOrder);
-    _sendImageChannelIfChanged(segment.channel);
 
-    auto message = QByteArray{(const char*)(&segment.parameters),
-                              sizeof(SegmentParameters)};
-    message.append(segment.imageData);
-    return _send(MESSAGE_TYPE_PIXELSTREAM, message, false);
+    _segmentBatch.resize(0);
+    _batchedSegments = 0;
+    _batchStream = nullptr;
+    return success;
 }
 
-bool StreamSendWorker::_sendImageView(const View view)
+bool StreamSendWorker::_sendImageView(StreamState& stream, const View view)
 {
-    return _send(MESSAGE_TYPE_IMAGE_VIEW,
+    return _send(stream, MESSAGE_TYPE_IMAGE_VIEW,
                  QByteArray{(const char*)(&view), sizeof(View)});
 }
 
-bool StreamSendWorker::_sendRowOrderIfChanged(const RowOrder rowOrder)
+bool StreamSendWorker::_sendRowOrderIfChanged(StreamState& stream,
+                                              const RowOrder rowOrder)
 {
-    if (rowOrder != _currentRowOrder)
+    if (rowOrder != stream.rowOrder)
     {
-        if (!_sendImageRowOrder(rowOrder))
+        if (!_sendImageRowOrder(stream, rowOrder))
             return false;
-        _currentRowOrder = rowOrder;
+        stream.rowOrder = rowOrder;
     }
     return true;
 }
 
-bool StreamSendWorker::_sendImageRowOrder(const RowOrder rowOrder)
+bool StreamSendWorker::_sendImageRowOrder(StreamState& stream,
+                                          const RowOrder rowOrder)
 {
-    return _send(MESSAGE_TYPE_IMAGE_ROW_ORDER,
+    return _send(stream, MESSAGE_TYPE_IMAGE_ROW_ORDER,
                  QByteArray{(const char*)(&rowOrder), sizeof(RowOrder)});
 }
 
-bool StreamSendWorker::_sendImageChannelIfChanged(const uint8_t channel)
+bool StreamSendWorker::_sendImageChannelIfChanged(StreamState& stream,
+                                                  const uint8_t channel)
 {
-    if (channel != _currentChannel)
+    if (channel != stream.channel)
     {
-        if (!_sendImageChannel(channel))
+        if (!_sendImageChannel(stream, channel))
             return false;
-        _currentChannel = channel;
+        stream.channel = channel;
     }
     return true;
 }
 
-bool StreamSendWorker::_sendImageChannel(const uint8_t channel)
+bool StreamSendWorker::_sendImageChannel(StreamState& stream,
+                                         const uint8_t channel)
 {
-    return _send(MESSAGE_TYPE_IMAGE_CHANNEL,
+    return _send(stream, MESSAGE_TYPE_IMAGE_CHANNEL,
                  QByteArray{(const char*)(&channel), sizeof(uint8_t)});
 }
 
-bool StreamSendWorker::_sendFinish()
+bool StreamSendWorker::_sendFinish(StreamState& stream)
+{
+    // [uint64_t sequence][int64_t sendTime]
+    QByteArray message;
+    message.append((const char*)(&stream.finishedFrame.sequence),
+                   sizeof(uint64_t));
+    message.append((const char*)(&stream.finishedFrame.sendTime),
+                   sizeof(int64_t));
+    return _send(stream, MESSAGE_TYPE_PIXELSTREAM_FINISH_FRAME, message);
+}
+
+bool StreamSendWorker::_sendPing(StreamState& stream)
 {
-    return _send(MESSAGE_TYPE_PIXELSTREAM_FINISH_FRAME, {});
+    // the Server replies with [int64_t clientTime][int64_t serverTime]
+    const int64_t clientTime =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    return _send(stream, MESSAGE_TYPE_PING,
+                 QByteArray{(const char*)(&clientTime), sizeof(int64_t)});
 }
 
-bool StreamSendWorker::_sendData(const QByteArray data)
+bool StreamSendWorker::_sendData(StreamState& stream, const QByteArray data)
 {
-    return _send(MESSAGE_TYPE_DATA, data);
+    return _send(stream, MESSAGE_TYPE_DATA, data);
 }
 
-bool StreamSendWorker::_sendSizeHints(const SizeHints& hints)
+bool StreamSendWorker::_sendSizeHints(StreamState& stream,
+                                      const SizeHints& hints)
 {
-    return _send(MESSAGE_TYPE_SIZE_HINTS,
+    return _send(stream, MESSAGE_TYPE_SIZE_HINTS,
                  QByteArray{(const char*)(&hints), sizeof(SizeHints)});
 }
 
-bool StreamSendWorker::_sendBindEvents(const bool exclusive)
+bool StreamSendWorker::_sendBindEvents(StreamState& stream,
+                                       const bool exclusive)
 {
-    return _send(exclusive ? MESSAGE_TYPE_BIND_EVENTS_EX
+    return _send(stream,
+                 exclusive ? MESSAGE_TYPE_BIND_EVENTS_EX
                            : MESSAGE_TYPE_BIND_EVENTS,
                  {});
 }
 
-bool StreamSendWorker::_send(const MessageType type, const QByteArray& message,
+bool StreamSendWorker::_send(const StreamState& stream, const MessageType type,
+                             const QByteArray& message,
                              const bool waitForBytesWritten)
 {
-    return _socket.send(MessageHeader(type, message.size(), _id), message,
-                        waitForBytesWritten);
+    // preserve the order of messages with respect to batched segments
+    if (!_flushSegments())
+        return false;
+
+    return _socket.send(MessageHeader(type, message.size(), stream.id),
+                        message, waitForBytesWritten);
 }
 }
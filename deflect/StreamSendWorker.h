@@ -41,9 +41,12 @@
 #ifndef DEFLECT_STREAMSENDWORKER_H
 #define DEFLECT_STREAMSENDWORKER_H
 
-#include "MessageHeader.h" // MessageType
-#include "Socket.h"        // member
-#include "Stream.h"        // Stream::Future
+#include "LatencyHistogram.h" // member
+#include "MessageHeader.h"    // MessageType
+#include "Socket.h"           // member
+#include "Stream.h"           // Stream::Future
+#include "StreamStatistics.h" // updateStatistics()
+#include "Trace.h"            // trace::Clock
 
 #ifdef __GNUC__
 #pragma GCC diagnostic push
@@ -60,6 +63,35 @@ namespace deflect
 {
 using Task = std::function<bool()>;
 
+/** Identification of a frame, sent when it is finished. */
+struct FrameInfo
+{
+    /** The number of frames finished by the stream, including this one. */
+    uint64_t sequence = 0;
+
+    /** When the frame was started, in ns on the Server clock; 0 if unknown. */
+    int64_t sendTime = 0;
+};
+
+/** The state of one of the streams which send through a StreamSendWorker. */
+struct StreamState
+{
+    explicit StreamState(const std::string& id_)
+        : id{id_}
+    {
+    }
+
+    /** The stream identifier, sent in the header of each message. */
+    const std::string id;
+
+    View view = View::mono;
+    RowOrder rowOrder = RowOrder::top_down;
+    uint8_t channel = 0;
+
+    /** The frame sent by the next _sendFinish(). */
+    FrameInfo finishedFrame;
+};
+
 /**
  * Worker thread class that sends images and messages through a Socket.
  *
@@ -68,17 +100,25 @@ using Task = std::function<bool()>;
  * "QSocketNotifier: Socket notifiers cannot be enabled or disabled from another
  * thread".
  * To avoid it, the Socket must be moved to the worker thread (moveToThread()).
+ *
+ * Several streams can send through the same worker, each task being bound to
+ * the StreamState of its stream.
  */
 class StreamSendWorker : public QThread
 {
 public:
     /** Create a new stream worker associated to an existing socket. */
-    StreamSendWorker(Socket& socket, const std::string& id);
+    explicit StreamSendWorker(Socket& socket);
 
     /** Stop and destroy the worker. */
     ~StreamSendWorker();
 
-    /** Enqueue a request to be send during the execution of run(). */
+    /**
+     * Enqueue a request to be send during the execution of run().
+     * @param action the task to execute
+     * @param isFinish defer the request until the previously enqueued ones have
+     *        been processed
+     */
     Stream::Future enqueueRequest(Task&& action, bool isFinish = false);
 
     /** Enqueue a request to be send during the execution of run(). */
@@ -88,6 +128,12 @@ public:
     /** Enqueue a request with no future to check for its completion. */
     void enqueueFastRequest(Task&& task);
 
+    /**
+     * Add the send queue counters to the statistics.
+     * @param statistics the statistics to update: queue depth and wait time.
+     */
+    void updateStatistics(StreamStatistics& statistics) const;
+
 private:
     using Promise = std::promise<bool>;
     using PromisePtr = std::shared_ptr<Promise>;
@@ -97,20 +143,31 @@ private:
         PromisePtr promise;
         std::vector<Task> tasks;
         bool isFinish;
+
+        /** When the request was enqueued. */
+        trace::Clock::time_point enqueueTime;
+
+        /** The frame traced by the thread which enqueued the request. */
+        int64_t frame;
     };
 
     Socket& _socket;
-    const std::string& _id;
 
     moodycamel::BlockingConcurrentQueue<Request> _requests;
     std::atomic_bool _running{false};
-    View _currentView = View::mono;
-    RowOrder _currentRowOrder = RowOrder::top_down;
-    uint8_t _currentChannel = 0;
 
     std::vector<Request> _dequeuedRequests;
-    bool _pendingFinish = false;
-    Request _finishRequest;
+    std::vector<Request> _finishRequests;
+
+    /** Requests enqueued and not processed yet. */
+    std::atomic<size_t> _queueDepth{0};
+    LatencyHistogram _queueWaitTime;
+    mutable std::mutex _statisticsMutex;
+
+    /** Segments coalesced into a single message, see _flushSegments(). */
+    QByteArray _segmentBatch;
+    size_t _batchedSegments = 0;
+    const StreamState* _batchStream = nullptr;
 
     /** Stop the worker and clear any pending send tasks. */
     void stop();
@@ -120,23 +177,28 @@ private:
 
     friend class deflect::test::Application; // to send pre-compressed segments
     friend class TaskBuilder;
-
-    bool _sendOpenObserver();
-    bool _sendOpenStream();
-    bool _sendClose();
-    bool _sendSegment(const Segment& segment);
-    bool _sendImageView(View view);
-    bool _sendRowOrderIfChanged(RowOrder rowOrder);
-    bool _sendImageRowOrder(RowOrder rowOrder);
-    bool _sendImageChannelIfChanged(uint8_t channel);
-    bool _sendImageChannel(uint8_t channel);
-    bool _sendFinish();
-    bool _sendData(const QByteArray data);
-    bool _sendSizeHints(const SizeHints& hints);
-    bool _sendBindEvents(const bool exclusive);
-
-    bool _send(MessageType type, const QByteArray& message,
-               bool waitForBytesWritten = true);
+    friend class WallRouter; // to send to the nodes of a wall
+
+    void _process(Request& request);
+
+    bool _sendOpenObserver(StreamState& stream);
+    bool _sendOpenStream(StreamState& stream);
+    bool _sendClose(StreamState& stream);
+    bool _sendSegment(StreamState& stream, const Segment& segment);
+    bool _flushSegments();
+    bool _sendImageView(StreamState& stream, View view);
+    bool _sendRowOrderIfChanged(StreamState& stream, RowOrder rowOrder);
+    bool _sendImageRowOrder(StreamState& stream, RowOrder rowOrder);
+    bool _sendImageChannelIfChanged(StreamState& stream, uint8_t channel);
+    bool _sendImageChannel(StreamState& stream, uint8_t channel);
+    bool _sendFinish(StreamState& stream);
+    bool _sendPing(StreamState& stream);
+    bool _sendData(StreamState& stream, const QByteArray data);
+    bool _sendSizeHints(StreamState& stream, const SizeHints& hints);
+    bool _sendBindEvents(StreamState& stream, const bool exclusive);
+
+    bool _send(const StreamState& stream, MessageType type,
+               const QByteArray& message, bool waitForBytesWritten = true);
 };
 }
 #endif
@@ -0,0 +1,138 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_STREAMSTATISTICS_H
+#define DEFLECT_STREAMSTATISTICS_H
+
+#include <deflect/LatencyHistogram.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace deflect
+{
+/**
+ * Counters of a Stream since it was opened, returned by
+ * Stream::getStatistics().
+ *
+ * The send queue and socket counters belong to the connection, they are
+ * shared by the streams of a Session.
+ *
+ * @version 1.1
+ */
+struct StreamStatistics
+{
+    /** @name Frames */
+    //@{
+    /** Frames whose finish was sent to the Server. */
+    uint64_t framesSent = 0;
+
+    /** Frames dropped by the FlowControl::drop policy. */
+    uint64_t framesDropped = 0;
+
+    /** Frames for which sending a segment or the finish failed. */
+    uint64_t framesFailed = 0;
+    //@}
+
+    /** @name Segments */
+    //@{
+    /** Segments generated and handed to the send queue. */
+    uint64_t segmentsSent = 0;
+
+    /** Segments of a single color, sent as a fill color instead of JPEG. */
+    uint64_t segmentsFilled = 0;
+
+    /** Size of the uncompressed image data of the segments. */
+    uint64_t rawBytes = 0;
+
+    /** Size of the image data of the segments, after compression. */
+    uint64_t compressedBytes = 0;
+
+    /** Time to compress each segment, except those found in the cache. */
+    LatencyHistogram compressTime;
+
+    /** @return rawBytes / compressedBytes, 0 if nothing was sent. */
+    double getCompressionRatio() const
+    {
+        return compressedBytes ? double(rawBytes) / compressedBytes : 0.0;
+    }
+
+    /** Segments whose JPEG data was found in the segment cache. */
+    uint64_t segmentCacheHits = 0;
+
+    /** Segments looked up in the segment cache and compressed. */
+    uint64_t segmentCacheMisses = 0;
+
+    /** @return the fraction of cache lookups which hit, 0 if none. */
+    double getSegmentCacheHitRate() const
+    {
+        const auto lookups = segmentCacheHits + segmentCacheMisses;
+        return lookups ? double(segmentCacheHits) / lookups : 0.0;
+    }
+    //@}
+
+    /** @name Send queue */
+    //@{
+    /** Requests waiting in the send queue or being processed. */
+    size_t sendQueueDepth = 0;
+
+    /** Time between enqueuing a request and starting to process it. */
+    LatencyHistogram sendQueueWaitTime;
+    //@}
+
+    /** @name Socket */
+    //@{
+    /** Bytes written to the socket, including message headers. */
+    uint64_t bytesWritten = 0;
+
+    /** Time spent writing to the socket. */
+    std::chrono::nanoseconds writeTime{0};
+
+    /** @return the bytes written per second spent writing, 0 if none. */
+    double getWriteThroughput() const
+    {
+        const auto seconds = std::chrono::duration<double>(writeTime).count();
+        return seconds > 0.0 ? bytesWritten / seconds : 0.0;
+    }
+    //@}
+};
+}
+
+#endif
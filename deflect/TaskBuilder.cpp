@@ -42,43 +42,60 @@
 #include "ImageSegmenter.h"
 #include "SizeHints.h"
 #include "StreamPrivate.h"
+#include "Trace.h"
+#include "WallRouter.h"
 
 namespace deflect
 {
 TaskBuilder::TaskBuilder(StreamSendWorker* worker, StreamPrivate* stream)
     : _worker{worker}
     , _stream{stream}
+    , _state{&stream->sendState}
 {
 }
 
 Task TaskBuilder::openStream()
 {
-    return std::bind(&StreamSendWorker::_sendOpenStream, _worker);
+    return std::bind(&StreamSendWorker::_sendOpenStream, _worker,
+                     std::ref(*_state));
 }
 
 Task TaskBuilder::close()
 {
-    return std::bind(&StreamSendWorker::_sendClose, _worker);
+    return std::bind(&StreamSendWorker::_sendClose, _worker,
+                     std::ref(*_state));
 }
 
 Task TaskBuilder::openObserver()
 {
-    return std::bind(&StreamSendWorker::_sendOpenObserver, _worker);
+    return std::bind(&StreamSendWorker::_sendOpenObserver, _worker,
+                     std::ref(*_state));
+}
+
+Task TaskBuilder::ping()
+{
+    return std::bind(&StreamSendWorker::_sendPing, _worker, std::ref(*_state));
 }
 
 Task TaskBuilder::bindEvents(const bool exclusive)
 {
-    return std::bind(&StreamSendWorker::_sendBindEvents, _worker, exclusive);
+    return std::bind(&StreamSendWorker::_sendBindEvents, _worker,
+                     std::ref(*_state), exclusive);
 }
 
 Task TaskBuilder::send(const SizeHints& hints)
 {
-    return std::bind(&StreamSendWorker::_sendSizeHints, _worker, hints);
+    if (_stream->router)
+        return std::bind(&WallRouter::sendSizeHints, _stream->router.get(),
+                         hints);
+    return std::bind(&StreamSendWorker::_sendSizeHints, _worker,
+                     std::ref(*_state), hints);
 }
 
 Task TaskBuilder::send(const QByteArray& data)
 {
-    return std::bind(&StreamSendWorker::_sendData, _worker, data);
+    return std::bind(&StreamSendWorker::_sendData, _worker, std::ref(*_state),
+                     data);
 }
 
 std::vector<Task> TaskBuilder::sendUsingMTCompression(
@@ -99,23 +116,69 @@ std::vector<Task> TaskBuilder::sendUsingMTCompression(
 std::vector<Task> TaskBuilder::finishFrame()
 {
     std::vector<Task> tasks;
-    tasks.emplace_back(std::bind(&StreamSendWorker::_sendFinish, _worker));
+
+    // the frame info is copied now, the next frame may start before it is sent
+    auto state = _state;
+    const auto frame = _stream->finishedFrame;
+    tasks.emplace_back([state, frame] {
+        state->finishedFrame = frame;
+        return true;
+    });
+
+    if (_stream->router)
+        tasks.emplace_back(_countFailure(
+            std::bind(&WallRouter::finishFrame, _stream->router.get())));
+    else
+        tasks.emplace_back(_countFailure(std::bind(
+            &StreamSendWorker::_sendFinish, _worker, std::ref(*_state))));
     tasks.emplace_back(std::bind(&StreamPrivate::_finishFrameDone, _stream));
     return tasks;
 }
 
 Task TaskBuilder::send(Segment&& segment)
 {
-    return std::bind(&StreamSendWorker::_sendSegment, _worker, segment);
+    if (_stream->router)
+        return _countFailure(std::bind(&WallRouter::sendSegment,
+                                       _stream->router.get(),
+                                       std::move(segment)));
+    return _countFailure(std::bind(&StreamSendWorker::_sendSegment, _worker,
+                                   std::ref(*_state), segment));
 }
 
 Task TaskBuilder::send(const ImageWrapper& image,
                        ImageSegmenter& imageSegmenter)
 {
-    auto sendFunc = std::bind(&StreamSendWorker::_sendSegment, _worker,
-                              std::placeholders::_1);
-    return [&imageSegmenter, image, sendFunc]() {
+    ImageSegmenter::Handler sendFunc;
+    if (_stream->router)
+        sendFunc = std::bind(&WallRouter::sendSegment, _stream->router.get(),
+                             std::placeholders::_1);
+    else
+        sendFunc = std::bind(&StreamSendWorker::_sendSegment, _worker,
+                             std::ref(*_state), std::placeholders::_1);
+    const auto frame = trace::getThreadFrame();
+    return _countFailure([&imageSegmenter, image, sendFunc, frame]() {
+        trace::setThreadFrame(frame);
         return imageSegmenter.generate(image, sendFunc);
+    });
+}
+
+Task TaskBuilder::_countFailure(Task task) const
+{
+    auto stream = _stream;
+    const auto frame = _stream->currentFrame;
+    return [stream, frame, task]() {
+        try
+        {
+            if (task())
+                return true;
+        }
+        catch (...)
+        {
+            stream->_frameFailed(frame);
+            throw;
+        }
+        stream->_frameFailed(frame);
+        return false;
     };
 }
 }
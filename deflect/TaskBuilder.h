@@ -57,6 +57,7 @@ public:
     Task openObserver();
     Task bindEvents(bool exclusive);
     Task close();
+    Task ping();
 
     Task send(const SizeHints& hints);
     Task send(const QByteArray& data);
@@ -69,8 +70,10 @@ public:
 private:
     StreamSendWorker* _worker = nullptr;
     StreamPrivate* _stream = nullptr;
+    StreamState* _state = nullptr;
 
     Task send(const ImageWrapper& image, ImageSegmenter& imageSegmenter);
+    Task _countFailure(Task task) const;
 };
 }
 
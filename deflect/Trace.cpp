@@ -0,0 +1,201 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "Trace.h"
+
+#include <QCoreApplication>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace deflect
+{
+namespace trace
+{
+namespace
+{
+// Events are buffered and written to the file in batches of this size
+const size_t FLUSH_EVENT_COUNT = 4096;
+
+struct Event
+{
+    const char* name;
+    const char* category;
+    Clock::time_point begin;
+    Clock::duration duration;
+    int64_t frame;
+    int64_t segment;
+    uint32_t thread;
+};
+
+double _toMicroseconds(const Clock::duration duration)
+{
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+uint32_t _getThreadId()
+{
+    static std::atomic<uint32_t> threadCount{0};
+    thread_local const uint32_t id = ++threadCount;
+    return id;
+}
+
+thread_local int64_t _threadFrame = -1;
+
+/**
+ * Write the events in the JSON array format. The closing bracket is optional
+ * in this format, so the file remains readable if the process is killed.
+ */
+class TraceWriter
+{
+public:
+    explicit TraceWriter(const char* filename)
+        : _file{std::fopen(filename, "w")}
+        , _pid{QCoreApplication::applicationPid()}
+    {
+        if (!_file)
+        {
+            std::cerr << "deflect: could not open trace file: " << filename
+                      << std::endl;
+            return;
+        }
+        std::fputs("[", _file);
+        _events.reserve(FLUSH_EVENT_COUNT);
+    }
+
+    ~TraceWriter()
+    {
+        if (!_file)
+            return;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _flush();
+        std::fputs("\n]\n", _file);
+        std::fclose(_file);
+    }
+
+    bool isOpen() const { return _file != nullptr; }
+    void add(const Event& event)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _events.push_back(event);
+        if (_events.size() >= FLUSH_EVENT_COUNT)
+            _flush();
+    }
+
+private:
+    std::FILE* _file = nullptr;
+    const qint64 _pid;
+    std::mutex _mutex;
+    std::vector<Event> _events;
+    bool _first = true;
+
+    void _flush()
+    {
+        for (const auto& event : _events)
+        {
+            std::fprintf(_file,
+                         "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                         "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lld,\"tid\":%u,"
+                         "\"args\":{",
+                         _first ? "" : ",", event.name, event.category,
+                         _toMicroseconds(event.begin.time_since_epoch()),
+                         _toMicroseconds(event.duration), (long long)_pid,
+                         event.thread);
+            if (event.frame >= 0)
+                std::fprintf(_file, "\"frame\":%lld", (long long)event.frame);
+            if (event.segment >= 0)
+                std::fprintf(_file, "%s\"segment\":%lld",
+                             event.frame >= 0 ? "," : "",
+                             (long long)event.segment);
+            std::fputs("}}", _file);
+            _first = false;
+        }
+        _events.clear();
+        std::fflush(_file);
+    }
+};
+
+TraceWriter* _getWriter()
+{
+    static std::unique_ptr<TraceWriter> writer = [] {
+        const char* filename = std::getenv(TRACE_FILE_ENV_VAR);
+        if (!filename || !*filename)
+            return std::unique_ptr<TraceWriter>();
+        std::unique_ptr<TraceWriter> newWriter(new TraceWriter(filename));
+        if (!newWriter->isOpen())
+            newWriter.reset();
+        return newWriter;
+    }();
+    return writer.get();
+}
+}
+
+bool isEnabled()
+{
+    static const bool enabled = _getWriter() != nullptr;
+    return enabled;
+}
+
+void addSpan(const char* name, const char* category,
+             const Clock::time_point begin, const Clock::time_point end,
+             const int64_t frame, const int64_t segment)
+{
+    if (!isEnabled())
+        return;
+
+    _getWriter()->add(
+        {name, category, begin, end - begin, frame, segment, _getThreadId()});
+}
+
+void setThreadFrame(const int64_t frame)
+{
+    _threadFrame = frame;
+}
+
+int64_t getThreadFrame()
+{
+    return _threadFrame;
+}
+}
+}
@@ -0,0 +1,149 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_TRACE_H
+#define DEFLECT_TRACE_H
+
+#include <deflect/api.h>
+
+#include <chrono>
+#include <cstdint>
+
+namespace deflect
+{
+/**
+ * Optional tracing of the streaming pipeline in the Chrome trace_event format.
+ *
+ * Tracing is enabled by setting the DEFLECT_TRACE_FILE environment variable to
+ * the path of the file to write, which can then be opened in Perfetto or
+ * chrome://tracing. Spans carry the frame and segment they belong to (if
+ * known) so that a frame can be followed across threads.
+ *
+ * When tracing is disabled, a span only costs the check of a static flag.
+ */
+namespace trace
+{
+using Clock = std::chrono::steady_clock;
+
+/** Environment variable for the path of the trace file. */
+const char* const TRACE_FILE_ENV_VAR = "DEFLECT_TRACE_FILE";
+
+/** @return true if tracing was enabled when the process started. */
+DEFLECT_API bool isEnabled();
+
+/**
+ * Record a complete span, ignored if tracing is disabled.
+ *
+ * @param name of the span, must be a string literal (not escaped)
+ * @param category of the span, must be a string literal (not escaped)
+ * @param begin time at which the span started
+ * @param end time at which the span ended
+ * @param frame the frame of the span, negative if unknown
+ * @param segment the segment of the span within the frame, negative if none
+ */
+DEFLECT_API void addSpan(const char* name, const char* category,
+                         Clock::time_point begin, Clock::time_point end,
+                         int64_t frame, int64_t segment);
+
+/**
+ * Set the frame of the spans subsequently started in the calling thread.
+ * @param frame the frame, negative if unknown
+ */
+DEFLECT_API void setThreadFrame(int64_t frame);
+
+/** @return the frame of the spans started in the calling thread. */
+DEFLECT_API int64_t getThreadFrame();
+
+/** @return the current time if tracing is enabled, the epoch otherwise. */
+inline Clock::time_point now()
+{
+    return isEnabled() ? Clock::now() : Clock::time_point();
+}
+
+/** Record a span for the lifetime of the object. */
+class Span
+{
+public:
+    /**
+     * Start a span.
+     *
+     * @param name of the span, must be a string literal
+     * @param category of the span, must be a string literal
+     * @param segment the segment of the span, negative if none
+     * @param frame the frame of the span, by default the frame of the thread
+     *        when the span ends
+     */
+    Span(const char* name, const char* category, const int64_t segment = -1,
+         const int64_t frame = -2)
+        : _name{isEnabled() ? name : nullptr}
+    {
+        if (!_name)
+            return;
+        _category = category;
+        _frame = frame;
+        _segment = segment;
+        _begin = Clock::now();
+    }
+
+    /** End the span. */
+    ~Span()
+    {
+        if (!_name)
+            return;
+        const auto frame = _frame == -2 ? getThreadFrame() : _frame;
+        addSpan(_name, _category, _begin, Clock::now(), frame, _segment);
+    }
+
+    /** Set the frame of the span, if it was not known when it started. */
+    void setFrame(const int64_t frame) { _frame = frame; }
+
+private:
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    const char* _name;
+    const char* _category = nullptr;
+    int64_t _frame = -2;
+    int64_t _segment = -1;
+    Clock::time_point _begin;
+};
+}
+}
+
+#endif
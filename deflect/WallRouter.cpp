@@ -0,0 +1,186 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "WallRouter.h"
+
+#include "SegmentParameters.h"
+#include "SizeHints.h"
+#include "StreamPrivate.h"
+
+#include <algorithm>
+
+namespace deflect
+{
+namespace
+{
+bool _intersects(const DisplayNode& node, const SegmentParameters& params)
+{
+    return params.x < node.x + node.width && node.x < params.x + params.width &&
+           params.y < node.y + node.height && node.y < params.y + params.height;
+}
+
+std::vector<unsigned int> _sorted(std::vector<unsigned int> positions)
+{
+    std::sort(positions.begin(), positions.end());
+    positions.erase(std::unique(positions.begin(), positions.end()),
+                    positions.end());
+    return positions;
+}
+}
+
+WallRouter::Node::Node(const std::string& id, const DisplayNode& displayNode_)
+    : displayNode(displayNode_)
+    , connection{std::make_shared<Connection>(displayNode.host,
+                                              displayNode.port)}
+    , inbox{connection->addStream(id)}
+    , sendState{id}
+{
+}
+
+WallRouter::WallRouter(StreamPrivate& stream, const WallLayout& layout)
+    : _stream(stream)
+    , _layout(layout)
+{
+    for (size_t i = 1; i < _layout.size(); ++i)
+    {
+        _nodes.emplace_back(new Node(_stream.id, _layout[i]));
+        _enqueue(*_nodes.back(), &StreamSendWorker::_sendOpenStream).wait();
+    }
+}
+
+WallRouter::~WallRouter()
+{
+    for (auto& node : _nodes)
+    {
+        _enqueue(*node, &StreamSendWorker::_sendClose, true).wait();
+        node->connection->removeStream(node->sendState.id);
+    }
+}
+
+std::vector<unsigned int> WallRouter::getColumnBoundaries() const
+{
+    std::vector<unsigned int> columns;
+    for (const auto& node : _layout)
+    {
+        columns.push_back(node.x);
+        columns.push_back(node.x + node.width);
+    }
+    return _sorted(std::move(columns));
+}
+
+std::vector<unsigned int> WallRouter::getRowBoundaries() const
+{
+    std::vector<unsigned int> rows;
+    for (const auto& node : _layout)
+    {
+        rows.push_back(node.y);
+        rows.push_back(node.y + node.height);
+    }
+    return _sorted(std::move(rows));
+}
+
+bool WallRouter::isConnected() const
+{
+    for (const auto& node : _nodes)
+    {
+        if (!node->connection->socket.isConnected() || !node->inbox->isOpen())
+            return false;
+    }
+    return true;
+}
+
+bool WallRouter::sendSegment(const Segment& segment)
+{
+    bool sent = true;
+    if (_intersects(_layout.front(), segment.parameters))
+        sent = _stream.sendWorker._sendSegment(_stream.sendState, segment);
+
+    for (auto& node : _nodes)
+    {
+        if (!_intersects(node->displayNode, segment.parameters))
+            continue;
+
+        auto& worker = node->connection->sendWorker;
+        worker.enqueueFastRequest(std::bind(&StreamSendWorker::_sendSegment,
+                                            &worker, std::ref(node->sendState),
+                                            segment));
+    }
+    return sent;
+}
+
+bool WallRouter::sendSizeHints(const SizeHints& hints)
+{
+    for (auto& node : _nodes)
+    {
+        auto& worker = node->connection->sendWorker;
+        worker.enqueueFastRequest(std::bind(&StreamSendWorker::_sendSizeHints,
+                                            &worker, std::ref(node->sendState),
+                                            hints));
+    }
+    return _stream.sendWorker._sendSizeHints(_stream.sendState, hints);
+}
+
+bool WallRouter::finishFrame()
+{
+    // the segments of each node were enqueued before its finish, from this
+    // thread, so they are sent first
+    std::vector<Stream::Future> finished;
+    for (auto& node : _nodes)
+    {
+        // the clock offset is only known for the first node
+        node->sendState.finishedFrame.sequence =
+            _stream.sendState.finishedFrame.sequence;
+        finished.emplace_back(_enqueue(*node, &StreamSendWorker::_sendFinish));
+    }
+
+    bool success = _stream.sendWorker._sendFinish(_stream.sendState);
+    for (auto& future : finished)
+        success = future.get() && success;
+    return success;
+}
+
+Stream::Future WallRouter::_enqueue(Node& node, const SendMethod send,
+                                    const bool isFinish)
+{
+    auto& worker = node.connection->sendWorker;
+    return worker.enqueueRequest(std::bind(send, &worker,
+                                           std::ref(node.sendState)),
+                                 isFinish);
+}
+}
@@ -0,0 +1,121 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_WALLROUTER_H
+#define DEFLECT_WALLROUTER_H
+
+#include "Connection.h"       // member
+#include "StreamSendWorker.h" // StreamState
+#include "WallLayout.h"       // member
+
+#include <memory>
+#include <vector>
+
+namespace deflect
+{
+class StreamPrivate;
+
+/**
+ * Route the segments of a Stream to the display nodes of a wall.
+ *
+ * The first node of the layout is the one of the Stream itself, the other
+ * nodes each get a connection and a send thread of their own. Each segment is
+ * only sent to the node(s) which display it, and frames are finished on all
+ * the nodes.
+ *
+ * The methods which send are called from the send thread of the Stream, where
+ * they send directly to the first node and delegate to the send threads of
+ * the other nodes.
+ */
+class WallRouter
+{
+public:
+    /**
+     * Open the stream on the display nodes of a wall.
+     *
+     * @param stream the stream, connected to the first node of the layout
+     * @param layout the display nodes of the wall
+     * @throw std::runtime_error if a node could not be connected.
+     */
+    WallRouter(StreamPrivate& stream, const WallLayout& layout);
+
+    /** Close the stream on all the nodes but the first one. */
+    ~WallRouter();
+
+    /** @return the positions of the vertical boundaries between the nodes. */
+    std::vector<unsigned int> getColumnBoundaries() const;
+
+    /** @return the positions of the horizontal boundaries between nodes. */
+    std::vector<unsigned int> getRowBoundaries() const;
+
+    /** @return true if all the nodes are connected. */
+    bool isConnected() const;
+
+    /** Send a segment to the nodes which display it. */
+    bool sendSegment(const Segment& segment);
+
+    /** Send size hints to all the nodes. */
+    bool sendSizeHints(const SizeHints& hints);
+
+    /** Finish the frame on all the nodes, waiting for each of them. */
+    bool finishFrame();
+
+private:
+    /** One of the display nodes other than the first one. */
+    struct Node
+    {
+        Node(const std::string& id, const DisplayNode& displayNode);
+
+        const DisplayNode displayNode;
+        const std::shared_ptr<Connection> connection;
+        const Connection::InboxPtr inbox;
+        StreamState sendState;
+    };
+
+    StreamPrivate& _stream;
+    const WallLayout _layout;
+    std::vector<std::unique_ptr<Node>> _nodes;
+
+    using SendMethod = bool (StreamSendWorker::*)(StreamState&);
+    Stream::Future _enqueue(Node& node, SendMethod send,
+                            bool isFinish = false);
+};
+}
+
+#endif
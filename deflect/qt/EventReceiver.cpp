@@ -42,6 +42,11 @@
 
 #include <QCoreApplication>
 
+namespace
+{
+const int CONNECTION_CHECK_INTERVAL_MS = 100;
+}
+
 namespace deflect
 {
 namespace qt
@@ -49,21 +54,22 @@ namespace qt
 EventReceiver::EventReceiver(Stream& stream)
     : QObject()
     , _stream(stream)
-    , _notifier(
-          new QSocketNotifier(_stream.getDescriptor(), QSocketNotifier::Read))
     , _timer(new QTimer)
 {
-    connect(_notifier.get(), &QSocketNotifier::activated, this,
-            &EventReceiver::_onEvent);
+    // events are delivered by the stream's receiving thread, no need to poll
+    connect(this, &EventReceiver::_eventReceived, this,
+            &EventReceiver::_onEvent, Qt::QueuedConnection);
+    _stream.setEventCallback(
+        [this](const Event& event) { emit _eventReceived(event); });
 
-    // QSocketNotifier sometimes does not fire, help with a timer
-    connect(_timer.get(), &QTimer::timeout,
-            [this] { _onEvent(_stream.getDescriptor()); });
-    _timer->start(1);
+    connect(_timer.get(), &QTimer::timeout, this,
+            &EventReceiver::_checkConnection);
+    _timer->start(CONNECTION_CHECK_INTERVAL_MS);
 }
 
 EventReceiver::~EventReceiver()
 {
+    _stream.setEventCallback(nullptr);
 }
 
 inline QPointF _pos(const Event& deflectEvent)
@@ -71,77 +77,74 @@ inline QPointF _pos(const Event& deflectEvent)
     return QPointF{deflectEvent.mouseX, deflectEvent.mouseY};
 }
 
-void EventReceiver::_onEvent(const int socket)
+void EventReceiver::_onEvent(const Event& deflectEvent)
 {
-    if (socket != _stream.getDescriptor())
+    if (!_timer->isActive())
         return;
 
-    while (_stream.hasEvent())
+    switch (deflectEvent.type)
     {
-        const Event& deflectEvent = _stream.getEvent();
-
-        switch (deflectEvent.type)
-        {
-        case Event::EVT_CLOSE:
-            _stop();
-            return;
-        case Event::EVT_PRESS:
-            emit pressed(_pos(deflectEvent));
-            break;
-        case Event::EVT_RELEASE:
-            emit released(_pos(deflectEvent));
-            break;
-        case Event::EVT_MOVE:
-            emit moved(_pos(deflectEvent));
-            break;
-        case Event::EVT_VIEW_SIZE_CHANGED:
-            emit resized(QSize{int(deflectEvent.dx), int(deflectEvent.dy)});
-            break;
-        case Event::EVT_SWIPE_LEFT:
-            emit swipeLeft();
-            break;
-        case Event::EVT_SWIPE_RIGHT:
-            emit swipeRight();
-            break;
-        case Event::EVT_SWIPE_UP:
-            emit swipeUp();
-            break;
-        case Event::EVT_SWIPE_DOWN:
-            emit swipeDown();
-            break;
-        case Event::EVT_KEY_PRESS:
-            emit keyPress(deflectEvent.key, deflectEvent.modifiers,
-                          QString::fromStdString(deflectEvent.text));
-            break;
-        case Event::EVT_KEY_RELEASE:
-            emit keyRelease(deflectEvent.key, deflectEvent.modifiers,
-                            QString::fromStdString(deflectEvent.text));
-            break;
-        case Event::EVT_TOUCH_ADD:
-            emit touchPointAdded(deflectEvent.key, _pos(deflectEvent));
-            break;
-        case Event::EVT_TOUCH_UPDATE:
-            emit touchPointUpdated(deflectEvent.key, _pos(deflectEvent));
-            break;
-        case Event::EVT_TOUCH_REMOVE:
-            emit touchPointRemoved(deflectEvent.key, _pos(deflectEvent));
-            break;
-        case Event::EVT_CLICK:
-        case Event::EVT_DOUBLECLICK:
-        case Event::EVT_PINCH:
-        case Event::EVT_WHEEL:
-        default:
-            break;
-        }
+    case Event::EVT_CLOSE:
+        _stop();
+        return;
+    case Event::EVT_PRESS:
+        emit pressed(_pos(deflectEvent));
+        break;
+    case Event::EVT_RELEASE:
+        emit released(_pos(deflectEvent));
+        break;
+    case Event::EVT_MOVE:
+        emit moved(_pos(deflectEvent));
+        break;
+    case Event::EVT_VIEW_SIZE_CHANGED:
+        emit resized(QSize{int(deflectEvent.dx), int(deflectEvent.dy)});
+        break;
+    case Event::EVT_SWIPE_LEFT:
+        emit swipeLeft();
+        break;
+    case Event::EVT_SWIPE_RIGHT:
+        emit swipeRight();
+        break;
+    case Event::EVT_SWIPE_UP:
+        emit swipeUp();
+        break;
+    case Event::EVT_SWIPE_DOWN:
+        emit swipeDown();
+        break;
+    case Event::EVT_KEY_PRESS:
+        emit keyPress(deflectEvent.key, deflectEvent.modifiers,
+                      QString::fromStdString(deflectEvent.text));
+        break;
+    case Event::EVT_KEY_RELEASE:
+        emit keyRelease(deflectEvent.key, deflectEvent.modifiers,
+                        QString::fromStdString(deflectEvent.text));
+        break;
+    case Event::EVT_TOUCH_ADD:
+        emit touchPointAdded(deflectEvent.key, _pos(deflectEvent));
+        break;
+    case Event::EVT_TOUCH_UPDATE:
+        emit touchPointUpdated(deflectEvent.key, _pos(deflectEvent));
+        break;
+    case Event::EVT_TOUCH_REMOVE:
+        emit touchPointRemoved(deflectEvent.key, _pos(deflectEvent));
+        break;
+    case Event::EVT_CLICK:
+    case Event::EVT_DOUBLECLICK:
+    case Event::EVT_PINCH:
+    case Event::EVT_WHEEL:
+    default:
+        break;
     }
+}
 
+void EventReceiver::_checkConnection()
+{
     if (!_stream.isConnected())
         _stop();
 }
 
 void EventReceiver::_stop()
 {
-    _notifier->setEnabled(false);
     _timer->stop();
     emit closed();
 }
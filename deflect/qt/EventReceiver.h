@@ -44,7 +44,6 @@
 #include <QObject>
 #include <QPointF>
 #include <QSize>
-#include <QSocketNotifier>
 #include <QTimer>
 
 #include <deflect/Stream.h>
@@ -81,12 +80,15 @@ signals:
     void touchPointUpdated(int id, QPointF position);
     void touchPointRemoved(int id, QPointF position);
 
+    /** @internal emitted from the Stream's receiving thread. */
+    void _eventReceived(deflect::Event event);
+
 private:
     Stream& _stream;
-    std::unique_ptr<QSocketNotifier> _notifier;
     std::unique_ptr<QTimer> _timer;
 
-    void _onEvent(int socket);
+    void _onEvent(const Event& event);
+    void _checkConnection();
     void _stop();
 };
 }
@@ -0,0 +1,113 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_SERVER_CAPTUREFORMAT_H
+#define DEFLECT_SERVER_CAPTUREFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace deflect
+{
+namespace server
+{
+/**
+ * Layout of a capture file written by FrameRecorder.
+ *
+ * [CaptureFileHeader][frame record]...[frame index]
+ *
+ * A frame record is a CaptureFrameHeader, followed by the uri of the stream
+ * and by a CaptureTileHeader and the image data of each tile. Each element
+ * starts on an 8 bytes boundary so that the headers can be read in place from
+ * the mapped file. The frame index is an array of uint64_t offsets of the
+ * frame records, written once the recording is finished. All values are in
+ * the byte order of the recording host, and the FrameTiming times are in ns on
+ * its steady clock.
+ */
+const uint32_t CAPTURE_FILE_MAGIC = 0x50434644; // "DFCP"
+const uint32_t CAPTURE_FILE_VERSION = 2;
+const uint32_t CAPTURE_FRAME_MAGIC = 0x4d415246; // "FRAM"
+
+struct CaptureFileHeader
+{
+    uint32_t magic = CAPTURE_FILE_MAGIC;
+    uint32_t version = CAPTURE_FILE_VERSION;
+    uint64_t frameCount = 0;  //!< Number of complete frame records
+    uint64_t indexOffset = 0; //!< 0 until the recording is finished
+};
+
+struct CaptureFrameHeader
+{
+    uint32_t magic = CAPTURE_FRAME_MAGIC;
+    uint32_t uriSize = 0;
+    uint32_t tileCount = 0;
+    uint32_t reserved = 0;
+    int64_t timestamp = 0; //!< Dispatch time, in ns since the epoch
+    uint64_t sequence = 0; //!< FrameTiming::sequence
+    int64_t sendTime = 0;
+    int64_t receiveTime = 0;
+    int64_t dispatchTime = 0;
+};
+
+struct CaptureTileHeader
+{
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t dataSize = 0;
+    uint8_t format = 0;
+    uint8_t rowOrder = 0;
+    uint8_t view = 0;
+    uint8_t channel = 0;
+};
+
+static_assert(sizeof(CaptureFileHeader) == 24, "unexpected padding");
+static_assert(sizeof(CaptureFrameHeader) == 56, "unexpected padding");
+static_assert(sizeof(CaptureTileHeader) == 24, "unexpected padding");
+
+/** @return the size of an element padded to the next 8 bytes boundary. */
+inline size_t alignCaptureSize(const size_t size)
+{
+    return (size + 7) & ~size_t(7);
+}
+}
+}
+
+#endif
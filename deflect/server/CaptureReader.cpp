@@ -0,0 +1,239 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "CaptureReader.h"
+
+#include "CaptureFormat.h"
+#include "Frame.h"
+
+#include <QFile>
+
+#include <stdexcept>
+#include <vector>
+
+namespace deflect
+{
+namespace server
+{
+namespace
+{
+std::runtime_error _corruptedError()
+{
+    return std::runtime_error("corrupted capture file");
+}
+
+FrameTiming::Clock::time_point _toTimePoint(const int64_t nanoseconds)
+{
+    return FrameTiming::Clock::time_point{
+        std::chrono::duration_cast<FrameTiming::Clock::duration>(
+            std::chrono::nanoseconds{nanoseconds})};
+}
+}
+
+class CaptureReader::Impl
+{
+public:
+    explicit Impl(const QString& filename)
+        : file{filename}
+    {
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            throw std::runtime_error("could not open capture file: " +
+                                     filename.toStdString());
+        }
+        size = file.size();
+        if (size < qint64(sizeof(CaptureFileHeader)))
+            throw std::runtime_error("not a capture file");
+
+        data = file.map(0, size);
+        if (!data)
+            throw std::runtime_error("could not map capture file");
+
+        const auto& header = *reinterpret_cast<const CaptureFileHeader*>(data);
+        if (header.magic != CAPTURE_FILE_MAGIC)
+            throw std::runtime_error("not a capture file");
+        if (header.version != CAPTURE_FILE_VERSION)
+            throw std::runtime_error("unsupported capture file version");
+
+        if (header.indexOffset > 0)
+            _readIndex(header);
+        else
+            _rebuildIndex(header.frameCount);
+    }
+
+    ~Impl()
+    {
+        if (data)
+            file.unmap(data);
+    }
+
+    const CaptureFrameHeader& getFrameHeader(const size_t index) const
+    {
+        if (index >= offsets.size())
+            throw std::out_of_range("invalid capture frame index");
+        return *reinterpret_cast<const CaptureFrameHeader*>(data +
+                                                            offsets[index]);
+    }
+
+    Frame getFrame(const size_t index) const
+    {
+        const auto& frameHeader = getFrameHeader(index);
+
+        Frame frame;
+        frame.timing.sequence = frameHeader.sequence;
+        frame.timing.sendTime = _toTimePoint(frameHeader.sendTime);
+        frame.timing.receiveTime = _toTimePoint(frameHeader.receiveTime);
+        frame.timing.dispatchTime = _toTimePoint(frameHeader.dispatchTime);
+
+        uint64_t offset = offsets[index] + sizeof(CaptureFrameHeader);
+        _checkRange(offset, frameHeader.uriSize);
+        frame.uri = QString::fromUtf8((const char*)data + offset,
+                                      frameHeader.uriSize);
+        offset += alignCaptureSize(frameHeader.uriSize);
+
+        frame.tiles.reserve(frameHeader.tileCount);
+        for (uint32_t i = 0; i < frameHeader.tileCount; ++i)
+        {
+            _checkRange(offset, sizeof(CaptureTileHeader));
+            const auto& tileHeader =
+                *reinterpret_cast<const CaptureTileHeader*>(data + offset);
+            offset += sizeof(CaptureTileHeader);
+            _checkRange(offset, tileHeader.dataSize);
+
+            Tile tile;
+            tile.x = tileHeader.x;
+            tile.y = tileHeader.y;
+            tile.width = tileHeader.width;
+            tile.height = tileHeader.height;
+            tile.format = Format(tileHeader.format);
+            tile.rowOrder = RowOrder(tileHeader.rowOrder);
+            tile.view = View(tileHeader.view);
+            tile.channel = tileHeader.channel;
+            tile.imageData = QByteArray::fromRawData((const char*)data + offset,
+                                                     tileHeader.dataSize);
+            offset += alignCaptureSize(tileHeader.dataSize);
+
+            frame.tiles.push_back(std::move(tile));
+        }
+        return frame;
+    }
+
+    QFile file;
+    uchar* data = nullptr;
+    qint64 size = 0;
+    std::vector<uint64_t> offsets;
+
+private:
+    void _checkRange(const uint64_t offset, const uint64_t count) const
+    {
+        if (offset > uint64_t(size) || count > uint64_t(size) - offset)
+            throw _corruptedError();
+    }
+
+    void _checkFrameHeader(const uint64_t offset) const
+    {
+        _checkRange(offset, sizeof(CaptureFrameHeader));
+        const auto& frameHeader =
+            *reinterpret_cast<const CaptureFrameHeader*>(data + offset);
+        if (offset % 8 != 0 || frameHeader.magic != CAPTURE_FRAME_MAGIC)
+            throw _corruptedError();
+    }
+
+    void _readIndex(const CaptureFileHeader& header)
+    {
+        if (header.frameCount > uint64_t(size) / sizeof(uint64_t))
+            throw _corruptedError();
+        _checkRange(header.indexOffset, header.frameCount * sizeof(uint64_t));
+
+        const auto index =
+            reinterpret_cast<const uint64_t*>(data + header.indexOffset);
+        offsets.assign(index, index + header.frameCount);
+        for (const auto offset : offsets)
+            _checkFrameHeader(offset);
+    }
+
+    void _rebuildIndex(const uint64_t frameCount)
+    {
+        uint64_t offset = sizeof(CaptureFileHeader);
+        while (offsets.size() < frameCount)
+        {
+            _checkFrameHeader(offset);
+            offsets.push_back(offset);
+
+            const auto& frameHeader =
+                *reinterpret_cast<const CaptureFrameHeader*>(data + offset);
+            offset += sizeof(CaptureFrameHeader) +
+                      alignCaptureSize(frameHeader.uriSize);
+            for (uint32_t i = 0; i < frameHeader.tileCount; ++i)
+            {
+                _checkRange(offset, sizeof(CaptureTileHeader));
+                const auto& tileHeader =
+                    *reinterpret_cast<const CaptureTileHeader*>(data + offset);
+                offset += sizeof(CaptureTileHeader) +
+                          alignCaptureSize(tileHeader.dataSize);
+            }
+        }
+    }
+};
+
+CaptureReader::CaptureReader(const QString& filename)
+    : _impl(new Impl(filename))
+{
+}
+
+CaptureReader::~CaptureReader()
+{
+}
+
+size_t CaptureReader::getFrameCount() const
+{
+    return _impl->offsets.size();
+}
+
+Frame CaptureReader::getFrame(const size_t index) const
+{
+    return _impl->getFrame(index);
+}
+
+std::chrono::nanoseconds CaptureReader::getTimestamp(const size_t index) const
+{
+    return std::chrono::nanoseconds{_impl->getFrameHeader(index).timestamp};
+}
+}
+}
@@ -0,0 +1,106 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_SERVER_CAPTUREREADER_H
+#define DEFLECT_SERVER_CAPTUREREADER_H
+
+#include <deflect/api.h>
+#include <deflect/server/types.h>
+
+#include <QString>
+
+#include <chrono>
+
+namespace deflect
+{
+namespace server
+{
+/**
+ * Read the frames of a capture file written by FrameRecorder.
+ *
+ * The file is memory-mapped and the frames are accessed randomly through the
+ * frame index. If the recording was interrupted or is still in progress, the
+ * index is rebuilt from the frames which were completely written when the
+ * file was opened.
+ */
+class CaptureReader
+{
+public:
+    /**
+     * Open a capture file.
+     *
+     * @param filename the capture file
+     * @throw std::runtime_error if the file is not a valid capture file
+     */
+    DEFLECT_API explicit CaptureReader(const QString& filename);
+
+    /** Close the file. */
+    DEFLECT_API ~CaptureReader();
+
+    /** @return the number of frames in the file. */
+    DEFLECT_API size_t getFrameCount() const;
+
+    /**
+     * Get a frame.
+     *
+     * The image data of the tiles is not copied: it references the mapped
+     * file and remains valid only as long as the reader exists.
+     *
+     * @param index the index of the frame, less than getFrameCount()
+     * @return the recorded frame, with its FrameTiming
+     * @throw std::out_of_range if the index is invalid
+     * @throw std::runtime_error if the frame record is corrupted
+     */
+    DEFLECT_API Frame getFrame(size_t index) const;
+
+    /**
+     * @param index the index of the frame, less than getFrameCount()
+     * @return the time at which the frame was recorded, since the epoch
+     * @throw std::out_of_range if the index is invalid
+     */
+    DEFLECT_API std::chrono::nanoseconds getTimestamp(size_t index) const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> _impl;
+};
+}
+}
+
+#endif
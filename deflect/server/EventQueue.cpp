@@ -0,0 +1,121 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "EventQueue.h"
+
+namespace deflect
+{
+namespace server
+{
+namespace
+{
+bool _isCoalescable(const Event& evt)
+{
+    return evt.type == Event::EVT_MOVE || evt.type == Event::EVT_TOUCH_UPDATE;
+}
+
+/** @return true if both events describe the same (mouse or touch) point. */
+bool _isSamePoint(const Event& a, const Event& b)
+{
+    return a.type == b.type && (a.type == Event::EVT_MOVE || a.key == b.key);
+}
+}
+
+EventQueue::EventQueue(const bool coalesce, QObject* parent)
+    : _coalesce{coalesce}
+{
+    setParent(parent);
+}
+
+void EventQueue::setCoalescing(const bool enable)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _coalesce = enable;
+}
+
+std::vector<Event> EventQueue::takeEvents()
+{
+    std::vector<Event> events;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        events.swap(_events);
+    }
+    return events;
+}
+
+void EventQueue::processEvent(const Event evt)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_coalesce && _merge(evt))
+            return;
+
+        _events.emplace_back(evt);
+        if (_events.size() > 1)
+            return;
+    }
+    emit eventsAvailable();
+}
+
+bool EventQueue::_merge(const Event& evt)
+{
+    if (!_isCoalescable(evt))
+        return false;
+
+    // Only merge with a pending event of the same point which has not been
+    // followed by any other kind of event (press, release, gesture...).
+    for (auto it = _events.rbegin(); it != _events.rend(); ++it)
+    {
+        if (!_isCoalescable(*it))
+            return false;
+
+        if (_isSamePoint(*it, evt))
+        {
+            const auto dx = it->dx + evt.dx;
+            const auto dy = it->dy + evt.dy;
+            *it = evt;
+            it->dx = dx;
+            it->dy = dy;
+            return true;
+        }
+    }
+    return false;
+}
+}
+}
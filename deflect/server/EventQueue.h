@@ -0,0 +1,97 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_SERVER_EVENTQUEUE_H
+#define DEFLECT_SERVER_EVENTQUEUE_H
+
+#include <deflect/server/EventReceiver.h>
+
+#include <mutex>
+#include <vector>
+
+namespace deflect
+{
+namespace server
+{
+/**
+ * Collect the events to be sent to a stream by a ServerWorker.
+ *
+ * Events can be passed to processEvent() from any thread.
+ *
+ * Optionally, an EVT_MOVE or EVT_TOUCH_UPDATE event which is still pending is
+ * replaced by a newer one for the same point, with the dx/dy deltas
+ * accumulated. Events are never merged across any other type of event, to
+ * preserve the ordering of the interaction for the application.
+ */
+class EventQueue : public EventReceiver
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Create an event queue.
+     * @param coalesce merge superseded move/update events
+     * @param parent the parent QObject
+     */
+    EventQueue(bool coalesce, QObject* parent);
+
+    /** Enable merging superseded move/update events. */
+    void setCoalescing(bool enable);
+
+    /** @return the pending events, removing them from the queue. */
+    std::vector<Event> takeEvents();
+
+public slots:
+    void processEvent(Event evt) final;
+
+signals:
+    /** Emitted when an event is added to an empty queue. */
+    void eventsAvailable();
+
+private:
+    std::mutex _mutex;
+    bool _coalesce = true;
+    std::vector<Event> _events;
+
+    bool _merge(const Event& evt);
+};
+}
+}
+
+#endif
@@ -59,6 +59,13 @@ QSize Frame::computeDimensions(const uint8_t channel) const
     return size;
 }
 
+void Frame::mirrorTilesPositionsVertically()
+{
+    const auto sizes = computeChannelDimensions();
+    for (auto& tile : tiles)
+        tile.y = sizes.at(tile.channel).height() - tile.y - tile.height;
+}
+
 RowOrder Frame::determineRowOrder() const
 {
     if (tiles.empty())
@@ -46,12 +46,36 @@
 #include <QSize>
 #include <QString>
 
+#include <chrono>
 #include <map>
 
 namespace deflect
 {
 namespace server
 {
+/**
+ * Timing of a frame, on the steady clock of the Server.
+ */
+struct FrameTiming
+{
+    using Clock = std::chrono::steady_clock;
+
+    /** Number of the frame given by its sources, 0 if they do not send it. */
+    uint64_t sequence = 0;
+
+    /**
+     * When the first source started sending the frame, estimated with the
+     * clock offset of the source. Clock::time_point() if unknown.
+     */
+    Clock::time_point sendTime;
+
+    /** When the last source finished the frame (or its deadline elapsed). */
+    Clock::time_point receiveTime;
+
+    /** When the frame was dispatched to the application. */
+    Clock::time_point dispatchTime;
+};
+
 /**
  * A frame for a PixelStream.
  */
@@ -63,6 +87,16 @@ struct Frame
     /** The PixelStream uri to which this frame is associated. */
     QString uri;
 
+    /**
+     * The sources which missed the frame deadline, and for which the tiles of
+     * their previous frame were used instead.
+     * @see Server::setFrameDeadline()
+     */
+    std::vector<size_t> lateSources;
+
+    /** The timing of the frame from the sources to the application. */
+    FrameTiming timing;
+
     /** @return the total dimensions of the given channel of this frame. */
     DEFLECT_API QSize computeDimensions(const uint8_t channel = 0) const;
 
@@ -74,6 +108,14 @@ struct Frame
      * @throws std::runtime_error if not all tiles have the same RowOrder.
      */
     DEFLECT_API RowOrder determineRowOrder() const;
+
+    /**
+     * Mirror the y position of the tiles within the height of their channel.
+     *
+     * The Server does it for bottom_up frames before dispatching them;
+     * mirroring them again restores the positions sent by the stream.
+     */
+    DEFLECT_API void mirrorTilesPositionsVertically();
 };
 }
 }
@@ -42,6 +42,10 @@
 #include "Frame.h"
 #include "ReceiveBuffer.h"
 
+#include "deflect/Trace.h"
+
+#include <QTimer>
+
 #include <cassert>
 
 namespace deflect
@@ -52,20 +56,51 @@ class FrameDispatcher::Impl
 {
 public:
     Impl() {}
+    struct Stream
+    {
+        ReceiveBuffer buffer;
+        size_t observers = 0;
+        bool deadlineScheduled = false;
+        std::chrono::steady_clock::time_point openTime =
+            std::chrono::steady_clock::now();
+        StreamMetrics metrics;
+        std::map<size_t, SourceMetrics> sources;
+    };
+
     FramePtr consumeLatestFrame(const QString& uri)
     {
+        trace::Span span{"assembleFrame", "server"};
         auto frame = std::make_shared<Frame>();
         frame->uri = uri;
 
-        auto& buffer = streams[uri].buffer;
+        auto& stream = streams[uri];
+        auto& buffer = stream.buffer;
 
+        size_t poppedFrames = 0;
         while (buffer.hasCompleteFrame())
+        {
             frame->tiles = buffer.popFrame();
+            frame->lateSources = buffer.getLateSources();
+            frame->timing = buffer.getLastFrameTiming();
+            stream.metrics.sourceSkew.record(buffer.getLastFrameSkew());
+            ++poppedFrames;
+        }
 
         assert(!frame->tiles.empty());
+        ++stream.metrics.framesCompleted;
+        stream.metrics.framesDropped += poppedFrames - 1;
+
+        auto& timing = frame->timing;
+        span.setFrame(int64_t(timing.sequence));
+        timing.dispatchTime = FrameTiming::Clock::now();
+        if (timing.sendTime != FrameTiming::Clock::time_point())
+        {
+            stream.metrics.frameLatency.record(timing.dispatchTime -
+                                               timing.sendTime);
+        }
 
         if (frame->determineRowOrder() == RowOrder::bottom_up)
-            mirrorTilesPositionsVertically(*frame);
+            frame->mirrorTilesPositionsVertically();
 
         // receiver will request a new frame once this frame was consumed
         buffer.setAllowedToSend(false);
@@ -73,24 +108,41 @@ public:
         return frame;
     }
 
-    void mirrorTilesPositionsVertically(Frame& frame) const
-    {
-        const auto sizes = frame.computeChannelDimensions();
-        for (auto& tile : frame.tiles)
-            tile.y = sizes.at(tile.channel).height() - tile.y - tile.height;
-    }
-
     bool allConnectionsClosed(const QString& uri) const
     {
         const auto& stream = streams.at(uri);
         return stream.buffer.getSourceCount() == 0 && stream.observers == 0;
     }
 
-    struct Stream
+    void countTiles(Stream& stream, const size_t sourceIndex,
+                    const uint64_t tiles, const uint64_t bytes)
     {
-        ReceiveBuffer buffer;
-        size_t observers = 0;
-    };
+        stream.metrics.tiles += tiles;
+        stream.metrics.bytes += bytes;
+        auto& source = stream.sources[sourceIndex];
+        source.tiles += tiles;
+        source.bytes += bytes;
+    }
+
+    StreamMetrics getMetrics(const QString& uri, const Stream& stream) const
+    {
+        auto metrics = stream.metrics;
+        metrics.uri = uri;
+        metrics.uptime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - stream.openTime);
+        metrics.sources = stream.buffer.getSourceCount();
+        metrics.observers = stream.observers;
+        metrics.pendingFrames = stream.buffer.getPendingFrameCount();
+        for (const auto& kv : stream.sources)
+        {
+            auto source = kv.second;
+            source.sourceIndex = kv.first;
+            source.queuedFrames = stream.buffer.getQueueSize(kv.first);
+            metrics.sourceMetrics.push_back(source);
+        }
+        return metrics;
+    }
+
     std::map<QString, Stream> streams;
 };
 
@@ -104,6 +156,22 @@ FrameDispatcher::~FrameDispatcher()
 {
 }
 
+LatencyHistogram FrameDispatcher::getFrameLatency(const QString& uri) const
+{
+    const auto it = _impl->streams.find(uri);
+    if (it == _impl->streams.end())
+        return LatencyHistogram();
+    return it->second.metrics.frameLatency;
+}
+
+std::vector<StreamMetrics> FrameDispatcher::getMetrics() const
+{
+    std::vector<StreamMetrics> metrics;
+    for (const auto& kv : _impl->streams)
+        metrics.push_back(_impl->getMetrics(kv.first, kv.second));
+    return metrics;
+}
+
 void FrameDispatcher::addSource(const QString uri, const size_t sourceIndex)
 {
     try
@@ -111,6 +179,7 @@ void FrameDispatcher::addSource(const QString uri, const size_t sourceIndex)
         auto& stream = _impl->streams[uri];
 
         stream.buffer.addSource(sourceIndex);
+        stream.sources[sourceIndex] = SourceMetrics();
 
         if (stream.observers == 0 && stream.buffer.getSourceCount() == 1)
             emit pixelStreamOpened(uri);
@@ -127,7 +196,9 @@ void FrameDispatcher::removeSource(const QString uri, const size_t sourceIndex)
     if (!_impl->streams.count(uri))
         return;
 
-    _impl->streams[uri].buffer.removeSource(sourceIndex);
+    auto& stream = _impl->streams[uri];
+    stream.buffer.removeSource(sourceIndex);
+    stream.sources.erase(sourceIndex);
 
     if (_impl->allConnectionsClosed(uri))
         deleteStream(uri);
@@ -158,22 +229,49 @@ void FrameDispatcher::removeObserver(QString uri)
 void FrameDispatcher::processTile(const QString uri, const size_t sourceIndex,
                                   deflect::server::Tile tile)
 {
-    if (_impl->streams.count(uri))
-        _impl->streams[uri].buffer.insert(tile, sourceIndex);
+    if (!_impl->streams.count(uri))
+        return;
+
+    auto& stream = _impl->streams[uri];
+    stream.buffer.insert(tile, sourceIndex);
+    _impl->countTiles(stream, sourceIndex, 1, tile.imageData.size());
+}
+
+void FrameDispatcher::processTiles(const QString uri, const size_t sourceIndex,
+                                   deflect::server::Tiles tiles)
+{
+    if (!_impl->streams.count(uri))
+        return;
+
+    auto& stream = _impl->streams[uri];
+    uint64_t bytes = 0;
+    for (auto& tile : tiles)
+    {
+        stream.buffer.insert(tile, sourceIndex);
+        bytes += tile.imageData.size();
+    }
+    _impl->countTiles(stream, sourceIndex, tiles.size(), bytes);
 }
 
 void FrameDispatcher::processFrameFinished(const QString uri,
-                                           const size_t sourceIndex)
+                                           const size_t sourceIndex,
+                                           const quint64 sequence,
+                                           const qint64 sendTime)
 {
     if (!_impl->streams.count(uri))
         return;
 
-    auto& buffer = _impl->streams[uri].buffer;
+    auto sendTimePoint = FrameTiming::Clock::time_point();
+    if (sendTime != 0)
+        sendTimePoint += std::chrono::nanoseconds(sendTime);
+
     try
     {
-        buffer.finishFrameForSource(sourceIndex);
-        if (buffer.isAllowedToSend() && buffer.hasCompleteFrame())
-            emit sendFrame(_impl->consumeLatestFrame(uri));
+        auto& stream = _impl->streams[uri];
+        stream.buffer.finishFrameForSource(sourceIndex, sequence,
+                                           sendTimePoint);
+        ++stream.sources[sourceIndex].framesFinished;
+        _sendFrameIfReady(uri);
     }
     catch (const std::runtime_error& e)
     {
@@ -181,17 +279,21 @@ void FrameDispatcher::processFrameFinished(const QString uri,
     }
 }
 
+void FrameDispatcher::processEventsSent(const QString uri, const size_t count)
+{
+    if (_impl->streams.count(uri))
+        _impl->streams[uri].metrics.events += count;
+}
+
 void FrameDispatcher::requestFrame(const QString uri)
 {
     if (!_impl->streams.count(uri))
         return;
 
-    auto& buffer = _impl->streams[uri].buffer;
-    buffer.setAllowedToSend(true);
+    _impl->streams[uri].buffer.setAllowedToSend(true);
     try
     {
-        if (buffer.hasCompleteFrame())
-            emit sendFrame(_impl->consumeLatestFrame(uri));
+        _sendFrameIfReady(uri);
     }
     catch (const std::runtime_error& e)
     {
@@ -199,10 +301,66 @@ void FrameDispatcher::requestFrame(const QString uri)
     }
 }
 
+void FrameDispatcher::setFrameDeadline(const QString uri,
+                                       const unsigned int milliseconds)
+{
+    if (!_impl->streams.count(uri))
+        return;
+
+    const auto deadline = std::chrono::milliseconds{milliseconds};
+    _impl->streams[uri].buffer.setFrameDeadline(deadline);
+}
+
 void FrameDispatcher::deleteStream(const QString uri)
 {
     _impl->streams.erase(uri);
     emit pixelStreamClosed(uri);
 }
+
+void FrameDispatcher::_sendFrameIfReady(const QString& uri)
+{
+    auto& buffer = _impl->streams[uri].buffer;
+    if (!buffer.isAllowedToSend())
+        return;
+
+    if (!buffer.hasCompleteFrame())
+    {
+        _scheduleDeadline(uri);
+        return;
+    }
+
+    auto frame = _impl->consumeLatestFrame(uri);
+    // buffer may be deleted by a receiver of sendFrame()
+    const auto frameIndex = buffer.getLastFrameIndex();
+    emit sendFrame(frame);
+    emit framesConsumed(uri, frameIndex);
+}
+
+void FrameDispatcher::_scheduleDeadline(const QString& uri)
+{
+    auto& stream = _impl->streams[uri];
+    if (stream.deadlineScheduled)
+        return;
+
+    const auto timeLeft = stream.buffer.getTimeToDeadline();
+    if (timeLeft == std::chrono::milliseconds::max())
+        return;
+
+    stream.deadlineScheduled = true;
+    QTimer::singleShot(int(timeLeft.count()), this, [this, uri] {
+        if (!_impl->streams.count(uri))
+            return;
+
+        _impl->streams[uri].deadlineScheduled = false;
+        try
+        {
+            _sendFrameIfReady(uri);
+        }
+        catch (const std::runtime_error& e)
+        {
+            emit pixelStreamError(uri, e.what());
+        }
+    });
+}
 }
 }
@@ -40,7 +40,9 @@
 #ifndef DEFLECT_SERVER_FRAMEDISPATCHER_H
 #define DEFLECT_SERVER_FRAMEDISPATCHER_H
 
+#include <deflect/LatencyHistogram.h>
 #include <deflect/api.h>
+#include <deflect/server/Metrics.h>
 #include <deflect/server/Tile.h>
 
 #include <QObject>
@@ -64,6 +66,21 @@ public:
     /** Destructor. */
     ~FrameDispatcher();
 
+    /**
+     * Get the latency of the frames dispatched for a stream, from the moment
+     * the sources started sending them until they were dispatched.
+     *
+     * Only the frames of sources whose clock is synchronized with the server
+     * are measured.
+     *
+     * @param uri Identifier for the stream
+     * @return the latency histogram, empty if the stream is not open
+     */
+    LatencyHistogram getFrameLatency(const QString& uri) const;
+
+    /** @return the metrics of the open streams, without event counters. */
+    std::vector<StreamMetrics> getMetrics() const;
+
 public slots:
     /**
      * Add a source of Tiles for a Stream.
@@ -107,13 +124,35 @@ public slots:
     void processTile(QString uri, size_t sourceIndex,
                      deflect::server::Tile tile);
 
+    /**
+     * Process new Tiles received together.
+     *
+     * @param uri Identifier for the stream
+     * @param sourceIndex Identifier for the source in the stream
+     * @param tiles to process
+     */
+    void processTiles(QString uri, size_t sourceIndex,
+                      deflect::server::Tiles tiles);
+
     /**
      * The given source has finished sending Tiles for the current frame.
      *
      * @param uri Identifier for the stream
      * @param sourceIndex Identifier for the source in the stream
+     * @param sequence The number of the frame given by the source, if any
+     * @param sendTime When the source started sending the frame in
+     *        steady_clock nanoseconds of the server, 0 if unknown
      */
-    void processFrameFinished(QString uri, size_t sourceIndex);
+    void processFrameFinished(QString uri, size_t sourceIndex,
+                              quint64 sequence = 0, qint64 sendTime = 0);
+
+    /**
+     * Count the events sent to a stream, see getMetrics().
+     *
+     * @param uri Identifier for the stream
+     * @param count the number of events sent
+     */
+    void processEventsSent(QString uri, size_t count);
 
     /**
      * Request the dispatching of a new frame for any stream (mono/stereo).
@@ -128,6 +167,20 @@ public slots:
      */
     void requestFrame(QString uri);
 
+    /**
+     * Set the maximum time to wait for all sources to finish a frame.
+     *
+     * When the deadline elapses after the first source has finished a frame,
+     * the frame is dispatched with the previous tiles of the late sources.
+     *
+     * The setting is ignored if the stream is not open, and it is reset when
+     * the stream is deleted.
+     *
+     * @param uri Identifier for the stream
+     * @param milliseconds the deadline, 0 to wait for all sources (default)
+     */
+    void setFrameDeadline(QString uri, unsigned int milliseconds);
+
     /**
      * Delete all the buffers for a Stream.
      *
@@ -181,9 +234,21 @@ signals:
      */
     void sendFrame(deflect::server::FramePtr frame);
 
+    /**
+     * Notify that the frames of a stream have been consumed, either because
+     * they were dispatched or because they were superseded by a newer frame.
+     *
+     * @param uri Identifier for the stream
+     * @param frameIndex Number of frames consumed since the stream was opened
+     */
+    void framesConsumed(QString uri, unsigned int frameIndex);
+
 private:
     class Impl;
     std::unique_ptr<Impl> _impl;
+
+    void _sendFrameIfReady(const QString& uri);
+    void _scheduleDeadline(const QString& uri);
 };
 }
 }
@@ -0,0 +1,212 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "FrameRecorder.h"
+
+#include "CaptureFormat.h"
+#include "Frame.h"
+
+#include <QFile>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+const qint64 FILE_GROWTH = 64 * 1024 * 1024;
+
+int64_t _toNanoseconds(const deflect::server::FrameTiming::Clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               t.time_since_epoch())
+        .count();
+}
+}
+
+namespace deflect
+{
+namespace server
+{
+class FrameRecorder::Impl
+{
+public:
+    explicit Impl(const QString& filename)
+        : file{filename}
+    {
+        if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate))
+        {
+            throw std::runtime_error("could not create capture file: " +
+                                     filename.toStdString());
+        }
+        reserve(sizeof(CaptureFileHeader));
+        new (data) CaptureFileHeader;
+        size = sizeof(CaptureFileHeader);
+    }
+
+    ~Impl()
+    {
+        try
+        {
+            const auto indexOffset = size;
+            const auto indexSize = offsets.size() * sizeof(uint64_t);
+            reserve(indexOffset + indexSize);
+            std::memcpy(data + indexOffset, offsets.data(), indexSize);
+            size += indexSize;
+            getHeader().indexOffset = indexOffset;
+        }
+        catch (const std::runtime_error&)
+        {
+            // the index can be rebuilt by the reader
+        }
+        if (data)
+            file.unmap(data);
+        file.resize(size);
+    }
+
+    void record(const Frame& frame)
+    {
+        const auto uri = frame.uri.toUtf8();
+
+        qint64 recordSize =
+            sizeof(CaptureFrameHeader) + alignCaptureSize(uri.size());
+        for (const auto& tile : frame.tiles)
+            recordSize += sizeof(CaptureTileHeader) +
+                          alignCaptureSize(tile.imageData.size());
+
+        const auto offset = size;
+        reserve(offset + recordSize);
+
+        CaptureFrameHeader frameHeader;
+        frameHeader.uriSize = uri.size();
+        frameHeader.tileCount = frame.tiles.size();
+        frameHeader.timestamp =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        frameHeader.sequence = frame.timing.sequence;
+        frameHeader.sendTime = _toNanoseconds(frame.timing.sendTime);
+        frameHeader.receiveTime = _toNanoseconds(frame.timing.receiveTime);
+        frameHeader.dispatchTime = _toNanoseconds(frame.timing.dispatchTime);
+        _append(&frameHeader, sizeof(frameHeader));
+        _append(uri.constData(), uri.size());
+
+        for (const auto& tile : frame.tiles)
+        {
+            CaptureTileHeader tileHeader;
+            tileHeader.x = tile.x;
+            tileHeader.y = tile.y;
+            tileHeader.width = tile.width;
+            tileHeader.height = tile.height;
+            tileHeader.dataSize = tile.imageData.size();
+            tileHeader.format = uint8_t(tile.format);
+            tileHeader.rowOrder = uint8_t(tile.rowOrder);
+            tileHeader.view = uint8_t(tile.view);
+            tileHeader.channel = tile.channel;
+            _append(&tileHeader, sizeof(tileHeader));
+            _append(tile.imageData.constData(), tile.imageData.size());
+        }
+
+        // publish the frame once its record is complete
+        offsets.push_back(offset);
+        getHeader().frameCount = offsets.size();
+    }
+
+    void reserve(const qint64 required)
+    {
+        if (required <= capacity)
+            return;
+
+        const auto newCapacity = std::max(required, capacity + FILE_GROWTH);
+        if (data)
+            file.unmap(data);
+        data = nullptr;
+        capacity = 0;
+
+        if (!file.resize(newCapacity))
+            throw std::runtime_error("could not extend capture file");
+        data = file.map(0, newCapacity);
+        if (!data)
+            throw std::runtime_error("could not map capture file");
+        capacity = newCapacity;
+    }
+
+    CaptureFileHeader& getHeader()
+    {
+        return *reinterpret_cast<CaptureFileHeader*>(data);
+    }
+
+    QFile file;
+    uchar* data = nullptr;
+    qint64 capacity = 0;
+    qint64 size = 0;
+    std::vector<uint64_t> offsets;
+
+private:
+    // the file is extended with zeros, which also fill the padding
+    void _append(const void* source, const size_t count)
+    {
+        std::memcpy(data + size, source, count);
+        size += alignCaptureSize(count);
+    }
+};
+
+FrameRecorder::FrameRecorder(const QString& filename)
+    : _impl(new Impl(filename))
+{
+}
+
+FrameRecorder::~FrameRecorder()
+{
+}
+
+void FrameRecorder::record(const Frame& frame)
+{
+    _impl->record(frame);
+}
+
+size_t FrameRecorder::getFrameCount() const
+{
+    return _impl->offsets.size();
+}
+}
+}
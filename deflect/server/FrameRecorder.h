@@ -0,0 +1,98 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_SERVER_FRAMERECORDER_H
+#define DEFLECT_SERVER_FRAMERECORDER_H
+
+#include <deflect/api.h>
+#include <deflect/server/types.h>
+
+#include <QString>
+
+namespace deflect
+{
+namespace server
+{
+/**
+ * Record frames to an append-only capture file.
+ *
+ * The tiles are stored as received from the streams, without decoding or
+ * re-encoding, together with their geometry, format, view, channel and row
+ * order and the time at which the frame was recorded. The file is written
+ * through a memory mapping which grows in large steps, so that recording a
+ * frame amounts to copying its compressed data.
+ *
+ * An index of the frames is appended when the recorder is destroyed. Frames
+ * recorded before an interruption remain readable by CaptureReader, which
+ * then rebuilds the index.
+ */
+class FrameRecorder
+{
+public:
+    /**
+     * Create a new capture file.
+     *
+     * @param filename the file to create, replaced if it exists
+     * @throw std::runtime_error if the file could not be created
+     */
+    DEFLECT_API explicit FrameRecorder(const QString& filename);
+
+    /** Write the frame index and close the file. */
+    DEFLECT_API ~FrameRecorder();
+
+    /**
+     * Append a frame to the file.
+     *
+     * @param frame the frame to record, with the tile positions of the stream
+     *        (not mirrored for bottom_up tiles, see Server::startRecording())
+     * @throw std::runtime_error if the file could not be extended
+     */
+    DEFLECT_API void record(const Frame& frame);
+
+    /** @return the number of frames recorded. */
+    DEFLECT_API size_t getFrameCount() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> _impl;
+};
+}
+}
+
+#endif
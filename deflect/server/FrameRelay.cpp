@@ -0,0 +1,330 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "FrameRelay.h"
+
+#include "Frame.h"
+#include "deflect/NetworkProtocol.h"
+#include "deflect/SegmentParameters.h"
+
+#include <QDataStream>
+#include <QtNetwork/QTcpSocket>
+
+#include <algorithm>
+
+namespace
+{
+const int CONNECTION_TIMEOUT_MS = 5000;
+const auto RECONNECTION_INTERVAL = std::chrono::seconds{1};
+}
+
+namespace deflect
+{
+namespace server
+{
+FrameRelay::FrameRelay(const QString& host, const quint16 port,
+                       const unsigned int maxQueuedFrames)
+    : _host{host}
+    , _port{port}
+    , _maxQueuedFrames{std::max(maxQueuedFrames, 1u)}
+{
+    connect(this, &FrameRelay::_requestsAvailable, this,
+            &FrameRelay::_processRequests, Qt::QueuedConnection);
+}
+
+FrameRelay::~FrameRelay()
+{
+    for (const auto& stream : _streams)
+        _send(MESSAGE_TYPE_QUIT, stream.first);
+    _flush();
+}
+
+const QString& FrameRelay::getHost() const
+{
+    return _host;
+}
+
+quint16 FrameRelay::getPort() const
+{
+    return _port;
+}
+
+size_t FrameRelay::getDroppedFrames() const
+{
+    return _droppedFrames;
+}
+
+void FrameRelay::forward(FramePtr frame)
+{
+    bool wasEmpty = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        // drop the oldest pending frame of the stream if it is too far behind
+        size_t queuedFrames = 0;
+        auto oldest = _requests.end();
+        for (auto it = _requests.begin(); it != _requests.end(); ++it)
+        {
+            if (it->frame && it->uri == frame->uri && queuedFrames++ == 0)
+                oldest = it;
+        }
+        if (queuedFrames >= _maxQueuedFrames)
+        {
+            _requests.erase(oldest);
+            ++_droppedFrames;
+        }
+
+        wasEmpty = _requests.empty();
+        const auto uri = frame->uri;
+        _requests.push_back({uri, std::move(frame)});
+    }
+    if (wasEmpty)
+        emit _requestsAvailable();
+}
+
+void FrameRelay::closeStream(const QString uri)
+{
+    bool wasEmpty = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _requests.erase(std::remove_if(_requests.begin(), _requests.end(),
+                                       [&uri](const Request& request) {
+                                           return request.uri == uri;
+                                       }),
+                        _requests.end());
+        wasEmpty = _requests.empty();
+        _requests.push_back({uri, nullptr});
+    }
+    if (wasEmpty)
+        emit _requestsAvailable();
+}
+
+void FrameRelay::_processRequests()
+{
+    for (;;)
+    {
+        Request request;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_requests.empty())
+                return;
+            request = std::move(_requests.front());
+            _requests.pop_front();
+        }
+
+        if (!request.frame)
+            _sendClose(request.uri);
+        else if (_isConnected() || _connect())
+            _sendFrame(*request.frame);
+        else
+            ++_droppedFrames;
+    }
+}
+
+bool FrameRelay::_connect()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (now - _lastConnectionAttempt < RECONNECTION_INTERVAL)
+        return false;
+    _lastConnectionAttempt = now;
+
+    _disconnect();
+
+    auto socket = new QTcpSocket(this);
+    socket->connectToHost(_host, _port);
+    if (!socket->waitForConnected(CONNECTION_TIMEOUT_MS))
+    {
+        emit connectionError(socket->errorString());
+        delete socket;
+        return false;
+    }
+
+    // the Server sends its protocol version first
+    while (socket->bytesAvailable() < qint64(sizeof(int32_t)))
+    {
+        if (!socket->waitForReadyRead(CONNECTION_TIMEOUT_MS))
+        {
+            emit connectionError("Timeout reading the protocol version");
+            delete socket;
+            return false;
+        }
+    }
+    int32_t version = 0;
+    socket->read((char*)&version, sizeof(int32_t));
+    if (version < NETWORK_PROTOCOL_VERSION)
+    {
+        emit connectionError(
+            QString("The Server protocol version %1 is not supported")
+                .arg(version));
+        delete socket;
+        return false;
+    }
+
+    // the messages of the downstream Server (frame acks, events) are unused
+    connect(socket, &QTcpSocket::readyRead, socket,
+            [socket] { socket->readAll(); });
+
+    _socket = socket;
+    return true;
+}
+
+void FrameRelay::_disconnect()
+{
+    delete _socket;
+    _socket = nullptr;
+    _streams.clear();
+}
+
+bool FrameRelay::_isConnected() const
+{
+    return _socket && _socket->state() == QTcpSocket::ConnectedState;
+}
+
+void FrameRelay::_sendFrame(const Frame& frame)
+{
+    auto it = _streams.find(frame.uri);
+    if (it == _streams.end())
+    {
+        _send(MESSAGE_TYPE_PIXELSTREAM_OPEN, frame.uri,
+              QByteArray::number(NETWORK_PROTOCOL_VERSION));
+        it = _streams.emplace(frame.uri, StreamState()).first;
+    }
+
+    // batch the consecutive tiles with the same view, row order and channel
+    const auto end = frame.tiles.data() + frame.tiles.size();
+    auto begin = frame.tiles.data();
+    while (begin != end)
+    {
+        _sendStateIfChanged(frame.uri, it->second, *begin);
+
+        auto last = begin + 1;
+        while (last != end && last->view == begin->view &&
+               last->rowOrder == begin->rowOrder &&
+               last->channel == begin->channel)
+        {
+            ++last;
+        }
+        _sendTiles(frame.uri, begin, last);
+        begin = last;
+    }
+
+    _send(MESSAGE_TYPE_PIXELSTREAM_FINISH_FRAME, frame.uri);
+    _flush();
+}
+
+void FrameRelay::_sendClose(const QString& uri)
+{
+    if (!_streams.erase(uri))
+        return;
+
+    _send(MESSAGE_TYPE_QUIT, uri);
+    _flush();
+}
+
+void FrameRelay::_sendTiles(const QString& uri, const Tile* begin,
+                            const Tile* end)
+{
+    // batch record: [uint32_t size][SegmentParameters][imageData]
+    QByteArray batch;
+    for (auto tile = begin; tile != end; ++tile)
+    {
+        SegmentParameters params;
+        params.x = tile->x;
+        params.y = tile->y;
+        params.width = tile->width;
+        params.height = tile->height;
+        params.format = tile->format;
+
+        const uint32_t size = tile->imageData.size();
+        batch.append((const char*)(&size), sizeof(uint32_t));
+        batch.append((const char*)(&params), sizeof(SegmentParameters));
+        batch.append(tile->imageData);
+    }
+    _send(MESSAGE_TYPE_PIXELSTREAM_BATCH, uri, batch);
+}
+
+void FrameRelay::_sendStateIfChanged(const QString& uri, StreamState& stream,
+                                     const Tile& tile)
+{
+    if (tile.view != stream.view)
+    {
+        _send(MESSAGE_TYPE_IMAGE_VIEW, uri,
+              QByteArray{(const char*)(&tile.view), sizeof(View)});
+        stream.view = tile.view;
+    }
+    if (tile.rowOrder != stream.rowOrder)
+    {
+        _send(MESSAGE_TYPE_IMAGE_ROW_ORDER, uri,
+              QByteArray{(const char*)(&tile.rowOrder), sizeof(RowOrder)});
+        stream.rowOrder = tile.rowOrder;
+    }
+    if (tile.channel != stream.channel)
+    {
+        _send(MESSAGE_TYPE_IMAGE_CHANNEL, uri,
+              QByteArray{(const char*)(&tile.channel), sizeof(uint8_t)});
+        stream.channel = tile.channel;
+    }
+}
+
+void FrameRelay::_send(const MessageType type, const QString& uri,
+                       const QByteArray& message)
+{
+    if (!_isConnected())
+        return;
+
+    {
+        QDataStream stream(_socket);
+        stream << MessageHeader(type, message.size(), uri.toStdString());
+    }
+    if (!message.isEmpty())
+        _socket->write(message);
+}
+
+void FrameRelay::_flush()
+{
+    if (!_isConnected())
+        return;
+
+    // wait until the frame is sent, meanwhile the next frames are dropped
+    _socket->flush();
+    while (_socket->bytesToWrite() > 0 && _isConnected())
+        _socket->waitForBytesWritten();
+}
+}
+}
@@ -0,0 +1,173 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_SERVER_FRAMERELAY_H
+#define DEFLECT_SERVER_FRAMERELAY_H
+
+#include <deflect/MessageHeader.h>
+#include <deflect/api.h>
+#include <deflect/server/types.h>
+
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+
+class QTcpSocket;
+
+namespace deflect
+{
+namespace server
+{
+/**
+ * Forward the frames of a Server to a downstream Server.
+ *
+ * The tiles are sent as they were received, without decoding or re-encoding,
+ * and each frame is finished on the downstream Server. All the streams are
+ * multiplexed on a single connection.
+ *
+ * The frames are sent from the thread of the object, so that a slow
+ * downstream Server does not stall the caller of forward(). Frames which are
+ * still queued when more than maxQueuedFrames newer frames of the same stream
+ * are forwarded are dropped.
+ */
+class FrameRelay : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Create a relay to a downstream Server.
+     *
+     * The connection is established from the thread of the object, once
+     * the first frame is to be sent.
+     *
+     * @param host the address of the downstream Server
+     * @param port the port of the downstream Server
+     * @param maxQueuedFrames the number of frames per stream waiting to be
+     *        sent before the oldest one is dropped
+     */
+    DEFLECT_API FrameRelay(const QString& host, quint16 port,
+                           unsigned int maxQueuedFrames = 2);
+
+    /** Close the streams and the connection. */
+    DEFLECT_API ~FrameRelay();
+
+    /** @return the address of the downstream Server. */
+    DEFLECT_API const QString& getHost() const;
+
+    /** @return the port of the downstream Server. */
+    DEFLECT_API quint16 getPort() const;
+
+    /** @return the number of frames which have been dropped. */
+    DEFLECT_API size_t getDroppedFrames() const;
+
+    /**
+     * Queue a frame to be sent to the downstream Server.
+     * @param frame the frame, which must not be modified afterwards
+     * @threadsafe
+     */
+    DEFLECT_API void forward(FramePtr frame);
+
+    /**
+     * Close a stream on the downstream Server, dropping its queued frames.
+     * @param uri Identifier for the stream
+     * @threadsafe
+     */
+    DEFLECT_API void closeStream(QString uri);
+
+signals:
+    /** Emitted when the downstream Server could not be reached. */
+    void connectionError(QString what);
+
+    /** @internal */
+    void _requestsAvailable();
+
+private slots:
+    void _processRequests();
+
+private:
+    /** A frame to send, or a stream to close if there is no frame. */
+    struct Request
+    {
+        QString uri;
+        FramePtr frame;
+    };
+
+    /** The state of a stream on the downstream Server. */
+    struct StreamState
+    {
+        View view = View::mono;
+        RowOrder rowOrder = RowOrder::top_down;
+        uint8_t channel = 0;
+    };
+
+    const QString _host;
+    const quint16 _port;
+    const unsigned int _maxQueuedFrames;
+
+    std::mutex _mutex;
+    std::deque<Request> _requests;
+    std::atomic<size_t> _droppedFrames{0};
+
+    QTcpSocket* _socket = nullptr; // child QObject, once connected
+    std::chrono::steady_clock::time_point _lastConnectionAttempt;
+    std::map<QString, StreamState> _streams;
+
+    bool _connect();
+    void _disconnect();
+    bool _isConnected() const;
+
+    void _sendFrame(const Frame& frame);
+    void _sendClose(const QString& uri);
+    void _sendTiles(const QString& uri, const Tile* begin, const Tile* end);
+    void _sendStateIfChanged(const QString& uri, StreamState& stream,
+                             const Tile& tile);
+    void _send(MessageType type, const QString& uri,
+               const QByteArray& message = QByteArray());
+    void _flush();
+};
+}
+}
+
+#endif
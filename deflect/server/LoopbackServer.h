@@ -0,0 +1,89 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_SERVER_LOOPBACKSERVER_H
+#define DEFLECT_SERVER_LOOPBACKSERVER_H
+
+#include <deflect/Loopback.h>
+
+#include <QObject>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace deflect
+{
+namespace server
+{
+/**
+ * Accept the in-process connections to a port, like a QTcpServer.
+ */
+class LoopbackServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Start accepting the in-process connections to a port.
+     * @param port the port of the Server.
+     * @param parent the parent QObject.
+     * @throw std::runtime_error if the port is already in use.
+     */
+    explicit LoopbackServer(quint16 port, QObject* parent = nullptr);
+
+    /** Stop accepting connections. */
+    ~LoopbackServer();
+
+    /** @return the next pending connection, nullptr if there is none. */
+    std::shared_ptr<loopback::Channel> nextPendingConnection();
+
+signals:
+    /** Emitted from the thread of the client for each new connection. */
+    void newConnection();
+
+private:
+    const quint16 _port;
+    std::mutex _mutex;
+    std::deque<std::shared_ptr<loopback::Channel>> _pending;
+};
+}
+}
+
+#endif
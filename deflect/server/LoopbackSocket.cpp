@@ -0,0 +1,122 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "LoopbackSocket.h"
+
+#include <cstring>
+
+namespace deflect
+{
+namespace server
+{
+LoopbackSocket::LoopbackSocket(std::shared_ptr<loopback::Channel> channel,
+                               QObject* parent_)
+    : QIODevice(parent_)
+    , _channel{std::move(channel)}
+{
+    open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+
+    // Coalesce the notifications of the client writes: a new one is only
+    // queued once the previous one has been processed.
+    _channel->toServer.setNotifier([this] {
+        if (!_notifyPending.exchange(true))
+            QMetaObject::invokeMethod(this, "_notify", Qt::QueuedConnection);
+    });
+
+    // the client may have written before the notifier was set
+    if (_channel->toServer.size() > 0 || _channel->toServer.isClosed())
+    {
+        _notifyPending = true;
+        QMetaObject::invokeMethod(this, "_notify", Qt::QueuedConnection);
+    }
+}
+
+LoopbackSocket::~LoopbackSocket()
+{
+    _channel->toServer.setNotifier(nullptr);
+    _channel->close();
+}
+
+bool LoopbackSocket::isConnected() const
+{
+    return !_channel->toServer.isClosed() && !_channel->toClient.isClosed();
+}
+
+qint64 LoopbackSocket::bytesAvailable() const
+{
+    return qint64(_channel->toServer.size()) + QIODevice::bytesAvailable();
+}
+
+bool LoopbackSocket::waitForReadyRead(const int msecs)
+{
+    return _channel->toServer.waitForData(msecs);
+}
+
+qint64 LoopbackSocket::readData(char* data, const qint64 maxSize)
+{
+    const auto received = _channel->toServer.read(size_t(maxSize));
+    if (received.isEmpty() && _channel->toServer.isClosed())
+        return -1;
+
+    std::memcpy(data, received.constData(), size_t(received.size()));
+    return received.size();
+}
+
+qint64 LoopbackSocket::writeData(const char* data, const qint64 maxSize)
+{
+    if (!_channel->toClient.write(data, size_t(maxSize)))
+        return -1;
+    return maxSize;
+}
+
+void LoopbackSocket::_notify()
+{
+    _notifyPending = false;
+
+    if (_channel->toServer.size() > 0)
+        emit readyRead();
+
+    if (!isConnected() && !_disconnected)
+    {
+        _disconnected = true;
+        emit disconnected();
+    }
+}
+}
+}
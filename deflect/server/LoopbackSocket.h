@@ -0,0 +1,98 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_SERVER_LOOPBACKSOCKET_H
+#define DEFLECT_SERVER_LOOPBACKSOCKET_H
+
+#include <deflect/Loopback.h>
+
+#include <QIODevice>
+
+#include <atomic>
+#include <memory>
+
+namespace deflect
+{
+namespace server
+{
+/**
+ * Server end of an in-process connection, used by a ServerWorker in place of
+ * a QTcpSocket.
+ *
+ * Like a socket, it emits readyRead() from its own thread when the client has
+ * written data, and disconnected() once the client has closed the connection.
+ */
+class LoopbackSocket : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    LoopbackSocket(std::shared_ptr<loopback::Channel> channel,
+                   QObject* parent = nullptr);
+
+    /** Close the connection. */
+    ~LoopbackSocket();
+
+    /** @return true until either end has closed the connection. */
+    bool isConnected() const;
+
+    bool isSequential() const final { return true; }
+    qint64 bytesAvailable() const final;
+    bool waitForReadyRead(int msecs) final;
+
+signals:
+    /** Emitted once the connection has been closed. */
+    void disconnected();
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) final;
+    qint64 writeData(const char* data, qint64 maxSize) final;
+
+private slots:
+    void _notify();
+
+private:
+    std::shared_ptr<loopback::Channel> _channel;
+    std::atomic_bool _notifyPending{false};
+    bool _disconnected = false;
+};
+}
+}
+
+#endif
@@ -0,0 +1,227 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "Metrics.h"
+
+namespace deflect
+{
+namespace server
+{
+namespace
+{
+const double QUANTILES[] = {0.5, 0.9, 0.99};
+
+double _perSecond(const uint64_t count, const std::chrono::nanoseconds time)
+{
+    const auto seconds = std::chrono::duration<double>(time).count();
+    return seconds > 0.0 ? count / seconds : 0.0;
+}
+
+double _toSeconds(const LatencyHistogram::Duration duration)
+{
+    return std::chrono::duration<double>(duration).count();
+}
+
+QByteArray _escape(const QString& labelValue)
+{
+    auto value = labelValue.toUtf8();
+    value.replace('\\', "\\\\");
+    value.replace('"', "\\\"");
+    value.replace('\n', "\\n");
+    return value;
+}
+
+/** Write metric families in the Prometheus text format. */
+class PrometheusWriter
+{
+public:
+    void family(const char* name, const char* type, const char* help)
+    {
+        _text.append("# HELP ").append(name).append(' ').append(help);
+        _text.append("\n# TYPE ").append(name).append(' ').append(type);
+        _text.append('\n');
+    }
+
+    void sample(const char* name, const QByteArray& labels, const double value)
+    {
+        _text.append(name);
+        if (!labels.isEmpty())
+            _text.append('{').append(labels).append('}');
+        _text.append(' ').append(QByteArray::number(value, 'g', 15));
+        _text.append('\n');
+    }
+
+    void summary(const char* name, const QByteArray& labels,
+                 const LatencyHistogram& histogram)
+    {
+        for (const auto quantile : QUANTILES)
+        {
+            const auto quantileLabels =
+                labels + ",quantile=\"" + QByteArray::number(quantile) + '"';
+            sample(name, quantileLabels,
+                   _toSeconds(histogram.getPercentile(quantile * 100.0)));
+        }
+        sample((QByteArray(name) + "_sum").constData(), labels,
+               _toSeconds(histogram.getSum()));
+        sample((QByteArray(name) + "_count").constData(), labels,
+               double(histogram.getCount()));
+    }
+
+    const QByteArray& getText() const { return _text; }
+private:
+    QByteArray _text;
+};
+
+QByteArray _streamLabels(const StreamMetrics& stream)
+{
+    return "stream=\"" + _escape(stream.uri) + '"';
+}
+
+QByteArray _sourceLabels(const StreamMetrics& stream,
+                         const SourceMetrics& source)
+{
+    return _streamLabels(stream) + ",source=\"" +
+           QByteArray::number(qulonglong(source.sourceIndex)) + '"';
+}
+
+template <typename Getter>
+void _writeStreams(PrometheusWriter& writer, const ServerMetrics& metrics,
+                   const char* name, const char* type, const char* help,
+                   Getter getValue)
+{
+    writer.family(name, type, help);
+    for (const auto& stream : metrics.streams)
+        writer.sample(name, _streamLabels(stream), double(getValue(stream)));
+}
+
+template <typename Getter>
+void _writeSources(PrometheusWriter& writer, const ServerMetrics& metrics,
+                   const char* name, const char* type, const char* help,
+                   Getter getValue)
+{
+    writer.family(name, type, help);
+    for (const auto& stream : metrics.streams)
+        for (const auto& source : stream.sourceMetrics)
+            writer.sample(name, _sourceLabels(stream, source),
+                          double(getValue(source)));
+}
+}
+
+double StreamMetrics::getTilesPerSecond() const
+{
+    return _perSecond(tiles, uptime);
+}
+
+double StreamMetrics::getBytesPerSecond() const
+{
+    return _perSecond(bytes, uptime);
+}
+
+double StreamMetrics::getEventsPerSecond() const
+{
+    return _perSecond(events, uptime);
+}
+
+QByteArray toPrometheusText(const ServerMetrics& metrics)
+{
+    using Stream = StreamMetrics;
+    using Source = SourceMetrics;
+
+    PrometheusWriter writer;
+
+    writer.family("deflect_connections", "gauge", "Open connections.");
+    writer.sample("deflect_connections", {}, double(metrics.connections));
+    writer.family("deflect_connections_accepted_total", "counter",
+                  "Connections accepted.");
+    writer.sample("deflect_connections_accepted_total", {},
+                  double(metrics.connectionsAccepted));
+
+    _writeStreams(writer, metrics, "deflect_stream_sources", "gauge",
+                  "Sources of the stream.",
+                  [](const Stream& s) { return s.sources; });
+    _writeStreams(writer, metrics, "deflect_stream_observers", "gauge",
+                  "Observers of the stream.",
+                  [](const Stream& s) { return s.observers; });
+    _writeStreams(writer, metrics, "deflect_stream_tiles_total", "counter",
+                  "Tiles received.", [](const Stream& s) { return s.tiles; });
+    _writeStreams(writer, metrics, "deflect_stream_bytes_total", "counter",
+                  "Bytes of tile image data received.",
+                  [](const Stream& s) { return s.bytes; });
+    _writeStreams(writer, metrics, "deflect_stream_frames_completed_total",
+                  "counter", "Frames dispatched.",
+                  [](const Stream& s) { return s.framesCompleted; });
+    _writeStreams(writer, metrics, "deflect_stream_frames_dropped_total",
+                  "counter", "Frames superseded before being dispatched.",
+                  [](const Stream& s) { return s.framesDropped; });
+    _writeStreams(writer, metrics, "deflect_stream_pending_frames", "gauge",
+                  "Frames finished by some sources, not dispatched yet.",
+                  [](const Stream& s) { return s.pendingFrames; });
+    _writeStreams(writer, metrics, "deflect_stream_events_total", "counter",
+                  "Events sent to the stream.",
+                  [](const Stream& s) { return s.events; });
+
+    writer.family("deflect_stream_source_skew_seconds", "summary",
+                  "Time between the first and last source finishing a frame.");
+    for (const auto& stream : metrics.streams)
+        writer.summary("deflect_stream_source_skew_seconds",
+                       _streamLabels(stream), stream.sourceSkew);
+
+    writer.family("deflect_stream_frame_latency_seconds", "summary",
+                  "Time from the sources starting a frame to its dispatch.");
+    for (const auto& stream : metrics.streams)
+        writer.summary("deflect_stream_frame_latency_seconds",
+                       _streamLabels(stream), stream.frameLatency);
+
+    _writeSources(writer, metrics, "deflect_source_tiles_total", "counter",
+                  "Tiles received from the source.",
+                  [](const Source& s) { return s.tiles; });
+    _writeSources(writer, metrics, "deflect_source_bytes_total", "counter",
+                  "Bytes of tile image data received from the source.",
+                  [](const Source& s) { return s.bytes; });
+    _writeSources(writer, metrics, "deflect_source_frames_finished_total",
+                  "counter", "Frames finished by the source.",
+                  [](const Source& s) { return s.framesFinished; });
+    _writeSources(writer, metrics, "deflect_source_queued_frames", "gauge",
+                  "Frames buffered for the source.",
+                  [](const Source& s) { return s.queuedFrames; });
+
+    return writer.getText();
+}
+}
+}
@@ -0,0 +1,174 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_SERVER_METRICS_H
+#define DEFLECT_SERVER_METRICS_H
+
+#include <deflect/LatencyHistogram.h>
+#include <deflect/api.h>
+
+#include <QByteArray>
+#include <QString>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace deflect
+{
+namespace server
+{
+/**
+ * Counters of one source of a stream, since it was added.
+ *
+ * @version 1.1
+ */
+struct SourceMetrics
+{
+    /** Identifier of the source in the stream. */
+    size_t sourceIndex = 0;
+
+    /** Tiles received. */
+    uint64_t tiles = 0;
+
+    /** Bytes of tile image data received. */
+    uint64_t bytes = 0;
+
+    /** Frames finished by the source. */
+    uint64_t framesFinished = 0;
+
+    /** Frames buffered for the source, including the one being received. */
+    size_t queuedFrames = 0;
+};
+
+/**
+ * Counters of a stream, since it was opened.
+ *
+ * Rates are averaged since the stream was opened; the difference between the
+ * counters of two successive calls to Server::getMetrics() gives the current
+ * rates.
+ *
+ * @version 1.1
+ */
+struct StreamMetrics
+{
+    /** Identifier of the stream. */
+    QString uri;
+
+    /** Time since the stream was opened. */
+    std::chrono::nanoseconds uptime{0};
+
+    /** @name Connections */
+    //@{
+    size_t sources = 0;
+    size_t observers = 0;
+    //@}
+
+    /** @name Tiles */
+    //@{
+    /** Tiles received from all the sources. */
+    uint64_t tiles = 0;
+
+    /** Bytes of tile image data received from all the sources. */
+    uint64_t bytes = 0;
+    //@}
+
+    /** @name Frames */
+    //@{
+    /** Frames dispatched with Server::receivedFrame(). */
+    uint64_t framesCompleted = 0;
+
+    /** Complete frames superseded by a newer one before being dispatched. */
+    uint64_t framesDropped = 0;
+
+    /** Frames finished by at least one source and not dispatched yet. */
+    size_t pendingFrames = 0;
+
+    /** Time between the first and the last source finishing each frame. */
+    LatencyHistogram sourceSkew;
+
+    /** Time from the sources starting a frame until its dispatch. */
+    LatencyHistogram frameLatency;
+    //@}
+
+    /** Events sent to the stream. */
+    uint64_t events = 0;
+
+    /** The counters of each source currently connected. */
+    std::vector<SourceMetrics> sourceMetrics;
+
+    /** @return the average number of tiles received per second. */
+    DEFLECT_API double getTilesPerSecond() const;
+
+    /** @return the average number of bytes received per second. */
+    DEFLECT_API double getBytesPerSecond() const;
+
+    /** @return the average number of events sent per second. */
+    DEFLECT_API double getEventsPerSecond() const;
+};
+
+/**
+ * Counters of a Server, returned by Server::getMetrics().
+ *
+ * @version 1.1
+ */
+struct ServerMetrics
+{
+    /** Connections currently open. */
+    size_t connections = 0;
+
+    /** Connections accepted since the Server was started. */
+    uint64_t connectionsAccepted = 0;
+
+    /** The metrics of each open stream. */
+    std::vector<StreamMetrics> streams;
+};
+
+/**
+ * Format metrics in the Prometheus text exposition format (version 0.0.4).
+ *
+ * @param metrics the metrics to format
+ * @return the text to serve to a Prometheus scraper.
+ * @version 1.1
+ */
+DEFLECT_API QByteArray toPrometheusText(const ServerMetrics& metrics);
+}
+}
+
+#endif
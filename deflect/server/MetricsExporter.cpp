@@ -0,0 +1,126 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "MetricsExporter.h"
+
+#include <QtNetwork/QNetworkProxy>
+#include <QtNetwork/QTcpSocket>
+
+#include <memory>
+#include <stdexcept>
+
+namespace
+{
+// Scrapers send small requests, anything bigger is not a metrics request
+const int MAX_REQUEST_SIZE = 8192;
+
+const char* const CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+
+QByteArray _makeResponse(const QByteArray& status, const QByteArray& body)
+{
+    return "HTTP/1.1 " + status + "\r\nContent-Type: " + CONTENT_TYPE +
+           "\r\nContent-Length: " + QByteArray::number(body.size()) +
+           "\r\nConnection: close\r\n\r\n" + body;
+}
+}
+
+namespace deflect
+{
+namespace server
+{
+MetricsExporter::MetricsExporter(const quint16 port, Provider provider,
+                                 QObject* parent_)
+    : QTcpServer(parent_)
+    , _provider{std::move(provider)}
+{
+    setProxy(QNetworkProxy::NoProxy);
+
+    if (!listen(QHostAddress::Any, port))
+    {
+        const auto err =
+            QString("could not serve metrics on port: %1. QTcpServer: %2")
+                .arg(port)
+                .arg(errorString());
+        throw std::runtime_error(err.toStdString());
+    }
+
+    connect(this, &QTcpServer::newConnection, this,
+            &MetricsExporter::_acceptConnections);
+}
+
+void MetricsExporter::_acceptConnections()
+{
+    while (hasPendingConnections())
+    {
+        auto socket = nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, socket,
+                &QTcpSocket::deleteLater);
+
+        auto request = std::make_shared<QByteArray>();
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket, request] {
+            request->append(socket->readAll());
+            if (request->size() > MAX_REQUEST_SIZE)
+            {
+                socket->abort();
+                return;
+            }
+            if (request->contains("\r\n\r\n"))
+                _reply(*socket, *request);
+        });
+    }
+}
+
+void MetricsExporter::_reply(QTcpSocket& socket, const QByteArray& request)
+{
+    // a single reply per connection
+    disconnect(&socket, &QTcpSocket::readyRead, this, nullptr);
+
+    // request line: "GET /metrics HTTP/1.1"
+    const auto requestLine = request.left(request.indexOf("\r\n")).split(' ');
+    if (requestLine.size() < 2 || requestLine[0] != "GET")
+        socket.write(_makeResponse("405 Method Not Allowed", {}));
+    else if (requestLine[1] != "/metrics" && requestLine[1] != "/")
+        socket.write(_makeResponse("404 Not Found", {}));
+    else
+        socket.write(_makeResponse("200 OK", _provider()));
+
+    socket.disconnectFromHost();
+}
+}
+}
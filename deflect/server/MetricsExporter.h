@@ -0,0 +1,86 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_SERVER_METRICSEXPORTER_H
+#define DEFLECT_SERVER_METRICSEXPORTER_H
+
+#include <QByteArray>
+#include <QtNetwork/QTcpServer>
+
+#include <functional>
+
+class QTcpSocket;
+
+namespace deflect
+{
+namespace server
+{
+/**
+ * Serve metrics over HTTP for a Prometheus scraper.
+ *
+ * Each GET request for /metrics (or /) is answered with the text returned by
+ * the provider, which is called from the thread of the object. The connection
+ * is closed after each reply.
+ */
+class MetricsExporter : public QTcpServer
+{
+public:
+    /** Function returning the metrics in the Prometheus text format. */
+    using Provider = std::function<QByteArray()>;
+
+    /**
+     * Start serving the metrics.
+     *
+     * @param port the port to listen on, 0 to let the system choose one
+     * @param provider the function returning the metrics
+     * @param parent the parent QObject
+     * @throw std::runtime_error if the port could not be opened
+     */
+    MetricsExporter(quint16 port, Provider provider, QObject* parent = nullptr);
+
+private:
+    const Provider _provider;
+
+    void _acceptConnections();
+    void _reply(QTcpSocket& socket, const QByteArray& request);
+};
+}
+}
+
+#endif
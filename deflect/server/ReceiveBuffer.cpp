@@ -39,6 +39,7 @@
 
 #include "ReceiveBuffer.h"
 
+#include <algorithm>
 #include <cassert>
 
 namespace
@@ -60,11 +61,23 @@ void ReceiveBuffer::addSource(const size_t sourceIndex)
 
 void ReceiveBuffer::removeSource(const size_t sourceIndex)
 {
-    _sourceBuffers.erase(sourceIndex);
+    if (!_sourceBuffers.erase(sourceIndex))
+        return;
 
     // reset for new sources starting with getBackFrameIndex() == 0
     if (_sourceBuffers.empty())
+    {
         _lastFrameComplete = 0;
+        _pendingFrames.clear();
+        return;
+    }
+
+    for (auto& frame : _pendingFrames)
+    {
+        auto& sources = frame.finishedSources;
+        sources.erase(std::remove(sources.begin(), sources.end(), sourceIndex),
+                      sources.end());
+    }
 }
 
 size_t ReceiveBuffer::getSourceCount() const
@@ -79,7 +92,9 @@ void ReceiveBuffer::insert(const Tile& tile, const size_t sourceIndex)
     _sourceBuffers[sourceIndex].insert(tile);
 }
 
-void ReceiveBuffer::finishFrameForSource(const size_t sourceIndex)
+void ReceiveBuffer::finishFrameForSource(
+    const size_t sourceIndex, const uint64_t sequence,
+    const FrameTiming::Clock::time_point sendTime)
 {
     assert(_sourceBuffers.count(sourceIndex));
 
@@ -88,37 +103,162 @@ void ReceiveBuffer::finishFrameForSource(const size_t sourceIndex)
         throw std::runtime_error("maximum queue size exceeded");
 
     buffer.push();
+
+    // The frame was already dispatched without this source (deadline missed),
+    // keep its tiles for the next frame that this source may miss.
+    if (buffer.getBackFrameIndex() <= _lastFrameComplete)
+    {
+        buffer.popAndRetain();
+        return;
+    }
+
+    // Frames are finished in order so the new back frame of a source which
+    // is not late is always the next slot after the front.
+    const size_t pendingIndex = buffer.getBackFrameIndex() - _lastFrameComplete;
+    if (_pendingFrames.size() < pendingIndex)
+        _pendingFrames.resize(pendingIndex);
+
+    const auto now = Clock::now();
+    auto& frame = _pendingFrames[pendingIndex - 1];
+    if (frame.finishedSources.empty())
+        frame.firstFinishTime = now;
+    frame.finishedSources.push_back(sourceIndex);
+
+    auto& timing = frame.timing;
+    timing.sequence = std::max(timing.sequence, sequence);
+    if (sendTime != FrameTiming::Clock::time_point() &&
+        (timing.sendTime == FrameTiming::Clock::time_point() ||
+         sendTime < timing.sendTime))
+    {
+        timing.sendTime = sendTime;
+    }
+    timing.receiveTime = now;
 }
 
 bool ReceiveBuffer::hasCompleteFrame() const
 {
-    // Check if all sources for Stream have reached the same index
-    for (const auto& kv : _sourceBuffers)
-    {
-        const auto& buffer = kv.second;
-        if (buffer.getBackFrameIndex() <= _lastFrameComplete)
-            return false;
-    }
-    return !_sourceBuffers.empty();
+    if (_pendingFrames.empty())
+        return false;
+
+    // Check if all sources for Stream have finished the next frame
+    const auto& frame = _pendingFrames.front();
+    if (frame.finishedSources.size() == _sourceBuffers.size())
+        return true;
+
+    return getTimeToDeadline() == std::chrono::milliseconds::zero();
 }
 
 Tiles ReceiveBuffer::popFrame()
 {
     Tiles frame;
-    for (auto& kv : _sourceBuffers)
+    _lateSources.clear();
+
+    if (_pendingFrames.empty())
+        return frame;
+
+    const auto& sources = _pendingFrames.front().finishedSources;
+    const bool partial = sources.size() < _sourceBuffers.size();
+
+    // Only visit the sources which have contributed to this frame
+    for (const auto sourceIndex : sources)
     {
-        auto& buffer = kv.second;
-        if (buffer.getBackFrameIndex() > _lastFrameComplete)
-        {
-            const auto& tiles = buffer.getTiles();
-            frame.insert(frame.end(), tiles.begin(), tiles.end());
+        auto& buffer = _sourceBuffers[sourceIndex];
+        const auto& tiles = buffer.getTiles();
+        frame.insert(frame.end(), tiles.begin(), tiles.end());
+        if (_hasFrameDeadline())
+            buffer.popAndRetain();
+        else
             buffer.pop();
-        }
     }
+
+    if (partial)
+        _appendLateSourcesTiles(frame);
+
+    const auto& pendingFrame = _pendingFrames.front();
+    _lastFrameTiming = pendingFrame.timing;
+    _lastFrameSkew = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        pendingFrame.timing.receiveTime - pendingFrame.firstFinishTime);
+    if (partial)
+        _lastFrameTiming.receiveTime = Clock::now();
+
+    _pendingFrames.pop_front();
     ++_lastFrameComplete;
     return frame;
 }
 
+FrameIndex ReceiveBuffer::getLastFrameIndex() const
+{
+    return _lastFrameComplete;
+}
+
+void ReceiveBuffer::setFrameDeadline(const std::chrono::milliseconds deadline)
+{
+    _frameDeadline = deadline;
+}
+
+std::chrono::milliseconds ReceiveBuffer::getTimeToDeadline() const
+{
+    if (!_hasFrameDeadline() || _pendingFrames.empty() ||
+        _pendingFrames.front().finishedSources.empty())
+    {
+        return std::chrono::milliseconds::max();
+    }
+
+    const auto elapsed = Clock::now() - _pendingFrames.front().firstFinishTime;
+    if (elapsed >= _frameDeadline)
+        return std::chrono::milliseconds::zero();
+
+    // round up so that the deadline has elapsed once the time is waited for
+    const auto remaining = _frameDeadline - elapsed;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        remaining + std::chrono::milliseconds(1) - Clock::duration(1));
+}
+
+const std::vector<size_t>& ReceiveBuffer::getLateSources() const
+{
+    return _lateSources;
+}
+
+bool ReceiveBuffer::_hasFrameDeadline() const
+{
+    return _frameDeadline > std::chrono::milliseconds::zero();
+}
+
+void ReceiveBuffer::_appendLateSourcesTiles(Tiles& frame)
+{
+    for (const auto& kv : _sourceBuffers)
+    {
+        const auto& buffer = kv.second;
+        if (buffer.getBackFrameIndex() > _lastFrameComplete)
+            continue;
+
+        const auto& tiles = buffer.getLastTiles();
+        frame.insert(frame.end(), tiles.begin(), tiles.end());
+        _lateSources.push_back(kv.first);
+    }
+}
+
+const FrameTiming& ReceiveBuffer::getLastFrameTiming() const
+{
+    return _lastFrameTiming;
+}
+
+std::chrono::nanoseconds ReceiveBuffer::getLastFrameSkew() const
+{
+    return _lastFrameSkew;
+}
+
+size_t ReceiveBuffer::getPendingFrameCount() const
+{
+    return _pendingFrames.size();
+}
+
+size_t ReceiveBuffer::getQueueSize(const size_t sourceIndex) const
+{
+    const auto it = _sourceBuffers.find(sourceIndex);
+    return it == _sourceBuffers.end() ? 0 : it->second.getQueueSize();
+}
+
 void ReceiveBuffer::setAllowedToSend(const bool enable)
 {
     _allowedToSend = enable;
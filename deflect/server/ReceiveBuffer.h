@@ -41,10 +41,13 @@
 #define DEFLECT_SERVER_RECEIVEBUFFER_H
 
 #include <deflect/api.h>
+#include <deflect/server/Frame.h>
 #include <deflect/server/SourceBuffer.h>
 
+#include <chrono>
+#include <deque>
 #include <map>
-#include <queue>
+#include <vector>
 
 namespace deflect
 {
@@ -55,6 +58,15 @@ namespace server
  *
  * The buffer aggregates tiles coming from different sources and delivers
  * complete frames.
+ *
+ * Frame completion is tracked incrementally: the buffer records which sources
+ * have finished each pending frame, so that checking for a complete frame does
+ * not depend on the number of sources.
+ *
+ * Optionally, a frame deadline can be set to avoid that a single slow source
+ * holds back the whole stream. Once the deadline has elapsed after the first
+ * source finished a frame, the frame is considered complete and the sources
+ * which are late contribute the tiles of the last frame they finished.
  */
 class ReceiveBuffer
 {
@@ -86,19 +98,76 @@ public:
     /**
      * Call when the source has finished sending tiles for the current frame.
      * @param sourceIndex Unique source identifier
+     * @param sequence the number of the frame given by the source, if any
+     * @param sendTime when the source started sending the frame, if known
      * @throw std::runtime_error if the buffer exceeds its maximum size
      */
-    DEFLECT_API void finishFrameForSource(size_t sourceIndex);
+    DEFLECT_API void finishFrameForSource(
+        size_t sourceIndex, uint64_t sequence = 0,
+        FrameTiming::Clock::time_point sendTime = {});
 
-    /** Does the Buffer have a new complete frame (from all sources) */
+    /**
+     * Does the Buffer have a new complete frame (from all sources, or from
+     * some sources if the frame deadline has elapsed).
+     */
     DEFLECT_API bool hasCompleteFrame() const;
 
     /**
      * Get the finished frame.
-     * @return A collection of tiles that form a frame
+     * @return A collection of tiles that form a frame, empty if no source has
+     *         finished the next frame yet
      */
     DEFLECT_API Tiles popFrame();
 
+    /**
+     * @return the number of frames returned by popFrame() since the first
+     *         source was added.
+     */
+    DEFLECT_API FrameIndex getLastFrameIndex() const;
+
+    /**
+     * Set the maximum time to wait for all sources to finish a frame.
+     * @param deadline time after the first source has finished a frame, zero
+     *        to wait for all sources (default).
+     */
+    DEFLECT_API void setFrameDeadline(std::chrono::milliseconds deadline);
+
+    /**
+     * Get the time left before the next frame is complete because of the
+     * frame deadline.
+     * @return the remaining time, zero if the deadline has elapsed or
+     *         std::chrono::milliseconds::max() if no deadline is pending.
+     */
+    DEFLECT_API std::chrono::milliseconds getTimeToDeadline() const;
+
+    /**
+     * @return the sources which had not finished the last frame returned by
+     *         popFrame(), and whose previous tiles were used instead.
+     */
+    DEFLECT_API const std::vector<size_t>& getLateSources() const;
+
+    /**
+     * @return the timing of the last frame returned by popFrame(), without
+     *         its dispatchTime.
+     */
+    DEFLECT_API const FrameTiming& getLastFrameTiming() const;
+
+    /**
+     * @return the time between the first and the last source finishing the
+     *         last frame returned by popFrame().
+     */
+    DEFLECT_API std::chrono::nanoseconds getLastFrameSkew() const;
+
+    /** @return the number of frames finished by some of the sources. */
+    DEFLECT_API size_t getPendingFrameCount() const;
+
+    /**
+     * @param sourceIndex Unique source identifier
+     * @return the number of frames buffered for the source, including the
+     *         one being received, 0 if the source does not exist.
+     */
+    DEFLECT_API size_t getQueueSize(size_t sourceIndex) const;
+
     /** Allow this buffer to be used by the next
      * FrameDispatcher::sendLatestFrame */
     DEFLECT_API void setAllowedToSend(bool enable);
@@ -107,9 +176,30 @@ public:
     DEFLECT_API bool isAllowedToSend() const;
 
 private:
+    using Clock = std::chrono::steady_clock;
+
+    struct PendingFrame
+    {
+        std::vector<size_t> finishedSources;
+        Clock::time_point firstFinishTime;
+        FrameTiming timing;
+    };
+
     FrameIndex _lastFrameComplete = 0;
     std::map<size_t, SourceBuffer> _sourceBuffers;
+
+    /** Frames finished by at least one source, from _lastFrameComplete+1 */
+    std::deque<PendingFrame> _pendingFrames;
+
+    std::chrono::milliseconds _frameDeadline{0};
+    std::vector<size_t> _lateSources;
+    FrameTiming _lastFrameTiming;
+    std::chrono::nanoseconds _lastFrameSkew{0};
+
     bool _allowedToSend = false;
+
+    bool _hasFrameDeadline() const;
+    void _appendLateSourcesTiles(Tiles& frame);
 };
 }
 }
@@ -40,7 +40,12 @@
 
 #include "Server.h"
 
+#include "Frame.h"
 #include "FrameDispatcher.h"
+#include "FrameRecorder.h"
+#include "FrameRelay.h"
+#include "LoopbackServer.h"
+#include "MetricsExporter.h"
 #include "ServerWorker.h"
 #include "deflect/NetworkProtocol.h"
 
@@ -48,7 +53,21 @@
 #include <QtNetwork/QNetworkProxy>
 #include <QtNetwork/QTcpServer>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <set>
 #include <stdexcept>
+#include <vector>
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 namespace deflect
 {
@@ -56,15 +75,342 @@ namespace server
 {
 const int Server::defaultPortNumber = DEFAULT_PORT_NUMBER;
 
+namespace
+{
+#ifdef SO_REUSEPORT
+std::runtime_error _listenError(const quint16 port, const int error)
+{
+    const auto err = QString("could not listen on port: %1. %2")
+                         .arg(port)
+                         .arg(std::strerror(error));
+    return std::runtime_error(err.toStdString());
+}
+
+/** Open a listening socket which can share its port with other sockets. */
+int _listenReusePort(const quint16 port)
+{
+    // dual-stack like QHostAddress::Any, unless IPv6 is not available
+    int fd = ::socket(AF_INET6, SOCK_STREAM, 0);
+    const bool ipv6 = fd >= 0;
+    if (!ipv6)
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw _listenError(port, errno);
+
+    const int on = 1;
+    const int off = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+    int result = 0;
+    if (ipv6)
+    {
+        ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        sockaddr_in6 address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(port);
+        result = ::bind(fd, (const sockaddr*)&address, sizeof(address));
+    }
+    else
+    {
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        result = ::bind(fd, (const sockaddr*)&address, sizeof(address));
+    }
+
+    if (result < 0 || ::listen(fd, SOMAXCONN) < 0)
+    {
+        const auto error = errno;
+        ::close(fd);
+        throw _listenError(port, error);
+    }
+    return fd;
+}
+
+/** @return the port to which a socket is bound, 0 on error. */
+quint16 _getPort(const int fd)
+{
+    sockaddr_storage address;
+    socklen_t size = sizeof(address);
+    if (::getsockname(fd, (sockaddr*)&address, &size) < 0)
+        return 0;
+
+    if (address.ss_family == AF_INET6)
+        return ntohs(((const sockaddr_in6*)&address)->sin6_port);
+    return ntohs(((const sockaddr_in*)&address)->sin_port);
+}
+#endif
+
+/**
+ * @return a copy of a dispatched frame with the tile positions sent by the
+ *         stream, as the FrameDispatcher mirrored those of bottom_up frames.
+ */
+FramePtr _copyAsSent(const Frame& frame)
+{
+    // the tiles are implicitly shared, the copy only protects the recorded
+    // and relayed frame from the modifications of the application
+    const auto copy = std::make_shared<Frame>(frame);
+    if (copy->determineRowOrder() == RowOrder::bottom_up)
+        copy->mirrorTilesPositionsVertically();
+    return copy;
+}
+
+/** Accept the connections of a listening socket, in the object's thread. */
+class Listener : public QTcpServer
+{
+public:
+    using Handler = std::function<void(qintptr)>;
+
+    explicit Listener(Handler handler)
+        : _handler{std::move(handler)}
+    {
+        setProxy(QNetworkProxy::NoProxy);
+    }
+
+    void incomingConnection(const qintptr socketHandle) final
+    {
+        _handler(socketHandle);
+    }
+
+private:
+    const Handler _handler;
+};
+}
+
 class Server::Impl : public QTcpServer
 {
 public:
-    Impl(const int port, Server* parent_)
+    Impl(const int port, const unsigned int acceptThreads, Server* parent_)
         : QTcpServer(parent_)
         , server{parent_}
         , frameDispatcher{new FrameDispatcher{parent_}}
     {
         setProxy(QNetworkProxy::NoProxy);
+
+        // record and relay the frames before the application may modify them
+        connect(frameDispatcher, &FrameDispatcher::sendFrame, this,
+                [this](const FramePtr frame) {
+                    if (!recorder && _relays.empty())
+                        return;
+                    const auto sentFrame = _copyAsSent(*frame);
+                    _record(*sentFrame);
+                    _forwardToRelays(sentFrame);
+                });
+        connect(frameDispatcher, &FrameDispatcher::pixelStreamClosed, this,
+                [this](const QString uri) {
+                    for (const auto& relay : _relays)
+                        relay.relay->closeStream(uri);
+                });
+#ifdef SO_REUSEPORT
+        if (acceptThreads > 1)
+            _startListeners(quint16(port), acceptThreads);
+        else
+            _listen(port);
+#else
+        Q_UNUSED(acceptThreads);
+        _listen(port);
+#endif
+        _startLoopback();
+    }
+
+    ~Impl()
+    {
+        // stop accepting before closing the connections
+        _loopbackServer.reset();
+        for (auto listenerThread : _listenerThreads)
+        {
+            listenerThread->quit();
+            listenerThread->wait();
+        }
+
+        for (const auto& relay : _relays)
+        {
+            relay.thread->quit();
+            relay.thread->wait();
+        }
+
+        std::set<QThread*> workerThreads;
+        {
+            std::lock_guard<std::mutex> lock(_workerThreadsMutex);
+            workerThreads.swap(_workerThreads);
+        }
+        for (auto workerThread : workerThreads)
+        {
+            workerThread->quit();
+            workerThread->wait();
+            delete workerThread;
+        }
+    }
+
+    /** Re-implemented handling of connections from QTCPSocket. */
+    void incomingConnection(const qintptr socketHandle) final
+    {
+        startWorker(socketHandle);
+    }
+
+    /**
+     * Set up a new connection in a worker thread.
+     * Called from the thread of the Server or from an accept thread.
+     */
+    void startWorker(const qintptr socketHandle)
+    {
+        ++connectionsAccepted;
+        try
+        {
+            _startWorker(new ServerWorker(socketHandle));
+        }
+        catch (const std::runtime_error& e)
+        {
+            emit server->pixelStreamException("", e.what());
+        }
+    }
+
+    /** Set up a new in-process connection in a worker thread. */
+    void startLoopbackWorker(std::shared_ptr<loopback::Channel> channel)
+    {
+        ++connectionsAccepted;
+        _startWorker(new ServerWorker(std::move(channel)));
+    }
+
+    void addRelay(const QString& host, const quint16 port,
+                  const unsigned int maxQueuedFrames)
+    {
+        removeRelay(host, port);
+
+        auto relay = new FrameRelay(host, port, maxQueuedFrames);
+        auto relayThread = new QThread(this);
+        relay->moveToThread(relayThread);
+
+        connect(relayThread, &QThread::finished, relay,
+                &FrameRelay::deleteLater);
+        connect(relayThread, &QThread::finished, relayThread,
+                &QThread::deleteLater);
+        connect(relay, &FrameRelay::connectionError, server,
+                [this, host, port](const QString what) {
+                    emit server->pixelStreamException(
+                        "", QString("relay to %1:%2: %3")
+                                .arg(host)
+                                .arg(port)
+                                .arg(what));
+                });
+
+        _relays.push_back({relay, relayThread});
+        relayThread->start();
+    }
+
+    void removeRelay(const QString& host, const quint16 port)
+    {
+        auto it = std::find_if(_relays.begin(), _relays.end(),
+                               [&host, port](const Relay& relay) {
+                                   return relay.relay->getHost() == host &&
+                                          relay.relay->getPort() == port;
+                               });
+        if (it == _relays.end())
+            return;
+
+        // the relay closes its streams from its thread before it finishes
+        it->thread->quit();
+        it->thread->wait();
+        _relays.erase(it);
+    }
+
+    Server* server = nullptr;
+    FrameDispatcher* frameDispatcher = nullptr; // owned by QObject's parent
+    std::unique_ptr<FrameRecorder> recorder;
+    std::unique_ptr<MetricsExporter> metricsExporter;
+    std::atomic_bool eventCoalescing{true};
+    std::atomic<uint64_t> connectionsAccepted{0};
+    quint16 listeningPort = 0;
+
+    size_t getConnectionCount()
+    {
+        std::lock_guard<std::mutex> lock(_workerThreadsMutex);
+        return _workerThreads.size();
+    }
+
+private:
+    struct Relay
+    {
+        FrameRelay* relay; // deleted once its thread has finished
+        QThread* thread;   // child QObject
+    };
+    std::vector<Relay> _relays;
+
+    void _startWorker(ServerWorker* worker)
+    {
+        worker->setEventCoalescing(eventCoalescing);
+        auto workerThread = new QThread;
+        worker->moveToThread(workerThread);
+
+        connect(workerThread, &QThread::started, worker,
+                &ServerWorker::initConnection);
+        connect(worker, &ServerWorker::connectionClosed, workerThread,
+                &QThread::quit);
+
+        // Make sure the thread will be deleted
+        connect(workerThread, &QThread::finished, worker,
+                &ServerWorker::deleteLater);
+        connect(workerThread, &QThread::finished, this,
+                [this, workerThread] {
+                    std::lock_guard<std::mutex> lock(_workerThreadsMutex);
+                    if (_workerThreads.erase(workerThread))
+                        workerThread->deleteLater();
+                },
+                Qt::DirectConnection);
+
+        // public signals/slots, forwarding from/to worker
+        connect(worker, &ServerWorker::registerToEvents, server,
+                &Server::registerToEvents);
+        connect(worker, &ServerWorker::receivedSizeHints, server,
+                &Server::receivedSizeHints);
+        connect(worker, &ServerWorker::receivedData, server,
+                &Server::receivedData);
+        connect(worker, &ServerWorker::connectionError, server,
+                &Server::pixelStreamException);
+        connect(server, &Server::_closePixelStream, worker,
+                &ServerWorker::closeConnections);
+        connect(server, &Server::_setEventCoalescing, worker,
+                &ServerWorker::setEventCoalescing);
+
+        // FrameDispatcher
+        connect(worker, &ServerWorker::addStreamSource, frameDispatcher,
+                &FrameDispatcher::addSource);
+        connect(frameDispatcher, &FrameDispatcher::sourceRejected, worker,
+                &ServerWorker::closeConnection);
+        connect(worker, &ServerWorker::receivedTile, frameDispatcher,
+                &FrameDispatcher::processTile);
+        connect(worker, &ServerWorker::receivedTiles, frameDispatcher,
+                &FrameDispatcher::processTiles);
+        connect(worker, &ServerWorker::receivedFrameFinished,
+                frameDispatcher, &FrameDispatcher::processFrameFinished);
+        connect(worker, &ServerWorker::removeStreamSource, frameDispatcher,
+                &FrameDispatcher::removeSource);
+        connect(worker, &ServerWorker::addObserver, frameDispatcher,
+                &FrameDispatcher::addObserver);
+        connect(worker, &ServerWorker::removeObserver, frameDispatcher,
+                &FrameDispatcher::removeObserver);
+        connect(frameDispatcher, &FrameDispatcher::framesConsumed, worker,
+                &ServerWorker::acknowledgeFrames);
+        connect(worker, &ServerWorker::sentEvents, frameDispatcher,
+                &FrameDispatcher::processEventsSent);
+
+        // the thread object is deleted from the thread of the Server
+        if (workerThread->thread() != thread())
+            workerThread->moveToThread(thread());
+        {
+            std::lock_guard<std::mutex> lock(_workerThreadsMutex);
+            _workerThreads.insert(workerThread);
+        }
+        workerThread->start();
+    }
+
+    void _listen(const int port)
+    {
         if (!listen(QHostAddress::Any, port))
         {
             const auto err =
@@ -73,82 +419,109 @@ public:
                     .arg(QTcpServer::errorString());
             throw std::runtime_error(err.toStdString());
         }
+        listeningPort = serverPort();
     }
 
-    ~Impl()
+    /** Accept the in-process connections to the port of the Server. */
+    void _startLoopback()
     {
-        for (auto child : children())
-        {
-            if (auto workerThread = qobject_cast<QThread*>(child))
-            {
-                workerThread->quit();
-                workerThread->wait();
-            }
-        }
+        _loopbackServer.reset(new LoopbackServer(listeningPort));
+        connect(_loopbackServer.get(), &LoopbackServer::newConnection, this,
+                [this] {
+                    while (auto channel =
+                               _loopbackServer->nextPendingConnection())
+                        startLoopbackWorker(std::move(channel));
+                },
+                Qt::QueuedConnection);
     }
 
-    /** Re-implemented handling of connections from QTCPSocket. */
-    void incomingConnection(const qintptr socketHandle) final
+    void _record(const Frame& frame)
     {
+        if (!recorder)
+            return;
+
         try
         {
-            auto worker = new ServerWorker(socketHandle);
-            auto workerThread = new QThread(this);
-            worker->moveToThread(workerThread);
-
-            connect(workerThread, &QThread::started, worker,
-                    &ServerWorker::initConnection);
-            connect(worker, &ServerWorker::connectionClosed, workerThread,
-                    &QThread::quit);
-
-            // Make sure the thread will be deleted
-            connect(workerThread, &QThread::finished, worker,
-                    &ServerWorker::deleteLater);
-            connect(workerThread, &QThread::finished, workerThread,
-                    &QThread::deleteLater);
-
-            // public signals/slots, forwarding from/to worker
-            connect(worker, &ServerWorker::registerToEvents, server,
-                    &Server::registerToEvents);
-            connect(worker, &ServerWorker::receivedSizeHints, server,
-                    &Server::receivedSizeHints);
-            connect(worker, &ServerWorker::receivedData, server,
-                    &Server::receivedData);
-            connect(worker, &ServerWorker::connectionError, server,
-                    &Server::pixelStreamException);
-            connect(server, &Server::_closePixelStream, worker,
-                    &ServerWorker::closeConnections);
-
-            // FrameDispatcher
-            connect(worker, &ServerWorker::addStreamSource, frameDispatcher,
-                    &FrameDispatcher::addSource);
-            connect(frameDispatcher, &FrameDispatcher::sourceRejected, worker,
-                    &ServerWorker::closeConnection);
-            connect(worker, &ServerWorker::receivedTile, frameDispatcher,
-                    &FrameDispatcher::processTile);
-            connect(worker, &ServerWorker::receivedFrameFinished,
-                    frameDispatcher, &FrameDispatcher::processFrameFinished);
-            connect(worker, &ServerWorker::removeStreamSource, frameDispatcher,
-                    &FrameDispatcher::removeSource);
-            connect(worker, &ServerWorker::addObserver, frameDispatcher,
-                    &FrameDispatcher::addObserver);
-            connect(worker, &ServerWorker::removeObserver, frameDispatcher,
-                    &FrameDispatcher::removeObserver);
-
-            workerThread->start();
+            recorder->record(frame);
         }
         catch (const std::runtime_error& e)
         {
+            recorder.reset();
             emit server->pixelStreamException("", e.what());
         }
     }
 
-    Server* server = nullptr;
-    FrameDispatcher* frameDispatcher = nullptr; // owned by QObject's parent
+    void _forwardToRelays(const FramePtr& frame)
+    {
+        for (const auto& relay : _relays)
+            relay.relay->forward(frame);
+    }
+
+    std::vector<QThread*> _listenerThreads; // children QObject
+    std::unique_ptr<LoopbackServer> _loopbackServer;
+    std::mutex _workerThreadsMutex;
+    std::set<QThread*> _workerThreads;
+
+#ifdef SO_REUSEPORT
+    void _startListeners(const quint16 port, const unsigned int count)
+    {
+        // open all the sockets first, as any of them may fail
+        std::vector<int> sockets;
+        try
+        {
+            sockets.push_back(_listenReusePort(port));
+            listeningPort = _getPort(sockets.front());
+            while (sockets.size() < count)
+                sockets.push_back(_listenReusePort(listeningPort));
+        }
+        catch (...)
+        {
+            for (const auto fd : sockets)
+                ::close(fd);
+            throw;
+        }
+
+        // adopt them before starting the threads, so that errors are thrown
+        std::vector<std::unique_ptr<Listener>> listeners;
+        for (size_t i = 0; i < sockets.size(); ++i)
+        {
+            listeners.emplace_back(new Listener([this](const qintptr handle) {
+                startWorker(handle);
+            }));
+            if (!listeners.back()->setSocketDescriptor(sockets[i]))
+            {
+                const auto err =
+                    QString("could not listen on port: %1. QTcpServer: %2")
+                        .arg(port)
+                        .arg(listeners.back()->errorString());
+                for (auto j = i; j < sockets.size(); ++j)
+                    ::close(sockets[j]);
+                throw std::runtime_error(err.toStdString());
+            }
+        }
+
+        for (auto& listener : listeners)
+        {
+            auto listenerThread = new QThread(this);
+            listener->moveToThread(listenerThread);
+            connect(listenerThread, &QThread::finished, listener.get(),
+                    &Listener::deleteLater);
+
+            _listenerThreads.push_back(listenerThread);
+            listener.release();
+            listenerThread->start();
+        }
+    }
+#endif
 };
 
 Server::Server(const int port)
-    : _impl(new Impl(port, this))
+    : Server(port, 1)
+{
+}
+
+Server::Server(const int port, const unsigned int acceptThreads)
+    : _impl(new Impl(port, acceptThreads, this))
 {
     // Forward FrameDispatcher signals
     connect(_impl->frameDispatcher, &FrameDispatcher::pixelStreamOpened, this,
@@ -173,7 +546,40 @@ Server::~Server()
 
 quint16 Server::getPort() const
 {
-    return _impl->serverPort();
+    return _impl->listeningPort;
+}
+
+LatencyHistogram Server::getFrameLatency(const QString& uri) const
+{
+    return _impl->frameDispatcher->getFrameLatency(uri);
+}
+
+ServerMetrics Server::getMetrics() const
+{
+    ServerMetrics metrics;
+    metrics.connections = _impl->getConnectionCount();
+    metrics.connectionsAccepted = _impl->connectionsAccepted;
+    metrics.streams = _impl->frameDispatcher->getMetrics();
+    return metrics;
+}
+
+void Server::startMetricsExporter(const quint16 port)
+{
+    _impl->metricsExporter.reset();
+    _impl->metricsExporter.reset(
+        new MetricsExporter(port, [this] {
+            return toPrometheusText(getMetrics());
+        }));
+}
+
+quint16 Server::getMetricsExporterPort() const
+{
+    return _impl->metricsExporter ? _impl->metricsExporter->serverPort() : 0;
+}
+
+void Server::stopMetricsExporter()
+{
+    _impl->metricsExporter.reset();
 }
 
 void Server::requestFrame(const QString uri)
@@ -181,6 +587,47 @@ void Server::requestFrame(const QString uri)
     _impl->frameDispatcher->requestFrame(uri);
 }
 
+void Server::setFrameDeadline(const QString uri,
+                              const unsigned int milliseconds)
+{
+    _impl->frameDispatcher->setFrameDeadline(uri, milliseconds);
+}
+
+void Server::setEventCoalescing(const bool enable)
+{
+    _impl->eventCoalescing = enable;
+    emit _setEventCoalescing(enable);
+}
+
+void Server::addRelay(const QString host, const quint16 port,
+                      const unsigned int maxQueuedFrames)
+{
+    _impl->addRelay(host, port, maxQueuedFrames);
+}
+
+void Server::removeRelay(const QString host, const quint16 port)
+{
+    _impl->removeRelay(host, port);
+}
+
+void Server::startRecording(const QString filename)
+{
+    _impl->recorder.reset();
+    try
+    {
+        _impl->recorder.reset(new FrameRecorder(filename));
+    }
+    catch (const std::runtime_error& e)
+    {
+        emit pixelStreamException("", e.what());
+    }
+}
+
+void Server::stopRecording()
+{
+    _impl->recorder.reset();
+}
+
 void Server::closePixelStream(const QString uri)
 {
     emit _closePixelStream(uri);
@@ -41,8 +41,10 @@
 #ifndef DEFLECT_SERVER_SERVER_H
 #define DEFLECT_SERVER_SERVER_H
 
+#include <deflect/LatencyHistogram.h>
 #include <deflect/SizeHints.h>
 #include <deflect/api.h>
+#include <deflect/server/Metrics.h>
 #include <deflect/server/types.h>
 
 #include <QObject>
@@ -75,12 +77,71 @@ public:
      */
     explicit Server(int port = defaultPortNumber);
 
+    /**
+     * Create a new server accepting Stream connections in several threads.
+     *
+     * Each thread listens on its own socket bound to the same port with
+     * SO_REUSEPORT, and sets up the new connections, so that many sources
+     * connecting at once do not stall the thread of the Server. The kernel
+     * distributes the incoming connections between the sockets (Linux >= 3.9).
+     *
+     * On platforms without SO_REUSEPORT, or if acceptThreads is less than 2,
+     * connections are accepted in the thread of the Server.
+     *
+     * @param port The port to listen on, 0 to let the system choose one.
+     * @param acceptThreads The number of threads accepting connections.
+     * @throw std::runtime_error if the server could not be started.
+     */
+    Server(int port, unsigned int acceptThreads);
+
     /** Stop the server and close all open pixel stream connections. */
     ~Server();
 
     /** @return the port on which the server is running. */
     quint16 getPort() const;
 
+    /**
+     * Get the latency of the frames of a stream, from the moment the sources
+     * started sending them until they were dispatched with receivedFrame().
+     *
+     * Must be called from the thread of the Server. Only the frames of
+     * sources whose clock is synchronized with the server are measured.
+     *
+     * @param uri Identifier for the stream
+     * @return the latency histogram, empty if the stream is not open
+     * @version 1.1
+     */
+    LatencyHistogram getFrameLatency(const QString& uri) const;
+
+    /**
+     * Get the counters of the connections, streams and sources.
+     *
+     * Must be called from the thread of the Server.
+     *
+     * @return the current metrics of the Server.
+     * @version 1.1
+     */
+    ServerMetrics getMetrics() const;
+
+    /**
+     * Serve the metrics over HTTP in the Prometheus text format.
+     *
+     * The metrics are served at http://<host>:<port>/metrics, on all the
+     * network interfaces, from the thread of the Server. An exporter which is
+     * already running is stopped first.
+     *
+     * @param port the port to listen on, 0 to let the system choose one.
+     * @throw std::runtime_error if the port could not be opened.
+     * @version 1.1
+     */
+    void startMetricsExporter(quint16 port);
+
+    /** @return the port of the metrics exporter, 0 if it is not running. */
+    quint16 getMetricsExporterPort() const;
+
+    /** Stop serving the metrics, see startMetricsExporter(). */
+    void stopMetricsExporter();
+
 public slots:
     /**
      * Request the dispatching of the next frame for a given pixel stream.
@@ -95,6 +156,77 @@ public slots:
      */
     void requestFrame(QString uri);
 
+    /**
+     * Set the maximum time to wait for all the sources of a stream to finish a
+     * frame.
+     *
+     * This avoids that a single slow source holds back the whole stream. When
+     * the deadline elapses after the first source has finished a frame, the
+     * frame is dispatched using the previous tiles of the late sources, which
+     * are listed in Frame::lateSources.
+     *
+     * The stream must be open (see pixelStreamOpened()); the setting is reset
+     * when the stream is closed.
+     *
+     * @param uri Identifier for the stream
+     * @param milliseconds the deadline, 0 to wait for all sources (default)
+     */
+    void setFrameDeadline(QString uri, unsigned int milliseconds);
+
+    /**
+     * Enable the coalescing of input events sent to the streams.
+     *
+     * When enabled (default), an EVT_MOVE or EVT_TOUCH_UPDATE event which is
+     * still waiting to be sent to a stream is replaced by a newer one for the
+     * same point, with the dx/dy deltas accumulated. Events are never merged
+     * across any other type of event, so the sequence of the interaction is
+     * preserved.
+     *
+     * @param enable true to coalesce move/update events, false to send every
+     *        event.
+     */
+    void setEventCoalescing(bool enable);
+
+    /**
+     * Forward the frames of all the streams to a downstream Server.
+     *
+     * The frames dispatched by this Server (see requestFrame()) are sent to
+     * the downstream Server with their tiles unchanged, without decoding or
+     * re-encoding them. Each downstream Server is served from its own thread:
+     * when it does not keep up, its frames are dropped without slowing down
+     * this Server or the other downstream Servers.
+     *
+     * @param host the address of the downstream Server
+     * @param port the port of the downstream Server
+     * @param maxQueuedFrames the number of frames per stream waiting to be
+     *        sent to the downstream Server before the oldest one is dropped
+     */
+    void addRelay(QString host, quint16 port, unsigned int maxQueuedFrames = 2);
+
+    /**
+     * Stop forwarding the frames to a downstream Server.
+     *
+     * @param host the address of the downstream Server
+     * @param port the port of the downstream Server
+     */
+    void removeRelay(QString host, quint16 port);
+
+    /**
+     * Record the frames of all the streams to a capture file.
+     *
+     * The frames dispatched by this Server (see requestFrame()) are appended
+     * to the file with their tiles as sent by the streams, see FrameRecorder.
+     * Unlike in the dispatched frames, the positions of bottom_up tiles are
+     * thus not mirrored. A recording in progress is finished first. Errors
+     * are reported by pixelStreamException() and stop the recording.
+     *
+     * @param filename the capture file to create
+     */
+    void startRecording(QString filename);
+
+    /** Finish the current recording, see startRecording(). */
+    void stopRecording();
+
     /**
      * Close a pixel stream, disconnecting the remote client.
      *
@@ -172,6 +304,9 @@ private:
 signals:
     /** @internal */
     void _closePixelStream(QString uri);
+
+    /** @internal */
+    void _setEventCoalescing(bool enable);
 };
 }
 }
@@ -40,23 +40,36 @@
 
 #include "ServerWorker.h"
 
+#include "EventQueue.h"
+#include "LoopbackSocket.h"
 #include "deflect/NetworkProtocol.h"
+#include "deflect/PackedEvent.h"
 #include "deflect/SegmentParameters.h"
+#include "deflect/Trace.h"
 
 #include <QDataStream>
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <stdexcept>
 
 namespace
 {
 const int RECEIVE_TIMEOUT_MS = 3000;
+const int FIRST_PROTOCOL_VERSION_WITH_FRAME_ACK = 9;
+const int FIRST_PROTOCOL_VERSION_WITH_PACKED_EVENTS = 11;
+const int FIRST_PROTOCOL_VERSION_WITH_SESSIONS = 12;
 
 class protocol_error : public std::runtime_error
 {
     using runtime_error::runtime_error;
 };
 
+/** Negative source ids for in-process connections, unlike socket handles. */
+std::atomic<int> _lastLoopbackSourceId{0};
+
 bool _isProtocolStart(const deflect::MessageType messageType)
 {
     return messageType == deflect::MESSAGE_TYPE_PIXELSTREAM_OPEN ||
@@ -80,13 +93,21 @@ ServerWorker::ServerWorker(const int socketDescriptor)
                                  _tcpSocket->errorString().toStdString());
     }
 
+    _socket = _tcpSocket;
     connect(_tcpSocket, &QTcpSocket::disconnected, this,
             &ServerWorker::connectionClosed);
+    _connectSocket();
+}
 
-    connect(_tcpSocket, &QTcpSocket::readyRead, this,
-            &ServerWorker::_processMessages, Qt::QueuedConnection);
-    connect(this, &ServerWorker::_dataAvailable, this,
-            &ServerWorker::_processMessages, Qt::QueuedConnection);
+ServerWorker::ServerWorker(std::shared_ptr<loopback::Channel> channel)
+    : _loopbackSocket{new LoopbackSocket(std::move(channel), this)}
+    , _sourceId{--_lastLoopbackSourceId}
+    , _clientProtocolVersion{NETWORK_PROTOCOL_VERSION}
+{
+    _socket = _loopbackSocket;
+    connect(_loopbackSocket, &LoopbackSocket::disconnected, this,
+            &ServerWorker::connectionClosed);
+    _connectSocket();
 }
 
 ServerWorker::~ServerWorker()
@@ -95,17 +116,19 @@ ServerWorker::~ServerWorker()
     // We still want to remove this source so that the stream does not get stuck
     // if other senders are still active / resp. the window gets closed if no
     // more senders contribute to it.
-    if (_isProtocolStarted())
-        _notifyProtocolEnd();
+    for (const auto& stream : _streams)
+        _notifyProtocolEnd(stream.first, stream.second);
 
     if (_isConnected())
         _sendQuit();
 }
 
-void ServerWorker::processEvent(const Event evt)
+void ServerWorker::_connectSocket()
 {
-    _events.emplace_back(evt);
-    emit _dataAvailable();
+    connect(_socket, &QIODevice::readyRead, this,
+            &ServerWorker::_processMessages, Qt::QueuedConnection);
+    connect(this, &ServerWorker::_dataAvailable, this,
+            &ServerWorker::_processMessages, Qt::QueuedConnection);
 }
 
 void ServerWorker::initConnection()
@@ -113,26 +136,66 @@ void ServerWorker::initConnection()
     _sendProtocolVersion();
 }
 
+void ServerWorker::setEventCoalescing(const bool enable)
+{
+    _coalesceEvents = enable;
+    for (auto& stream : _streams)
+    {
+        if (stream.second.events)
+            stream.second.events->setCoalescing(enable);
+    }
+}
+
 void ServerWorker::closeConnections(const QString uri)
 {
-    if (uri == _streamId)
+    if (!_streams.count(uri))
+        return;
+
+    if (_hasSessions())
+        _closeStream(uri);
+    else
         _terminateConnection();
 }
 
 void ServerWorker::closeConnection(const QString uri, const size_t sourceIndex)
 {
-    if (uri == _streamId && sourceIndex == (size_t)_sourceId)
-        _terminateConnection();
+    if (sourceIndex == (size_t)_sourceId)
+        closeConnections(uri);
+}
+
+void ServerWorker::acknowledgeFrames(const QString uri,
+                                     const unsigned int frameIndex)
+{
+    const auto it = _streams.find(uri);
+    if (it == _streams.end() || it->second.observer ||
+        _clientProtocolVersion < FIRST_PROTOCOL_VERSION_WITH_FRAME_ACK)
+    {
+        return;
+    }
+    _sendFrameAck(uri, frameIndex);
 }
 
 void ServerWorker::_terminateConnection()
 {
-    if (_registeredToEvents)
-        _sendCloseEvent();
+    for (const auto& stream : _streams)
+    {
+        if (stream.second.events)
+            _sendCloseEvent(stream.first);
+    }
 
     emit connectionClosed();
 }
 
+void ServerWorker::_closeStream(const QString& uri)
+{
+    if (_streams[uri].events)
+        _sendCloseEvent(uri);
+
+    // let the client close this stream only, the connection remains open
+    _sendQuit(uri);
+    _stopProtocol(uri);
+}
+
 void ServerWorker::_processMessages()
 {
     if (_socketHasMessage())
@@ -154,15 +217,19 @@ void ServerWorker::_processMessages()
 
 void ServerWorker::_receiveMessage()
 {
+    trace::Span span{"receiveMessage", "server"};
+    trace::setThreadFrame(-1);
+
+    MessageHeader messageHeader;
     try
     {
-        const auto messageHeader = _receiveMessageHeader();
+        messageHeader = _receiveMessageHeader();
         const auto messageBody = _receiveMessageBody(messageHeader.size);
         _handleMessage(messageHeader, messageBody);
     }
     catch (const std::runtime_error& e)
     {
-        emit connectionError(_streamId, e.what());
+        emit connectionError(_getStreamUri(messageHeader), e.what());
         _terminateConnection();
     }
 }
@@ -171,7 +238,7 @@ MessageHeader ServerWorker::_receiveMessageHeader()
 {
     MessageHeader messageHeader;
 
-    QDataStream stream(_tcpSocket);
+    QDataStream stream(_socket);
     stream >> messageHeader;
 
     return messageHeader;
@@ -183,14 +250,14 @@ QByteArray ServerWorker::_receiveMessageBody(const int size)
 
     if (size > 0)
     {
-        messageData = _tcpSocket->read(size);
+        messageData = _socket->read(size);
 
         while (messageData.size() < size)
         {
-            if (!_tcpSocket->waitForReadyRead(RECEIVE_TIMEOUT_MS))
+            if (!_socket->waitForReadyRead(RECEIVE_TIMEOUT_MS))
                 throw std::runtime_error("Timeout reading message data");
 
-            messageData.append(_tcpSocket->read(size - messageData.size()));
+            messageData.append(_socket->read(size - messageData.size()));
         }
     }
 
@@ -199,53 +266,102 @@ QByteArray ServerWorker::_receiveMessageBody(const int size)
 
 bool ServerWorker::_socketHasMessage() const
 {
-    return _tcpSocket->bytesAvailable() >=
+    return _socket->bytesAvailable() >=
            (qint64)MessageHeader::serializedSize;
 }
 
+QString ServerWorker::_getStreamUri(const MessageHeader& messageHeader) const
+{
+    // clients without sessions have a single stream for the connection
+    if (!_hasSessions() && _streams.size() == 1)
+        return _streams.begin()->first;
+
+    return QString(messageHeader.uri);
+}
+
 void ServerWorker::_handleMessage(const MessageHeader& messageHeader,
                                   const QByteArray& byteArray)
 {
-    _validate(messageHeader.type);
+    if (_isProtocolStart(messageHeader.type))
+    {
+        const auto observer =
+            messageHeader.type == MESSAGE_TYPE_OBSERVER_OPEN;
+        _startProtocol(messageHeader.uri, byteArray, observer);
+        return;
+    }
 
-    switch (messageHeader.type)
+    const auto uri = _getStreamUri(messageHeader);
+    const auto it = _streams.find(uri);
+    if (it == _streams.end())
     {
-    case MESSAGE_TYPE_PIXELSTREAM_OPEN:
-        _startProtocol(messageHeader.uri, byteArray, false);
-        break;
+        // the stream was closed by the server while the client was sending
+        if (_hasSessions() && _endedStreams.count(uri))
+            return;
 
-    case MESSAGE_TYPE_OBSERVER_OPEN:
-        _startProtocol(messageHeader.uri, byteArray, true);
-        break;
+        throw protocol_error(
+            std::string("Unexpected message received before protocol start (") +
+            std::to_string((int)messageHeader.type) + ")");
+    }
+    _handleMessage(uri, it->second, messageHeader, byteArray);
+}
+
+void ServerWorker::_handleMessage(const QString& uri, StreamState& stream,
+                                  const MessageHeader& messageHeader,
+                                  const QByteArray& byteArray)
+{
+    trace::setThreadFrame(int64_t(stream.finishedFrames + 1));
 
+    switch (messageHeader.type)
+    {
     case MESSAGE_TYPE_QUIT:
-        _stopProtocol();
+        _stopProtocol(uri);
         break;
 
     case MESSAGE_TYPE_PIXELSTREAM_FINISH_FRAME:
-        emit receivedFrameFinished(_streamId, _sourceId);
+    {
+        // [uint64_t sequence][int64_t sendTime] since protocol version 13
+        quint64 sequence = 0;
+        qint64 sendTime = 0;
+        if (size_t(byteArray.size()) >= sizeof(quint64) + sizeof(qint64))
+        {
+            const auto data = byteArray.constData();
+            sequence = *reinterpret_cast<const quint64*>(data);
+            sendTime = *reinterpret_cast<const qint64*>(data + sizeof(quint64));
+        }
+        stream.finishedFrames =
+            sequence > 0 ? sequence : stream.finishedFrames + 1;
+        emit receivedFrameFinished(uri, _sourceId, sequence, sendTime);
+        break;
+    }
+
+    case MESSAGE_TYPE_PING:
+        _sendPong(uri, byteArray);
         break;
 
     case MESSAGE_TYPE_PIXELSTREAM:
-        emit receivedTile(_streamId, _sourceId, _parseTile(byteArray));
+        emit receivedTile(uri, _sourceId, _parseTile(stream, byteArray));
+        break;
+
+    case MESSAGE_TYPE_PIXELSTREAM_BATCH:
+        emit receivedTiles(uri, _sourceId, _parseTiles(stream, byteArray));
         break;
 
     case MESSAGE_TYPE_SIZE_HINTS:
     {
         const auto hints = reinterpret_cast<const SizeHints*>(byteArray.data());
-        emit receivedSizeHints(_streamId, *hints);
+        emit receivedSizeHints(uri, *hints);
         break;
     }
 
     case MESSAGE_TYPE_DATA:
-        emit receivedData(_streamId, byteArray);
+        emit receivedData(uri, byteArray);
         break;
 
     case MESSAGE_TYPE_IMAGE_VIEW:
     {
         const auto view = reinterpret_cast<const View*>(byteArray.data());
         if (*view >= View::mono && *view <= View::right_eye)
-            _activeView = *view;
+            stream.activeView = *view;
         break;
     }
 
@@ -253,14 +369,14 @@ void ServerWorker::_handleMessage(const MessageHeader& messageHeader,
     {
         const auto order = reinterpret_cast<const RowOrder*>(byteArray.data());
         if (*order >= RowOrder::top_down && *order <= RowOrder::bottom_up)
-            _activeRowOrder = *order;
+            stream.activeRowOrder = *order;
         break;
     }
 
     case MESSAGE_TYPE_IMAGE_CHANNEL:
     {
         const auto channel = reinterpret_cast<const uint8_t*>(byteArray.data());
-        _activeChannel = *channel;
+        stream.activeChannel = *channel;
         break;
     }
 
@@ -268,8 +384,7 @@ void ServerWorker::_handleMessage(const MessageHeader& messageHeader,
     case MESSAGE_TYPE_BIND_EVENTS_EX:
     {
         const auto excl = messageHeader.type == MESSAGE_TYPE_BIND_EVENTS_EX;
-        _tryRegisteringForEvents(excl);
-        _sendBindReply(_registeredToEvents);
+        _sendBindReply(uri, _tryRegisteringForEvents(uri, stream, excl));
         break;
     }
 
@@ -278,61 +393,56 @@ void ServerWorker::_handleMessage(const MessageHeader& messageHeader,
     }
 }
 
-void ServerWorker::_validate(const MessageType messageType) const
-{
-    if (!_isProtocolStarted() && !_isProtocolStart(messageType))
-    {
-        throw protocol_error(
-            std::string("Unexpected message received before protocol start (") +
-            std::to_string((int)messageType) + ")");
-    }
-}
-
 void ServerWorker::_startProtocol(const QString& uri,
                                   const QByteArray& byteArray,
                                   const bool observer)
 {
-    if (_isProtocolStarted())
-        throw protocol_error("Stream protocol was started already");
-
     if (uri.isEmpty())
         throw protocol_error("Can't init stream protocol with empty stream id");
 
-    if (_protocolEnded)
+    _parseClientProtocolVersion(byteArray);
+
+    if (_streams.count(uri) || (!_hasSessions() && !_streams.empty()))
+        throw protocol_error("Stream protocol was started already");
+
+    if (_endedStreams.count(uri) || (!_hasSessions() && !_endedStreams.empty()))
         throw protocol_error("Stream protocol cannot be restarted once ended");
 
-    _streamId = uri;
-    _observer = observer;
-    _parseClientProtocolVersion(byteArray);
+    auto& stream = _streams[uri];
+    stream.observer = observer;
 
-    if (_observer)
-        emit addObserver(_streamId);
+    if (observer)
+        emit addObserver(uri);
     else
-        emit addStreamSource(_streamId, _sourceId);
+        emit addStreamSource(uri, _sourceId);
 }
 
-void ServerWorker::_stopProtocol()
+void ServerWorker::_stopProtocol(const QString& uri)
 {
-    if (!_isProtocolStarted())
+    const auto it = _streams.find(uri);
+    if (it == _streams.end())
         throw protocol_error("Stream protocol had already ended");
 
-    _notifyProtocolEnd();
+    _notifyProtocolEnd(uri, it->second);
 
-    _streamId = QString();
-    _protocolEnded = true;
+    if (it->second.events)
+        it->second.events->deleteLater();
+    _streams.erase(it);
+    _endedStreams.insert(uri);
 }
 
-void ServerWorker::_notifyProtocolEnd()
+void ServerWorker::_notifyProtocolEnd(const QString& uri,
+                                      const StreamState& stream)
 {
-    if (_observer)
-        emit removeObserver(_streamId);
+    if (stream.observer)
+        emit removeObserver(uri);
     else
-        emit removeStreamSource(_streamId, _sourceId);
+        emit removeStreamSource(uri, _sourceId);
 }
 
-bool ServerWorker::_isProtocolStarted() const
+bool ServerWorker::_hasSessions() const
 {
-    return !_streamId.isEmpty();
+    return _clientProtocolVersion >= FIRST_PROTOCOL_VERSION_WITH_SESSIONS;
 }
 
 void ServerWorker::_parseClientProtocolVersion(const QByteArray& message)
@@ -347,98 +457,208 @@ void ServerWorker::_parseClientProtocolVersion(const QByteArray& message)
         _clientProtocolVersion = version;
 }
 
-Tile ServerWorker::_parseTile(const QByteArray& message) const
+Tile ServerWorker::_parseTile(const StreamState& stream,
+                              const QByteArray& message) const
 {
-    Tile tile;
+    const auto params =
+        reinterpret_cast<const SegmentParameters*>(message.data());
+    return _makeTile(stream, *params,
+                     message.right(message.size() - sizeof(SegmentParameters)));
+}
+
+Tiles ServerWorker::_parseTiles(const StreamState& stream,
+                                const QByteArray& message) const
+{
+    Tiles tiles;
 
-    const auto data = message.data();
-    const auto params = reinterpret_cast<const SegmentParameters*>(data);
-    tile.format = params->format;
-    tile.x = params->x;
-    tile.y = params->y;
-    tile.width = params->width;
-    tile.height = params->height;
-    tile.imageData = message.right(message.size() - sizeof(SegmentParameters));
-    tile.view = _activeView;
-    tile.rowOrder = _activeRowOrder;
-    tile.channel = _activeChannel;
+    const auto recordHeaderSize = sizeof(uint32_t) + sizeof(SegmentParameters);
+    const auto data = message.constData();
+    const auto size = size_t(message.size());
+    size_t offset = 0;
+    while (offset < size)
+    {
+        if (size - offset < recordHeaderSize)
+            throw protocol_error("Truncated segment in batch");
+
+        // records are not aligned in the batch
+        uint32_t imageSize = 0;
+        SegmentParameters params;
+        std::memcpy(&imageSize, data + offset, sizeof(uint32_t));
+        std::memcpy(&params, data + offset + sizeof(uint32_t),
+                    sizeof(SegmentParameters));
+        offset += recordHeaderSize;
+
+        if (size - offset < imageSize)
+            throw protocol_error("Truncated segment data in batch");
+
+        tiles.emplace_back(_makeTile(stream, params,
+                                     QByteArray{data + offset,
+                                                int(imageSize)}));
+        offset += imageSize;
+    }
+    return tiles;
+}
 
+Tile ServerWorker::_makeTile(const StreamState& stream,
+                             const SegmentParameters& params,
+                             QByteArray imageData) const
+{
+    Tile tile;
+    tile.format = params.format;
+    tile.x = params.x;
+    tile.y = params.y;
+    tile.width = params.width;
+    tile.height = params.height;
+    tile.imageData = std::move(imageData);
+    tile.view = stream.activeView;
+    tile.rowOrder = stream.activeRowOrder;
+    tile.channel = stream.activeChannel;
     return tile;
 }
 
-void ServerWorker::_tryRegisteringForEvents(const bool exclusive)
+bool ServerWorker::_tryRegisteringForEvents(const QString& uri,
+                                            StreamState& stream,
+                                            const bool exclusive)
 {
-    if (_registeredToEvents)
+    if (stream.events)
         throw protocol_error("The stream has already registered for events");
 
+    auto events = new EventQueue(_coalesceEvents, this);
+    connect(events, &EventQueue::eventsAvailable, this,
+            &ServerWorker::_processMessages, Qt::QueuedConnection);
+
     auto promise = std::make_shared<std::promise<bool>>();
     auto future = promise->get_future();
 
-    emit registerToEvents(_streamId, exclusive, this, std::move(promise));
+    emit registerToEvents(uri, exclusive, events, std::move(promise));
 
+    bool registered = false;
     try
     {
-        _registeredToEvents = future.get();
+        registered = future.get();
     }
     catch (...)
     {
     }
+
+    if (registered)
+        stream.events = events;
+    else
+        delete events;
+    return registered;
 }
 
 void ServerWorker::_sendProtocolVersion()
 {
     const int32_t protocolVersion = NETWORK_PROTOCOL_VERSION;
-    _tcpSocket->write((char*)&protocolVersion, sizeof(int32_t));
+    _socket->write((char*)&protocolVersion, sizeof(int32_t));
     _flushSocket();
 }
 
 void ServerWorker::_sendPendingEvents()
 {
-    for (const auto& evt : _events)
-        _send(evt);
-    _events.clear();
-    _flushSocket();
+    bool sent = false;
+    for (const auto& stream : _streams)
+    {
+        if (!stream.second.events)
+            continue;
+
+        const auto events = stream.second.events->takeEvents();
+        if (events.empty())
+            continue;
+
+        _send(stream.first, events);
+        emit sentEvents(stream.first, events.size());
+        sent = true;
+    }
+
+    // a single flush for the events of all the streams
+    if (sent)
+        _flushSocket();
 }
 
-void ServerWorker::_sendBindReply(const bool successful)
+void ServerWorker::_sendBindReply(const QString& uri, const bool successful)
 {
-    MessageHeader mh(MESSAGE_TYPE_BIND_EVENTS_REPLY, sizeof(bool));
+    MessageHeader mh(MESSAGE_TYPE_BIND_EVENTS_REPLY, sizeof(bool),
+                     uri.toStdString());
     _send(mh);
 
-    _tcpSocket->write((const char*)&successful, sizeof(bool));
+    _socket->write((const char*)&successful, sizeof(bool));
     _flushSocket();
 }
 
-void ServerWorker::_send(const Event& evt)
+void ServerWorker::_sendFrameAck(const QString& uri, const uint32_t frameIndex)
 {
-    // send message header
-    MessageHeader mh(MESSAGE_TYPE_EVENT, Event::serializedSize);
+    MessageHeader mh(MESSAGE_TYPE_FRAME_ACK, sizeof(uint32_t),
+                     uri.toStdString());
     _send(mh);
 
+    _socket->write((const char*)&frameIndex, sizeof(uint32_t));
+    _flushSocket();
+}
+
+void ServerWorker::_sendPong(const QString& uri, const QByteArray& ping)
+{
+    if (size_t(ping.size()) != sizeof(qint64))
+        return;
+
+    // [int64_t clientTime][int64_t serverTime]
+    const qint64 serverTime =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    QByteArray pong = ping;
+    pong.append((const char*)&serverTime, sizeof(qint64));
+
+    _send(MessageHeader(MESSAGE_TYPE_PONG, pong.size(), uri.toStdString()));
+    _socket->write(pong);
+    _flushSocket();
+}
+
+void ServerWorker::_send(const QString& uri, const std::vector<Event>& events)
+{
+    const auto streamUri = uri.toStdString();
+
+    if (_clientProtocolVersion >= FIRST_PROTOCOL_VERSION_WITH_PACKED_EVENTS)
+    {
+        const auto message = packEvents(events);
+        _send(MessageHeader(MESSAGE_TYPE_EVENTS, message.size(), streamUri));
+        _socket->write(message);
+        return;
+    }
+
+    // Serialize the whole batch to write it to the socket at once
+    QByteArray buffer;
+    buffer.reserve(events.size() *
+                   (MessageHeader::serializedSize + Event::serializedSize));
     {
-        QDataStream stream(_tcpSocket);
-        stream << evt;
+        QDataStream stream(&buffer, QIODevice::WriteOnly);
+        const MessageHeader mh(MESSAGE_TYPE_EVENT, Event::serializedSize,
+                               streamUri);
+        for (const auto& evt : events)
+            stream << mh << evt;
     }
-    _flushSocket();
+    _socket->write(buffer);
 }
 
-void ServerWorker::_sendCloseEvent()
+void ServerWorker::_sendCloseEvent(const QString& uri)
 {
     Event closeEvent;
     closeEvent.type = Event::EVT_CLOSE;
-    _send(closeEvent);
+    _send(uri, {closeEvent});
+    _flushSocket();
 }
 
-void ServerWorker::_sendQuit()
+void ServerWorker::_sendQuit(const QString& uri)
 {
-    MessageHeader mh(MESSAGE_TYPE_QUIT, 0);
+    MessageHeader mh(MESSAGE_TYPE_QUIT, 0, uri.toStdString());
     _send(mh);
     _flushSocket();
 }
 
 bool ServerWorker::_send(const MessageHeader& messageHeader)
 {
-    QDataStream stream(_tcpSocket);
+    QDataStream stream(_socket);
     stream << messageHeader;
 
     return stream.status() == QDataStream::Ok;
@@ -446,6 +666,10 @@ bool ServerWorker::_send(const MessageHeader& messageHeader)
 
 void ServerWorker::_flushSocket()
 {
+    // the writes of a LoopbackSocket are never pending
+    if (!_tcpSocket)
+        return;
+
     _tcpSocket->flush();
     while (_tcpSocket->bytesToWrite() > 0 && _isConnected())
         _tcpSocket->waitForBytesWritten();
@@ -453,6 +677,8 @@ void ServerWorker::_flushSocket()
 
 bool ServerWorker::_isConnected() const
 {
+    if (_loopbackSocket)
+        return _loopbackSocket->isConnected();
     return _tcpSocket->state() == QTcpSocket::ConnectedState;
 }
 }
@@ -49,24 +49,48 @@
 
 #include <QtNetwork/QTcpSocket>
 
+#include <map>
+#include <memory>
+#include <set>
+
 namespace deflect
 {
+namespace loopback
+{
+struct Channel;
+}
+
 namespace server
 {
-class ServerWorker : public EventReceiver
+class EventQueue;
+class LoopbackSocket;
+
+/**
+ * Handle the connection of a client, which can carry several streams and
+ * observers.
+ *
+ * Since protocol version 12, the messages of a connection are attributed to
+ * the stream whose id is in the uri of their MessageHeader. Older clients have
+ * a single stream per connection.
+ */
+class ServerWorker : public QObject
 {
     Q_OBJECT
 
 public:
     explicit ServerWorker(int socketDescriptor);
+
+    /** Handle an in-process connection, see loopback::connect(). */
+    explicit ServerWorker(std::shared_ptr<loopback::Channel> channel);
+
     ~ServerWorker();
 
 public slots:
-    void processEvent(Event evt) final;
-
     void initConnection();
+    void setEventCoalescing(bool enable);
     void closeConnections(QString uri);
     void closeConnection(QString uri, size_t sourceIndex);
+    void acknowledgeFrames(QString uri, unsigned int frameIndex);
 
 signals:
     void addStreamSource(QString uri, size_t sourceIndex);
@@ -77,7 +101,10 @@ signals:
 
     void receivedTile(QString uri, size_t sourceIndex,
                       deflect::server::Tile tile);
-    void receivedFrameFinished(QString uri, size_t sourceIndex);
+    void receivedTiles(QString uri, size_t sourceIndex,
+                       deflect::server::Tiles tiles);
+    void receivedFrameFinished(QString uri, size_t sourceIndex,
+                               quint64 sequence, qint64 sendTime);
     void registerToEvents(QString uri, bool exclusive,
                           deflect::server::EventReceiver* receiver,
                           deflect::server::BoolPromisePtr success);
@@ -85,6 +112,8 @@ signals:
 
     void receivedData(QString uri, QByteArray data);
 
+    void sentEvents(QString uri, size_t count);
+
     void connectionClosed();
 
     void connectionError(QString uri, QString what);
@@ -96,49 +125,67 @@ private slots:
     void _processMessages();
 
 private:
-    QTcpSocket* _tcpSocket = nullptr; // child QObject
+    /** A stream or observer opened on the connection. */
+    struct StreamState
+    {
+        bool observer = false;
+        View activeView = View::mono;
+        RowOrder activeRowOrder = RowOrder::top_down;
+        uint8_t activeChannel = 0;
+        EventQueue* events = nullptr; // child QObject, once registered
+        uint64_t finishedFrames = 0;  // last frame sequence, for tracing
+    };
+
+    QIODevice* _socket = nullptr;              // child QObject
+    QTcpSocket* _tcpSocket = nullptr;          // same as _socket, or null
+    LoopbackSocket* _loopbackSocket = nullptr; // same as _socket, or null
     const int _sourceId;
 
-    QString _streamId;
     int _clientProtocolVersion;
-    bool _observer = false;
-
-    bool _registeredToEvents = false;
-    std::vector<Event> _events;
+    bool _coalesceEvents = true;
 
-    View _activeView = View::mono;
-    RowOrder _activeRowOrder = RowOrder::top_down;
-    uint8_t _activeChannel = 0;
-
-    bool _protocolEnded = false;
+    std::map<QString, StreamState> _streams;
+    std::set<QString> _endedStreams;
 
+    void _connectSocket();
     void _terminateConnection();
+    void _closeStream(const QString& uri);
 
     void _receiveMessage();
     MessageHeader _receiveMessageHeader();
     QByteArray _receiveMessageBody(int size);
 
     bool _socketHasMessage() const;
+    QString _getStreamUri(const MessageHeader& messageHeader) const;
     void _handleMessage(const MessageHeader& messageHeader,
                         const QByteArray& message);
-    void _validate(MessageType messageType) const;
+    void _handleMessage(const QString& uri, StreamState& stream,
+                        const MessageHeader& messageHeader,
+                        const QByteArray& message);
     void _startProtocol(const QString& uri, const QByteArray& byteArray,
                         bool observer);
-    void _stopProtocol();
-    void _notifyProtocolEnd();
-    bool _isProtocolStarted() const;
+    void _stopProtocol(const QString& uri);
+    void _notifyProtocolEnd(const QString& uri, const StreamState& stream);
+    bool _hasSessions() const;
 
     void _parseClientProtocolVersion(const QByteArray& message);
-    Tile _parseTile(const QByteArray& message) const;
+    Tile _parseTile(const StreamState& stream, const QByteArray& message) const;
+    Tiles _parseTiles(const StreamState& stream,
+                      const QByteArray& message) const;
+    Tile _makeTile(const StreamState& stream, const SegmentParameters& params,
+                   QByteArray imageData) const;
 
-    void _tryRegisteringForEvents(bool exclusive);
+    bool _tryRegisteringForEvents(const QString& uri, StreamState& stream,
+                                  bool exclusive);
 
     void _sendProtocolVersion();
     void _sendPendingEvents();
-    void _sendBindReply(bool successful);
-    void _send(const Event& evt);
-    void _sendCloseEvent();
-    void _sendQuit();
+    void _sendBindReply(const QString& uri, bool successful);
+    void _sendFrameAck(const QString& uri, uint32_t frameIndex);
+    void _sendPong(const QString& uri, const QByteArray& ping);
+    void _send(const QString& uri, const std::vector<Event>& events);
+    void _sendCloseEvent(const QString& uri);
+    void _sendQuit(const QString& uri = QString());
     bool _send(const MessageHeader& messageHeader);
     void _flushSocket();
     bool _isConnected() const;
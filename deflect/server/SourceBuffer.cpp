@@ -70,6 +70,17 @@ void SourceBuffer::pop()
     _tiles.pop();
 }
 
+void SourceBuffer::popAndRetain()
+{
+    _lastTiles = std::move(_tiles.front());
+    _tiles.pop();
+}
+
+const Tiles& SourceBuffer::getLastTiles() const
+{
+    return _lastTiles;
+}
+
 void SourceBuffer::push()
 {
     _tiles.push(Tiles());
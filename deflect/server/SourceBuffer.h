@@ -78,6 +78,12 @@ public:
     /** Pop the front frame. */
     void pop();
 
+    /** Pop the front frame, retaining its tiles as getLastTiles(). */
+    void popAndRetain();
+
+    /** @return the tiles of the last frame popped by popAndRetain(). */
+    const Tiles& getLastTiles() const;
+
     /** @return the size of the queue. */
     size_t getQueueSize() const;
 
@@ -87,6 +93,9 @@ private:
 
     /** The current indices of the mono/left/right frame for this source. */
     FrameIndex _backFrameIndex = 0u;
+
+    /** The tiles of the last retained frame. */
+    Tiles _lastTiles;
 };
 }
 }
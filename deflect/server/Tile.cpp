@@ -0,0 +1,95 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "Tile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace deflect
+{
+namespace server
+{
+namespace
+{
+uint8_t _clamp(const float value)
+{
+    return uint8_t(std::min(std::max(value + 0.5f, 0.f), 255.f));
+}
+}
+
+void Tile::expandFill(const Format target)
+{
+    if (format != Format::fill)
+        throw std::invalid_argument("Tile is not in fill format");
+    if (imageData.size() != 4)
+        throw std::runtime_error("unexpected fill tile size");
+    if (target != Format::rgba && target != Format::yuv444)
+        throw std::invalid_argument("fill tiles expand to rgba or yuv444");
+
+    const auto rgba = (const uint8_t*)imageData.constData();
+    const size_t pixels = size_t(width) * height;
+
+    QByteArray expanded(int(pixels * (target == Format::rgba ? 4 : 3)),
+                        Qt::Uninitialized);
+    auto out = expanded.data();
+    if (target == Format::yuv444)
+    {
+        // JFIF conversion, as done by libjpeg-turbo
+        const float r = rgba[0];
+        const float g = rgba[1];
+        const float b = rgba[2];
+        const auto y = _clamp(0.299f * r + 0.587f * g + 0.114f * b);
+        const auto u = _clamp(128.f - 0.168736f * r - 0.331264f * g + 0.5f * b);
+        const auto v = _clamp(128.f + 0.5f * r - 0.418688f * g - 0.081312f * b);
+        std::memset(out, y, pixels);
+        std::memset(out + pixels, u, pixels);
+        std::memset(out + 2 * pixels, v, pixels);
+    }
+    else
+    {
+        for (size_t i = 0; i < pixels; ++i, out += 4)
+            std::memcpy(out, rgba, 4);
+    }
+    imageData = expanded;
+    format = target;
+}
+}
+}
@@ -40,6 +40,7 @@
 #ifndef DEFLECT_SERVER_TILE_H
 #define DEFLECT_SERVER_TILE_H
 
+#include <deflect/api.h>
 #include <deflect/server/types.h>
 
 #include <QByteArray>
@@ -79,6 +80,19 @@ struct Tile
     View view = View::mono; //!< Eye pass for the Tile
     uint8_t channel = 0;    //!< Channel for the Tile
     //@}
+
+    /**
+     * Expand the color of a Format::fill tile to a full image.
+     *
+     * This does not need a JPEG decoder, the tiles of a single color can be
+     * expanded by any Server.
+     *
+     * @param target the format of the expanded image, Format::rgba or
+     *        Format::yuv444 (planar, JFIF conversion).
+     * @throw std::invalid_argument if the tile or target format is invalid
+     * @throw std::runtime_error if the tile data is not a single RGBA pixel
+     */
+    DEFLECT_API void expandFill(Format target);
 };
 }
 }
@@ -42,6 +42,8 @@
 #include "ImageJpegDecompressor.h"
 #include "Tile.h"
 
+#include "deflect/Trace.h"
+
 #include <QFuture>
 #include <QtConcurrentRun>
 
@@ -73,6 +75,9 @@ TileDecoder::~TileDecoder()
 
 ChromaSubsampling TileDecoder::decodeType(const Tile& tile)
 {
+    if (tile.format == Format::fill)
+        return ChromaSubsampling::YUV444;
+
     if (tile.format != Format::jpeg)
         throw std::runtime_error("Tile is not in JPEG format");
 
@@ -100,9 +105,18 @@ size_t _getExpectedSize(const Format format, const Tile& tile)
 void _decodeTile(ImageJpegDecompressor* decompressor, Tile* tile,
                  const bool skipRgbConversion)
 {
+    // solid colors are expanded without going through turbojpeg
+    if (tile->format == Format::fill)
+    {
+        tile->expandFill(skipRgbConversion ? Format::yuv444 : Format::rgba);
+        return;
+    }
+
     if (tile->format != Format::jpeg)
         return;
 
+    // may run in a thread pool, the frame of the tile is not known here
+    trace::Span span{"decodeTile", "server", -1, -1};
     QByteArray decodedData;
     Format format;
     try
@@ -63,7 +63,8 @@ public:
     /**
      * Decode the data type of a JPEG tile.
      *
-     * @param tile The tile to decode.
+     * @param tile The tile to decode, fill tiles are reported as YUV444 which
+     *        is what decodeToYUV() expands them to.
      * @throw std::runtime_error if a decompression error occured
      */
     DEFLECT_API ChromaSubsampling decodeType(const Tile& tile);
@@ -71,6 +72,8 @@ public:
     /**
      * Decode a JPEG tile to RGB.
      *
+     * Format::fill tiles are expanded to their color, without JPEG decoding.
+     *
      * @param tile The tile to decode. Upon success, its imageData member
      *        will hold the decompressed RGB image and its "format" flag will
      *        be set to Format::rgba.
@@ -85,7 +88,8 @@ public:
      *
      * @param tile The tile to decode. Upon success, its imageData member
      *        will hold the decompressed YUV image and its "format" flag will
-     *        be set to the matching Format::yuv4**.
+     *        be set to the matching Format::yuv4**, or Format::yuv444 for a
+     *        Format::fill tile.
      * @throw std::runtime_error if a decompression error occured
      */
     DEFLECT_API void decodeToYUV(Tile& tile);
@@ -46,8 +46,10 @@ namespace deflect
 {
 namespace server
 {
+class CaptureReader;
 class EventReceiver;
 class FrameDispatcher;
+class FrameRecorder;
 class TileDecoder;
 class Server;
 
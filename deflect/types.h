@@ -71,6 +71,15 @@ enum class RowOrder
     bottom_up /**< OpenGL image with (0,0) at the bottom-left corner. */
 };
 
+/** Policy of a Stream which is too many frames ahead of the Server. */
+enum class FlowControl
+{
+    off,          /**< Always send frames (default). */
+    block,        /**< Wait until the Server has consumed pending frames. */
+    drop,         /**< Skip frames until the Server has consumed pending ones. */
+    lower_quality /**< Reduce JPEG quality until the Server has caught up. */
+};
+
 /** The possible formats for image data. */
 enum class Format : std::uint8_t
 {
@@ -78,7 +87,8 @@ enum class Format : std::uint8_t
     jpeg = 1,
     yuv444,
     yuv422,
-    yuv420
+    yuv420,
+    fill /**< Solid color, the data is a single RGBA pixel. */
 };
 
 /** Cast an enum class value to its underlying type. */
@@ -0,0 +1,157 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#define BOOST_TEST_MODULE CaptureFileTests
+
+#include <boost/test/unit_test.hpp>
+namespace ut = boost::unit_test;
+
+#include "FrameUtils.h"
+
+#include <deflect/server/CaptureReader.h>
+#include <deflect/server/FrameRecorder.h>
+
+#include <QFile>
+#include <QTemporaryDir>
+
+namespace
+{
+deflect::server::Frame makeRecordedFrame(const int width, const int height,
+                                         const QString& uri)
+{
+    auto frame = makeTestFrame(width, height, 64);
+    frame.uri = uri;
+    uint8_t value = 0;
+    for (auto& tile : frame.tiles)
+    {
+        // odd sizes to exercise the padding of the records
+        tile.imageData = QByteArray(int(tile.width) + 3, char(++value));
+        tile.format = deflect::Format::rgba;
+        tile.rowOrder = deflect::RowOrder::bottom_up;
+        tile.view = deflect::View::right_eye;
+        tile.channel = value % 2;
+    }
+    using Clock = deflect::server::FrameTiming::Clock;
+    frame.timing.sequence = uint64_t(width);
+    frame.timing.sendTime = Clock::time_point{std::chrono::microseconds{10}};
+    frame.timing.receiveTime = Clock::time_point{std::chrono::seconds{height}};
+    frame.timing.dispatchTime = Clock::now();
+    return frame;
+}
+
+void compareRecorded(const deflect::server::Frame& frame1,
+                     const deflect::server::Frame& frame2)
+{
+    compare(frame1, frame2);
+    BOOST_CHECK_EQUAL(frame1.uri.toStdString(), frame2.uri.toStdString());
+    for (size_t i = 0; i < frame1.tiles.size(); ++i)
+    {
+        const auto& t1 = frame1.tiles[i];
+        const auto& t2 = frame2.tiles[i];
+        BOOST_CHECK(t1.format == t2.format);
+        BOOST_CHECK_EQUAL(t1.channel, t2.channel);
+        BOOST_CHECK(t1.imageData == t2.imageData);
+    }
+    BOOST_CHECK_EQUAL(frame1.timing.sequence, frame2.timing.sequence);
+    BOOST_CHECK(frame1.timing.sendTime == frame2.timing.sendTime);
+    BOOST_CHECK(frame1.timing.receiveTime == frame2.timing.receiveTime);
+    BOOST_CHECK(frame1.timing.dispatchTime == frame2.timing.dispatchTime);
+}
+}
+
+BOOST_AUTO_TEST_CASE(recordedFramesAreReadBack)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+    const auto filename = dir.filePath("frames.dcap");
+
+    const auto frame1 = makeRecordedFrame(640, 480, "stream1");
+    const auto frame2 = makeRecordedFrame(100, 70, "stream_2");
+    {
+        deflect::server::FrameRecorder recorder(filename);
+        recorder.record(frame1);
+        recorder.record(frame2);
+        recorder.record(frame1);
+        BOOST_CHECK_EQUAL(recorder.getFrameCount(), 3);
+    }
+
+    deflect::server::CaptureReader reader(filename);
+    BOOST_REQUIRE_EQUAL(reader.getFrameCount(), 3);
+    compareRecorded(reader.getFrame(2), frame1);
+    compareRecorded(reader.getFrame(1), frame2);
+    compareRecorded(reader.getFrame(0), frame1);
+
+    BOOST_CHECK(reader.getTimestamp(0) <= reader.getTimestamp(1));
+    BOOST_CHECK(reader.getTimestamp(1) <= reader.getTimestamp(2));
+    BOOST_CHECK_THROW(reader.getFrame(3), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(recordingInProgressCanBeRead)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+    const auto filename = dir.filePath("frames.dcap");
+
+    const auto frame = makeRecordedFrame(200, 100, "stream");
+    deflect::server::FrameRecorder recorder(filename);
+    recorder.record(frame);
+    recorder.record(frame);
+
+    // no index yet, the reader rebuilds it from the frame records
+    deflect::server::CaptureReader reader(filename);
+    BOOST_REQUIRE_EQUAL(reader.getFrameCount(), 2);
+    compareRecorded(reader.getFrame(1), frame);
+}
+
+BOOST_AUTO_TEST_CASE(invalidCaptureFileIsRejected)
+{
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+    const auto filename = dir.filePath("invalid.dcap");
+
+    QFile file(filename);
+    BOOST_REQUIRE(file.open(QIODevice::WriteOnly));
+    file.write(QByteArray(64, 'x'));
+    file.close();
+
+    BOOST_CHECK_THROW(deflect::server::CaptureReader{filename},
+                      std::runtime_error);
+    BOOST_CHECK_THROW(deflect::server::CaptureReader{dir.filePath("none")},
+                      std::runtime_error);
+}
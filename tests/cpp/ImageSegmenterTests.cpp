@@ -47,6 +47,8 @@ namespace ut = boost::unit_test;
 
 #include <QMutex>
 
+#include <algorithm>
+
 static bool append(deflect::Segments& segments, const deflect::Segment& segment)
 {
     static QMutex lock;
@@ -72,6 +74,7 @@ BOOST_AUTO_TEST_CASE(testImageSegmenterSegmentParameters)
     // clang-format on
 
     deflect::ImageWrapper imageWrapper(data, 4, 8, deflect::RGB);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
 
     deflect::Segments segments;
     const auto appendFunc =
@@ -323,3 +326,176 @@ BOOST_AUTO_TEST_CASE(testImageSegmenterNonUniformSegmentationData)
                                       dataOut + segment.imageData.size());
     }
 }
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterSegmentBoundaries)
+{
+    // clang-format off
+    char dataIn[] =
+    {
+        1,1,1, 2,2,2,   3,3,3, 4,4,4,
+        5,5,5, 6,6,6,   7,7,7, 8,8,8,
+        1,1,1, 2,2,2,   3,3,3, 4,4,4,
+
+        5,5,5, 6,6,6,   7,7,7, 8,8,8,
+        1,1,1, 2,2,2,   3,3,3, 4,4,4,
+        5,5,5, 6,6,6,   7,7,7, 8,8,8
+    };
+    char dataSegmented[4][18] =
+    {
+        {
+        1,1,1, 2,2,2,
+        5,5,5, 6,6,6,
+        1,1,1, 2,2,2
+        },
+        {
+        3,3,3, 4,4,4,
+        7,7,7, 8,8,8,
+        3,3,3, 4,4,4
+        },
+        {
+        5,5,5, 6,6,6,
+        1,1,1, 2,2,2,
+        5,5,5, 6,6,6
+        },
+        {
+        7,7,7, 8,8,8,
+        3,3,3, 4,4,4,
+        7,7,7, 8,8,8
+        }
+    };
+    // clang-format on
+
+    // image positioned at (10, 20) in the stream, with the boundaries between
+    // display nodes at x=12 and y=23 (and outside of the image)
+    deflect::ImageWrapper imageWrapper(dataIn, 4, 6, deflect::RGB, 10, 20);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    deflect::ImageSegmenter segmenter;
+    deflect::Segments segments;
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    segmenter.setNominalSegmentDimensions(3, 5);
+    segmenter.setSegmentBoundaries({12, 0, 100}, {23});
+    segmenter.generate(imageWrapper, appendFunc);
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        const auto& params = segments[i].parameters;
+        BOOST_CHECK_EQUAL(params.x, 10 + 2 * (i % 2));
+        BOOST_CHECK_EQUAL(params.y, 20 + 3 * (i / 2));
+        BOOST_CHECK_EQUAL(params.width, 2);
+        BOOST_CHECK_EQUAL(params.height, 3);
+
+        const char* dataOut = segments[i].imageData.constData();
+        BOOST_CHECK_EQUAL_COLLECTIONS(dataSegmented[i], dataSegmented[i] + 18,
+                                      dataOut,
+                                      dataOut + segments[i].imageData.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterAutoCompressionFormats)
+{
+    // opaque, left half of a single color, right half with a pattern
+    const unsigned int width = 8;
+    const unsigned int height = 4;
+    std::vector<char> data(width * height * 4, 5);
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            if (x >= width / 2)
+                data[(y * width + x) * 4] = char(x * y);
+            data[(y * width + x) * 4 + 3] = char(0xff);
+        }
+    }
+
+    deflect::ImageWrapper imageWrapper(data.data(), width, height,
+                                       deflect::RGBA);
+    BOOST_REQUIRE_EQUAL(imageWrapper.compressionPolicy,
+                        deflect::COMPRESSION_AUTO);
+
+    deflect::ImageSegmenter segmenter;
+    segmenter.setNominalSegmentDimensions(width / 2, height);
+
+    deflect::Segments segments;
+    segmenter.generate(imageWrapper, std::bind(&append, std::ref(segments),
+                                               std::placeholders::_1));
+    BOOST_REQUIRE_EQUAL(segments.size(), 2);
+
+    // segments are computed in parallel, in any order
+    std::sort(segments.begin(), segments.end(),
+              [](const deflect::Segment& a, const deflect::Segment& b) {
+                  return a.parameters.x < b.parameters.x;
+              });
+
+    const auto& fill = segments[0];
+    BOOST_CHECK(fill.parameters.format == deflect::Format::fill);
+    const char color[] = {5, 5, 5, char(0xff)};
+    BOOST_REQUIRE_EQUAL(fill.imageData.size(), 4);
+    const char* colorOut = fill.imageData.constData();
+    BOOST_CHECK_EQUAL_COLLECTIONS(color, color + 4, colorOut, colorOut + 4);
+
+    // uncompressed while the link throughput is unknown
+    const auto& raw = segments[1];
+    BOOST_CHECK(raw.parameters.format == deflect::Format::rgba);
+    BOOST_REQUIRE_EQUAL(raw.imageData.size(), width / 2 * height * 4);
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        const char* rowIn = data.data() + (y * width + width / 2) * 4;
+        const char* rowOut = raw.imageData.constData() + y * width / 2 * 4;
+        BOOST_CHECK_EQUAL_COLLECTIONS(rowIn, rowIn + width / 2 * 4, rowOut,
+                                      rowOut + width / 2 * 4);
+    }
+
+    deflect::StreamStatistics statistics;
+    segmenter.updateStatistics(statistics);
+    BOOST_CHECK_EQUAL(statistics.segmentsSent, 2);
+    BOOST_CHECK_EQUAL(statistics.segmentsFilled, 1);
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterAutoCompressionKeepsAlpha)
+{
+    // translucent, left half of a single color, right half with a pattern
+    const unsigned int width = 8;
+    const unsigned int height = 4;
+    std::vector<char> data(width * height * 4, 5);
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            if (x >= width / 2)
+                data[(y * width + x) * 4] = char(x * y);
+            data[(y * width + x) * 4 + 3] = char(0x80);
+        }
+    }
+
+    deflect::ImageWrapper imageWrapper(data.data(), width, height,
+                                       deflect::RGBA);
+
+    // a link too slow for sending opaque segments uncompressed
+    deflect::ImageSegmenter segmenter;
+    segmenter.setNominalSegmentDimensions(width / 2, height);
+    segmenter.setLinkThroughput(1000.0);
+
+    deflect::Segments segments;
+    segmenter.generate(imageWrapper, std::bind(&append, std::ref(segments),
+                                               std::placeholders::_1));
+    BOOST_REQUIRE_EQUAL(segments.size(), 2);
+    std::sort(segments.begin(), segments.end(),
+              [](const deflect::Segment& a, const deflect::Segment& b) {
+                  return a.parameters.x < b.parameters.x;
+              });
+
+    const auto& fill = segments[0];
+    BOOST_CHECK(fill.parameters.format == deflect::Format::fill);
+    BOOST_REQUIRE_EQUAL(fill.imageData.size(), 4);
+    BOOST_CHECK_EQUAL(fill.imageData.constData()[3], char(0x80));
+
+    // JPEG would lose the alpha channel
+    const auto& raw = segments[1];
+    BOOST_CHECK(raw.parameters.format == deflect::Format::rgba);
+    BOOST_REQUIRE_EQUAL(raw.imageData.size(), width / 2 * height * 4);
+    BOOST_CHECK_EQUAL(raw.imageData.constData()[3], char(0x80));
+}
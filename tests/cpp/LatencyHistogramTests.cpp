@@ -0,0 +1,94 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#define BOOST_TEST_MODULE LatencyHistogramTests
+
+#include <boost/test/unit_test.hpp>
+namespace ut = boost::unit_test;
+
+#include <deflect/LatencyHistogram.h>
+
+using namespace std::chrono;
+
+BOOST_AUTO_TEST_CASE(testEmptyHistogram)
+{
+    const deflect::LatencyHistogram histogram;
+    BOOST_CHECK_EQUAL(histogram.getCount(), 0u);
+    BOOST_CHECK(histogram.getPercentile(50.0) == nanoseconds::zero());
+    BOOST_CHECK(histogram.getMax() == nanoseconds::zero());
+    BOOST_CHECK(histogram.getSum() == nanoseconds::zero());
+}
+
+BOOST_AUTO_TEST_CASE(testPercentilesWithinBucketPrecision)
+{
+    deflect::LatencyHistogram histogram;
+    for (int i = 1; i <= 1000; ++i)
+        histogram.record(milliseconds(i));
+
+    BOOST_CHECK_EQUAL(histogram.getCount(), 1000u);
+    BOOST_CHECK(histogram.getMax() == milliseconds(1000));
+    BOOST_CHECK(histogram.getSum() == milliseconds(500500));
+
+    // buckets have a relative precision of 1/32
+    const auto p50 = duration_cast<microseconds>(histogram.getPercentile(50));
+    BOOST_CHECK_CLOSE(double(p50.count()), 500000.0, 100.0 / 32);
+    const auto p99 = duration_cast<microseconds>(histogram.getPercentile(99));
+    BOOST_CHECK_CLOSE(double(p99.count()), 990000.0, 100.0 / 32);
+
+    BOOST_CHECK(histogram.getPercentile(100) <= histogram.getMax());
+}
+
+BOOST_AUTO_TEST_CASE(testNegativeLatencyCountsAsZero)
+{
+    deflect::LatencyHistogram histogram;
+    histogram.record(milliseconds(-5));
+    BOOST_CHECK_EQUAL(histogram.getCount(), 1u);
+    BOOST_CHECK(histogram.getMax() == nanoseconds::zero());
+    BOOST_CHECK(histogram.getPercentile(50) == nanoseconds::zero());
+}
+
+BOOST_AUTO_TEST_CASE(testClear)
+{
+    deflect::LatencyHistogram histogram;
+    histogram.record(microseconds(42));
+    histogram.clear();
+    BOOST_CHECK_EQUAL(histogram.getCount(), 0u);
+    BOOST_CHECK(histogram.getMax() == nanoseconds::zero());
+    BOOST_CHECK(histogram.getSum() == nanoseconds::zero());
+}
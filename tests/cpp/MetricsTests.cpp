@@ -0,0 +1,126 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#define BOOST_TEST_MODULE MetricsTests
+
+#include <boost/test/unit_test.hpp>
+namespace ut = boost::unit_test;
+
+#include <deflect/server/Metrics.h>
+
+using namespace std::chrono;
+
+namespace
+{
+bool contains(const QByteArray& text, const char* line)
+{
+    return text.contains(QByteArray(line) + '\n');
+}
+}
+
+BOOST_AUTO_TEST_CASE(testServerCountersWithoutStreams)
+{
+    deflect::server::ServerMetrics metrics;
+    metrics.connections = 2;
+    metrics.connectionsAccepted = 5;
+
+    const auto text = deflect::server::toPrometheusText(metrics);
+    BOOST_CHECK(contains(text, "# TYPE deflect_connections gauge"));
+    BOOST_CHECK(contains(text, "deflect_connections 2"));
+    BOOST_CHECK(
+        contains(text, "# TYPE deflect_connections_accepted_total counter"));
+    BOOST_CHECK(contains(text, "deflect_connections_accepted_total 5"));
+    BOOST_CHECK(!text.contains("stream=\""));
+}
+
+BOOST_AUTO_TEST_CASE(testStreamAndSourceSamples)
+{
+    deflect::server::StreamMetrics stream;
+    stream.uri = "test";
+    stream.uptime = seconds(2);
+    stream.tiles = 8;
+    stream.bytes = 1024;
+    stream.framesCompleted = 3;
+    stream.frameLatency.record(milliseconds(10));
+    stream.frameLatency.record(milliseconds(30));
+
+    deflect::server::SourceMetrics source;
+    source.sourceIndex = 7;
+    source.tiles = 8;
+    source.framesFinished = 4;
+    stream.sourceMetrics.push_back(source);
+
+    BOOST_CHECK_EQUAL(stream.getTilesPerSecond(), 4.0);
+    BOOST_CHECK_EQUAL(stream.getBytesPerSecond(), 512.0);
+    BOOST_CHECK_EQUAL(stream.getEventsPerSecond(), 0.0);
+
+    deflect::server::ServerMetrics metrics;
+    metrics.streams.push_back(stream);
+
+    const auto text = deflect::server::toPrometheusText(metrics);
+    BOOST_CHECK(
+        contains(text, "deflect_stream_tiles_total{stream=\"test\"} 8"));
+    BOOST_CHECK(
+        contains(text, "deflect_stream_bytes_total{stream=\"test\"} 1024"));
+    BOOST_CHECK(contains(
+        text, "deflect_stream_frames_completed_total{stream=\"test\"} 3"));
+    BOOST_CHECK(contains(
+        text, "deflect_stream_frame_latency_seconds_count{stream=\"test\"} 2"));
+    BOOST_CHECK(contains(text, "deflect_stream_frame_latency_seconds_sum{"
+                               "stream=\"test\"} 0.04"));
+    BOOST_CHECK(text.contains("deflect_stream_frame_latency_seconds{"
+                              "stream=\"test\",quantile=\"0.99\"} "));
+    BOOST_CHECK(contains(
+        text, "deflect_source_tiles_total{stream=\"test\",source=\"7\"} 8"));
+    BOOST_CHECK(contains(text, "deflect_source_frames_finished_total{"
+                               "stream=\"test\",source=\"7\"} 4"));
+}
+
+BOOST_AUTO_TEST_CASE(testLabelValuesAreEscaped)
+{
+    deflect::server::StreamMetrics stream;
+    stream.uri = "a\"b\\c\nd";
+
+    deflect::server::ServerMetrics metrics;
+    metrics.streams.push_back(stream);
+
+    const auto text = deflect::server::toPrometheusText(metrics);
+    BOOST_CHECK(contains(
+        text, "deflect_stream_tiles_total{stream=\"a\\\"b\\\\c\\nd\"} 0"));
+}
@@ -43,10 +43,13 @@ namespace ut = boost::unit_test;
 
 #include <deflect/Event.h>
 #include <deflect/MessageHeader.h>
+#include <deflect/PackedEvent.h>
 
 #include <QByteArray>
 #include <QDataStream>
 
+#include <algorithm>
+
 BOOST_AUTO_TEST_CASE(testMessageHeaderSerialization)
 {
     QByteArray storage;
@@ -103,3 +106,50 @@ BOOST_AUTO_TEST_CASE(testEventSerialization)
     BOOST_CHECK_EQUAL(eventDeserialized.key, event.key);
     BOOST_CHECK_EQUAL(eventDeserialized.modifiers, event.modifiers);
 }
+
+BOOST_AUTO_TEST_CASE(testPackedEventsSerialization)
+{
+    std::vector<deflect::Event> events(3);
+    events[0].type = deflect::Event::EVT_TOUCH_UPDATE;
+    events[0].mouseX = 0.75;
+    events[0].mouseY = 0.125;
+    events[0].dx = -0.5;
+    events[0].key = 7;
+
+    events[1].type = deflect::Event::EVT_PRESS;
+    events[1].mouseLeft = true;
+    events[1].mouseMiddle = true;
+
+    events[2].type = deflect::Event::EVT_KEY_PRESS;
+    events[2].key = 'Y';
+    events[2].modifiers = Qt::ControlModifier;
+    std::copy_n("Yz!", UNICODE_TEXT_SIZE, events[2].text);
+
+    const auto message = deflect::packEvents(events);
+    BOOST_CHECK_EQUAL(size_t(message.size()), 3 * sizeof(deflect::PackedEvent));
+
+    // decoding must not depend on the alignment of the received data
+    const auto unaligned = QByteArray(" ").append(message).mid(1);
+    const auto eventsDeserialized = deflect::unpackEvents(unaligned);
+    BOOST_REQUIRE_EQUAL(eventsDeserialized.size(), events.size());
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        const auto& event = events[i];
+        const auto& eventDeserialized = eventsDeserialized[i];
+        BOOST_CHECK_EQUAL(eventDeserialized.type, event.type);
+        BOOST_CHECK_EQUAL(eventDeserialized.mouseX, event.mouseX);
+        BOOST_CHECK_EQUAL(eventDeserialized.mouseY, event.mouseY);
+        BOOST_CHECK_EQUAL(eventDeserialized.dx, event.dx);
+        BOOST_CHECK_EQUAL(eventDeserialized.dy, event.dy);
+        BOOST_CHECK_EQUAL(eventDeserialized.mouseLeft, event.mouseLeft);
+        BOOST_CHECK_EQUAL(eventDeserialized.mouseRight, event.mouseRight);
+        BOOST_CHECK_EQUAL(eventDeserialized.mouseMiddle, event.mouseMiddle);
+        BOOST_CHECK_EQUAL(eventDeserialized.key, event.key);
+        BOOST_CHECK_EQUAL(eventDeserialized.modifiers, event.modifiers);
+        BOOST_CHECK(std::equal(event.text, event.text + UNICODE_TEXT_SIZE,
+                               eventDeserialized.text));
+    }
+
+    BOOST_CHECK_THROW(deflect::unpackEvents(message.left(40)),
+                      std::runtime_error);
+}
@@ -44,6 +44,8 @@ namespace ut = boost::unit_test;
 #include <deflect/server/Frame.h>
 #include <deflect/server/ReceiveBuffer.h>
 
+#include <thread>
+
 inline std::ostream& operator<<(std::ostream& str, const QSize& s)
 {
     str << s.width() << 'x' << s.height();
@@ -110,6 +112,41 @@ BOOST_AUTO_TEST_CASE(TestAllowedToSend)
     BOOST_CHECK(!buffer.isAllowedToSend());
 }
 
+BOOST_AUTO_TEST_CASE(TestFrameTimingOfTwoSources)
+{
+    using Clock = deflect::server::FrameTiming::Clock;
+
+    deflect::server::ReceiveBuffer buffer;
+    buffer.addSource(0);
+    buffer.addSource(1);
+
+    const auto start = Clock::now();
+    const auto earlier = start - std::chrono::milliseconds{20};
+
+    buffer.insert(deflect::server::Tile(), 0);
+    buffer.insert(deflect::server::Tile(), 1);
+    buffer.finishFrameForSource(0, 7, start);
+    buffer.finishFrameForSource(1, 8, earlier);
+    BOOST_REQUIRE(buffer.hasCompleteFrame());
+    buffer.popFrame();
+
+    const auto& timing = buffer.getLastFrameTiming();
+    BOOST_CHECK_EQUAL(timing.sequence, 8u);
+    BOOST_CHECK(timing.sendTime == earlier);
+    BOOST_CHECK(timing.receiveTime >= start);
+    BOOST_CHECK(timing.dispatchTime == Clock::time_point());
+
+    // sources which do not know the server clock do not reset the send time
+    buffer.insert(deflect::server::Tile(), 0);
+    buffer.insert(deflect::server::Tile(), 1);
+    buffer.finishFrameForSource(0, 9);
+    buffer.finishFrameForSource(1, 9, start);
+    buffer.popFrame();
+
+    BOOST_CHECK_EQUAL(buffer.getLastFrameTiming().sequence, 9u);
+    BOOST_CHECK(buffer.getLastFrameTiming().sendTime == start);
+}
+
 BOOST_AUTO_TEST_CASE(TestCompleteAFrame)
 {
     const size_t sourceIndex = 46;
@@ -246,6 +283,141 @@ BOOST_AUTO_TEST_CASE(TestCompleteACompositeFrameMultipleSources)
     BOOST_CHECK_EQUAL(frame.computeDimensions(), QSize(192, 768));
 }
 
+BOOST_AUTO_TEST_CASE(TestCompleteFramesManySourcesFinishingOutOfOrder)
+{
+    const size_t sourceCount = 128;
+
+    deflect::server::ReceiveBuffer buffer;
+    for (size_t i = 0; i < sourceCount; ++i)
+        buffer.addSource(i);
+
+    deflect::server::Tile tile;
+    tile.width = 16;
+    tile.height = 16;
+
+    // Even sources are two frames ahead of odd sources
+    for (size_t i = 0; i < sourceCount; i += 2)
+    {
+        for (int frame = 0; frame < 2; ++frame)
+        {
+            buffer.insert(tile, i);
+            buffer.finishFrameForSource(i);
+        }
+    }
+    BOOST_CHECK(!buffer.hasCompleteFrame());
+
+    for (size_t i = 1; i < sourceCount; i += 2)
+    {
+        BOOST_CHECK(!buffer.hasCompleteFrame());
+        buffer.insert(tile, i);
+        buffer.finishFrameForSource(i);
+    }
+    BOOST_REQUIRE(buffer.hasCompleteFrame());
+    BOOST_CHECK_EQUAL(buffer.popFrame().size(), sourceCount);
+    BOOST_CHECK(!buffer.hasCompleteFrame());
+
+    for (size_t i = 1; i < sourceCount; i += 2)
+        buffer.finishFrameForSource(i);
+    BOOST_REQUIRE(buffer.hasCompleteFrame());
+    BOOST_CHECK_EQUAL(buffer.popFrame().size(), sourceCount / 2);
+    BOOST_CHECK(!buffer.hasCompleteFrame());
+    BOOST_CHECK(buffer.popFrame().empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestRemovingLastPendingSourceCompletesFrame)
+{
+    const size_t sourceIndex1 = 46;
+    const size_t sourceIndex2 = 819;
+    const size_t sourceIndex3 = 11;
+
+    deflect::server::ReceiveBuffer buffer;
+    buffer.addSource(sourceIndex1);
+    buffer.addSource(sourceIndex2);
+    buffer.addSource(sourceIndex3);
+
+    const auto testTiles = generateTestTiles();
+
+    buffer.insert(testTiles[0], sourceIndex1);
+    buffer.insert(testTiles[1], sourceIndex2);
+    buffer.insert(testTiles[2], sourceIndex3);
+    buffer.finishFrameForSource(sourceIndex1);
+    buffer.finishFrameForSource(sourceIndex3);
+    BOOST_CHECK(!buffer.hasCompleteFrame());
+
+    buffer.removeSource(sourceIndex2);
+    BOOST_REQUIRE(buffer.hasCompleteFrame());
+    BOOST_CHECK_EQUAL(buffer.popFrame().size(), 2);
+
+    // A finished source which leaves no longer counts for pending frames
+    buffer.insert(testTiles[0], sourceIndex1);
+    buffer.finishFrameForSource(sourceIndex1);
+    buffer.removeSource(sourceIndex1);
+    BOOST_CHECK(!buffer.hasCompleteFrame());
+
+    buffer.insert(testTiles[2], sourceIndex3);
+    buffer.finishFrameForSource(sourceIndex3);
+    BOOST_REQUIRE(buffer.hasCompleteFrame());
+    BOOST_CHECK_EQUAL(buffer.popFrame().size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(TestFrameDeadlineUsesLastTilesOfLateSources)
+{
+    const size_t sourceIndex1 = 46;
+    const size_t sourceIndex2 = 819;
+    const auto deadline = std::chrono::milliseconds{50};
+
+    deflect::server::ReceiveBuffer buffer;
+    buffer.addSource(sourceIndex1);
+    buffer.addSource(sourceIndex2);
+    BOOST_CHECK(buffer.getTimeToDeadline() ==
+                std::chrono::milliseconds::max());
+    buffer.setFrameDeadline(deadline);
+
+    const auto testTiles = generateTestTiles();
+
+    // First frame - both sources
+    buffer.insert(testTiles[0], sourceIndex1);
+    buffer.insert(testTiles[1], sourceIndex2);
+    buffer.finishFrameForSource(sourceIndex1);
+    BOOST_CHECK(buffer.getTimeToDeadline() <= deadline);
+    buffer.finishFrameForSource(sourceIndex2);
+    BOOST_REQUIRE(buffer.hasCompleteFrame());
+    BOOST_CHECK_EQUAL(buffer.popFrame().size(), 2);
+    BOOST_CHECK(buffer.getLateSources().empty());
+
+    // Second frame - source 2 misses the deadline
+    buffer.insert(testTiles[2], sourceIndex1);
+    buffer.finishFrameForSource(sourceIndex1);
+    BOOST_CHECK(!buffer.hasCompleteFrame());
+
+    std::this_thread::sleep_for(deadline + std::chrono::milliseconds{10});
+    BOOST_CHECK(buffer.getTimeToDeadline() == std::chrono::milliseconds::zero());
+    BOOST_REQUIRE(buffer.hasCompleteFrame());
+
+    auto tiles = buffer.popFrame();
+    BOOST_REQUIRE_EQUAL(tiles.size(), 2);
+    BOOST_CHECK_EQUAL(tiles[0].y, testTiles[2].y);
+    BOOST_CHECK_EQUAL(tiles[1].x, testTiles[1].x);
+    BOOST_REQUIRE_EQUAL(buffer.getLateSources().size(), 1);
+    BOOST_CHECK_EQUAL(buffer.getLateSources()[0], sourceIndex2);
+    BOOST_CHECK(!buffer.hasCompleteFrame());
+
+    // Source 2 finishes the second frame late, it is not a new frame
+    buffer.insert(testTiles[3], sourceIndex2);
+    buffer.finishFrameForSource(sourceIndex2);
+    BOOST_CHECK(!buffer.hasCompleteFrame());
+
+    // Third frame - both sources in time again
+    buffer.insert(testTiles[0], sourceIndex1);
+    buffer.insert(testTiles[1], sourceIndex2);
+    buffer.finishFrameForSource(sourceIndex2);
+    buffer.finishFrameForSource(sourceIndex1);
+    BOOST_REQUIRE(buffer.hasCompleteFrame());
+    tiles = buffer.popFrame();
+    BOOST_CHECK_EQUAL(tiles.size(), 2);
+    BOOST_CHECK(buffer.getLateSources().empty());
+}
+
 BOOST_AUTO_TEST_CASE(TestRemoveSourceWhileStreaming)
 {
     const size_t sourceIndex1 = 46;
@@ -0,0 +1,222 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#define BOOST_TEST_MODULE SegmentCacheTests
+#include <boost/test/unit_test.hpp>
+namespace ut = boost::unit_test;
+
+#include <deflect/ImageSegmenter.h>
+#include <deflect/ImageWrapper.h>
+#include <deflect/SegmentCache.h>
+
+#include <QMutex>
+
+#include <vector>
+
+namespace
+{
+const unsigned int width = 64;
+const unsigned int height = 32;
+
+std::vector<char> makePixels(const char seed)
+{
+    std::vector<char> pixels(width * height * 4);
+    for (size_t i = 0; i < pixels.size(); ++i)
+        pixels[i] = char(i * 7 + seed);
+    return pixels;
+}
+
+QByteArray makeData(const int size)
+{
+    return QByteArray(size, 'x');
+}
+}
+
+BOOST_AUTO_TEST_CASE(testKeyDependsOnPixelsAndParametersNotPosition)
+{
+    auto pixels = makePixels(0);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+
+    // the two halves of the image are identical
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        const auto row = pixels.data() + y * width * 4;
+        std::copy(row, row + width * 2, row + width * 2);
+    }
+
+    const QRect left{0, 0, width / 2, height};
+    const QRect right{width / 2, 0, width / 2, height};
+    const auto key = deflect::SegmentCache::makeKey(image, left);
+    BOOST_CHECK(key == deflect::SegmentCache::makeKey(image, right));
+
+    BOOST_CHECK(!(key == deflect::SegmentCache::makeKey(
+                           image, QRect{0, 0, width / 2, height / 2})));
+
+    image.compressionQuality = 50;
+    BOOST_CHECK(!(key == deflect::SegmentCache::makeKey(image, left)));
+    image.compressionQuality = 75;
+
+    image.subsampling = deflect::ChromaSubsampling::YUV420;
+    BOOST_CHECK(!(key == deflect::SegmentCache::makeKey(image, left)));
+    image.subsampling = deflect::ChromaSubsampling::YUV444;
+
+    BOOST_REQUIRE(key == deflect::SegmentCache::makeKey(image, left));
+    ++pixels[width * 4 * (height - 1) + 3];
+    BOOST_CHECK(!(key == deflect::SegmentCache::makeKey(image, left)));
+}
+
+BOOST_AUTO_TEST_CASE(testDisabledCacheNeverHits)
+{
+    const auto pixels = makePixels(0);
+    const deflect::ImageWrapper image(pixels.data(), width, height,
+                                      deflect::RGBA);
+    const auto key =
+        deflect::SegmentCache::makeKey(image, QRect{0, 0, width, height});
+
+    deflect::SegmentCache cache;
+    BOOST_CHECK(!cache.isEnabled());
+
+    cache.insert(key, makeData(10));
+    QByteArray data;
+    BOOST_CHECK(!cache.find(key, data));
+    BOOST_CHECK_EQUAL(cache.getBytes(), 0);
+    BOOST_CHECK_EQUAL(cache.getHits(), 0);
+    BOOST_CHECK_EQUAL(cache.getMisses(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(testLeastRecentlyUsedEntriesAreEvicted)
+{
+    const auto pixels0 = makePixels(0);
+    const auto pixels1 = makePixels(1);
+    const auto pixels2 = makePixels(2);
+    const QRect region{0, 0, width, height};
+    const auto key0 = deflect::SegmentCache::makeKey(
+        deflect::ImageWrapper(pixels0.data(), width, height, deflect::RGBA),
+        region);
+    const auto key1 = deflect::SegmentCache::makeKey(
+        deflect::ImageWrapper(pixels1.data(), width, height, deflect::RGBA),
+        region);
+    const auto key2 = deflect::SegmentCache::makeKey(
+        deflect::ImageWrapper(pixels2.data(), width, height, deflect::RGBA),
+        region);
+
+    deflect::SegmentCache cache(25);
+    cache.insert(key0, makeData(10));
+    cache.insert(key1, makeData(10));
+    BOOST_CHECK_EQUAL(cache.getBytes(), 20);
+
+    QByteArray data;
+    BOOST_REQUIRE(cache.find(key0, data));
+    BOOST_CHECK(data == makeData(10));
+
+    // key1 is now the least recently used
+    cache.insert(key2, makeData(10));
+    BOOST_CHECK_EQUAL(cache.getBytes(), 20);
+    BOOST_CHECK(cache.find(key0, data));
+    BOOST_CHECK(!cache.find(key1, data));
+    BOOST_CHECK(cache.find(key2, data));
+    BOOST_CHECK_EQUAL(cache.getHits(), 3);
+    BOOST_CHECK_EQUAL(cache.getMisses(), 1);
+
+    // too big for the cache
+    cache.insert(key1, makeData(30));
+    BOOST_CHECK(!cache.find(key1, data));
+
+    cache.setMaxBytes(10);
+    BOOST_CHECK_EQUAL(cache.getBytes(), 10);
+    BOOST_CHECK(cache.find(key2, data));
+    BOOST_CHECK(!cache.find(key0, data));
+}
+
+#ifdef DEFLECT_USE_LIBJPEGTURBO
+static bool append(deflect::Segments& segments, const deflect::Segment& segment)
+{
+    static QMutex lock;
+    QMutexLocker locker(&lock);
+    segments.push_back(segment);
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterReusesCachedJpegData)
+{
+    // two identical halves, each made of two segments
+    auto pixels = makePixels(0);
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        const auto row = pixels.data() + y * width * 4;
+        std::copy(row, row + width * 2, row + width * 2);
+    }
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_ON;
+
+    deflect::Segments uncached;
+    deflect::Segments cached;
+    {
+        deflect::ImageSegmenter segmenter;
+        segmenter.setNominalSegmentDimensions(width / 2, height);
+        segmenter.generate(image, std::bind(&append, std::ref(uncached),
+                                            std::placeholders::_1));
+    }
+
+    deflect::ImageSegmenter segmenter;
+    segmenter.setNominalSegmentDimensions(width / 2, height);
+    segmenter.setCacheSize(1024 * 1024);
+    segmenter.generate(image, std::bind(&append, std::ref(cached),
+                                        std::placeholders::_1));
+    segmenter.generate(image, std::bind(&append, std::ref(cached),
+                                        std::placeholders::_1));
+
+    BOOST_REQUIRE_EQUAL(uncached.size(), 2);
+    BOOST_REQUIRE_EQUAL(cached.size(), 4);
+    for (const auto& segment : cached)
+    {
+        BOOST_CHECK(segment.parameters.format == deflect::Format::jpeg);
+        BOOST_CHECK(segment.imageData == uncached[0].imageData);
+    }
+
+    deflect::StreamStatistics statistics;
+    segmenter.updateStatistics(statistics);
+    BOOST_CHECK_EQUAL(statistics.segmentCacheMisses +
+                          statistics.segmentCacheHits,
+                      4);
+    BOOST_CHECK_GE(statistics.segmentCacheHits, 2);
+    BOOST_CHECK_EQUAL(statistics.compressTime.getCount(),
+                      statistics.segmentCacheMisses);
+}
+#endif
@@ -42,19 +42,59 @@
 #include <boost/test/unit_test.hpp>
 namespace ut = boost::unit_test;
 
+#include "CaptureUtils.h"
 #include "DeflectServer.h"
 #include "MinimalGlobalQtApp.h"
 #include "boost_test_thread_safe.h"
 
+#include <deflect/Loopback.h>
+#include <deflect/Session.h>
 #include <deflect/Stream.h>
+#include <deflect/server/CaptureReader.h>
 #include <deflect/server/Frame.h>
 
+#include <QTcpSocket>
+#include <QTemporaryDir>
+
 #include <boost/mpl/vector.hpp>
 #include <cmath>
+#include <condition_variable>
+#include <mutex>
 
 namespace
 {
 const QString testStreamId("teststream");
+
+/** Send a bottom_up frame of two tiles: the lower half, then the upper one. */
+void sendBottomUpFrame(deflect::Stream& stream, const unsigned int size)
+{
+    const std::vector<uint8_t> lower(size * size / 2 * 4, 1);
+    const std::vector<uint8_t> upper(size * size / 2 * 4, 2);
+    for (const auto pixels : {&lower, &upper})
+    {
+        const unsigned int y = pixels == &lower ? 0 : size / 2;
+        deflect::ImageWrapper image(pixels->data(), size, size / 2,
+                                    deflect::RGBA, 0, y);
+        image.compressionPolicy = deflect::COMPRESSION_OFF;
+        image.rowOrder = deflect::RowOrder::bottom_up;
+        stream.send(image);
+    }
+    BOOST_CHECK(stream.finishFrame().get());
+}
+
+/** Check the dispatched positions of the tiles of sendBottomUpFrame(). */
+void checkBottomUpTiles(const deflect::server::Tiles& tiles,
+                        const unsigned int size)
+{
+    BOOST_REQUIRE_EQUAL(tiles.size(), 2);
+    for (const auto& tile : tiles)
+    {
+        BOOST_CHECK(tile.rowOrder == deflect::RowOrder::bottom_up);
+        BOOST_REQUIRE(!tile.imageData.isEmpty());
+        const bool lower = tile.imageData[0] == 1;
+        BOOST_CHECK_EQUAL(tile.y, lower ? size / 2 : 0);
+    }
+}
 }
 
 BOOST_GLOBAL_FIXTURE(MinimalGlobalQtApp);
@@ -207,6 +247,197 @@ BOOST_AUTO_TEST_CASE(oneObserverAndOneStream)
     SAFE_BOOST_CHECK_EQUAL(getReceivedFrames(), expectedFrames);
 }
 
+BOOST_AUTO_TEST_CASE(eventsDeliveredToObserverCallback)
+{
+    deflect::Observer observer(testStreamId.toStdString(), "localhost",
+                               serverPort());
+    BOOST_REQUIRE(observer.isConnected());
+    waitForMessage(); // handle observer open
+
+    BOOST_REQUIRE(observer.registerForEvents(true));
+    waitForMessage();
+
+    std::mutex mutex;
+    std::condition_variable received;
+    std::vector<deflect::Event> events;
+    observer.setEventCallback([&](const deflect::Event& event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(event);
+        received.notify_one();
+    });
+
+    const size_t expectedEvents = 3;
+    deflect::Event event;
+    event.type = deflect::Event::EVT_KEY_PRESS;
+    for (size_t i = 0; i < expectedEvents; ++i)
+    {
+        event.key = i;
+        processEvent(event);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    received.wait_for(lock, std::chrono::seconds(5),
+                      [&] { return events.size() == expectedEvents; });
+    BOOST_REQUIRE_EQUAL(events.size(), expectedEvents);
+    for (size_t i = 0; i < expectedEvents; ++i)
+    {
+        BOOST_CHECK_EQUAL(events[i].type, event.type);
+        BOOST_CHECK_EQUAL(events[i].key, int(i));
+    }
+    BOOST_CHECK(!observer.hasEvent());
+}
+
+BOOST_AUTO_TEST_CASE(queuedEventsDeliveredFirstToObserverCallback)
+{
+    deflect::Observer observer(testStreamId.toStdString(), "localhost",
+                               serverPort());
+    BOOST_REQUIRE(observer.isConnected());
+    waitForMessage(); // handle observer open
+
+    BOOST_REQUIRE(observer.registerForEvents(true));
+    waitForMessage();
+
+    // some events are queued, some in transit when the callback is set
+    const int queuedEvents = 50;
+    const int expectedEvents = 100;
+    deflect::Event event;
+    event.type = deflect::Event::EVT_KEY_PRESS;
+    for (int i = 0; i < queuedEvents; ++i)
+    {
+        event.key = i;
+        processEvent(event);
+    }
+    BOOST_REQUIRE_EQUAL(observer.getEvent().key, 0);
+
+    std::mutex mutex;
+    std::condition_variable received;
+    std::vector<int> keys;
+    observer.setEventCallback([&](const deflect::Event& event_) {
+        std::lock_guard<std::mutex> lock(mutex);
+        keys.push_back(event_.key);
+        received.notify_one();
+    });
+    for (int i = queuedEvents; i < expectedEvents; ++i)
+    {
+        event.key = i;
+        processEvent(event);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    received.wait_for(lock, std::chrono::seconds(5), [&] {
+        return keys.size() == size_t(expectedEvents - 1);
+    });
+    BOOST_REQUIRE_EQUAL(keys.size(), size_t(expectedEvents - 1));
+    for (size_t i = 0; i < keys.size(); ++i)
+        BOOST_CHECK_EQUAL(keys[i], int(i + 1));
+    BOOST_CHECK(!observer.hasEvent());
+}
+
+BOOST_AUTO_TEST_CASE(moveEventsCoalescedPerTouchPoint)
+{
+    deflect::Observer observer(testStreamId.toStdString(), "localhost",
+                               serverPort());
+    BOOST_REQUIRE(observer.isConnected());
+    waitForMessage(); // handle observer open
+
+    BOOST_REQUIRE(observer.registerForEvents(true));
+    waitForMessage();
+
+    std::mutex mutex;
+    std::condition_variable received;
+    std::vector<deflect::Event> events;
+    observer.setEventCallback([&](const deflect::Event& event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(event);
+        received.notify_one();
+    });
+
+    // two touch points moving concurrently, then a release which must not be
+    // merged with the updates that precede it
+    const size_t updates = 100;
+    deflect::Event event;
+    event.type = deflect::Event::EVT_TOUCH_UPDATE;
+    event.dx = 1.0;
+    for (size_t i = 0; i < updates; ++i)
+    {
+        for (int point = 0; point < 2; ++point)
+        {
+            event.key = point;
+            event.mouseX = double(i) / updates;
+            processEvent(event);
+        }
+    }
+    event.type = deflect::Event::EVT_TOUCH_REMOVE;
+    event.key = 0;
+    processEvent(event);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    received.wait_for(lock, std::chrono::seconds(5), [&] {
+        return !events.empty() &&
+               events.back().type == deflect::Event::EVT_TOUCH_REMOVE;
+    });
+    BOOST_REQUIRE(!events.empty());
+    BOOST_REQUIRE_EQUAL(events.back().type, deflect::Event::EVT_TOUCH_REMOVE);
+    BOOST_CHECK_LE(events.size(), 2 * updates + 1);
+
+    // deltas are accumulated and the last position of each point is kept
+    double dx[2] = {0.0, 0.0};
+    double lastX[2] = {-1.0, -1.0};
+    for (size_t i = 0; i < events.size() - 1; ++i)
+    {
+        BOOST_REQUIRE_EQUAL(events[i].type, deflect::Event::EVT_TOUCH_UPDATE);
+        dx[events[i].key] += events[i].dx;
+        lastX[events[i].key] = events[i].mouseX;
+    }
+    for (int point = 0; point < 2; ++point)
+    {
+        BOOST_CHECK_EQUAL(dx[point], double(updates));
+        BOOST_CHECK_EQUAL(lastX[point], double(updates - 1) / updates);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(onlyMotionEventsDroppedWhenObserverLags)
+{
+    deflect::Observer observer(testStreamId.toStdString(), "localhost",
+                               serverPort());
+    BOOST_REQUIRE(observer.isConnected());
+    waitForMessage(); // handle observer open
+
+    BOOST_REQUIRE(observer.registerForEvents(true));
+    waitForMessage();
+
+    // more events than the observer keeps pending, read only at the end
+    const int presses = 5000;
+    deflect::Event event;
+    for (int i = 0; i < presses; ++i)
+    {
+        event.type = deflect::Event::EVT_MOVE;
+        event.mouseX = double(i) / presses;
+        processEvent(event);
+        event.type = deflect::Event::EVT_PRESS;
+        event.key = i;
+        processEvent(event);
+    }
+    event.type = deflect::Event::EVT_CLOSE;
+    processEvent(event);
+
+    uint64_t moves = 0;
+    int nextKey = 0;
+    deflect::Event received = observer.getEvent();
+    for (; received.type == deflect::Event::EVT_MOVE ||
+           received.type == deflect::Event::EVT_PRESS;
+         received = observer.getEvent())
+    {
+        if (received.type == deflect::Event::EVT_MOVE)
+            ++moves;
+        else
+            BOOST_REQUIRE_EQUAL(received.key, nextKey++);
+    }
+    BOOST_CHECK_EQUAL(received.type, deflect::Event::EVT_CLOSE);
+    BOOST_CHECK_EQUAL(nextKey, presses);
+    BOOST_CHECK_LE(moves + observer.getDroppedEventCount(), uint64_t(presses));
+}
+
 BOOST_AUTO_TEST_CASE(closeObserverBeforeStream)
 {
     {
@@ -249,6 +480,270 @@ BOOST_AUTO_TEST_CASE(closeStreamBeforeObserver)
     BOOST_CHECK_EQUAL(getOpenedStreams(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(streamsShareSessionConnection)
+{
+    std::vector<std::string> frameUris;
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        SAFE_BOOST_CHECK_EQUAL(frame->tiles.size(), 1);
+        frameUris.push_back(frame->uri.toStdString());
+    });
+
+    const std::vector<std::string> ids{"stream_a", "stream_b"};
+    {
+        deflect::Session session("localhost", serverPort());
+        BOOST_REQUIRE(session.isConnected());
+
+        deflect::Stream streamA(ids[0], session);
+        deflect::Stream streamB(ids[1], session);
+        BOOST_REQUIRE(streamA.isConnected());
+        BOOST_REQUIRE(streamB.isConnected());
+
+        while (getOpenedStreams() < 2)
+            waitForMessage();
+
+        const unsigned int width = 4;
+        const unsigned int height = 4;
+        const std::vector<uint8_t> pixels(width * height * 4);
+        deflect::ImageWrapper image(pixels.data(), width, height,
+                                    deflect::RGBA);
+
+        for (auto stream : {&streamA, &streamB})
+        {
+            stream->sendAndFinish(image).wait();
+            requestFrame(QString::fromStdString(stream->getId()));
+            waitForMessage();
+        }
+    }
+
+    while (getOpenedStreams() > 0)
+        waitForMessage();
+
+    SAFE_BOOST_CHECK_EQUAL(getReceivedFrames(), 2);
+    BOOST_CHECK_EQUAL_COLLECTIONS(frameUris.begin(), frameUris.end(),
+                                  ids.begin(), ids.end());
+}
+
+BOOST_AUTO_TEST_CASE(wallStreamSendsSegmentsToDisplayNodes)
+{
+    const unsigned int width = 8;
+    const unsigned int height = 8;
+
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        // one segment from each of the two (left and right) display nodes
+        SAFE_BOOST_CHECK_EQUAL(frame->tiles.size(), 2);
+        unsigned int x = 0;
+        for (const auto& tile : frame->tiles)
+        {
+            SAFE_BOOST_CHECK_EQUAL(tile.width, width / 2);
+            SAFE_BOOST_CHECK_EQUAL(tile.height, height);
+            x += tile.x;
+        }
+        SAFE_BOOST_CHECK_EQUAL(x, width / 2);
+    });
+
+    // both display nodes are served by the same test server, each of them
+    // being a source for the stream
+    deflect::DisplayNode left;
+    left.host = "localhost";
+    left.port = serverPort();
+    left.width = width / 2;
+    left.height = height;
+    auto right = left;
+    right.x = width / 2;
+
+    {
+        deflect::Stream stream(testStreamId.toStdString(), {left, right});
+        BOOST_REQUIRE(stream.isConnected());
+        waitForMessage(); // handle stream open
+
+        const std::vector<uint8_t> pixels(width * height * 4);
+        deflect::ImageWrapper image(pixels.data(), width, height,
+                                    deflect::RGBA);
+        BOOST_CHECK(stream.sendAndFinish(image).get());
+        requestFrame(testStreamId);
+        waitForMessage();
+    }
+
+    while (getOpenedStreams() > 0)
+        waitForMessage();
+
+    SAFE_BOOST_CHECK_EQUAL(getReceivedFrames(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(framesRelayedToDownstreamServer)
+{
+    const unsigned int width = 8;
+    const unsigned int height = 8;
+
+    std::vector<deflect::server::Tiles> frames;
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        frames.push_back(frame->tiles);
+    });
+
+    DeflectServer downstream;
+    std::vector<deflect::server::Tiles> relayedFrames;
+    downstream.setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        relayedFrames.push_back(frame->tiles);
+    });
+    addRelay(downstream.serverPort());
+
+    {
+        deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                               serverPort());
+        BOOST_REQUIRE(stream.isConnected());
+        waitForMessage(); // handle stream open
+
+        const std::vector<uint8_t> pixels(width * height * 4);
+        deflect::ImageWrapper image(pixels.data(), width, height,
+                                    deflect::RGBA);
+        BOOST_CHECK(stream.sendAndFinish(image).get());
+        requestFrame(testStreamId);
+        waitForMessage();
+
+        downstream.waitForMessage(); // relayed stream open
+        downstream.requestFrame(testStreamId);
+        downstream.waitForMessage();
+    }
+
+    while (getOpenedStreams() > 0)
+        waitForMessage();
+    while (downstream.getOpenedStreams() > 0)
+        downstream.waitForMessage();
+
+    BOOST_REQUIRE_EQUAL(frames.size(), 1);
+    BOOST_REQUIRE_EQUAL(relayedFrames.size(), 1);
+    const auto& tiles = frames[0];
+    const auto& relayedTiles = relayedFrames[0];
+    BOOST_REQUIRE_EQUAL(relayedTiles.size(), tiles.size());
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(relayedTiles[i].x, tiles[i].x);
+        BOOST_CHECK_EQUAL(relayedTiles[i].y, tiles[i].y);
+        BOOST_CHECK_EQUAL(relayedTiles[i].width, tiles[i].width);
+        BOOST_CHECK_EQUAL(relayedTiles[i].height, tiles[i].height);
+        BOOST_CHECK(relayedTiles[i].format == tiles[i].format);
+        BOOST_CHECK(relayedTiles[i].imageData == tiles[i].imageData);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bottomUpFramesRelayedToDownstreamServer)
+{
+    const unsigned int size = 8;
+
+    std::vector<deflect::server::Tiles> frames;
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        frames.push_back(frame->tiles);
+    });
+
+    DeflectServer downstream;
+    std::vector<deflect::server::Tiles> relayedFrames;
+    downstream.setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        relayedFrames.push_back(frame->tiles);
+    });
+    addRelay(downstream.serverPort());
+
+    {
+        deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                               serverPort());
+        BOOST_REQUIRE(stream.isConnected());
+        waitForMessage(); // handle stream open
+
+        sendBottomUpFrame(stream, size);
+        requestFrame(testStreamId);
+        waitForMessage();
+
+        downstream.waitForMessage(); // relayed stream open
+        downstream.requestFrame(testStreamId);
+        downstream.waitForMessage();
+    }
+
+    while (getOpenedStreams() > 0)
+        waitForMessage();
+    while (downstream.getOpenedStreams() > 0)
+        downstream.waitForMessage();
+
+    // both Servers dispatch the tiles at the same mirrored positions
+    BOOST_REQUIRE_EQUAL(frames.size(), 1);
+    BOOST_REQUIRE_EQUAL(relayedFrames.size(), 1);
+    checkBottomUpTiles(frames[0], size);
+    checkBottomUpTiles(relayedFrames[0], size);
+}
+
+BOOST_AUTO_TEST_CASE(bottomUpFramesRecordedAndReplayedAsSentByStream)
+{
+    const unsigned int size = 8;
+
+    QTemporaryDir dir;
+    BOOST_REQUIRE(dir.isValid());
+    const auto filename = dir.filePath("frames.dcap");
+    startRecording(filename);
+
+    deflect::server::Tiles dispatchedTiles;
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        dispatchedTiles = frame->tiles;
+    });
+
+    {
+        deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                               serverPort());
+        BOOST_REQUIRE(stream.isConnected());
+        waitForMessage(); // handle stream open
+
+        sendBottomUpFrame(stream, size);
+        requestFrame(testStreamId);
+        waitForMessage();
+    }
+    while (getOpenedStreams() > 0)
+        waitForMessage();
+    stopRecording();
+    checkBottomUpTiles(dispatchedTiles, size);
+
+    deflect::server::CaptureReader reader(filename);
+    BOOST_REQUIRE_EQUAL(reader.getFrameCount(), 1);
+    const auto frame = reader.getFrame(0);
+    BOOST_REQUIRE_EQUAL(frame.tiles.size(), 2);
+    for (const auto& tile : frame.tiles)
+    {
+        BOOST_REQUIRE(!tile.imageData.isEmpty());
+        const bool lower = tile.imageData[0] == 1;
+        BOOST_CHECK_EQUAL(tile.y, lower ? 0 : size / 2);
+    }
+
+    // replaying the recorded tiles to a Server dispatches the original frame
+    DeflectServer target;
+    deflect::server::Tiles replayedTiles;
+    target.setFrameReceivedCallback([&](deflect::server::FramePtr frame_) {
+        replayedTiles = frame_->tiles;
+    });
+    {
+        deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                               target.serverPort());
+        BOOST_REQUIRE(stream.isConnected());
+        target.waitForMessage(); // handle stream open
+
+        for (const auto& tile : frame.tiles)
+        {
+            const auto segment = makeReplaySegment(tile);
+            const auto& params = segment.parameters;
+            BOOST_REQUIRE(params.format == deflect::Format::rgba);
+            deflect::ImageWrapper image(segment.imageData.constData(),
+                                        params.width, params.height,
+                                        deflect::RGBA, params.x, params.y);
+            image.compressionPolicy = deflect::COMPRESSION_OFF;
+            image.rowOrder = segment.rowOrder;
+            image.view = segment.view;
+            image.channel = segment.channel;
+            stream.send(image);
+        }
+        BOOST_CHECK(stream.finishFrame().get());
+        target.requestFrame(testStreamId);
+        target.waitForMessage();
+    }
+    while (target.getOpenedStreams() > 0)
+        target.waitForMessage();
+    checkBottomUpTiles(replayedTiles, size);
+}
+
 struct Fixture1 : public DeflectServer
 {
     bool requestBeforeSource{true};
@@ -470,4 +965,298 @@ BOOST_AUTO_TEST_CASE(uncompressedImages)
     BOOST_CHECK_EQUAL(getReceivedFrames(), expectedFrames);
 }
 
+BOOST_AUTO_TEST_CASE(smallSegmentsOfDifferentViewsInSameFrame)
+{
+    const unsigned int size = 8;
+    const std::vector<uint8_t> pixels(size * size * 4);
+
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        SAFE_BOOST_REQUIRE_EQUAL(frame->tiles.size(), 4);
+        for (const auto& tile : frame->tiles)
+        {
+            const auto view = tile.x < 2 * size ? deflect::View::left_eye
+                                                : deflect::View::right_eye;
+            SAFE_BOOST_CHECK(tile.view == view);
+        }
+    });
+
+    deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                           serverPort());
+    BOOST_REQUIRE(stream.isConnected());
+    waitForMessage(); // handle stream open
+
+    // small images are sent together in the same message when possible
+    for (const auto view : {deflect::View::left_eye, deflect::View::right_eye})
+    {
+        const unsigned int x = view == deflect::View::left_eye ? 0 : 2 * size;
+        for (const auto offset : {0u, size})
+        {
+            deflect::ImageWrapper image(pixels.data(), size, size,
+                                        deflect::RGBA, x + offset);
+            image.compressionPolicy = deflect::COMPRESSION_OFF;
+            image.view = view;
+            stream.send(image);
+        }
+    }
+    BOOST_CHECK(stream.finishFrame().get());
+
+    requestFrame(testStreamId);
+    waitForMessage();
+    BOOST_CHECK_EQUAL(getReceivedFrames(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(framesAreDroppedUntilConsumedByServer)
+{
+    const unsigned int width = 4;
+    const unsigned int height = 4;
+    const std::vector<uint8_t> pixels(width * height * 4);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                           serverPort());
+    BOOST_REQUIRE(stream.isConnected());
+    waitForMessage(); // handle stream open
+
+    stream.setFlowControl(deflect::FlowControl::drop, 1);
+
+    BOOST_CHECK(stream.sendAndFinish(image).get());
+    BOOST_CHECK_EQUAL(stream.getPendingFrames(), 1);
+
+    // the first frame was not requested by the server yet
+    BOOST_CHECK(stream.sendAndFinish(image).get());
+    BOOST_CHECK_EQUAL(stream.getPendingFrames(), 1);
+
+    requestFrame(testStreamId);
+    waitForMessage();
+    BOOST_CHECK_EQUAL(getReceivedFrames(), 1);
+
+    while (stream.getPendingFrames() > 0)
+        ;
+
+    BOOST_CHECK(stream.sendAndFinish(image).get());
+    BOOST_CHECK_EQUAL(stream.getPendingFrames(), 1);
+
+    requestFrame(testStreamId);
+    waitForMessage();
+    BOOST_CHECK_EQUAL(getReceivedFrames(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(frameTimingMeasuredFromSourceToDispatch)
+{
+    using Clock = deflect::server::FrameTiming::Clock;
+
+    std::vector<deflect::server::FrameTiming> timings;
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        timings.push_back(frame->timing);
+    });
+
+    const unsigned int width = 4;
+    const unsigned int height = 4;
+    const std::vector<uint8_t> pixels(width * height * 4);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                           serverPort());
+    BOOST_REQUIRE(stream.isConnected());
+    waitForMessage(); // handle stream open
+
+    const size_t frameCount = 3;
+    for (size_t i = 0; i < frameCount; ++i)
+    {
+        BOOST_CHECK(stream.sendAndFinish(image).get());
+        requestFrame(testStreamId);
+        waitForMessage();
+    }
+
+    BOOST_REQUIRE_EQUAL(timings.size(), frameCount);
+    for (size_t i = 0; i < frameCount; ++i)
+    {
+        const auto& timing = timings[i];
+        BOOST_CHECK_EQUAL(timing.sequence, i + 1);
+        BOOST_CHECK(timing.receiveTime <= timing.dispatchTime);
+
+        // only known once the clock of the stream is synchronized
+        if (timing.sendTime != Clock::time_point())
+            BOOST_CHECK(timing.sendTime <= timing.receiveTime);
+    }
+
+    // all the frames were acknowledged once the server has requested them
+    while (stream.getPendingFrames() > 0)
+        ;
+    BOOST_CHECK_EQUAL(stream.getFrameLatency().getCount(), frameCount);
+}
+
+BOOST_AUTO_TEST_CASE(streamStatisticsCountFramesAndSegments)
+{
+    const unsigned int width = 4;
+    const unsigned int height = 4;
+    const std::vector<uint8_t> pixels(width * height * 4);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                           serverPort());
+    BOOST_REQUIRE(stream.isConnected());
+    waitForMessage(); // handle stream open
+
+    stream.setFlowControl(deflect::FlowControl::drop, 1);
+
+    BOOST_CHECK(stream.sendAndFinish(image).get());
+    // dropped, the first frame was not requested by the server yet
+    BOOST_CHECK(stream.sendAndFinish(image).get());
+
+    const auto statistics = stream.getStatistics();
+    BOOST_CHECK_EQUAL(statistics.framesSent, 1);
+    BOOST_CHECK_EQUAL(statistics.framesDropped, 1);
+    BOOST_CHECK_EQUAL(statistics.framesFailed, 0);
+    BOOST_CHECK_EQUAL(statistics.segmentsSent, 1);
+    BOOST_CHECK_EQUAL(statistics.rawBytes, pixels.size());
+    BOOST_CHECK_EQUAL(statistics.getCompressionRatio(), 1.0);
+    BOOST_CHECK_EQUAL(statistics.compressTime.getCount(), 0);
+    BOOST_CHECK(statistics.sendQueueWaitTime.getCount() > 0);
+    BOOST_CHECK(statistics.bytesWritten > pixels.size());
+    BOOST_CHECK(statistics.getWriteThroughput() > 0.0);
+
+    requestFrame(testStreamId);
+    waitForMessage();
+    BOOST_CHECK_EQUAL(getReceivedFrames(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(serverMetricsCountStreamsAndSources)
+{
+    const unsigned int width = 4;
+    const unsigned int height = 4;
+    const std::vector<uint8_t> pixels(width * height * 4);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                           serverPort());
+    BOOST_REQUIRE(stream.isConnected());
+    waitForMessage(); // handle stream open
+
+    const size_t frameCount = 2;
+    for (size_t i = 0; i < frameCount; ++i)
+    {
+        BOOST_CHECK(stream.sendAndFinish(image).get());
+        requestFrame(testStreamId);
+        waitForMessage();
+    }
+
+    const auto metrics = getMetrics();
+    BOOST_CHECK_EQUAL(metrics.connections, 1);
+    BOOST_CHECK_EQUAL(metrics.connectionsAccepted, 1);
+    BOOST_REQUIRE_EQUAL(metrics.streams.size(), 1);
+
+    const auto& streamMetrics = metrics.streams[0];
+    BOOST_CHECK_EQUAL(streamMetrics.uri.toStdString(),
+                      testStreamId.toStdString());
+    BOOST_CHECK_EQUAL(streamMetrics.sources, 1);
+    BOOST_CHECK_EQUAL(streamMetrics.tiles, frameCount);
+    BOOST_CHECK_EQUAL(streamMetrics.bytes, frameCount * pixels.size());
+    BOOST_CHECK_EQUAL(streamMetrics.framesCompleted, frameCount);
+    BOOST_CHECK_EQUAL(streamMetrics.framesDropped, 0);
+    BOOST_CHECK_EQUAL(streamMetrics.frameLatency.getCount(), frameCount);
+    BOOST_CHECK(streamMetrics.getTilesPerSecond() > 0.0);
+    BOOST_REQUIRE_EQUAL(streamMetrics.sourceMetrics.size(), 1);
+    BOOST_CHECK_EQUAL(streamMetrics.sourceMetrics[0].tiles, frameCount);
+    BOOST_CHECK_EQUAL(streamMetrics.sourceMetrics[0].framesFinished,
+                      frameCount);
+
+    const auto exporterPort = startMetricsExporter();
+    BOOST_REQUIRE(exporterPort != 0);
+
+    QTcpSocket socket;
+    socket.connectToHost("localhost", exporterPort);
+    BOOST_REQUIRE(socket.waitForConnected());
+    socket.write("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    QByteArray reply;
+    while (socket.waitForReadyRead())
+        reply += socket.readAll();
+    reply += socket.readAll();
+
+    BOOST_CHECK(reply.startsWith("HTTP/1.1 200 OK\r\n"));
+    const auto framesCompleted =
+        "deflect_stream_frames_completed_total{stream=\"" +
+        testStreamId.toUtf8() + "\"} 2\n";
+    BOOST_CHECK(reply.contains(framesCompleted));
+}
+
+BOOST_AUTO_TEST_CASE(streamThroughInProcessTransport)
+{
+    const unsigned int width = 8;
+    const unsigned int height = 8;
+    std::vector<uint8_t> pixels(width * height * 4);
+    for (size_t i = 0; i < pixels.size(); ++i)
+        pixels[i] = uint8_t(i);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        SAFE_BOOST_CHECK_EQUAL(frame->tiles.size(), 1);
+        if (frame->tiles.empty())
+            return;
+        const auto& data = frame->tiles[0].imageData;
+        SAFE_BOOST_CHECK(std::equal(pixels.begin(), pixels.end(),
+                                    (const uint8_t*)data.constData()));
+    });
+
+    BOOST_CHECK_THROW(deflect::Stream(testStreamId.toStdString(),
+                                      deflect::loopback::HOST,
+                                      serverPort() + 1),
+                      std::runtime_error);
+
+    const size_t frameCount = 2;
+    {
+        deflect::Stream stream(testStreamId.toStdString(),
+                               deflect::loopback::HOST, serverPort());
+        BOOST_REQUIRE(stream.isConnected());
+        waitForMessage(); // handle stream open
+        BOOST_CHECK_EQUAL(getOpenedStreams(), 1);
+
+        for (size_t i = 0; i < frameCount; ++i)
+        {
+            BOOST_CHECK(stream.sendAndFinish(image).get());
+            requestFrame(testStreamId);
+            waitForMessage();
+        }
+    }
+    waitForMessage(); // handle stream close
+    BOOST_CHECK_EQUAL(getReceivedFrames(), frameCount);
+    BOOST_CHECK_EQUAL(getOpenedStreams(), 0);
+}
+
+struct AcceptThreadsFixture : public DeflectServer
+{
+    AcceptThreadsFixture()
+        : DeflectServer(4)
+    {
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(streamsConnectThroughAcceptThreads,
+                        AcceptThreadsFixture)
+{
+    const size_t streamCount = 16;
+    {
+        std::vector<std::unique_ptr<deflect::Stream>> streams;
+        for (size_t i = 0; i < streamCount; ++i)
+        {
+            const auto id = testStreamId.toStdString() + std::to_string(i);
+            streams.emplace_back(
+                new deflect::Stream(id, "localhost", serverPort()));
+            BOOST_REQUIRE(streams.back()->isConnected());
+        }
+
+        while (getOpenedStreams() < streamCount)
+            waitForMessage();
+        BOOST_CHECK_EQUAL(getOpenedStreams(), streamCount);
+    }
+
+    while (getOpenedStreams() > 0)
+        waitForMessage();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
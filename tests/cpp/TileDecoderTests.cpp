@@ -50,7 +50,10 @@ namespace ut = boost::unit_test;
 #include <deflect/server/TileDecoder.h>
 
 #include <QMutex>
+
+#include <algorithm>
 #include <cmath> // std::round
+#include <cstdlib>
 
 namespace
 {
@@ -104,6 +107,23 @@ std::vector<char> makeTestImage()
     return data;
 }
 
+std::vector<char> makeGradientImage()
+{
+    std::vector<char> data;
+    data.reserve(8 * 8 * 4);
+    for (size_t y = 0; y < 8; ++y)
+    {
+        for (size_t x = 0; x < 8; ++x)
+        {
+            data.push_back(char(92 + 2 * y)); // R
+            data.push_back(char(28 + x));     // G
+            data.push_back(0);                // B
+            data.push_back(-1);               // A
+        }
+    }
+    return data;
+}
+
 BOOST_AUTO_TEST_CASE(testImageCompressionAndDecompression)
 {
     // Vector of RGBA data
@@ -242,12 +262,13 @@ static bool append(deflect::Segments& segments, const deflect::Segment& segment)
 
 BOOST_AUTO_TEST_CASE(testImageSegmentationWithCompressionAndDecompression)
 {
-    // Vector of rgba data
-    const auto data = makeTestImage();
+    // Vector of rgba data, not of a single color to be compressed in JPEG
+    const auto data = makeGradientImage();
 
     // Compress image
     deflect::ImageWrapper imageWrapper(data.data(), 8, 8, deflect::RGBA);
     imageWrapper.compressionPolicy = deflect::COMPRESSION_ON;
+    imageWrapper.compressionQuality = 100;
 
     deflect::Segments segments;
     deflect::ImageSegmenter segmenter;
@@ -272,7 +293,44 @@ BOOST_AUTO_TEST_CASE(testImageSegmentationWithCompressionAndDecompression)
     decoder.startDecoding(tile);
     decoder.waitDecoding();
 
-    // Check decoded image in format RGBA
+    // Check decoded image in format RGBA, JPEG is lossy even at quality 100
+    BOOST_REQUIRE_EQUAL(tile.format, deflect::Format::rgba);
+    BOOST_REQUIRE_EQUAL(tile.imageData.size(), data.size());
+
+    const auto dataOut = (const uint8_t*)tile.imageData.constData();
+    for (size_t i = 0; i < data.size(); ++i)
+        BOOST_CHECK_LE(std::abs(int(dataOut[i]) - uint8_t(data[i])), 4);
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmentationWithFillAndDecoding)
+{
+    // Vector of rgba data of a single color
+    const auto data = makeTestImage();
+
+    deflect::ImageWrapper imageWrapper(data.data(), 8, 8, deflect::RGBA);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_ON;
+
+    deflect::Segments segments;
+    deflect::ImageSegmenter segmenter;
+    segmenter.generate(imageWrapper, std::bind(&append, std::ref(segments),
+                                               std::placeholders::_1));
+    BOOST_REQUIRE_EQUAL(segments.size(), 1);
+
+    // sent as the color instead of JPEG
+    const auto& segment = segments.front();
+    BOOST_REQUIRE_EQUAL(segment.parameters.format, deflect::Format::fill);
+    BOOST_REQUIRE_EQUAL(segment.imageData.size(), 4);
+
+    deflect::server::Tile tile;
+    tile.width = segment.parameters.width;
+    tile.height = segment.parameters.height;
+    tile.format = segment.parameters.format;
+    tile.imageData = segment.imageData;
+
+    deflect::server::TileDecoder decoder;
+    decoder.decode(tile);
+
+    // the expanded color is exact
     BOOST_REQUIRE_EQUAL(tile.format, deflect::Format::rgba);
     BOOST_REQUIRE_EQUAL(tile.imageData.size(), data.size());
 
@@ -282,6 +340,74 @@ BOOST_AUTO_TEST_CASE(testImageSegmentationWithCompressionAndDecompression)
                                   dataOut + tile.imageData.size());
 }
 
+deflect::ChromaSubsampling generateAutoSubsampling(std::vector<char>& data)
+{
+    deflect::ImageWrapper imageWrapper(data.data(), 64, 64, deflect::RGBA);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_AUTO;
+
+    // a link too slow for sending uncompressed segments
+    deflect::ImageSegmenter segmenter;
+    segmenter.setLinkThroughput(1000.0);
+
+    deflect::Segments segments;
+    segmenter.generate(imageWrapper, std::bind(&append, std::ref(segments),
+                                               std::placeholders::_1));
+    BOOST_REQUIRE_EQUAL(segments.size(), 1);
+    BOOST_REQUIRE_EQUAL(segments[0].parameters.format, deflect::Format::jpeg);
+
+    deflect::server::Tile tile;
+    tile.format = segments[0].parameters.format;
+    tile.imageData = segments[0].imageData;
+    return deflect::server::TileDecoder().decodeType(tile);
+}
+
+BOOST_AUTO_TEST_CASE(testAutoCompressionSubsamplingFollowsContent)
+{
+    // black strokes on a white background, like text
+    std::vector<char> text(64 * 64 * 4, char(0xff));
+    for (size_t y = 0; y < 64; ++y)
+        for (size_t x = 0; x < 64; x += 6)
+            std::fill_n(text.begin() + (y * 64 + x) * 4, 3, 0);
+    BOOST_CHECK_EQUAL(generateAutoSubsampling(text),
+                      deflect::ChromaSubsampling::YUV444);
+
+    // a noisy gradient, like a photo
+    std::vector<char> natural(64 * 64 * 4, char(0xff));
+    for (size_t i = 0; i < natural.size(); ++i)
+        natural[i] = char(i / 256 + (i * 7919) % 11);
+    BOOST_CHECK_EQUAL(generateAutoSubsampling(natural),
+                      deflect::ChromaSubsampling::YUV420);
+}
+
+#ifndef DEFLECT_USE_LEGACY_LIBJPEGTURBO
+
+BOOST_AUTO_TEST_CASE(testFillTileDecodingToYUV)
+{
+    deflect::server::Tile tile;
+    tile.width = 8;
+    tile.height = 8;
+    tile.format = deflect::Format::fill;
+    tile.imageData = QByteArray{"\x5c\x1c\x00\xff", 4};
+
+    deflect::server::TileDecoder decoder;
+    BOOST_CHECK_EQUAL(decoder.decodeType(tile),
+                      deflect::ChromaSubsampling::YUV444);
+
+    decoder.decodeToYUV(tile);
+    BOOST_REQUIRE_EQUAL(tile.format, deflect::Format::yuv444);
+    BOOST_REQUIRE_EQUAL(tile.imageData.size(), 3 * 8 * 8);
+
+    const char* yuv = tile.imageData.constData();
+    BOOST_CHECK_EQUAL_COLLECTIONS(expectedYData.begin(), expectedYData.end(),
+                                  yuv, yuv + 8 * 8);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expectedUData.begin(), expectedUData.end(),
+                                  yuv + 8 * 8, yuv + 2 * 8 * 8);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expectedVData.begin(), expectedVData.end(),
+                                  yuv + 2 * 8 * 8, yuv + 3 * 8 * 8);
+}
+
+#endif
+
 BOOST_AUTO_TEST_CASE(testDecompressionOfInvalidData)
 {
     const QByteArray invalidJpegData{"notjpeg923%^#8"};
@@ -0,0 +1,112 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#define BOOST_TEST_MODULE TileTests
+
+#include <boost/test/unit_test.hpp>
+namespace ut = boost::unit_test;
+
+#include <deflect/server/Tile.h>
+
+#include <vector>
+
+namespace
+{
+const char color[] = {92, 28, 0, char(128)};
+
+deflect::server::Tile makeFillTile()
+{
+    deflect::server::Tile tile;
+    tile.width = 8;
+    tile.height = 4;
+    tile.format = deflect::Format::fill;
+    tile.imageData = QByteArray{color, 4};
+    return tile;
+}
+}
+
+BOOST_AUTO_TEST_CASE(expand_fill_tile_to_rgba)
+{
+    auto tile = makeFillTile();
+    tile.expandFill(deflect::Format::rgba);
+
+    BOOST_CHECK(tile.format == deflect::Format::rgba);
+    BOOST_REQUIRE_EQUAL(tile.imageData.size(), 8 * 4 * 4);
+    for (int i = 0; i < 8 * 4; ++i)
+    {
+        const char* pixel = tile.imageData.constData() + i * 4;
+        BOOST_CHECK_EQUAL_COLLECTIONS(pixel, pixel + 4, color, color + 4);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(expand_fill_tile_to_yuv444)
+{
+    auto tile = makeFillTile();
+    tile.expandFill(deflect::Format::yuv444);
+
+    BOOST_CHECK(tile.format == deflect::Format::yuv444);
+    BOOST_REQUIRE_EQUAL(tile.imageData.size(), 3 * 8 * 4);
+
+    // JFIF conversion of (92, 28, 0), planar
+    const auto planeSize = 8 * 4;
+    const std::vector<char> expected{44, 103, char(162)};
+    for (size_t plane = 0; plane < 3; ++plane)
+    {
+        const std::vector<char> expectedPlane(planeSize, expected[plane]);
+        const char* data = tile.imageData.constData() + plane * planeSize;
+        BOOST_CHECK_EQUAL_COLLECTIONS(expectedPlane.begin(),
+                                      expectedPlane.end(), data,
+                                      data + planeSize);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(expand_invalid_fill_tiles)
+{
+    auto tile = makeFillTile();
+    BOOST_CHECK_THROW(tile.expandFill(deflect::Format::jpeg),
+                      std::invalid_argument);
+
+    tile.imageData.append("x", 1);
+    BOOST_CHECK_THROW(tile.expandFill(deflect::Format::rgba),
+                      std::runtime_error);
+
+    tile.format = deflect::Format::rgba;
+    BOOST_CHECK_THROW(tile.expandFill(deflect::Format::rgba),
+                      std::invalid_argument);
+}
@@ -257,7 +257,8 @@ public:
         for (deflect::Segments::const_iterator it = _jpegSegments.begin();
              it != _jpegSegments.end(); ++it)
         {
-            if (!_stream->_impl->sendWorker._sendSegment(*it))
+            if (!_stream->_impl->sendWorker._sendSegment(
+                    _stream->_impl->sendState, *it))
                 return false;
         }
 
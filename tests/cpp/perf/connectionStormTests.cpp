@@ -0,0 +1,137 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#define BOOST_TEST_MODULE ConnectionStorm
+#include <boost/test/unit_test.hpp>
+namespace ut = boost::unit_test;
+
+#include "MinimalGlobalQtApp.h"
+#include "Timer.h"
+
+#include <deflect/Stream.h>
+#include <deflect/server/Server.h>
+
+#include <QTimer>
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Measures the time for many sources connecting at once to become ready,
+// like the processes of a large render job starting together. Compares the
+// Server accepting connections in its own thread to several accept threads
+// listening with SO_REUSEPORT.
+
+#define NSOURCES (200u)
+#define NACCEPTTHREADS (4u)
+#define TIMEOUT_MS (60000)
+
+BOOST_GLOBAL_FIXTURE(MinimalGlobalQtApp);
+
+namespace
+{
+/** @return the time until all the sources are opened on the Server. */
+float _connectSources(const unsigned int acceptThreads)
+{
+    deflect::server::Server server(0, acceptThreads);
+    const auto port = server.getPort();
+
+    Timer timer;
+    float timeToReady = 0.f;
+    std::atomic<size_t> opened{0};
+    std::atomic<size_t> failed{0};
+    QObject::connect(&server, &deflect::server::Server::pixelStreamOpened,
+                     [&](const QString) {
+                         if (++opened == NSOURCES)
+                             timeToReady = timer.elapsed();
+                     });
+
+    // the sources stay connected until all of them are ready
+    std::atomic_bool done{false};
+    std::vector<std::thread> sources;
+    timer.start();
+    for (size_t i = 0; i < NSOURCES; ++i)
+    {
+        sources.emplace_back([port, i, &failed, &done] {
+            try
+            {
+                deflect::Stream stream("source" + std::to_string(i),
+                                       "localhost", port);
+                if (!stream.isConnected())
+                    ++failed;
+                while (!done)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            catch (const std::runtime_error&)
+            {
+                ++failed;
+            }
+        });
+    }
+
+    QTimer poll;
+    QObject::connect(&poll, &QTimer::timeout, [&] {
+        if (opened + failed == NSOURCES || timer.elapsed() * 1000 > TIMEOUT_MS)
+            QCoreApplication::instance()->quit();
+    });
+    poll.start(10);
+    QCoreApplication::instance()->exec();
+
+    done = true;
+    for (auto& source : sources)
+        source.join();
+
+    BOOST_CHECK_EQUAL(failed.load(), 0);
+    BOOST_CHECK_EQUAL(opened.load(), NSOURCES);
+
+    std::cout << acceptThreads << " accept thread(s): " << NSOURCES
+              << " sources ready in " << timeToReady << " s" << std::endl;
+    return timeToReady;
+}
+}
+
+BOOST_AUTO_TEST_CASE(testConnectionStorm)
+{
+    const auto single = _connectSources(1);
+    const auto multiple = _connectSources(NACCEPTTHREADS);
+    std::cout << "speedup with " << NACCEPTTHREADS
+              << " accept threads: " << single / multiple << "x" << std::endl;
+}
@@ -0,0 +1,294 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "CaptureUtils.h"
+#include "Timer.h"
+
+#include <deflect/Segment.h>
+#include <deflect/Stream.h>
+#include <deflect/StreamPrivate.h>
+#include <deflect/server/CaptureReader.h>
+#include <deflect/server/Frame.h>
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#define MEGABYTE 1000000
+
+struct ReplayOptions
+{
+    ReplayOptions(int& argc, char** argv)
+        : desc("Replay a capture file recorded by a Deflect server.\n\n"
+               "Allowed options")
+        , getHelp(true)
+        , port(0)
+        , speed(0)
+        , sources(0)
+        , loops(0)
+    {
+        initDesc();
+        parseCommandLineArguments(argc, argv);
+    }
+
+    void showSyntax() const { std::cout << desc; }
+    void initDesc()
+    {
+        using namespace boost::program_options;
+        // clang-format off
+        desc.add_options()
+            ("help", "produce help message")
+            ("file", value<std::string>(), "capture file to replay")
+            ("id", value<std::string>()->default_value(""),
+                     "identifier for the stream (default: recorded uri)")
+            ("host", value<std::string>()->default_value("localhost"),
+                     "Target Deflect server host")
+            ("port", value<unsigned short>()->default_value(1701),
+                     "Target Deflect server port")
+            ("speed", value<double>()->default_value(1.0),
+                     "replay speed relative to the recording, 0 for maximum "
+                     "speed")
+            ("sources", value<unsigned int>()->default_value(1),
+                     "number of sources per stream sharing the tiles")
+            ("loops", value<unsigned int>()->default_value(1),
+                     "number of times to replay the file, 0 for infinite")
+        ;
+        // clang-format on
+    }
+
+    void parseCommandLineArguments(int& argc, char** argv)
+    {
+        if (argc <= 1)
+            return;
+
+        boost::program_options::variables_map vm;
+        try
+        {
+            using namespace boost::program_options;
+            positional_options_description positional;
+            positional.add("file", 1);
+            store(command_line_parser(argc, argv)
+                      .options(desc)
+                      .positional(positional)
+                      .run(),
+                  vm);
+            notify(vm);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return;
+        }
+
+        getHelp = vm.count("help") || !vm.count("file");
+        if (vm.count("file"))
+            file = vm["file"].as<std::string>();
+        id = vm["id"].as<std::string>();
+        host = vm["host"].as<std::string>();
+        port = vm["port"].as<unsigned short>();
+        speed = vm["speed"].as<double>();
+        sources = std::max(vm["sources"].as<unsigned int>(), 1u);
+        loops = vm["loops"].as<unsigned int>();
+    }
+
+    boost::program_options::options_description desc;
+
+    bool getHelp;
+    std::string file;
+    std::string id;
+    std::string host;
+    unsigned short port;
+    double speed;
+    unsigned int sources;
+    unsigned int loops;
+};
+
+namespace deflect
+{
+namespace test
+{
+/**
+ * Re-send the pre-compressed tiles of a capture file to a Server.
+ *
+ * Each recorded stream is replayed by one or more sources, the tiles of a
+ * frame being distributed among them. Like benchmarkStreamer --precompute,
+ * the tiles are sent as they were recorded, without any encoding.
+ */
+class Application
+{
+public:
+    explicit Application(const ReplayOptions& options)
+        : _options(options)
+        , _reader(QString::fromStdString(options.file))
+    {
+        std::cout << "Frames in capture file:   " << _reader.getFrameCount()
+                  << std::endl;
+    }
+
+    size_t getFrameCount() const { return _reader.getFrameCount(); }
+    size_t getBytesSent() const { return _bytesSent; }
+
+    /** @return the time of the frame relative to the first one. */
+    std::chrono::nanoseconds getTime(const size_t index) const
+    {
+        return _reader.getTimestamp(index) - _reader.getTimestamp(0);
+    }
+
+    /** @return the duration of one loop, including a frame interval. */
+    std::chrono::nanoseconds getDuration() const
+    {
+        const auto count = getFrameCount();
+        if (count < 2)
+            return std::chrono::nanoseconds::zero();
+        return getTime(count - 1) * int64_t(count) / int64_t(count - 1);
+    }
+
+    bool send(const size_t index)
+    {
+        const auto frame = _reader.getFrame(index);
+        auto& sources = _getSources(frame.uri.toStdString());
+
+        std::vector<std::vector<Task>> tasks(sources.size());
+        for (size_t i = 0; i < frame.tiles.size(); ++i)
+        {
+            const auto& tile = frame.tiles[i];
+            auto segment = makeReplaySegment(tile);
+
+            _bytesSent += tile.imageData.size();
+            auto& stream = *sources[i % sources.size()]->_impl;
+            tasks[i % sources.size()].emplace_back(
+                stream.task.send(std::move(segment)));
+        }
+
+        // every source finishes the frame, even without any tile
+        std::vector<Stream::Future> futures;
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            auto& stream = *sources[i]->_impl;
+            if (!tasks[i].empty())
+                futures.emplace_back(
+                    stream.sendWorker.enqueueRequest(std::move(tasks[i])));
+            futures.emplace_back(sources[i]->finishFrame());
+        }
+
+        bool success = true;
+        for (auto& future : futures)
+            success = future.get() && success;
+        return success;
+    }
+
+private:
+    using Sources = std::vector<std::unique_ptr<Stream>>;
+
+    const ReplayOptions& _options;
+    server::CaptureReader _reader;
+    std::map<std::string, Sources> _streams;
+    size_t _bytesSent = 0;
+
+    Sources& _getSources(const std::string& uri)
+    {
+        auto& sources = _streams[uri];
+        if (sources.empty())
+        {
+            const auto id = _options.id.empty() ? uri : _options.id;
+            for (size_t i = 0; i < _options.sources; ++i)
+                sources.emplace_back(
+                    new Stream(id, _options.host, _options.port));
+        }
+        return sources;
+    }
+};
+}
+}
+
+int main(int argc, char** argv)
+{
+    const ReplayOptions options(argc, argv);
+
+    if (options.getHelp)
+    {
+        options.showSyntax();
+        return 0;
+    }
+
+    deflect::test::Application replay(options);
+    if (replay.getFrameCount() == 0)
+        return 0;
+
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+
+    Timer timer;
+    timer.start();
+
+    size_t counter = 0;
+    bool streamOpen = true;
+    for (unsigned int loop = 0;
+         streamOpen && (options.loops == 0 || loop < options.loops); ++loop)
+    {
+        for (size_t i = 0; streamOpen && i < replay.getFrameCount(); ++i)
+        {
+            if (options.speed > 0.0)
+            {
+                const auto time =
+                    replay.getDuration() * int64_t(loop) + replay.getTime(i);
+                std::this_thread::sleep_until(
+                    start + std::chrono::duration_cast<clock::duration>(
+                                time / options.speed));
+            }
+            streamOpen = replay.send(i);
+            ++counter;
+        }
+    }
+
+    const float time = timer.elapsed();
+
+    std::cout << "Replay speed: " << options.speed << std::endl;
+    std::cout << "Time to send " << counter << " frames: " << time << std::endl;
+    std::cout << "Time per frame: " << time / counter << std::endl;
+    std::cout << "Throughput [Mbytes/sec]: "
+              << replay.getBytesSent() / time / MEGABYTE << std::endl;
+
+    return streamOpen ? 0 : 1;
+}
@@ -0,0 +1,692 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "Timer.h"
+
+#include <deflect/Loopback.h>
+#include <deflect/Observer.h>
+#include <deflect/Stream.h>
+#include <deflect/server/EventReceiver.h>
+#include <deflect/server/Frame.h>
+#include <deflect/server/Server.h>
+
+#include <QCoreApplication>
+#include <QProcess>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <boost/program_options.hpp>
+
+#define MEGABYTE 1000000
+#define CLOSE_TIMEOUT_MS 10000
+
+// Load generator for the Server in the shape of real deployments: M streams
+// of K sources each, optionally with observers registered for events, and a
+// mix of raw and JPEG streams. The sources run in threads of this process or
+// in child processes. Reports for each stream the frame rate, the dispatch
+// delay (time from the completion of a frame by its last source until the
+// Server dispatches it with receivedFrame()) and the frame latency (from the
+// moment the sources started sending the frame until its dispatch, as
+// Server::getFrameLatency()), and the resources used, as text, CSV or JSON.
+
+struct LoadOptions
+{
+    LoadOptions(int& argc, char** argv)
+        : desc("Allowed options")
+        , getHelp(true)
+    {
+        initDesc();
+        parseCommandLineArguments(argc, argv);
+    }
+
+    void showSyntax() const { std::cout << desc; }
+    void initDesc()
+    {
+        using namespace boost::program_options;
+        // clang-format off
+        desc.add_options()
+            ("help", "produce help message")
+            ("streams", value<unsigned int>()->default_value(4),
+                     "number of streams (M)")
+            ("sources", value<unsigned int>()->default_value(2),
+                     "number of sources per stream (K)")
+            ("observers", "register an observer for events on each stream")
+            ("width", value<unsigned int>()->default_value(1920),
+                     "width of each stream in pixel")
+            ("height", value<unsigned int>()->default_value(1080),
+                     "height of each stream in pixel")
+            ("nframes", value<unsigned int>()->default_value(100),
+                     "number of frames sent by each source")
+            ("compression", value<std::string>()->default_value("mixed"),
+                     "raw, jpeg or mixed (every other stream is compressed)")
+            ("quality", value<unsigned int>()->default_value(80),
+                     "quality of the jpeg compression")
+            ("processes", value<unsigned int>()->default_value(0),
+                     "run the sources in this number of child processes "
+                     "instead of threads")
+            ("loopback", "connect the sources through the in-process "
+                         "transport instead of TCP (not with --processes)")
+            ("format", value<std::string>()->default_value("text"),
+                     "output format: text, csv or json")
+            ("output", value<std::string>()->default_value(""),
+                     "output file (default: standard output)")
+            ("client", "internal: only run the sources of some streams")
+            ("host", value<std::string>()->default_value("localhost"),
+                     "internal: Deflect server host, with --client")
+            ("port", value<unsigned short>()->default_value(0),
+                     "internal: Deflect server port, with --client")
+            ("first-stream", value<unsigned int>()->default_value(0),
+                     "internal: index of the first stream, with --client")
+        ;
+        // clang-format on
+    }
+
+    void parseCommandLineArguments(int& argc, char** argv)
+    {
+        if (argc <= 1)
+            return;
+
+        boost::program_options::variables_map vm;
+        try
+        {
+            using namespace boost::program_options;
+            store(parse_command_line(argc, argv, desc), vm);
+            notify(vm);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return;
+        }
+
+        getHelp = vm.count("help");
+        streams = vm["streams"].as<unsigned int>();
+        sources = std::max(vm["sources"].as<unsigned int>(), 1u);
+        observers = vm.count("observers");
+        width = vm["width"].as<unsigned int>();
+        height = vm["height"].as<unsigned int>();
+        nframes = vm["nframes"].as<unsigned int>();
+        compression = vm["compression"].as<std::string>();
+        quality = vm["quality"].as<unsigned int>();
+        processes = vm["processes"].as<unsigned int>();
+        loopback = vm.count("loopback");
+        format = vm["format"].as<std::string>();
+        output = vm["output"].as<std::string>();
+        client = vm.count("client");
+        host = vm["host"].as<std::string>();
+        port = vm["port"].as<unsigned short>();
+        firstStream = vm["first-stream"].as<unsigned int>();
+    }
+
+    /** @return true if the stream of the given index sends JPEG images. */
+    bool isCompressed(const unsigned int stream) const
+    {
+        if (compression == "mixed")
+            return stream % 2 == 0;
+        return compression == "jpeg";
+    }
+
+    boost::program_options::options_description desc;
+
+    bool getHelp;
+    unsigned int streams = 0;
+    unsigned int sources = 0;
+    bool observers = false;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int nframes = 0;
+    std::string compression;
+    unsigned int quality = 0;
+    unsigned int processes = 0;
+    bool loopback = false;
+    std::string format;
+    std::string output;
+    bool client = false;
+    std::string host;
+    unsigned short port = 0;
+    unsigned int firstStream = 0;
+};
+
+namespace
+{
+std::string getStreamId(const unsigned int stream)
+{
+    return "loadgen_" + std::to_string(stream);
+}
+
+struct ResourceUsage
+{
+    double cpuSeconds = 0.0;
+    double maxRssMB = 0.0;
+};
+
+ResourceUsage getResourceUsage(const bool children)
+{
+    ResourceUsage usage;
+#ifndef _WIN32
+    rusage ru;
+    if (getrusage(children ? RUSAGE_CHILDREN : RUSAGE_SELF, &ru) == 0)
+    {
+        usage.cpuSeconds = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+                           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+        usage.maxRssMB = ru.ru_maxrss / 1024.0; // kilobytes on Linux
+    }
+#else
+    (void)children;
+#endif
+    return usage;
+}
+
+/** @return the nearest-rank percentile of the values. */
+double percentile(std::vector<double> values, const double p)
+{
+    if (values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    const auto rank = size_t(p / 100.0 * values.size() + 0.5);
+    return values[std::min(std::max(rank, size_t(1)), values.size()) - 1];
+}
+
+/** Send the frames of one source, which streams a horizontal band. */
+bool runSource(const LoadOptions& options, const unsigned int streamIndex,
+               const unsigned int sourceIndex)
+{
+    const auto bandHeight = options.height / options.sources;
+    const auto y = bandHeight * sourceIndex;
+    const auto height = sourceIndex + 1 == options.sources
+                            ? options.height - y
+                            : bandHeight;
+
+    std::vector<uint8_t> pixels(size_t(options.width) * height * 4);
+    for (auto& pixel : pixels)
+        pixel = rand();
+
+    deflect::ImageWrapper image(pixels.data(), options.width, height,
+                                deflect::RGBA, 0, y);
+    image.compressionPolicy = options.isCompressed(streamIndex)
+                                  ? deflect::COMPRESSION_ON
+                                  : deflect::COMPRESSION_OFF;
+    image.compressionQuality = options.quality;
+
+    try
+    {
+        deflect::Stream stream(getStreamId(streamIndex), options.host,
+                               options.port);
+        stream.setFlowControl(deflect::FlowControl::block);
+        for (unsigned int i = 0; i < options.nframes; ++i)
+        {
+            if (!stream.sendAndFinish(image).get())
+                return false;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "source failed: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/** Run the sources (and observers) of the streams [first, first + count). */
+bool runClients(const LoadOptions& options, const unsigned int first,
+                const unsigned int count)
+{
+    // observers first, so that they receive the events of all the frames
+    std::vector<std::unique_ptr<deflect::Observer>> observers;
+    std::atomic<size_t> events{0};
+    if (options.observers)
+    {
+        for (auto i = first; i < first + count; ++i)
+        {
+            observers.emplace_back(new deflect::Observer(
+                getStreamId(i), options.host, options.port));
+            observers.back()->registerForEvents();
+            observers.back()->setEventCallback(
+                [&events](const deflect::Event&) { ++events; });
+        }
+    }
+
+    std::atomic_bool success{true};
+    std::vector<std::thread> threads;
+    for (auto i = first; i < first + count; ++i)
+    {
+        for (unsigned int j = 0; j < options.sources; ++j)
+        {
+            threads.emplace_back([&options, &success, i, j] {
+                if (!runSource(options, i, j))
+                    success = false;
+            });
+        }
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    observers.clear();
+    return success;
+}
+
+/** The Server and the statistics that it collects, from its own thread. */
+class LoadServer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct StreamStats
+    {
+        size_t frames = 0;
+        size_t bytes = 0;
+        Clock::time_point firstFrame;
+        Clock::time_point lastFrame;
+        std::vector<double> dispatchDelays; // ms
+        std::vector<double> frameLatencies; // ms
+    };
+
+    LoadServer()
+        : _server{new deflect::server::Server(0 /* OS-chosen port */)}
+    {
+        using deflect::server::Server;
+
+        _server->moveToThread(&_thread);
+        _thread.connect(&_thread, &QThread::finished, _server,
+                        &Server::deleteLater);
+
+        _server->connect(_server, &Server::pixelStreamOpened, _server,
+                         [this](const QString uri) {
+                             _server->requestFrame(uri);
+                         });
+        _server->connect(_server, &Server::receivedFrame, _server,
+                         [this](deflect::server::FramePtr frame) {
+                             _onFrame(*frame);
+                             _server->requestFrame(frame->uri);
+                         });
+        _server->connect(_server, &Server::registerToEvents, _server,
+                         [this](const QString uri, bool,
+                                deflect::server::EventReceiver* receiver,
+                                deflect::server::BoolPromisePtr success) {
+                             _receivers[uri].push_back(receiver);
+                             success->set_value(true);
+                         });
+        _server->connect(_server, &Server::pixelStreamClosed, _server,
+                         [this](const QString uri) {
+                             _receivers.erase(uri);
+                             std::lock_guard<std::mutex> lock(_mutex);
+                             ++_closedStreams;
+                             _closed.notify_all();
+                         });
+        _port = _server->getPort();
+        _thread.start();
+    }
+
+    ~LoadServer() { stop(); }
+
+    quint16 getPort() const { return _port; }
+
+    bool waitForClosedStreams(const size_t count)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _closed.wait_for(lock,
+                                std::chrono::milliseconds(CLOSE_TIMEOUT_MS),
+                                [&] { return _closedStreams >= count; });
+    }
+
+    /** Stop the Server, after which the statistics can be read. */
+    void stop()
+    {
+        _thread.quit();
+        _thread.wait();
+    }
+
+    const std::map<QString, StreamStats>& getStats() const { return _stats; }
+
+private:
+    QThread _thread;
+    deflect::server::Server* _server = nullptr; // deleted by deleteLater
+    quint16 _port = 0;
+
+    std::map<QString, StreamStats> _stats;
+    std::map<QString, std::vector<deflect::server::EventReceiver*>> _receivers;
+
+    std::mutex _mutex;
+    std::condition_variable _closed;
+    size_t _closedStreams = 0;
+
+    void _onFrame(const deflect::server::Frame& frame)
+    {
+        const auto now = Clock::now();
+        auto& stats = _stats[frame.uri];
+        if (stats.frames == 0)
+            stats.firstFrame = now;
+        stats.lastFrame = now;
+        ++stats.frames;
+        for (const auto& tile : frame.tiles)
+            stats.bytes += tile.imageData.size();
+
+        using Milliseconds = std::chrono::duration<double, std::milli>;
+        const auto& timing = frame.timing;
+        stats.dispatchDelays.push_back(
+            Milliseconds(timing.dispatchTime - timing.receiveTime).count());
+        if (timing.sendTime != Clock::time_point())
+        {
+            stats.frameLatencies.push_back(
+                Milliseconds(timing.dispatchTime - timing.sendTime).count());
+        }
+
+        deflect::Event event;
+        event.type = deflect::Event::EVT_MOVE;
+        for (auto receiver : _receivers[frame.uri])
+            receiver->processEvent(event);
+    }
+};
+
+struct StreamResult
+{
+    std::string id;
+    bool compressed = false;
+    size_t frames = 0;
+    double fps = 0.0;
+    double mbytesPerSecond = 0.0;
+    double dispatchDelayP50 = 0.0;
+    double dispatchDelayP99 = 0.0;
+    double latencyP50 = 0.0;
+    double latencyP99 = 0.0;
+};
+
+struct Results
+{
+    std::vector<StreamResult> streams;
+    double elapsed = 0.0;
+    size_t frames = 0;
+    double fps = 0.0;
+    double mbytesPerSecond = 0.0;
+    ResourceUsage self;
+    ResourceUsage children;
+};
+
+Results computeResults(const LoadOptions& options, const LoadServer& server,
+                       const double elapsed)
+{
+    Results results;
+    results.elapsed = elapsed;
+
+    size_t bytes = 0;
+    for (unsigned int i = 0; i < options.streams; ++i)
+    {
+        StreamResult result;
+        result.id = getStreamId(i);
+        result.compressed = options.isCompressed(i);
+
+        const auto& allStats = server.getStats();
+        const auto it = allStats.find(QString::fromStdString(result.id));
+        if (it != allStats.end())
+        {
+            const auto& stats = it->second;
+            const std::chrono::duration<double> duration =
+                stats.lastFrame - stats.firstFrame;
+            result.frames = stats.frames;
+            if (stats.frames > 1 && duration.count() > 0.0)
+            {
+                result.fps = (stats.frames - 1) / duration.count();
+                result.mbytesPerSecond =
+                    stats.bytes / duration.count() / MEGABYTE;
+            }
+            result.dispatchDelayP50 = percentile(stats.dispatchDelays, 50.0);
+            result.dispatchDelayP99 = percentile(stats.dispatchDelays, 99.0);
+            result.latencyP50 = percentile(stats.frameLatencies, 50.0);
+            result.latencyP99 = percentile(stats.frameLatencies, 99.0);
+            bytes += stats.bytes;
+        }
+        results.frames += result.frames;
+        results.streams.push_back(result);
+    }
+
+    if (elapsed > 0.0)
+    {
+        results.fps = results.frames / elapsed;
+        results.mbytesPerSecond = bytes / elapsed / MEGABYTE;
+    }
+    return results;
+}
+
+void writeText(std::ostream& out, const LoadOptions& options,
+               const Results& results)
+{
+    out << "Streams x sources:        " << options.streams << " x "
+        << options.sources << std::endl;
+    out << "Image dimensions:         " << options.width << " x "
+        << options.height << std::endl;
+    for (const auto& stream : results.streams)
+    {
+        out << stream.id << (stream.compressed ? " (jpeg)" : " (raw)")
+            << ": " << stream.frames << " frames, " << stream.fps << " fps, "
+            << stream.mbytesPerSecond << " MB/s, dispatch delay p50 "
+            << stream.dispatchDelayP50 << " ms, p99 "
+            << stream.dispatchDelayP99 << " ms, latency p50 "
+            << stream.latencyP50 << " ms, p99 " << stream.latencyP99 << " ms"
+            << std::endl;
+    }
+    out << "Time [s]:                 " << results.elapsed << std::endl;
+    out << "Total frames:             " << results.frames << std::endl;
+    out << "Total framerate [fps]:    " << results.fps << std::endl;
+    out << "Throughput [Mbytes/sec]:  " << results.mbytesPerSecond
+        << std::endl;
+    out << "CPU time [s]:             " << results.self.cpuSeconds
+        << " (children: " << results.children.cpuSeconds << ")" << std::endl;
+    out << "Max RSS [MB]:             " << results.self.maxRssMB
+        << " (children: " << results.children.maxRssMB << ")" << std::endl;
+}
+
+void writeCsv(std::ostream& out, const Results& results)
+{
+    out << "stream,compression,frames,fps,mbytes_per_s,"
+           "dispatch_delay_p50_ms,dispatch_delay_p99_ms,latency_p50_ms,"
+           "latency_p99_ms,cpu_s,max_rss_mb,children_cpu_s,"
+           "children_max_rss_mb"
+        << std::endl;
+    for (const auto& stream : results.streams)
+    {
+        out << stream.id << ',' << (stream.compressed ? "jpeg" : "raw") << ','
+            << stream.frames << ',' << stream.fps << ','
+            << stream.mbytesPerSecond << ',' << stream.dispatchDelayP50 << ','
+            << stream.dispatchDelayP99 << ',' << stream.latencyP50 << ','
+            << stream.latencyP99 << ",,,," << std::endl;
+    }
+    out << "total,," << results.frames << ',' << results.fps << ','
+        << results.mbytesPerSecond << ",,,,," << results.self.cpuSeconds << ','
+        << results.self.maxRssMB << ',' << results.children.cpuSeconds << ','
+        << results.children.maxRssMB << std::endl;
+}
+
+void writeJson(std::ostream& out, const LoadOptions& options,
+               const Results& results)
+{
+    out << "{\n  \"config\": {\"streams\": " << options.streams
+        << ", \"sources\": " << options.sources
+        << ", \"observers\": " << (options.observers ? "true" : "false")
+        << ", \"width\": " << options.width
+        << ", \"height\": " << options.height
+        << ", \"nframes\": " << options.nframes << ", \"compression\": \""
+        << options.compression << "\", \"processes\": " << options.processes
+        << ", \"loopback\": " << (options.loopback ? "true" : "false")
+        << "},\n  \"streams\": [";
+    for (size_t i = 0; i < results.streams.size(); ++i)
+    {
+        const auto& stream = results.streams[i];
+        out << (i > 0 ? "," : "") << "\n    {\"id\": \"" << stream.id
+            << "\", \"compression\": \"" << (stream.compressed ? "jpeg" : "raw")
+            << "\", \"frames\": " << stream.frames
+            << ", \"fps\": " << stream.fps
+            << ", \"mbytes_per_s\": " << stream.mbytesPerSecond
+            << ", \"dispatch_delay_p50_ms\": " << stream.dispatchDelayP50
+            << ", \"dispatch_delay_p99_ms\": " << stream.dispatchDelayP99
+            << ", \"latency_p50_ms\": " << stream.latencyP50
+            << ", \"latency_p99_ms\": " << stream.latencyP99 << "}";
+    }
+    out << "\n  ],\n  \"total\": {\"time_s\": " << results.elapsed
+        << ", \"frames\": " << results.frames << ", \"fps\": " << results.fps
+        << ", \"mbytes_per_s\": " << results.mbytesPerSecond
+        << ", \"cpu_s\": " << results.self.cpuSeconds
+        << ", \"max_rss_mb\": " << results.self.maxRssMB
+        << ", \"children_cpu_s\": " << results.children.cpuSeconds
+        << ", \"children_max_rss_mb\": " << results.children.maxRssMB
+        << "}\n}" << std::endl;
+}
+
+bool runProcesses(const LoadOptions& options, const quint16 port)
+{
+    const auto count = std::min(options.processes, options.streams);
+    std::vector<std::unique_ptr<QProcess>> processes;
+    unsigned int first = 0;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        // distribute the streams evenly among the processes
+        const auto streams = options.streams / count +
+                             (i < options.streams % count ? 1 : 0);
+        QStringList args;
+        args << "--client"
+             << "--port" << QString::number(port) << "--first-stream"
+             << QString::number(first) << "--streams"
+             << QString::number(streams) << "--sources"
+             << QString::number(options.sources) << "--width"
+             << QString::number(options.width) << "--height"
+             << QString::number(options.height) << "--nframes"
+             << QString::number(options.nframes) << "--compression"
+             << QString::fromStdString(options.compression) << "--quality"
+             << QString::number(options.quality);
+        if (options.observers)
+            args << "--observers";
+        first += streams;
+
+        processes.emplace_back(new QProcess);
+        processes.back()->setProcessChannelMode(QProcess::ForwardedChannels);
+        processes.back()->start(QCoreApplication::applicationFilePath(),
+                                args);
+    }
+
+    bool success = true;
+    for (auto& process : processes)
+    {
+        process->waitForFinished(-1);
+        success = success && process->exitStatus() == QProcess::NormalExit &&
+                  process->exitCode() == 0;
+    }
+    return success;
+}
+}
+
+int main(int argc, char** argv)
+{
+    const LoadOptions options(argc, argv);
+
+    if (options.getHelp)
+    {
+        options.showSyntax();
+        return 0;
+    }
+
+    if (options.client)
+    {
+        const auto first = options.firstStream;
+        return runClients(options, first, options.streams) ? 0 : 1;
+    }
+
+    if (options.loopback && options.processes > 0)
+    {
+        std::cerr << "--loopback requires the sources to run in threads"
+                  << std::endl;
+        return 1;
+    }
+
+    QCoreApplication app(argc, argv);
+
+    const auto selfUsage = getResourceUsage(false);
+    const auto childrenUsage = getResourceUsage(true);
+
+    LoadServer server;
+    auto clientOptions = options;
+    clientOptions.port = server.getPort();
+    if (options.loopback)
+        clientOptions.host = deflect::loopback::HOST;
+
+    Timer timer;
+    timer.start();
+
+    const bool success = options.processes > 0
+                             ? runProcesses(options, server.getPort())
+                             : runClients(clientOptions, 0, options.streams);
+    if (!server.waitForClosedStreams(options.streams))
+        std::cerr << "timeout waiting for the streams to close" << std::endl;
+
+    const float time = timer.elapsed();
+    server.stop();
+
+    auto results = computeResults(options, server, time);
+    results.self = getResourceUsage(false);
+    results.self.cpuSeconds -= selfUsage.cpuSeconds;
+    results.children = getResourceUsage(true);
+    results.children.cpuSeconds -= childrenUsage.cpuSeconds;
+
+    std::ofstream file;
+    if (!options.output.empty())
+        file.open(options.output);
+    std::ostream& out = options.output.empty() ? std::cout : file;
+
+    if (options.format == "csv")
+        writeCsv(out, results);
+    else if (options.format == "json")
+        writeJson(out, options, results);
+    else
+        writeText(out, options, results);
+
+    return success ? 0 : 1;
+}
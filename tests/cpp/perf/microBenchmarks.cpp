@@ -0,0 +1,729 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include <deflect/Event.h>
+#include <deflect/ImageSegmenter.h>
+#include <deflect/ImageWrapper.h>
+#include <deflect/MessageHeader.h>
+#include <deflect/PackedEvent.h>
+#include <deflect/defines.h>
+#include <deflect/server/ReceiveBuffer.h>
+
+#ifdef DEFLECT_USE_LIBJPEGTURBO
+#include <deflect/ImageJpegCompressor.h>
+#include <deflect/server/ImageJpegDecompressor.h>
+#endif
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+// Microbenchmarks of the hot paths of the segmentation, the JPEG codec, the
+// network protocol and the reception of frames by the server. Each benchmark
+// is calibrated to run for a minimum time, then repeated to report the median
+// and the minimum time per operation, as text, CSV or JSON. The results can be
+// compared to a baseline written by a previous run with --format json or csv.
+
+struct BenchmarkOptions
+{
+    BenchmarkOptions(int& argc, char** argv)
+        : desc("Allowed options")
+    {
+        initDesc();
+        parseCommandLineArguments(argc, argv);
+    }
+
+    void showSyntax() const { std::cout << desc; }
+    void initDesc()
+    {
+        using namespace boost::program_options;
+        // clang-format off
+        desc.add_options()
+            ("help", "produce help message")
+            ("list", "list the benchmarks and exit")
+            ("filter", value<std::string>()->default_value(""),
+                     "only run the benchmarks whose name contains this text")
+            ("min-time", value<unsigned int>()->default_value(100),
+                     "minimum duration of each repetition in milliseconds")
+            ("repetitions", value<unsigned int>()->default_value(5),
+                     "number of timed repetitions of each benchmark")
+            ("format", value<std::string>()->default_value("text"),
+                     "output format: text, csv or json")
+            ("output", value<std::string>()->default_value(""),
+                     "output file (default: standard output)")
+            ("baseline", value<std::string>()->default_value(""),
+                     "results of a previous run (csv or json) to compare to")
+            ("threshold", value<double>()->default_value(10.0),
+                     "change in percent of the median time reported as a "
+                     "regression or an improvement over the baseline")
+        ;
+        // clang-format on
+    }
+
+    void parseCommandLineArguments(int& argc, char** argv)
+    {
+        boost::program_options::variables_map vm;
+        try
+        {
+            using namespace boost::program_options;
+            store(parse_command_line(argc, argv, desc), vm);
+            notify(vm);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            getHelp = true;
+            return;
+        }
+
+        getHelp = vm.count("help");
+        list = vm.count("list");
+        filter = vm["filter"].as<std::string>();
+        minTime = std::chrono::milliseconds(vm["min-time"].as<unsigned int>());
+        repetitions = std::max(vm["repetitions"].as<unsigned int>(), 1u);
+        format = vm["format"].as<std::string>();
+        output = vm["output"].as<std::string>();
+        baseline = vm["baseline"].as<std::string>();
+        threshold = vm["threshold"].as<double>();
+    }
+
+    boost::program_options::options_description desc;
+
+    bool getHelp = false;
+    bool list = false;
+    std::string filter;
+    std::chrono::milliseconds minTime{0};
+    unsigned int repetitions = 0;
+    std::string format;
+    std::string output;
+    std::string baseline;
+    double threshold = 0.0;
+};
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+const unsigned int imageWidth = 1920;
+const unsigned int imageHeight = 1080;
+const unsigned int codecImageSize = 512;
+const unsigned int jpegQuality = 80;
+
+/** Defeat the optimization of the results of the benchmarked operations. */
+volatile size_t sink = 0;
+
+struct Benchmark
+{
+    std::string name;
+    /** Run the operation the given number of times. */
+    std::function<void(size_t iterations)> run;
+    /** Bytes processed by each operation, 0 if not relevant. */
+    size_t bytesPerOp;
+};
+
+struct Result
+{
+    std::string name;
+    size_t iterations = 0;
+    double nsPerOp = 0.0;    // median of the repetitions
+    double minNsPerOp = 0.0; // fastest repetition
+    double mbytesPerSecond = 0.0;
+
+    bool hasBaseline = false;
+    double baselineNsPerOp = 0.0;
+    double changePercent = 0.0;
+};
+
+/** A reproducible image with gradients and noise, to compress realistically. */
+std::vector<uint8_t> makeImage(const unsigned int width,
+                               const unsigned int height,
+                               const unsigned int bytesPerPixel)
+{
+    std::vector<uint8_t> pixels(size_t(width) * height * bytesPerPixel);
+    uint32_t random = 12345;
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            random = random * 1664525u + 1013904223u;
+            const auto noise = uint8_t(random >> 28);
+            auto pixel = &pixels[(size_t(y) * width + x) * bytesPerPixel];
+            for (unsigned int c = 0; c < bytesPerPixel; ++c)
+                pixel[c] = uint8_t((x * (c + 1) + y * (3 - c % 3)) / 8 + noise);
+        }
+    }
+    return pixels;
+}
+
+unsigned int getBytesPerPixel(const deflect::PixelFormat format)
+{
+    return (format == deflect::RGB || format == deflect::BGR) ? 3 : 4;
+}
+
+const char* toString(const deflect::PixelFormat format)
+{
+    switch (format)
+    {
+    case deflect::RGB:
+        return "rgb";
+    case deflect::RGBA:
+        return "rgba";
+    case deflect::ARGB:
+        return "argb";
+    case deflect::BGR:
+        return "bgr";
+    case deflect::BGRA:
+        return "bgra";
+    case deflect::ABGR:
+        return "abgr";
+    default:
+        return "unknown";
+    }
+}
+
+const char* toString(const deflect::ChromaSubsampling subsampling)
+{
+    switch (subsampling)
+    {
+    case deflect::ChromaSubsampling::YUV444:
+        return "yuv444";
+    case deflect::ChromaSubsampling::YUV422:
+        return "yuv422";
+    case deflect::ChromaSubsampling::YUV420:
+        return "yuv420";
+    default:
+        return "unknown";
+    }
+}
+
+const deflect::ChromaSubsampling allSubsamplings[] = {
+    deflect::ChromaSubsampling::YUV444, deflect::ChromaSubsampling::YUV422,
+    deflect::ChromaSubsampling::YUV420};
+
+const unsigned int segmentSizes[] = {64, 128, 256, 512};
+
+void addSegmenterBenchmarks(std::vector<Benchmark>& benchmarks)
+{
+    const auto pixels = std::make_shared<std::vector<uint8_t>>(
+        makeImage(imageWidth, imageHeight, 4));
+
+    for (const auto compression : {deflect::COMPRESSION_OFF,
+                                   deflect::COMPRESSION_ON})
+    {
+        const bool jpeg = compression == deflect::COMPRESSION_ON;
+#ifndef DEFLECT_USE_LIBJPEGTURBO
+        if (jpeg)
+            continue;
+#endif
+        for (const auto size : segmentSizes)
+        {
+            // Raw segments only reference the image, which measures the
+            // computation of the segment parameters.
+            const auto name = std::string("segmenter/generate/") +
+                              (jpeg ? "jpeg/" : "raw/") + std::to_string(size);
+            auto segmenter = std::make_shared<deflect::ImageSegmenter>();
+            segmenter->setNominalSegmentDimensions(size, size);
+            const auto run = [pixels, segmenter, compression](size_t n) {
+                deflect::ImageWrapper image(pixels->data(), imageWidth,
+                                            imageHeight, deflect::RGBA);
+                image.compressionPolicy = compression;
+                image.compressionQuality = jpegQuality;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    segmenter->generate(image, [](const deflect::Segment& s) {
+                        sink = sink + size_t(s.imageData.size());
+                        return true;
+                    });
+                }
+            };
+            benchmarks.push_back({name, run, pixels->size()});
+        }
+    }
+}
+
+#ifdef DEFLECT_USE_LIBJPEGTURBO
+void addCodecBenchmarks(std::vector<Benchmark>& benchmarks)
+{
+    const deflect::PixelFormat formats[] = {deflect::RGB, deflect::RGBA,
+                                            deflect::ARGB, deflect::BGRA};
+    const QRect region(0, 0, codecImageSize, codecImageSize);
+
+    for (const auto format : formats)
+    {
+        const auto pixels = std::make_shared<std::vector<uint8_t>>(
+            makeImage(codecImageSize, codecImageSize,
+                      getBytesPerPixel(format)));
+        for (const auto subsampling : allSubsamplings)
+        {
+            const auto name = std::string("jpeg/compress/") +
+                              toString(format) + "/" + toString(subsampling);
+            auto compressor = std::make_shared<deflect::ImageJpegCompressor>();
+            const auto run = [pixels, compressor, format, region,
+                              subsampling](const size_t n) {
+                deflect::ImageWrapper image(pixels->data(), codecImageSize,
+                                            codecImageSize, format);
+                image.compressionQuality = jpegQuality;
+                image.subsampling = subsampling;
+                for (size_t i = 0; i < n; ++i)
+                    sink = sink + size_t(
+                                      compressor->computeJpeg(image, region)
+                                          .size());
+            };
+            benchmarks.push_back({name, run, pixels->size()});
+        }
+    }
+
+    const auto pixels = makeImage(codecImageSize, codecImageSize, 4);
+    const auto rgbaSize = pixels.size();
+    for (const auto subsampling : allSubsamplings)
+    {
+        deflect::ImageWrapper image(pixels.data(), codecImageSize,
+                                    codecImageSize, deflect::RGBA);
+        image.compressionQuality = jpegQuality;
+        image.subsampling = subsampling;
+        const auto jpeg = std::make_shared<QByteArray>(
+            deflect::ImageJpegCompressor().computeJpeg(image, region));
+
+        auto decompressor =
+            std::make_shared<deflect::server::ImageJpegDecompressor>();
+        benchmarks.push_back(
+            {std::string("jpeg/decompress/") + toString(subsampling),
+             [jpeg, decompressor](const size_t n) {
+                 for (size_t i = 0; i < n; ++i)
+                     sink = sink +
+                            size_t(decompressor->decompress(*jpeg).size());
+             },
+             rgbaSize});
+#ifndef DEFLECT_USE_LEGACY_LIBJPEGTURBO
+        benchmarks.push_back(
+            {std::string("jpeg/decompressToYUV/") + toString(subsampling),
+             [jpeg, decompressor](const size_t n) {
+                 for (size_t i = 0; i < n; ++i)
+                     sink = sink + size_t(decompressor->decompressToYUV(*jpeg)
+                                              .first.size());
+             },
+             rgbaSize});
+#endif
+    }
+}
+#endif
+
+deflect::Event makeEvent()
+{
+    deflect::Event event;
+    event.type = deflect::Event::EVT_MOVE;
+    event.mouseX = 0.25;
+    event.mouseY = 0.75;
+    event.dx = 0.01;
+    event.dy = -0.02;
+    event.mouseLeft = true;
+    return event;
+}
+
+void addProtocolBenchmarks(std::vector<Benchmark>& benchmarks)
+{
+    const deflect::MessageHeader header(deflect::MESSAGE_TYPE_PIXELSTREAM,
+                                        65536, "benchmark_stream");
+    benchmarks.push_back(
+        {"protocol/header/serialize",
+         [header](const size_t n) {
+             QByteArray storage;
+             storage.reserve(int(deflect::MessageHeader::serializedSize));
+             for (size_t i = 0; i < n; ++i)
+             {
+                 storage.resize(0);
+                 QDataStream stream(&storage, QIODevice::WriteOnly);
+                 stream << header;
+                 sink = sink + size_t(storage.size());
+             }
+         },
+         deflect::MessageHeader::serializedSize});
+
+    QByteArray serializedHeader;
+    {
+        QDataStream stream(&serializedHeader, QIODevice::WriteOnly);
+        stream << header;
+    }
+    benchmarks.push_back({"protocol/header/deserialize",
+                          [serializedHeader](const size_t n) {
+                              for (size_t i = 0; i < n; ++i)
+                              {
+                                  QDataStream stream(serializedHeader);
+                                  deflect::MessageHeader result;
+                                  stream >> result;
+                                  sink = sink + result.size;
+                              }
+                          },
+                          deflect::MessageHeader::serializedSize});
+
+    const auto event = makeEvent();
+    benchmarks.push_back({"protocol/event/serialize",
+                          [event](const size_t n) {
+                              QByteArray storage;
+                              for (size_t i = 0; i < n; ++i)
+                              {
+                                  storage.resize(0);
+                                  QDataStream stream(&storage,
+                                                     QIODevice::WriteOnly);
+                                  stream << event;
+                                  sink = sink + size_t(storage.size());
+                              }
+                          },
+                          deflect::Event::serializedSize});
+
+    QByteArray serializedEvent;
+    {
+        QDataStream stream(&serializedEvent, QIODevice::WriteOnly);
+        stream << event;
+    }
+    benchmarks.push_back({"protocol/event/deserialize",
+                          [serializedEvent](const size_t n) {
+                              for (size_t i = 0; i < n; ++i)
+                              {
+                                  QDataStream stream(serializedEvent);
+                                  deflect::Event result;
+                                  stream >> result;
+                                  sink = sink + size_t(result.type);
+                              }
+                          },
+                          deflect::Event::serializedSize});
+
+    const std::vector<deflect::Event> events(64, event);
+    const auto packedSize = events.size() * sizeof(deflect::PackedEvent);
+    benchmarks.push_back(
+        {"protocol/events/pack/64",
+         [events](const size_t n) {
+             for (size_t i = 0; i < n; ++i)
+                 sink = sink + size_t(deflect::packEvents(events).size());
+         },
+         packedSize});
+
+    const auto packedEvents = deflect::packEvents(events);
+    benchmarks.push_back(
+        {"protocol/events/unpack/64",
+         [packedEvents](const size_t n) {
+             for (size_t i = 0; i < n; ++i)
+                 sink = sink + deflect::unpackEvents(packedEvents).size();
+         },
+         packedSize});
+}
+
+void addReceiveBufferBenchmarks(std::vector<Benchmark>& benchmarks)
+{
+    const unsigned int tilesPerSource = 16;
+
+    for (const size_t sources : {1, 4, 16})
+    {
+        // Each operation receives a complete frame: all the tiles of all the
+        // sources, the frame finished messages and popFrame().
+        auto buffer = std::make_shared<deflect::server::ReceiveBuffer>();
+        for (size_t source = 0; source < sources; ++source)
+            buffer->addSource(source);
+
+        auto tiles = std::make_shared<deflect::server::Tiles>(tilesPerSource);
+        for (unsigned int i = 0; i < tilesPerSource; ++i)
+        {
+            auto& tile = (*tiles)[i];
+            tile.x = (i % 4) * 256;
+            tile.y = (i / 4) * 256;
+            tile.width = 256;
+            tile.height = 256;
+            tile.imageData = QByteArray(1024, 'x');
+        }
+
+        const auto run = [buffer, tiles, sources](const size_t n) {
+            for (size_t i = 0; i < n; ++i)
+            {
+                for (size_t source = 0; source < sources; ++source)
+                {
+                    for (const auto& tile : *tiles)
+                        buffer->insert(tile, source);
+                    buffer->finishFrameForSource(source);
+                }
+                if (!buffer->hasCompleteFrame())
+                    throw std::logic_error("ReceiveBuffer: incomplete frame");
+                sink = sink + buffer->popFrame().size();
+            }
+        };
+        benchmarks.push_back(
+            {"receivebuffer/frame/" + std::to_string(sources), run, 0});
+    }
+}
+
+std::vector<Benchmark> makeBenchmarks()
+{
+    std::vector<Benchmark> benchmarks;
+    addSegmenterBenchmarks(benchmarks);
+#ifdef DEFLECT_USE_LIBJPEGTURBO
+    addCodecBenchmarks(benchmarks);
+#endif
+    addProtocolBenchmarks(benchmarks);
+    addReceiveBufferBenchmarks(benchmarks);
+    return benchmarks;
+}
+
+double timeBatch(const Benchmark& benchmark, const size_t iterations)
+{
+    const auto start = Clock::now();
+    benchmark.run(iterations);
+    return std::chrono::duration<double, std::nano>(Clock::now() - start)
+        .count();
+}
+
+Result runBenchmark(const Benchmark& benchmark,
+                    const BenchmarkOptions& options)
+{
+    const double minTime =
+        std::chrono::duration<double, std::nano>(options.minTime).count();
+
+    // warm up caches and lazy initializations, then find the number of
+    // iterations that lasts at least the minimum time
+    size_t iterations = 1;
+    double elapsed = timeBatch(benchmark, iterations);
+    while (elapsed < minTime)
+    {
+        const double factor =
+            elapsed > 0.0 ? std::min(minTime * 1.2 / elapsed, 10.0) : 10.0;
+        iterations = std::max(iterations + 1, size_t(iterations * factor));
+        elapsed = timeBatch(benchmark, iterations);
+    }
+
+    std::vector<double> times;
+    for (unsigned int i = 0; i < options.repetitions; ++i)
+        times.push_back(timeBatch(benchmark, iterations) / iterations);
+    std::sort(times.begin(), times.end());
+
+    Result result;
+    result.name = benchmark.name;
+    result.iterations = iterations;
+    result.nsPerOp = times[times.size() / 2];
+    result.minNsPerOp = times.front();
+    if (benchmark.bytesPerOp > 0)
+        result.mbytesPerSecond = benchmark.bytesPerOp * 1000.0 / result.nsPerOp;
+    return result;
+}
+
+using Baseline = std::map<std::string, double>;
+
+Baseline readJsonBaseline(const QByteArray& data)
+{
+    Baseline baseline;
+    const auto doc = QJsonDocument::fromJson(data);
+    for (const auto value : doc.object()["benchmarks"].toArray())
+    {
+        const auto benchmark = value.toObject();
+        baseline[benchmark["name"].toString().toStdString()] =
+            benchmark["ns_per_op"].toDouble();
+    }
+    return baseline;
+}
+
+Baseline readCsvBaseline(const QByteArray& data)
+{
+    Baseline baseline;
+    const auto lines = data.split('\n');
+    for (int i = 1; i < lines.size(); ++i) // skip the header
+    {
+        const auto fields = lines[i].split(',');
+        if (fields.size() >= 3)
+            baseline[fields[0].toStdString()] = fields[2].toDouble();
+    }
+    return baseline;
+}
+
+Baseline readBaseline(const std::string& filename)
+{
+    QFile file(QString::fromStdString(filename));
+    if (!file.open(QIODevice::ReadOnly))
+        throw std::runtime_error("could not open baseline: " + filename);
+
+    const auto data = file.readAll();
+    if (data.trimmed().startsWith('{'))
+        return readJsonBaseline(data);
+    return readCsvBaseline(data);
+}
+
+const char* getVerdict(const Result& result, const double threshold)
+{
+    if (!result.hasBaseline)
+        return "";
+    if (result.changePercent > threshold)
+        return "regression";
+    if (result.changePercent < -threshold)
+        return "improvement";
+    return "unchanged";
+}
+
+void writeText(std::ostream& out, const std::vector<Result>& results,
+               const double threshold)
+{
+    for (const auto& result : results)
+    {
+        out << result.name << ": " << result.nsPerOp << " ns/op (min "
+            << result.minNsPerOp << ", " << result.iterations
+            << " iterations)";
+        if (result.mbytesPerSecond > 0.0)
+            out << ", " << result.mbytesPerSecond << " MB/s";
+        if (result.hasBaseline)
+        {
+            out << ", baseline " << result.baselineNsPerOp << " ns/op, "
+                << (result.changePercent > 0.0 ? "+" : "")
+                << result.changePercent << "% "
+                << getVerdict(result, threshold);
+        }
+        out << std::endl;
+    }
+}
+
+void writeCsv(std::ostream& out, const std::vector<Result>& results,
+              const double threshold)
+{
+    out << "name,iterations,ns_per_op,min_ns_per_op,mbytes_per_s,"
+           "baseline_ns_per_op,change_percent,verdict"
+        << std::endl;
+    for (const auto& result : results)
+    {
+        out << result.name << ',' << result.iterations << ','
+            << result.nsPerOp << ',' << result.minNsPerOp << ','
+            << result.mbytesPerSecond << ',';
+        if (result.hasBaseline)
+            out << result.baselineNsPerOp << ',' << result.changePercent;
+        else
+            out << ',';
+        out << ',' << getVerdict(result, threshold) << std::endl;
+    }
+}
+
+void writeJson(std::ostream& out, const std::vector<Result>& results,
+               const double threshold)
+{
+    out << "{\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const auto& result = results[i];
+        out << (i > 0 ? "," : "") << "\n    {\"name\": \"" << result.name
+            << "\", \"iterations\": " << result.iterations
+            << ", \"ns_per_op\": " << result.nsPerOp
+            << ", \"min_ns_per_op\": " << result.minNsPerOp
+            << ", \"mbytes_per_s\": " << result.mbytesPerSecond;
+        if (result.hasBaseline)
+        {
+            out << ", \"baseline_ns_per_op\": " << result.baselineNsPerOp
+                << ", \"change_percent\": " << result.changePercent
+                << ", \"verdict\": \"" << getVerdict(result, threshold)
+                << "\"";
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}" << std::endl;
+}
+}
+
+int main(int argc, char** argv)
+{
+    const BenchmarkOptions options(argc, argv);
+
+    if (options.getHelp)
+    {
+        options.showSyntax();
+        return 0;
+    }
+
+    const auto benchmarks = makeBenchmarks();
+    if (options.list)
+    {
+        for (const auto& benchmark : benchmarks)
+            std::cout << benchmark.name << std::endl;
+        return 0;
+    }
+
+    Baseline baseline;
+    if (!options.baseline.empty())
+        baseline = readBaseline(options.baseline);
+
+    std::vector<Result> results;
+    for (const auto& benchmark : benchmarks)
+    {
+        if (benchmark.name.find(options.filter) == std::string::npos)
+            continue;
+
+        auto result = runBenchmark(benchmark, options);
+        const auto it = baseline.find(result.name);
+        if (it != baseline.end() && it->second > 0.0)
+        {
+            result.hasBaseline = true;
+            result.baselineNsPerOp = it->second;
+            result.changePercent =
+                (result.nsPerOp - it->second) / it->second * 100.0;
+        }
+        results.push_back(result);
+    }
+
+    std::ofstream file;
+    if (!options.output.empty())
+        file.open(options.output);
+    std::ostream& out = options.output.empty() ? std::cout : file;
+
+    if (options.format == "csv")
+        writeCsv(out, results, options.threshold);
+    else if (options.format == "json")
+        writeJson(out, results, options.threshold);
+    else
+        writeText(out, results, options.threshold);
+
+    const bool regression =
+        std::any_of(results.begin(), results.end(), [&](const Result& r) {
+            return r.hasBaseline && r.changePercent > options.threshold;
+        });
+    return regression ? 1 : 0;
+}
@@ -0,0 +1,472 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                          Raphael Dumusc <raphael.dumusc@epfl.ch>  */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include <QCoreApplication>
+#include <QNetworkProxy>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#define MEGABIT 1000000.0
+
+// TCP proxy between Streams and a Server which emulates the conditions of a
+// wide area network: a bandwidth cap, a latency with jitter and bursts of
+// packet loss, which TCP turns into stalls of the connection. The throughput
+// of each direction of each connection is reported periodically. It requires
+// neither root privileges nor tc; the emulation happens in user space, with a
+// millisecond granularity.
+//
+// Example: networkEmulator --port 1701 --listen-port 1702 --bandwidth 100
+//          --latency 20 --jitter 5 --stall-rate 0.1 --stall-duration 200
+// then stream to localhost:1702. Without any option, only the syntax is shown.
+
+struct EmulatorOptions
+{
+    EmulatorOptions(int& argc, char** argv)
+        : desc("Allowed options")
+    {
+        initDesc();
+        parseCommandLineArguments(argc, argv);
+    }
+
+    void showSyntax() const { std::cout << desc; }
+    void initDesc()
+    {
+        using namespace boost::program_options;
+        // clang-format off
+        desc.add_options()
+            ("help", "produce help message")
+            ("listen-port", value<unsigned short>()->default_value(1702),
+                     "port on which the streams connect, 0 to let the system "
+                     "choose one")
+            ("host", value<std::string>()->default_value("localhost"),
+                     "Deflect server host")
+            ("port", value<unsigned short>()->default_value(1701),
+                     "Deflect server port")
+            ("bandwidth", value<double>()->default_value(0.0),
+                     "bandwidth of each direction in Mbit/s, 0 for unlimited")
+            ("latency", value<unsigned int>()->default_value(0),
+                     "one-way latency in milliseconds")
+            ("jitter", value<unsigned int>()->default_value(0),
+                     "maximum random delay added to the latency in "
+                     "milliseconds; the order of the data is preserved")
+            ("stall-rate", value<double>()->default_value(0.0),
+                     "average number of loss bursts per second and per "
+                     "connection, during which no data goes through")
+            ("stall-duration", value<unsigned int>()->default_value(200),
+                     "duration of each loss burst in milliseconds")
+            ("report-interval", value<double>()->default_value(1.0),
+                     "interval between the throughput reports in seconds, "
+                     "0 to disable them")
+            ("format", value<std::string>()->default_value("text"),
+                     "report format: text or csv")
+            ("seed", value<unsigned int>()->default_value(0),
+                     "seed of the jitter and stalls, for reproducible runs")
+        ;
+        // clang-format on
+    }
+
+    void parseCommandLineArguments(int& argc, char** argv)
+    {
+        // the perftests target runs the tool without arguments
+        if (argc <= 1)
+            return;
+
+        boost::program_options::variables_map vm;
+        try
+        {
+            using namespace boost::program_options;
+            store(parse_command_line(argc, argv, desc), vm);
+            notify(vm);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            getHelp = true;
+            return;
+        }
+
+        getHelp = vm.count("help");
+        listenPort = vm["listen-port"].as<unsigned short>();
+        host = vm["host"].as<std::string>();
+        port = vm["port"].as<unsigned short>();
+        bytesPerSecond = vm["bandwidth"].as<double>() * MEGABIT / 8.0;
+        latency = std::chrono::milliseconds(vm["latency"].as<unsigned int>());
+        jitter = std::chrono::milliseconds(vm["jitter"].as<unsigned int>());
+        stallRate = vm["stall-rate"].as<double>();
+        stallDuration =
+            std::chrono::milliseconds(vm["stall-duration"].as<unsigned int>());
+        reportInterval = vm["report-interval"].as<double>();
+        format = vm["format"].as<std::string>();
+        seed = vm["seed"].as<unsigned int>();
+    }
+
+    boost::program_options::options_description desc;
+
+    bool getHelp = true;
+    unsigned short listenPort = 0;
+    std::string host;
+    unsigned short port = 0;
+    double bytesPerSecond = 0.0;
+    std::chrono::milliseconds latency{0};
+    std::chrono::milliseconds jitter{0};
+    double stallRate = 0.0;
+    std::chrono::milliseconds stallDuration{0};
+    double reportInterval = 0.0;
+    std::string format;
+    unsigned int seed = 0;
+};
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+const int TICK_MS = 1;
+const qint64 READ_CHUNK_SIZE = 64 * 1024;
+const qint64 MAX_WRITE_BUFFER = 1024 * 1024; // stop when the peer is slow
+const size_t MIN_QUEUE_SIZE = 4 * 1024 * 1024;
+
+/**
+ * One direction of a connection: the data read from a socket is queued with
+ * the time at which it is due, then written to the other socket within the
+ * bandwidth budget. The queue is bounded so that a sender faster than the
+ * emulated link is throttled by TCP flow control, as on a real network.
+ */
+class Direction
+{
+public:
+    Direction(QTcpSocket& from, QTcpSocket& to, const EmulatorOptions& options,
+              std::mt19937& random)
+        : _from(from)
+        , _to(to)
+        , _options(options)
+        , _random(random)
+        , _maxQueueSize(std::max(
+              MIN_QUEUE_SIZE,
+              size_t(options.bytesPerSecond *
+                     std::chrono::duration<double>(options.latency +
+                                                   options.jitter)
+                         .count())))
+    {
+    }
+
+    void receive(const Clock::time_point now)
+    {
+        while (_queueSize < _maxQueueSize && _from.bytesAvailable() > 0)
+        {
+            const auto space = qint64(_maxQueueSize - _queueSize);
+            auto data = _from.read(std::min(READ_CHUNK_SIZE, space));
+            if (data.isEmpty())
+                break;
+
+            auto due = now + _options.latency;
+            if (_options.jitter.count() > 0)
+            {
+                const int maxDelay = int(_options.jitter.count());
+                std::uniform_int_distribution<int> delay(0, maxDelay);
+                due += std::chrono::milliseconds(delay(_random));
+            }
+            // jitter must not reorder the bytes of a TCP stream
+            due = std::max(due, _lastDue);
+            _lastDue = due;
+
+            _queueSize += size_t(data.size());
+            _queue.push_back({std::move(data), due});
+        }
+    }
+
+    void deliver(const Clock::time_point now, const bool stalled)
+    {
+        const double elapsed =
+            std::chrono::duration<double>(now - _lastDelivery).count();
+        _lastDelivery = now;
+
+        if (stalled || _to.state() != QAbstractSocket::ConnectedState)
+            return;
+
+        const bool limited = _options.bytesPerSecond > 0.0;
+        if (limited)
+        {
+            // allow a burst of only a few milliseconds worth of data after
+            // idling
+            const double maxBudget = std::max(_options.bytesPerSecond * 0.005,
+                                              double(READ_CHUNK_SIZE));
+            _budget = std::min(_budget + elapsed * _options.bytesPerSecond,
+                               maxBudget);
+        }
+
+        while (!_queue.empty() && _queue.front().due <= now &&
+               _to.bytesToWrite() < MAX_WRITE_BUFFER)
+        {
+            auto& chunk = _queue.front();
+            auto size = qint64(chunk.data.size());
+            if (limited)
+            {
+                if (_budget < 1.0)
+                    break;
+                size = std::min(size, qint64(_budget));
+                _budget -= size;
+            }
+
+            _to.write(chunk.data.constData(), size);
+            _delivered += uint64_t(size);
+            _queueSize -= size_t(size);
+            if (size == chunk.data.size())
+                _queue.pop_front();
+            else
+                chunk.data.remove(0, int(size));
+        }
+    }
+
+    bool isEmpty() const { return _queue.empty(); }
+    size_t getQueueSize() const { return _queueSize; }
+    uint64_t takeDeliveredBytes()
+    {
+        const auto delivered = _delivered;
+        _delivered = 0;
+        return delivered;
+    }
+
+private:
+    struct Chunk
+    {
+        QByteArray data;
+        Clock::time_point due;
+    };
+
+    QTcpSocket& _from;
+    QTcpSocket& _to;
+    const EmulatorOptions& _options;
+    std::mt19937& _random;
+    const size_t _maxQueueSize;
+
+    std::deque<Chunk> _queue;
+    size_t _queueSize = 0;
+    Clock::time_point _lastDue;
+    Clock::time_point _lastDelivery = Clock::now();
+    double _budget = 0.0;
+    uint64_t _delivered = 0;
+};
+
+/** A connection from a Stream, forwarded to the Server. */
+class Link
+{
+public:
+    Link(const int id, QTcpSocket* client, const EmulatorOptions& options)
+        : _id(id)
+        , _client(client)
+        , _server(new QTcpSocket)
+        , _options(options)
+        , _random(options.seed + unsigned(id))
+        , _upstream(*_client, *_server, options, _random)
+        , _downstream(*_server, *_client, options, _random)
+    {
+        // bounded socket buffers propagate the backpressure to the peers
+        _client->setReadBufferSize(READ_CHUNK_SIZE);
+        _server->setReadBufferSize(READ_CHUNK_SIZE);
+        _server->setProxy(QNetworkProxy::NoProxy);
+        _server->connectToHost(QString::fromStdString(options.host),
+                               options.port);
+        _scheduleStall(Clock::now());
+    }
+
+    int getId() const { return _id; }
+
+    /** Move the data forward. @return false once the link is closed. */
+    bool tick(const Clock::time_point now)
+    {
+        if (now >= _nextStall)
+        {
+            _stallEnd = now + _options.stallDuration;
+            _scheduleStall(_stallEnd);
+        }
+        const bool stalled = now < _stallEnd;
+
+        _upstream.receive(now);
+        _downstream.receive(now);
+        _upstream.deliver(now, stalled);
+        _downstream.deliver(now, stalled);
+
+        _closeOnceDelivered(*_client, _upstream, *_server);
+        _closeOnceDelivered(*_server, _downstream, *_client);
+        return _client->state() != QAbstractSocket::UnconnectedState ||
+               _server->state() != QAbstractSocket::UnconnectedState;
+    }
+
+    void report(std::ostream& out, const double time, const double interval,
+                const bool csv)
+    {
+        _report(out, time, interval, csv, "up", _upstream);
+        _report(out, time, interval, csv, "down", _downstream);
+    }
+
+private:
+    const int _id;
+    std::unique_ptr<QTcpSocket> _client;
+    std::unique_ptr<QTcpSocket> _server;
+    const EmulatorOptions& _options;
+    std::mt19937 _random;
+    Direction _upstream;   // Stream -> Server
+    Direction _downstream; // Server -> Stream
+    Clock::time_point _stallEnd;
+    Clock::time_point _nextStall = Clock::time_point::max();
+
+    void _scheduleStall(const Clock::time_point after)
+    {
+        if (_options.stallRate <= 0.0)
+            return;
+
+        // loss bursts are a Poisson process
+        std::exponential_distribution<double> interval(_options.stallRate);
+        _nextStall = after + std::chrono::duration_cast<Clock::duration>(
+                                 std::chrono::duration<double>(
+                                     interval(_random)));
+    }
+
+    /**
+     * Close the other socket once a socket is closed and the data that it
+     * sent has been delivered.
+     */
+    void _closeOnceDelivered(QTcpSocket& socket, const Direction& fromSocket,
+                             QTcpSocket& other)
+    {
+        if (socket.state() == QAbstractSocket::UnconnectedState &&
+            socket.bytesAvailable() == 0 && fromSocket.isEmpty() &&
+            other.state() == QAbstractSocket::ConnectedState)
+        {
+            other.disconnectFromHost();
+        }
+    }
+
+    void _report(std::ostream& out, const double time, const double interval,
+                 const bool csv, const char* name, Direction& direction)
+    {
+        const auto mbits =
+            direction.takeDeliveredBytes() * 8.0 / MEGABIT / interval;
+        if (csv)
+        {
+            out << time << ',' << _id << ',' << name << ',' << mbits << ','
+                << direction.getQueueSize() << std::endl;
+            return;
+        }
+        out << std::fixed << std::setprecision(1) << "[" << time << "s] link "
+            << _id << " " << name << ": " << std::setprecision(2) << mbits
+            << " Mbit/s, queued " << direction.getQueueSize() << " bytes"
+            << std::endl;
+    }
+};
+}
+
+int main(int argc, char** argv)
+{
+    const EmulatorOptions options(argc, argv);
+    if (options.getHelp)
+    {
+        options.showSyntax();
+        return 0;
+    }
+
+    QCoreApplication app(argc, argv);
+
+    QTcpServer listener;
+    listener.setProxy(QNetworkProxy::NoProxy);
+    if (!listener.listen(QHostAddress::Any, options.listenPort))
+    {
+        std::cerr << "could not listen on port " << options.listenPort << ": "
+                  << listener.errorString().toStdString() << std::endl;
+        return 1;
+    }
+    std::cerr << "forwarding port " << listener.serverPort() << " to "
+              << options.host << ":" << options.port << std::endl;
+
+    std::map<int, std::unique_ptr<Link>> links;
+    int lastId = 0;
+    QObject::connect(&listener, &QTcpServer::newConnection, [&] {
+        while (auto client = listener.nextPendingConnection())
+        {
+            client->setParent(nullptr);
+            const auto id = ++lastId;
+            links[id].reset(new Link(id, client, options));
+        }
+    });
+
+    QTimer tick;
+    tick.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&tick, &QTimer::timeout, [&] {
+        const auto now = Clock::now();
+        for (auto it = links.begin(); it != links.end();)
+        {
+            if (it->second->tick(now))
+                ++it;
+            else
+                it = links.erase(it);
+        }
+    });
+    tick.start(TICK_MS);
+
+    const bool csv = options.format == "csv";
+    if (csv)
+        std::cout << "time_s,link,direction,mbit_per_s,queued_bytes"
+                  << std::endl;
+
+    const auto start = Clock::now();
+    QTimer report;
+    QObject::connect(&report, &QTimer::timeout, [&] {
+        const auto time =
+            std::chrono::duration<double>(Clock::now() - start).count();
+        for (auto& link : links)
+            link.second->report(std::cout, time, options.reportInterval, csv);
+    });
+    if (options.reportInterval > 0.0)
+        report.start(int(options.reportInterval * 1000));
+
+    return app.exec();
+}
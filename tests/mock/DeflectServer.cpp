@@ -42,9 +42,12 @@
 
 #include <boost/test/unit_test.hpp>
 
-DeflectServer::DeflectServer()
+#include <QTimer>
+
+DeflectServer::DeflectServer(const unsigned int acceptThreads)
 {
-    _server = new deflect::server::Server(0 /* OS-chosen port */);
+    _server = new deflect::server::Server(0 /* OS-chosen port */,
+                                          acceptThreads);
     _server->moveToThread(&_thread);
     _thread.connect(&_thread, &QThread::finished, _server,
                     &deflect::server::Server::deleteLater);
@@ -128,6 +131,43 @@ void DeflectServer::requestFrame(QString uri)
                               Qt::BlockingQueuedConnection, Q_ARG(QString, uri));
 }
 
+void DeflectServer::addRelay(const quint16 port)
+{
+    QMetaObject::invokeMethod(_server, "addRelay", Qt::BlockingQueuedConnection,
+                              Q_ARG(QString, "localhost"), Q_ARG(quint16, port),
+                              Q_ARG(unsigned int, 2));
+}
+
+void DeflectServer::startRecording(QString filename)
+{
+    QMetaObject::invokeMethod(_server, "startRecording",
+                              Qt::BlockingQueuedConnection,
+                              Q_ARG(QString, filename));
+}
+
+void DeflectServer::stopRecording()
+{
+    QMetaObject::invokeMethod(_server, "stopRecording",
+                              Qt::BlockingQueuedConnection);
+}
+
+deflect::server::ServerMetrics DeflectServer::getMetrics()
+{
+    deflect::server::ServerMetrics metrics;
+    _runInServerThread([&] { metrics = _server->getMetrics(); });
+    return metrics;
+}
+
+quint16 DeflectServer::startMetricsExporter()
+{
+    quint16 port = 0;
+    _runInServerThread([&] {
+        _server->startMetricsExporter(0 /* OS-chosen port */);
+        port = _server->getMetricsExporterPort();
+    });
+    return port;
+}
+
 void DeflectServer::waitForMessage()
 {
     for (;;)
@@ -145,6 +185,23 @@ void DeflectServer::waitForMessage()
     _receivedState = false;
 }
 
+void DeflectServer::_runInServerThread(const std::function<void()>& func)
+{
+    QMutex mutex;
+    QWaitCondition done;
+    bool finished = false;
+
+    QMutexLocker lock(&mutex);
+    QTimer::singleShot(0, _server, [&] {
+        func();
+        QMutexLocker serverLock(&mutex);
+        finished = true;
+        done.wakeAll();
+    });
+    while (!finished)
+        done.wait(&mutex);
+}
+
 void DeflectServer::processEvent(const deflect::Event& event)
 {
     BOOST_REQUIRE(_eventReceiver);
@@ -54,13 +54,19 @@ typedef __int32 int32_t;
 class DeflectServer
 {
 public:
-    explicit DeflectServer();
+    explicit DeflectServer(unsigned int acceptThreads = 1);
     ~DeflectServer();
 
     quint16 serverPort() const { return _server->getPort(); }
     void requestFrame(QString uri);
+    void addRelay(quint16 port);
+    void startRecording(QString filename);
+    void stopRecording();
     void waitForMessage();
 
+    deflect::server::ServerMetrics getMetrics();
+    quint16 startMetricsExporter();
+
     size_t getReceivedFrames() const { return _receivedFrames; }
     size_t getOpenedStreams() const { return _openedStreams; }
     using SizeHintsCallback =
@@ -111,6 +117,8 @@ private:
     FrameReceivedCallback _frameReceivedCallback;
 
     deflect::server::EventReceiver* _eventReceiver{nullptr};
+
+    void _runInServerThread(const std::function<void()>& func);
 };
 
 #endif